@@ -0,0 +1,3 @@
+include("$(PORT_DIR)/boards/manifest.py")
+module("espdl_bench.py", base_path="$(BOARD_DIR)/../../tools")
+module("espdl_replay.py", base_path="$(BOARD_DIR)/../../tools")
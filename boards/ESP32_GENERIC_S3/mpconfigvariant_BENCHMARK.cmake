@@ -0,0 +1,17 @@
+set(SDKCONFIG_DEFAULTS
+    ${SDKCONFIG_DEFAULTS}
+    ${MICROPY_PORT_DIR}/boards/sdkconfig.240mhz
+    ${MICROPY_PORT_DIR}/boards/sdkconfig.spiram_oct
+    ESP32_GENERIC_S3/sdkconfig.flash_16m
+)
+
+list(APPEND MICROPY_DEF_BOARD
+    MICROPY_HW_BOARD_NAME="Generic ESP32S3 module 16MB flash with Octal-SPIRAM (benchmark)"
+)
+
+# Freezes tools/espdl_bench.py and tools/espdl_replay.py into the firmware
+set(MICROPY_FROZEN_MANIFEST ${MICROPY_BOARD_DIR}/manifest_benchmark.py)
+
+set(MP_DL_FACE_RECOGNITION_ENABLED 1)
+set(MP_DL_PEDESTRISN_DETECTOR_ENABLED 1)
+set(MP_DL_IMAGENET_CLS_ENABLED 1)
@@ -4,13 +4,11 @@ import time
 from acamera import Camera, FrameSize, PixelFormat # Import the async version of the Camera class, you can also use the sync version (camera.Camera)
 from jpeg import Decoder
 import espdl
-import json
 
 # Configuration
 cam = Camera(fb_count=1, frame_size=FrameSize.VGA, pixel_format=PixelFormat.JPEG, jpeg_quality=85, init=False)
 ssid = 'SSID' # Replace with your Wi-Fi credentials
 password = 'PWD' # Replace with your Wi-Fi credentials
-BoxSettings = {'color': {85: "green", 60: "yellow", 0: "red"}} # Define color settings for bounding boxes based on score
 
 # Connect to Wi-Fi
 station = network.WLAN(network.STA_IF)
@@ -31,12 +29,7 @@ except Exception as e:
 
 BB = None
 Model = None
-
-def LookupTable(value, dictionary):
-    for key in sorted(dictionary.keys(), reverse=True):
-        if value >= key:
-            return dictionary[key]
-    return None
+BoxBuffer = bytearray(512) # Reused for every /get_boxes answer, results_to_json() grows it if needed
 
 async def stream_camera(writer):
     global BB
@@ -75,22 +68,9 @@ async def handle_client(reader, writer):
             print("Start streaming...")
             await stream_camera(writer)
         elif 'GET /get_boxes' in request:
-            bounding_boxes = []
-            if BB is not None:
-                for box in BB:
-                    color = LookupTable(box['score']*100, BoxSettings['color'])
-                    Dict = {"x1":box['box'][0],
-                            "y1":box['box'][1],
-                            "x2":box['box'][2],
-                            "y2":box['box'][3],
-                            "label":f"Score: {box['score']*100:.0f}%",
-                            "color":color}
-                    if Model.__class__.__name__ == "FaceRecognizer":
-                        if box['person'] is not None:   
-                            Dict['label'] = f"{box['person']['name']} ({box['person']['similarity']*100:.0f}%), Score: {box['score']*100:.0f}%"
-                    bounding_boxes.append(Dict)
-            response = 'HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n' + json.dumps(bounding_boxes)
-            writer.write(response.encode())
+            # The results are encoded natively, labels and colors are made in the browser
+            writer.write(b'HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n')
+            writer.write(espdl.results_to_json(BB, BoxBuffer))
             await writer.drain()
         elif 'GET /set_' in request:
             method_name = request.split('GET /set_')[1].split('?')[0]
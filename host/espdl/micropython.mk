@@ -0,0 +1,56 @@
+# Host build of the espdl module for the MicroPython unix port.
+#
+# The esp-dl models are replaced by the mocks in host/include, so everything
+# measured with this build is binding, marshalling and database overhead.
+# Build with:
+#   make -C <micropython>/ports/unix USER_C_MODULES=<this repo>/host
+ESPDL_SRC_DIR := $(USERMOD_DIR)/../../src
+ESPDL_HOST_DIR := $(USERMOD_DIR)/..
+
+SRC_USERMOD_C += $(ESPDL_SRC_DIR)/mp_esp_dl_module.c
+SRC_USERMOD_C += $(ESPDL_SRC_DIR)/lib/mpfile.c
+SRC_USERMOD_C += $(ESPDL_SRC_DIR)/lib/mp_esp_dl_trace.c
+
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/esp_face_detector.cpp
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/esp_face_recognition.cpp
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/esp_human_detector.cpp
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/esp_imagenet_cls.cpp
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/esp_pipeline.cpp
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/esp_scheduler.cpp
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/esp_model.cpp
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/esp_results.cpp
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/esp_draw.cpp
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/mp_esp_dl_api.cpp
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/lib/mp_esp_dl_recognition_database.cpp
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/lib/mp_esp_dl_projection.cpp
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/lib/mp_esp_dl_face_store.cpp
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/lib/mp_esp_dl_face_align.cpp
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/lib/mp_esp_dl_human_face_recognition.cpp
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/lib/mp_esp_dl_arena.cpp
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/lib/mp_esp_dl_input_scaler.cpp
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/lib/mp_esp_dl_result_filter.cpp
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/lib/mp_esp_dl_overlay.cpp
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/lib/mp_esp_dl_model.cpp
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/lib/mp_esp_dl_imagenet_cls.cpp
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/lib/mp_esp_dl_jpeg_input.cpp
+SRC_USERMOD_CXX += $(ESPDL_SRC_DIR)/lib/mp_esp_dl_pedestrian_detect.cpp
+
+CFLAGS_USERMOD += -I$(ESPDL_SRC_DIR) -I$(ESPDL_HOST_DIR)/include
+CFLAGS_USERMOD += -DMP_DL_FACE_RECOGNITION_ENABLED=1
+CFLAGS_USERMOD += -DMP_DL_PEDESTRISN_DETECTOR_ENABLED=1
+CFLAGS_USERMOD += -DMP_DL_IMAGENET_CLS_ENABLED=1
+CFLAGS_USERMOD += -DCONFIG_HUMAN_FACE_FEAT_MFN_S8_V1=1
+CFLAGS_USERMOD += -DCONFIG_HUMAN_FACE_FEAT_MBF_S8_V1=1
+CFLAGS_USERMOD += -DCONFIG_HUMAN_FACE_FEAT_MODEL_TYPE=0
+CFLAGS_USERMOD += -DCONFIG_HUMAN_FACE_FEAT_MODEL_IN_FLASH_PARTITION=1
+CFLAGS_USERMOD += -DCONFIG_HUMAN_FACE_FEAT_MODEL_LOCATION=1
+CFLAGS_USERMOD += -DCONFIG_IMAGENET_CLS_MODEL_IN_FLASH_PARTITION=1
+CFLAGS_USERMOD += -DCONFIG_IMAGENET_CLS_MODEL_LOCATION=1
+CFLAGS_USERMOD += -DCONFIG_PEDESTRIAN_DETECT_MODEL_IN_FLASH_PARTITION=1
+CFLAGS_USERMOD += -DCONFIG_PEDESTRIAN_DETECT_MODEL_LOCATION=1
+ifeq ($(MP_DL_TRACE_ENABLED),1)
+CFLAGS_USERMOD += -DMP_DL_TRACE_ENABLED=1
+endif
+
+CXXFLAGS_USERMOD += -std=gnu++17
+LDFLAGS_USERMOD += -lstdc++
@@ -0,0 +1,84 @@
+// Host mock of the esp-dl classification base classes.
+#pragma once
+#include "dl_image_preprocessor.hpp"
+#include <cstdio>
+
+namespace dl {
+namespace cls {
+
+typedef struct {
+    const char *cat_name;
+    float score;
+} result_t;
+
+class ClsPostprocessor {
+public:
+    ClsPostprocessor(dl::Model *model,
+                     const int top_k,
+                     const float score_thr,
+                     bool need_softmax,
+                     const std::string &output_name = "") :
+        m_model(model), m_topk(top_k)
+    {
+        for (int i = 0; i < MOCK_NUM_CLASSES; i++) {
+            snprintf(m_names[i], sizeof(m_names[i]), "class_%d", i);
+        }
+    }
+    virtual ~ClsPostprocessor() {}
+
+    std::vector<result_t> &postprocess()
+    {
+        m_cls_result.clear();
+        for (int i = 0; i < m_topk; i++) {
+            m_cls_result.push_back({m_names[i % MOCK_NUM_CLASSES], 0.5f / (i + 1)});
+        }
+        return m_cls_result;
+    }
+
+protected:
+    static constexpr int MOCK_NUM_CLASSES = 16;
+    dl::Model *m_model;
+    int m_topk;
+    char m_names[MOCK_NUM_CLASSES][16];
+    std::vector<result_t> m_cls_result;
+};
+
+class Cls {
+public:
+    virtual ~Cls() {}
+    virtual std::vector<result_t> &run(const dl::image::img_t &img) = 0;
+};
+
+class ClsImpl : public Cls {
+protected:
+    dl::Model *m_model = nullptr;
+    dl::image::ImagePreprocessor *m_image_preprocessor = nullptr;
+    dl::cls::ClsPostprocessor *m_postprocessor = nullptr;
+
+public:
+    ~ClsImpl() override
+    {
+        delete m_postprocessor;
+        delete m_image_preprocessor;
+        delete m_model;
+    }
+
+    std::vector<result_t> &run(const dl::image::img_t &img) override
+    {
+        m_image_preprocessor->preprocess(img);
+        m_model->run();
+        return m_postprocessor->postprocess();
+    }
+};
+
+class ClsWrapper : public Cls {
+protected:
+    Cls *m_model = nullptr;
+
+public:
+    ~ClsWrapper() override { delete m_model; }
+    std::vector<result_t> &run(const dl::image::img_t &img) override { return m_model->run(img); }
+};
+
+} // namespace cls
+} // namespace dl
@@ -0,0 +1,71 @@
+// Host mock of the esp-dl detector base classes. The mocked detectors return a
+// fixed, deterministic set of boxes scaled to the input image.
+#pragma once
+#include "dl_detect_define.hpp"
+#include "dl_detect_postprocessor.hpp"
+#include "dl_image_define.hpp"
+#include "dl_image_preprocessor.hpp"
+#include <list>
+
+namespace dl {
+namespace detect {
+
+class Detect {
+public:
+    virtual ~Detect() {}
+    virtual std::list<result_t> &run(const dl::image::img_t &img) = 0;
+};
+
+class MockDetect : public Detect {
+public:
+    MockDetect(int num_results, bool keypoints) : m_num_results(num_results), m_keypoints(keypoints) {}
+
+    std::list<result_t> &run(const dl::image::img_t &img) override
+    {
+        mock_results(m_result, m_num_results, m_keypoints, img.width, img.height);
+        return m_result;
+    }
+
+private:
+    int m_num_results;
+    bool m_keypoints;
+    std::list<result_t> m_result;
+};
+
+class DetectWrapper : public Detect {
+protected:
+    Detect *m_model = nullptr;
+
+public:
+    ~DetectWrapper() override { delete m_model; }
+    std::list<result_t> &run(const dl::image::img_t &img) override { return m_model->run(img); }
+};
+
+class DetectImpl : public Detect {
+protected:
+    dl::Model *m_model = nullptr;
+    dl::image::ImagePreprocessor *m_image_preprocessor = nullptr;
+    dl::detect::DetectPostprocessor *m_postprocessor = nullptr;
+
+public:
+    ~DetectImpl() override
+    {
+        delete m_postprocessor;
+        delete m_image_preprocessor;
+        delete m_model;
+    }
+
+    std::list<result_t> &run(const dl::image::img_t &img) override
+    {
+        m_image_preprocessor->preprocess(img);
+        m_model->run();
+        m_postprocessor->clear_result();
+        m_postprocessor->set_resize_scale_x(m_image_preprocessor->get_resize_scale_x());
+        m_postprocessor->set_resize_scale_y(m_image_preprocessor->get_resize_scale_y());
+        m_postprocessor->postprocess();
+        return m_postprocessor->get_result(img.width, img.height);
+    }
+};
+
+} // namespace detect
+} // namespace dl
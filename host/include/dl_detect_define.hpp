@@ -0,0 +1,18 @@
+// Host mock of the esp-dl detection result, used by the host build only.
+#pragma once
+#include <vector>
+
+namespace dl {
+namespace detect {
+
+typedef struct {
+    int category;
+    float score;
+    std::vector<int> box;
+    std::vector<int> keypoint;
+
+    int box_area() const { return (box[2] - box[0]) * (box[3] - box[1]); }
+} result_t;
+
+} // namespace detect
+} // namespace dl
@@ -0,0 +1,29 @@
+// Host mock of the esp-dl postprocessor of the Pico detectors.
+#pragma once
+#include "dl_detect_postprocessor.hpp"
+#include <vector>
+
+namespace dl {
+namespace detect {
+
+typedef struct {
+    int stride_y;
+    int stride_x;
+    int offset_y;
+    int offset_x;
+} anchor_point_stage_t;
+
+class PicoPostprocessor : public DetectPostprocessor {
+public:
+    PicoPostprocessor(dl::Model *model,
+                      const float score_thr,
+                      const float nms_thr,
+                      const int top_k,
+                      const std::vector<anchor_point_stage_t> &stages) :
+        DetectPostprocessor(model, score_thr, nms_thr, top_k)
+    {
+    }
+};
+
+} // namespace detect
+} // namespace dl
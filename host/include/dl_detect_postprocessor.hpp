@@ -0,0 +1,65 @@
+// Host mock of the esp-dl detection postprocessor. It returns the same boxes
+// as the mocked detectors, in the coordinates of the image given to get_result().
+#pragma once
+#include "dl_detect_define.hpp"
+#include "dl_model_base.hpp"
+#include <algorithm>
+#include <list>
+
+namespace dl {
+namespace detect {
+
+// The boxes of the mocked detectors for an image of width x height
+inline void mock_results(std::list<result_t> &results, int num_results, bool keypoints, int width, int height)
+{
+    results.clear();
+    for (int i = 0; i < num_results; i++) {
+        int w = width / (num_results + 1);
+        int h = height / 2;
+        int x = w * i + w / 2;
+        int y = height / 4;
+        result_t res = {0, 0.9f - 0.1f * i, {x, y, x + w, y + h}, {}};
+        if (keypoints) {
+            res.keypoint = {x + w / 3,
+                            y + h / 3,
+                            x + 2 * w / 3,
+                            y + h / 3,
+                            x + w / 2,
+                            y + h / 2,
+                            x + w / 3,
+                            y + 2 * h / 3,
+                            x + 2 * w / 3,
+                            y + 2 * h / 3};
+        }
+        results.push_back(res);
+    }
+}
+
+class DetectPostprocessor {
+public:
+    DetectPostprocessor(dl::Model *model, const float score_thr, const float nms_thr, const int top_k) :
+        m_model(model), m_top_k(top_k)
+    {
+    }
+    virtual ~DetectPostprocessor() {}
+
+    void postprocess() {}
+    void clear_result() { m_result.clear(); }
+    void set_resize_scale_x(float resize_scale_x) { m_resize_scale_x = resize_scale_x; }
+    void set_resize_scale_y(float resize_scale_y) { m_resize_scale_y = resize_scale_y; }
+    std::list<result_t> &get_result(int width, int height)
+    {
+        mock_results(m_result, std::min(m_top_k, 2), false, width, height);
+        return m_result;
+    }
+
+protected:
+    dl::Model *m_model;
+    int m_top_k;
+    float m_resize_scale_x = 1.0f;
+    float m_resize_scale_y = 1.0f;
+    std::list<result_t> m_result;
+};
+
+} // namespace detect
+} // namespace dl
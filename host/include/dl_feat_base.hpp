@@ -0,0 +1,89 @@
+// Host mock of the esp-dl feature extraction base classes. The mocked
+// postprocessor emits a normalized embedding derived from the model input, so
+// the same face position always yields the same embedding.
+#pragma once
+#include "dl_image_preprocessor.hpp"
+#include <cmath>
+
+namespace dl {
+namespace feat {
+
+class FeatPostprocessor {
+public:
+    FeatPostprocessor(dl::Model *model, const std::string &output_name = "") : m_model(model)
+    {
+        dl::TensorBase *output = m_model->get_outputs().begin()->second;
+        m_feat = new dl::TensorBase(output->shape, nullptr, 0, dl::DATA_TYPE_FLOAT);
+    }
+    ~FeatPostprocessor() { delete m_feat; }
+
+    dl::TensorBase *postprocess()
+    {
+        dl::TensorBase *input = m_model->get_inputs().begin()->second;
+        const uint8_t *in = (const uint8_t *)input->data;
+        float *feat = (float *)m_feat->data;
+        uint32_t seed = 2166136261u;
+        for (int i = 0; i < 64; i++) {
+            seed = (seed ^ in[i]) * 16777619u;
+        }
+        float norm = 0;
+        for (int i = 0; i < m_feat->size; i++) {
+            seed = seed * 1664525u + 1013904223u;
+            feat[i] = (float)(seed >> 8) / (float)(1 << 24) - 0.5f;
+            norm += feat[i] * feat[i];
+        }
+        norm = sqrtf(norm);
+        for (int i = 0; i < m_feat->size; i++) {
+            feat[i] /= norm;
+        }
+        return m_feat;
+    }
+
+private:
+    dl::Model *m_model;
+    dl::TensorBase *m_feat;
+};
+
+class Feat {
+public:
+    virtual ~Feat() {}
+    virtual dl::TensorBase *run(const dl::image::img_t &img, const std::vector<int> &landmarks) = 0;
+    int m_feat_len = 0;
+};
+
+class FeatImpl : public Feat {
+protected:
+    dl::Model *m_model = nullptr;
+    dl::image::FeatImagePreprocessor *m_image_preprocessor = nullptr;
+    dl::feat::FeatPostprocessor *m_postprocessor = nullptr;
+
+public:
+    ~FeatImpl() override
+    {
+        delete m_postprocessor;
+        delete m_image_preprocessor;
+        delete m_model;
+    }
+
+    dl::TensorBase *run(const dl::image::img_t &img, const std::vector<int> &landmarks) override
+    {
+        m_image_preprocessor->preprocess(img, landmarks);
+        m_model->run();
+        return m_postprocessor->postprocess();
+    }
+};
+
+class FeatWrapper : public Feat {
+protected:
+    Feat *m_model = nullptr;
+
+public:
+    ~FeatWrapper() override { delete m_model; }
+    dl::TensorBase *run(const dl::image::img_t &img, const std::vector<int> &landmarks) override
+    {
+        return m_model->run(img, landmarks);
+    }
+};
+
+} // namespace feat
+} // namespace dl
@@ -0,0 +1,59 @@
+// Host mock of the esp-dl image preprocessors. They only touch the input
+// tensor so the memory traffic of a real preprocessor is roughly reproduced.
+#pragma once
+#include "dl_image_define.hpp"
+#include "dl_model_base.hpp"
+#include <string>
+#include <vector>
+
+namespace dl {
+namespace image {
+
+class ImagePreprocessor {
+public:
+    ImagePreprocessor(dl::Model *model,
+                      const std::vector<float> &mean,
+                      const std::vector<float> &std,
+                      uint32_t caps = 0,
+                      const std::string &input_name = "") :
+        m_model(model)
+    {
+    }
+
+    void preprocess(const dl::image::img_t &img, const std::vector<int> &crop_area = {})
+    {
+        dl::TensorBase *input = m_model->get_inputs().begin()->second;
+        memset(input->data, ((uint8_t *)img.data)[0], input->get_bytes());
+        m_resize_scale_x = (float)input->shape[2] / img.width;
+        m_resize_scale_y = (float)input->shape[1] / img.height;
+    }
+    float get_resize_scale_x() { return m_resize_scale_x; }
+    float get_resize_scale_y() { return m_resize_scale_y; }
+
+protected:
+    dl::Model *m_model;
+    float m_resize_scale_x = 1.0f;
+    float m_resize_scale_y = 1.0f;
+};
+
+class FeatImagePreprocessor : public ImagePreprocessor {
+public:
+    FeatImagePreprocessor(dl::Model *model,
+                          const std::vector<float> &mean,
+                          const std::vector<float> &std,
+                          uint32_t caps = 0,
+                          const std::string &input_name = "") :
+        ImagePreprocessor(model, mean, std, caps, input_name)
+    {
+    }
+
+    void preprocess(const dl::image::img_t &img, const std::vector<int> &landmarks)
+    {
+        ImagePreprocessor::preprocess(img);
+        dl::TensorBase *input = m_model->get_inputs().begin()->second;
+        memcpy(input->data, landmarks.data(), landmarks.size() * sizeof(int));
+    }
+};
+
+} // namespace image
+} // namespace dl
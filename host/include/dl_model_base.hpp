@@ -0,0 +1,103 @@
+// Host mock of dl::Model. Inference is a no-op; only the tensor layout of the
+// models used by this module is reproduced so the bindings can be exercised.
+#pragma once
+#include "dl_tensor_base.hpp"
+#include <map>
+#include <string>
+
+namespace fbs {
+typedef enum {
+    MODEL_LOCATION_IN_FLASH_RODATA = 0,
+    MODEL_LOCATION_IN_FLASH_PARTITION = 1,
+    MODEL_LOCATION_IN_SDCARD = 2,
+    MODEL_LOCATION_MAX = MODEL_LOCATION_IN_SDCARD,
+} model_location_type_t;
+} // namespace fbs
+
+namespace dl {
+
+typedef enum {
+    RUNTIME_MODE_AUTO = 0,
+    RUNTIME_MODE_SINGLE_CORE = 1,
+    RUNTIME_MODE_MULTI_CORE = 2,
+} runtime_mode_t;
+
+class Model {
+public:
+    Model(const char *rodata_address_or_partition_label_or_path,
+          fbs::model_location_type_t location = fbs::MODEL_LOCATION_IN_FLASH_RODATA)
+    {
+        init("");
+    }
+    Model(const char *rodata_address_or_partition_label_or_path,
+          const char *model_name,
+          fbs::model_location_type_t location = fbs::MODEL_LOCATION_IN_FLASH_RODATA)
+    {
+        init(model_name);
+    }
+    virtual ~Model()
+    {
+        for (auto &it : m_inputs) {
+            delete it.second;
+        }
+        for (auto &it : m_outputs) {
+            delete it.second;
+        }
+        for (auto &it : m_intermediates) {
+            delete it.second;
+        }
+    }
+
+    void run() { m_run_count++; }
+    // Copies the requested layers into user_outputs, as the layers may be
+    // reused by later ones on the device
+    void run(std::map<std::string, TensorBase *> &user_inputs,
+             runtime_mode_t mode = RUNTIME_MODE_SINGLE_CORE,
+             std::map<std::string, TensorBase *> user_outputs = {})
+    {
+        m_run_count++;
+        for (auto &it : user_outputs) {
+            TensorBase *layer = get_intermediate(it.first);
+            if (layer && layer->get_bytes() == it.second->get_bytes()) {
+                memcpy(it.second->data, layer->data, layer->get_bytes());
+            }
+        }
+    }
+    void minimize() {}
+    std::map<std::string, TensorBase *> &get_inputs() { return m_inputs; }
+    std::map<std::string, TensorBase *> &get_outputs() { return m_outputs; }
+    TensorBase *get_intermediate(std::string name)
+    {
+        auto it = m_outputs.find(name);
+        if (it != m_outputs.end()) {
+            return it->second;
+        }
+        it = m_intermediates.find(name);
+        return it == m_intermediates.end() ? nullptr : it->second;
+    }
+
+    int m_run_count = 0;
+
+private:
+    std::map<std::string, TensorBase *> m_inputs;
+    std::map<std::string, TensorBase *> m_outputs;
+    std::map<std::string, TensorBase *> m_intermediates;
+
+    void init(const std::string &model_name)
+    {
+        if (model_name.find("feat") != std::string::npos) {
+            m_inputs["input"] = new TensorBase({1, 112, 112, 3}, nullptr, -7, DATA_TYPE_INT8);
+            m_outputs["output"] = new TensorBase({1, 512}, nullptr, 0, DATA_TYPE_FLOAT);
+        } else if (model_name.find("imagenet") != std::string::npos) {
+            m_inputs["input"] = new TensorBase({1, 224, 224, 3}, nullptr, -7, DATA_TYPE_INT8);
+            m_outputs["output"] = new TensorBase({1, 1000}, nullptr, -3, DATA_TYPE_INT8);
+            m_intermediates["/GlobalAveragePool_output_0"] =
+                new TensorBase({1, 1, 1, 1280}, nullptr, -4, DATA_TYPE_INT8);
+        } else {
+            m_inputs["input"] = new TensorBase({1, 224, 224, 3}, nullptr, -7, DATA_TYPE_INT8);
+            m_outputs["output"] = new TensorBase({1, 16}, nullptr, -7, DATA_TYPE_INT8);
+        }
+    }
+};
+
+} // namespace dl
@@ -0,0 +1,68 @@
+// Host mock of the esp-dl tensor, used by the host build only.
+#pragma once
+#include "esp_heap_caps.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace dl {
+
+typedef enum {
+    DATA_TYPE_FLOAT = 0,
+    DATA_TYPE_INT8,
+    DATA_TYPE_INT16,
+    DATA_TYPE_INT32,
+    DATA_TYPE_UINT8,
+    DATA_TYPE_UINT16,
+    DATA_TYPE_UINT32,
+} dtype_t;
+
+inline size_t dtype_sizeof(dtype_t dtype)
+{
+    switch (dtype) {
+    case DATA_TYPE_INT8:
+    case DATA_TYPE_UINT8:
+        return 1;
+    case DATA_TYPE_INT16:
+    case DATA_TYPE_UINT16:
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+class TensorBase {
+public:
+    int size;
+    std::vector<int> shape;
+    dtype_t dtype;
+    int exponent;
+    void *data;
+
+    TensorBase(std::vector<int> shape, const void *element, int exponent = 0, dtype_t dtype = DATA_TYPE_FLOAT) :
+        size(1), shape(shape), dtype(dtype), exponent(exponent)
+    {
+        for (int dim : shape) {
+            size *= dim;
+        }
+        data = calloc(size, dtype_sizeof(dtype));
+        if (element) {
+            memcpy(data, element, get_bytes());
+        }
+    }
+    virtual ~TensorBase() { free(data); }
+
+    int get_size() { return size; }
+    size_t get_bytes() { return size * dtype_sizeof(dtype); }
+    std::vector<int> get_shape() { return shape; }
+    dtype_t get_dtype() { return dtype; }
+    int get_exponent() { return exponent; }
+    template <typename T>
+    T *get_element_ptr()
+    {
+        return (T *)data;
+    }
+};
+
+} // namespace dl
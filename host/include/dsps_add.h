@@ -0,0 +1,15 @@
+// Host mock of the esp-dsp element-wise addition, with the arithmetic of the
+// ANSI C implementation.
+#pragma once
+#include "esp_err.h"
+#include <stdint.h>
+
+static inline esp_err_t dsps_add_s16(const int16_t *input1, const int16_t *input2, int16_t *output, int len,
+                                     int step1, int step2, int step_out, int shift)
+{
+    for (int i = 0; i < len; i++) {
+        int32_t acc = (int32_t)input1[i * step1] + (int32_t)input2[i * step2];
+        output[i * step_out] = (int16_t)(acc >> shift);
+    }
+    return ESP_OK;
+}
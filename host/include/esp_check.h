@@ -0,0 +1,4 @@
+// Host mock of the ESP-IDF error check helpers.
+#pragma once
+#include "esp_err.h"
+#include "esp_log.h"
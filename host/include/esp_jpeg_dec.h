@@ -0,0 +1,112 @@
+// Host mock of the esp_new_jpeg decoder, used by the host build only. Only the
+// frame size is parsed from the SOF marker; block mode hands out mid-gray MCU
+// rows of 16 lines, so the cost of the consumer is reproduced, not the decode.
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+typedef enum {
+    JPEG_ERR_OK = 0,
+    JPEG_ERR_FAIL = -1,
+} jpeg_error_t;
+
+typedef enum {
+    JPEG_PIXEL_FORMAT_RGB565_LE = 0,
+    JPEG_PIXEL_FORMAT_RGB565_BE,
+    JPEG_PIXEL_FORMAT_RGB888,
+} jpeg_pixel_format_t;
+
+typedef enum {
+    JPEG_ROTATE_0D = 0,
+} jpeg_rotate_t;
+
+typedef struct {
+    jpeg_pixel_format_t output_type;
+    jpeg_rotate_t rotate;
+    bool block_enable;
+} jpeg_dec_config_t;
+
+#define DEFAULT_JPEG_DEC_CONFIG() {JPEG_PIXEL_FORMAT_RGB565_LE, JPEG_ROTATE_0D, false}
+
+typedef struct {
+    int width;
+    int height;
+} jpeg_dec_header_info_t;
+
+typedef struct {
+    uint8_t *inbuf;
+    int inbuf_len;
+    int inbuf_remain;
+    uint8_t *outbuf;
+    int out_size;
+} jpeg_dec_io_t;
+
+typedef struct {
+    jpeg_dec_config_t config;
+    int width;
+    int height;
+    int processed;
+} mock_jpeg_dec_t;
+
+typedef mock_jpeg_dec_t *jpeg_dec_handle_t;
+
+static inline jpeg_error_t jpeg_dec_open(jpeg_dec_config_t *config, jpeg_dec_handle_t *jpeg_dec)
+{
+    *jpeg_dec = (mock_jpeg_dec_t *)calloc(1, sizeof(mock_jpeg_dec_t));
+    (*jpeg_dec)->config = *config;
+    return JPEG_ERR_OK;
+}
+
+static inline jpeg_error_t jpeg_dec_parse_header(jpeg_dec_handle_t jpeg_dec, jpeg_dec_io_t *io, jpeg_dec_header_info_t *out_info)
+{
+    for (int i = 0; i + 8 < io->inbuf_len; i++) {
+        if (io->inbuf[i] == 0xff && (io->inbuf[i + 1] == 0xc0 || io->inbuf[i + 1] == 0xc2)) {
+            jpeg_dec->height = (io->inbuf[i + 5] << 8) | io->inbuf[i + 6];
+            jpeg_dec->width = (io->inbuf[i + 7] << 8) | io->inbuf[i + 8];
+            out_info->width = jpeg_dec->width;
+            out_info->height = jpeg_dec->height;
+            return JPEG_ERR_OK;
+        }
+    }
+    return JPEG_ERR_FAIL;
+}
+
+static inline jpeg_error_t jpeg_dec_get_outbuf_len(jpeg_dec_handle_t jpeg_dec, int *outbuf_len)
+{
+    int rows = jpeg_dec->config.block_enable ? 16 : jpeg_dec->height;
+    *outbuf_len = jpeg_dec->width * rows * (jpeg_dec->config.output_type == JPEG_PIXEL_FORMAT_RGB888 ? 3 : 2);
+    return JPEG_ERR_OK;
+}
+
+static inline jpeg_error_t jpeg_dec_get_process_count(jpeg_dec_handle_t jpeg_dec, int *process_count)
+{
+    *process_count = jpeg_dec->config.block_enable ? (jpeg_dec->height + 15) / 16 : 1;
+    return JPEG_ERR_OK;
+}
+
+static inline jpeg_error_t jpeg_dec_process(jpeg_dec_handle_t jpeg_dec, jpeg_dec_io_t *io)
+{
+    int len;
+    jpeg_dec_get_outbuf_len(jpeg_dec, &len);
+    memset(io->outbuf, 0x80, len);
+    io->out_size = len;
+    jpeg_dec->processed++;
+    return JPEG_ERR_OK;
+}
+
+static inline jpeg_error_t jpeg_dec_close(jpeg_dec_handle_t jpeg_dec)
+{
+    free(jpeg_dec);
+    return JPEG_ERR_OK;
+}
+
+static inline void *jpeg_calloc_align(size_t size, int aligned)
+{
+    return calloc(1, size);
+}
+
+static inline void jpeg_free_align(void *data)
+{
+    free(data);
+}
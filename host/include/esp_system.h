@@ -0,0 +1,4 @@
+// Host mock of the ESP-IDF system header.
+#pragma once
+#include "esp_err.h"
+#include "esp_heap_caps.h"
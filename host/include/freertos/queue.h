@@ -0,0 +1,3 @@
+// Host mock of the FreeRTOS header, nothing is needed from it.
+#pragma once
+#include "esp_system.h"
@@ -0,0 +1,12 @@
+// Host mock of the FreeRTOS task header.
+#pragma once
+#include "esp_system.h"
+#include <pthread.h>
+
+typedef void *TaskHandle_t;
+
+// The thread stands in for the task, e.g. as thread id of trace events
+static inline TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return (TaskHandle_t)pthread_self();
+}
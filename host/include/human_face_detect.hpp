@@ -0,0 +1,11 @@
+// Host mock of the esp-dl human_face_detect component.
+#pragma once
+#include "dl_detect_base.hpp"
+
+class HumanFaceDetect : public dl::detect::DetectWrapper {
+public:
+    typedef enum {
+        MSRMNP_S8_V1,
+    } model_type_t;
+    HumanFaceDetect(model_type_t model_type = MSRMNP_S8_V1) { m_model = new dl::detect::MockDetect(2, true); }
+};
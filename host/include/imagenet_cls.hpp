@@ -0,0 +1,26 @@
+// Host mock of the esp-dl imagenet_cls component.
+#pragma once
+#include "imagenet_cls_postprocessor.hpp"
+
+namespace imagenet_cls {
+class MobileNetV2 : public dl::cls::ClsImpl {
+public:
+    MobileNetV2(const char *model_name, const int topk)
+    {
+        m_model = new dl::Model("imagenet_cls", model_name);
+        m_image_preprocessor = new dl::image::ImagePreprocessor(m_model, {123.675, 116.28, 103.53}, {58.395, 57.12, 57.375});
+        m_postprocessor = new dl::cls::ImageNetClsPostprocessor(m_model, topk, -1e30f, true);
+    }
+};
+} // namespace imagenet_cls
+
+class ImageNetCls : public dl::cls::ClsWrapper {
+public:
+    typedef enum {
+        MOBILENETV2_S8_V1,
+    } model_type_t;
+    ImageNetCls(model_type_t model_type = MOBILENETV2_S8_V1, const int topk = 5)
+    {
+        m_model = new imagenet_cls::MobileNetV2("imagenet_cls_mobilenetv2_s8_v1.espdl", topk);
+    }
+};
@@ -0,0 +1,21 @@
+// Host mock of the esp-dl ImageNet postprocessor, used by the host build only.
+#pragma once
+#include "dl_cls_base.hpp"
+
+namespace dl {
+namespace cls {
+
+class ImageNetClsPostprocessor : public ClsPostprocessor {
+public:
+    ImageNetClsPostprocessor(dl::Model *model,
+                             const int top_k,
+                             const float score_thr,
+                             bool need_softmax,
+                             const std::string &output_name = "") :
+        ClsPostprocessor(model, top_k, score_thr, need_softmax, output_name)
+    {
+    }
+};
+
+} // namespace cls
+} // namespace dl
@@ -0,0 +1,11 @@
+// Host mock of the esp-dl pedestrian_detect component.
+#pragma once
+#include "dl_detect_base.hpp"
+
+class PedestrianDetect : public dl::detect::DetectWrapper {
+public:
+    typedef enum {
+        PICO_S8_V1,
+    } model_type_t;
+    PedestrianDetect(model_type_t model_type = PICO_S8_V1) { m_model = new dl::detect::MockDetect(2, false); }
+};
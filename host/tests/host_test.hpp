@@ -0,0 +1,21 @@
+// Minimal test helpers for the host tests of the library code.
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+
+// Fails the test with the expression and its location
+#define CHECK(cond)                                                                     \
+    do {                                                                                \
+        if (!(cond)) {                                                                  \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond);   \
+            exit(1);                                                                    \
+        }                                                                               \
+    } while (0)
+
+// The file functions of mpfile_host.cpp write through stdio. After
+// host_fail_writes(n), n more writes succeed and all later ones fail, as
+// with a full or removed SD card; host_fail_writes(-1) ends that.
+void host_fail_writes(int after);
+
+// Removes path and the sidecar files of a database at path
+void host_remove_db(const char *path);
@@ -0,0 +1,5 @@
+// Host mock of the MicroPython threading API, the tests run without a GIL.
+#pragma once
+
+#define MP_THREAD_GIL_ENTER() ((void)0)
+#define MP_THREAD_GIL_EXIT() ((void)0)
@@ -0,0 +1,30 @@
+// Host mock of the MicroPython object API, the subset used by the library
+// code in src/lib. The Python bindings are not built by the host tests.
+#pragma once
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef void *mp_obj_t;
+typedef intptr_t mp_int_t;
+typedef uintptr_t mp_uint_t;
+
+typedef struct _mp_obj_base_t {
+    const void *type;
+} mp_obj_base_t;
+
+typedef struct _mp_print_t {
+    void *data;
+} mp_print_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern const mp_print_t mp_plat_print;
+int mp_printf(const mp_print_t *print, const char *fmt, ...);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,4 @@
+// Host mock of the MicroPython runtime header.
+#pragma once
+#include "py/obj.h"
+#include "py/mpthread.h"
@@ -0,0 +1,96 @@
+// The mpfile API of src/lib/mpfile.h over stdio for the host tests.
+#include "host_test.hpp"
+#include <string>
+
+extern "C" {
+#include "mpfile.h"
+}
+
+static int s_writes_left = -1;
+
+void host_fail_writes(int after)
+{
+    s_writes_left = after;
+}
+
+void host_remove_db(const char *path)
+{
+    for (const char *suffix : {"", ".log", ".log.tmp", ".delta", ".pca", ".faces", ".tmp"}) {
+        remove((std::string(path) + suffix).c_str());
+    }
+}
+
+static FILE *file(mp_file_t *f)
+{
+    return (FILE *)f->file_obj;
+}
+
+extern "C" {
+
+const mp_print_t mp_plat_print = {nullptr};
+
+int mp_printf(const mp_print_t *print, const char *fmt, ...)
+{
+    (void)print;
+    (void)fmt;
+    return 0;
+}
+
+bool mp_isfile(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f) {
+        fclose(f);
+    }
+    return f != nullptr;
+}
+
+mp_file_t *mp_try_open(const char *filename, const char *mode)
+{
+    FILE *f = fopen(filename, mode);
+    if (!f) {
+        return nullptr;
+    }
+    mp_file_t *file = new mp_file_t();
+    file->file_obj = f;
+    return file;
+}
+
+mp_int_t mp_try_readinto(mp_file_t *f, void *buf, size_t num_bytes)
+{
+    return fread(buf, 1, num_bytes, file(f));
+}
+
+mp_int_t mp_try_write(mp_file_t *f, const void *buf, size_t num_bytes)
+{
+    if (s_writes_left == 0) {
+        return -1;
+    }
+    if (s_writes_left > 0) {
+        s_writes_left--;
+    }
+    return fwrite(buf, 1, num_bytes, file(f));
+}
+
+off_t mp_try_seek(mp_file_t *f, off_t offset, int whence)
+{
+    return fseek(file(f), offset, whence) == 0 ? ftell(file(f)) : -1;
+}
+
+off_t mp_try_tell(mp_file_t *f)
+{
+    return ftell(file(f));
+}
+
+void mp_try_close(mp_file_t *f)
+{
+    fclose(file(f));
+    delete f;
+}
+
+bool mp_try_rename(const char *from_path, const char *to_path)
+{
+    return rename(from_path, to_path) == 0;
+}
+
+}
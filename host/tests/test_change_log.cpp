@@ -0,0 +1,240 @@
+// Change log: export, apply, recovery of a pending delta and compaction.
+#include "host_test.hpp"
+#include "mp_esp_dl_recognition_database.hpp"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using mp_esp_dl::recognition::DataBase;
+
+static const int FEAT_LEN = 4;
+
+static long file_size(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+static bool has_name(DataBase &db, uint16_t id, const char *expected)
+{
+    char name[MAX_NAME_LENGTH];
+    return db.get_name(id, name) && strcmp(name, expected) == 0;
+}
+
+// A database from before the change log is logged on first use, its first
+// delta brings an empty replica up to date, applying it again is a no-op
+static void test_replay()
+{
+    host_remove_db("src.db");
+    host_remove_db("dst.db");
+    float feat[FEAT_LEN] = {1, 0, 0, 0};
+    uint16_t id;
+    {
+        DataBase src("src.db", FEAT_LEN);
+        CHECK(src.enroll_feat(feat, "a1", &id) == ESP_OK);
+        CHECK(src.enroll_feat(feat, "a2", &id) == ESP_OK);
+        CHECK(src.enroll_feat(feat, "a3", &id) == ESP_OK);
+        CHECK(src.delete_feat(2) == ESP_OK);
+    }
+    remove("src.db.log");
+
+    DataBase src("src.db", FEAT_LEN);
+    CHECK(src.get_sequence() == 4);
+    CHECK(src.rename_feat(1, "renamed") == ESP_OK);
+    CHECK(src.enroll_feat(feat, "a4", &id) == ESP_OK && id == 4);
+    CHECK(src.get_sequence() == 6);
+    std::vector<uint8_t> blob;
+    CHECK(src.export_changes(0, blob) == ESP_OK);
+
+    DataBase dst("dst.db", FEAT_LEN);
+    int applied;
+    CHECK(dst.apply_changes(blob.data(), blob.size(), &applied) == ESP_OK && applied == 6);
+    CHECK(dst.get_sequence() == 6 && dst.get_num_feats() == 3);
+    CHECK(has_name(dst, 1, "renamed") && has_name(dst, 4, "a4"));
+    CHECK(!has_name(dst, 2, "a2"));
+    CHECK(dst.apply_changes(blob.data(), blob.size(), &applied) == ESP_OK && applied == 0);
+
+    // A delta which skips changes of the replica
+    CHECK(src.delete_feat(3) == ESP_OK);
+    CHECK(src.enroll_feat(feat, "a5", &id) == ESP_OK);
+    std::vector<uint8_t> gap;
+    CHECK(src.export_changes(7, gap) == ESP_OK);
+    CHECK(dst.apply_changes(gap.data(), gap.size(), &applied) == ESP_ERR_INVALID_STATE);
+    CHECK(src.export_changes(6, blob) == ESP_OK);
+    CHECK(dst.apply_changes(blob.data(), blob.size(), &applied) == ESP_OK && applied == 2);
+    CHECK(dst.get_sequence() == 8 && has_name(dst, 5, "a5"));
+}
+
+// Deltas from another device are checked before anything is allocated or
+// changed
+static void test_invalid_deltas()
+{
+    host_remove_db("bad.db");
+    DataBase db("bad.db", FEAT_LEN);
+    int applied;
+    struct {
+        char magic[4];
+        uint16_t version;
+        uint16_t feat_len;
+        uint32_t count;
+    } delta = {{'E', 'D', 'L', 'D'}, 1, FEAT_LEN, 0xFFFFFFFF};
+    CHECK(db.apply_changes((const uint8_t *)&delta, sizeof(delta), &applied) == ESP_ERR_INVALID_SIZE);
+
+    std::vector<uint8_t> blob((const uint8_t *)&delta, (const uint8_t *)&delta + sizeof(delta));
+    blob.resize(sizeof(delta) + 8 * 1000);
+    CHECK(db.apply_changes(blob.data(), blob.size(), &applied) == ESP_ERR_INVALID_SIZE);
+
+    // A checkpoint is no change, it must not come with a delta
+    delta.count = 1;
+    uint8_t checkpoint[8 + 1] = {1, 0, 0, 0, 0, 0, 4, 0, 0};
+    blob.assign((const uint8_t *)&delta, (const uint8_t *)&delta + sizeof(delta));
+    blob.insert(blob.end(), checkpoint, checkpoint + sizeof(checkpoint));
+    CHECK(db.apply_changes(blob.data(), blob.size(), &applied) == ESP_ERR_INVALID_SIZE);
+
+    delta.count = 0;
+    delta.magic[0] = 'X';
+    CHECK(db.apply_changes((const uint8_t *)&delta, sizeof(delta), &applied) == ESP_ERR_INVALID_ARG);
+    delta.magic[0] = 'E';
+    delta.feat_len = FEAT_LEN + 1;
+    CHECK(db.apply_changes((const uint8_t *)&delta, sizeof(delta), &applied) == ESP_ERR_INVALID_SIZE);
+    CHECK(db.get_sequence() == 0 && db.get_num_feats() == 0);
+}
+
+// A delta staged before a reset is applied on the next use of the log, and a
+// torn record at the end of the log is overwritten by the next change
+static void test_recovery()
+{
+    host_remove_db("src.db");
+    host_remove_db("dst.db");
+    float feat[FEAT_LEN] = {0, 1, 0, 0};
+    uint16_t id;
+    DataBase src("src.db", FEAT_LEN);
+    CHECK(src.enroll_feat(feat, "s1", &id) == ESP_OK);
+    CHECK(src.enroll_feat(feat, "s2", &id) == ESP_OK);
+    std::vector<uint8_t> blob;
+    CHECK(src.export_changes(0, blob) == ESP_OK);
+    FILE *f = fopen("dst.db.delta", "wb");
+    fwrite(blob.data(), 1, blob.size(), f);
+    fclose(f);
+    {
+        DataBase dst("dst.db", FEAT_LEN);
+        CHECK(dst.get_sequence() == 2 && has_name(dst, 2, "s2"));
+    }
+    CHECK(file_size("dst.db.delta") == 0);
+
+    long complete = file_size("dst.db.log");
+    f = fopen("dst.db.log", "ab");
+    fwrite("xyz", 1, 3, f);
+    fclose(f);
+    {
+        DataBase dst("dst.db", FEAT_LEN);
+        CHECK(dst.enroll_feat(feat, "d3", &id) == ESP_OK && id == 3);
+        CHECK(dst.get_sequence() == 3);
+    }
+    CHECK(file_size("dst.db.log") == complete + 8 + (long)(sizeof(float) * FEAT_LEN) + MAX_NAME_LENGTH);
+    DataBase dst("dst.db", FEAT_LEN);
+    CHECK(dst.get_sequence() == 3 && dst.get_num_feats() == 3);
+}
+
+// Compaction drops the changes replicas have and keeps the sequence numbers
+static void test_compaction()
+{
+    host_remove_db("src.db");
+    host_remove_db("dst.db");
+    float feat[FEAT_LEN] = {0, 0, 1, 0};
+    uint16_t id;
+    DataBase src("src.db", FEAT_LEN);
+    DataBase dst("dst.db", FEAT_LEN);
+    for (int i = 0; i < 10; i++) {
+        CHECK(src.enroll_feat(feat, "c", &id) == ESP_OK);
+    }
+    CHECK(src.delete_feat(3) == ESP_OK);
+    CHECK(src.rename_feat(4, "c4") == ESP_OK);
+    std::vector<uint8_t> blob;
+    int applied;
+    CHECK(src.export_changes(0, blob) == ESP_OK);
+    CHECK(dst.apply_changes(blob.data(), blob.size(), &applied) == ESP_OK && applied == 12);
+
+    CHECK(src.enroll_feat(feat, "c11", &id) == ESP_OK);
+    CHECK(src.delete_feat(5) == ESP_OK);
+    CHECK(src.compact_changes(20) == ESP_ERR_INVALID_ARG);
+    long before = file_size("src.db.log");
+    CHECK(src.compact_changes(12) == ESP_OK);
+    long after = file_size("src.db.log");
+    CHECK(after < before / 4);
+    CHECK(src.compact_changes(5) == ESP_OK && file_size("src.db.log") == after);
+    CHECK(src.get_sequence() == 14);
+    CHECK(src.export_changes(11, blob) == ESP_ERR_INVALID_STATE);
+    CHECK(src.export_changes(12, blob) == ESP_OK);
+    CHECK(dst.apply_changes(blob.data(), blob.size(), &applied) == ESP_OK && applied == 2);
+    CHECK(dst.get_num_feats() == src.get_num_feats() && has_name(dst, 11, "c11"));
+
+    // The checkpoint covers the ids, nothing is logged again on the next open
+    {
+        DataBase reopened("src.db", FEAT_LEN);
+        CHECK(reopened.get_sequence() == 14);
+        CHECK(file_size("src.db.log") == after);
+        CHECK(reopened.delete_feat(4) == ESP_OK);
+        CHECK(reopened.get_sequence() == 15);
+        CHECK(reopened.export_changes(14, blob) == ESP_OK);
+        CHECK(dst.apply_changes(blob.data(), blob.size(), &applied) == ESP_OK && applied == 1);
+        CHECK(reopened.compact_changes(15) == ESP_OK);
+        CHECK(reopened.export_changes(15, blob) == ESP_OK && blob.size() == 12);
+    }
+    DataBase reopened("src.db", FEAT_LEN);
+    CHECK(reopened.get_sequence() == 15 && reopened.get_num_feats() == 8);
+    CHECK(!has_name(reopened, 4, "c4") && has_name(reopened, 11, "c11"));
+}
+
+// A checkpoint whose highest id fills its last byte: the bitmap holds
+// exactly the ids, and reading it back logs nothing again
+static void test_checkpoint_bytes()
+{
+    float feat[FEAT_LEN] = {0, 0, 0, 1};
+    uint16_t id;
+    for (int count : {8, 16}) {
+        host_remove_db("full.db");
+        uint32_t seq;
+        long size;
+        {
+            DataBase db("full.db", FEAT_LEN);
+            char name[MAX_NAME_LENGTH];
+            for (int i = 1; i <= count; i++) {
+                snprintf(name, sizeof(name), "f%d", i);
+                CHECK(db.enroll_feat(feat, name, &id) == ESP_OK && id == i);
+            }
+            CHECK(db.delete_feat(1) == ESP_OK);
+            CHECK(db.delete_feat(count - 1) == ESP_OK);
+            seq = db.get_sequence();
+            CHECK(db.compact_changes(seq) == ESP_OK);
+            size = file_size("full.db.log");
+            CHECK(size == 8 + count / 8);
+        }
+        DataBase db("full.db", FEAT_LEN);
+        CHECK(db.get_sequence() == seq && file_size("full.db.log") == size);
+        CHECK(db.get_num_feats() == count - 2);
+        char name[MAX_NAME_LENGTH];
+        for (int i = 1; i <= count; i++) {
+            snprintf(name, sizeof(name), "f%d", i);
+            CHECK(has_name(db, i, name) == (i != 1 && i != count - 1));
+        }
+        CHECK(db.enroll_feat(feat, "next", &id) == ESP_OK && id == count + 1);
+        CHECK(db.get_sequence() == seq + 1);
+    }
+}
+
+int main()
+{
+    test_replay();
+    test_invalid_deltas();
+    test_recovery();
+    test_compaction();
+    test_checkpoint_bytes();
+    return 0;
+}
@@ -0,0 +1,102 @@
+// DataBase: concurrent use and failing file writes.
+#include "host_test.hpp"
+#include "mp_esp_dl_recognition_database.hpp"
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using mp_esp_dl::recognition::DataBase;
+
+static const int FEAT_LEN = 8;
+
+static void unit(float *feat, int axis)
+{
+    memset(feat, 0, sizeof(float) * FEAT_LEN);
+    feat[axis % FEAT_LEN] = 1.0f;
+}
+
+// A failed write must not leave a lock held, the next change would deadlock
+static void test_failed_writes_release_locks()
+{
+    host_remove_db("fail.db");
+    DataBase db("fail.db", FEAT_LEN);
+    float feat[FEAT_LEN];
+    uint16_t id;
+    unit(feat, 0);
+    CHECK(db.enroll_feat(feat, "a", &id) == ESP_OK);
+    CHECK(db.enroll_feat(feat, "b", &id) == ESP_OK);
+
+    host_fail_writes(0);
+    CHECK(db.enroll_feat(feat, "c", &id) != ESP_OK);
+    CHECK(db.rename_feat(1, "renamed") != ESP_OK);
+    CHECK(db.delete_feat(2) != ESP_OK);
+    uint32_t since = 0;
+    std::vector<uint8_t> blob;
+    CHECK(db.export_changes(since, blob) == ESP_OK);
+    host_fail_writes(-1);
+
+    CHECK(db.enroll_feat(feat, "d", &id) == ESP_OK);
+    CHECK(db.delete_feat(id) == ESP_OK);
+    CHECK(!db.query_feat(feat, 0.5f, 5).empty());
+    char name[MAX_NAME_LENGTH];
+    CHECK(db.get_name(1, name));
+    CHECK(strcmp(name, "renamed") == 0);
+}
+
+// Readers query and copy names while one writer enrolls, renames and deletes
+static void test_concurrent_readers_and_writer()
+{
+    host_remove_db("mt.db");
+    DataBase db("mt.db", FEAT_LEN);
+    std::atomic<bool> stop(false);
+    std::atomic<long> queries(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; t++) {
+        readers.emplace_back([&, t] {
+            float query[FEAT_LEN];
+            char name[MAX_NAME_LENGTH];
+            unit(query, t);
+            while (!stop) {
+                for (const auto &result : db.query_feat(query, 0.1f, 5)) {
+                    CHECK(result.name[0] == 'w');
+                }
+                for (uint16_t id = 1; id < 20; id++) {
+                    if (db.get_name(id, name)) {
+                        CHECK(name[0] == 'w');
+                    }
+                }
+                queries++;
+            }
+        });
+    }
+    float feat[FEAT_LEN];
+    uint16_t id;
+    for (int i = 0; i < 200; i++) {
+        unit(feat, i);
+        CHECK(db.enroll_feat(feat, "w", &id) == ESP_OK);
+        CHECK(db.rename_feat(id, i % 2 ? "w odd" : "w even") == ESP_OK);
+        if (i % 3 == 0) {
+            CHECK(db.delete_feat(id) == ESP_OK);
+        }
+    }
+    stop = true;
+    for (auto &reader : readers) {
+        reader.join();
+    }
+    CHECK(queries > 0);
+    CHECK(db.get_num_feats() == 133);
+
+    DataBase reloaded("mt.db", FEAT_LEN);
+    CHECK(reloaded.get_num_feats() == 133);
+    char name[MAX_NAME_LENGTH];
+    CHECK(reloaded.get_name(2, name) && strcmp(name, "w odd") == 0);
+    CHECK(!reloaded.get_name(1, name) && name[0] == '\0');
+}
+
+int main()
+{
+    test_failed_writes_release_locks();
+    test_concurrent_readers_and_writer();
+    return 0;
+}
@@ -0,0 +1,210 @@
+// FaceAligner: the vectorized and the scalar fixed point alignment against
+// each other and the float reference.
+#include "host_test.hpp"
+#include "mp_esp_dl_face_align.hpp"
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using mp_esp_dl::recognition::FaceAligner;
+
+static const int SIZE = FaceAligner::TEMPLATE_SIZE;
+// Normalized black in the int8 input with exponent -7
+static const int BLACK = -128;
+
+struct frame_t {
+    dl::image::img_t img;
+    std::vector<uint8_t> buf;
+};
+
+struct diff_t {
+    int worst = 0;          // largest difference off the frame edge
+    int edge = 0;           // pixels where only one side sampled the border
+    long sum = 0;
+    long count = 0;
+    int scalar_worst = 0;   // largest difference of align() and align_scalar()
+                            // in quantization steps, 2 for a pixel value of 1
+    long scalar_diffs = 0;
+    double fast_us = 0;
+    double scalar_us = 0;
+    double reference_us = 0;
+    int runs = 0;
+};
+
+// A gradient with noise, so neighbouring pixels differ as in a camera frame
+static void make_frame(frame_t &frame, dl::image::pix_type_t pix_type, int width, int height, std::mt19937 &rng)
+{
+    int bpp = pix_type == dl::image::DL_IMAGE_PIX_TYPE_RGB565 ? 2 : 3;
+    frame.buf.resize(width * height * bpp);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            for (int c = 0; c < bpp; c++) {
+                frame.buf[(y * width + x) * bpp + c] = (uint8_t)(x * 3 + y * 5 + c * 40 + rng() % 64);
+            }
+        }
+    }
+    frame.img.data = frame.buf.data();
+    frame.img.width = width;
+    frame.img.height = height;
+    frame.img.pix_type = pix_type;
+}
+
+// The landmarks of the template, scaled, rotated and moved to (cx, cy)
+static std::vector<int> make_keypoints(float cx, float cy, float scale, float angle, std::mt19937 &rng)
+{
+    std::vector<int> keypoints(10);
+    for (int i = 0; i < 5; i++) {
+        float u = FaceAligner::TEMPLATE[2 * i] - SIZE / 2;
+        float v = FaceAligner::TEMPLATE[2 * i + 1] - SIZE / 2;
+        keypoints[2 * i] = (int)floorf(cx + scale * (cosf(angle) * u - sinf(angle) * v)) + rng() % 3;
+        keypoints[2 * i + 1] = (int)floorf(cy + scale * (sinf(angle) * u + cosf(angle) * v)) + rng() % 3;
+    }
+    return keypoints;
+}
+
+static void compare(const frame_t &frame, uint32_t caps, const std::vector<int> &keypoints, diff_t &diff)
+{
+    FaceAligner aligner({127.5f, 127.5f, 127.5f}, {127.5f, 127.5f, 127.5f}, caps);
+    dl::TensorBase fast({1, SIZE, SIZE, 3}, nullptr, -7, dl::DATA_TYPE_INT8);
+    dl::TensorBase scalar({1, SIZE, SIZE, 3}, nullptr, -7, dl::DATA_TYPE_INT8);
+    dl::TensorBase reference({1, SIZE, SIZE, 3}, nullptr, -7, dl::DATA_TYPE_INT8);
+    CHECK(FaceAligner::supports(frame.img, &fast));
+
+    auto t0 = std::chrono::steady_clock::now();
+    CHECK(aligner.align(frame.img, keypoints, &fast) == ESP_OK);
+    auto t1 = std::chrono::steady_clock::now();
+    CHECK(aligner.align_scalar(frame.img, keypoints, &scalar) == ESP_OK);
+    auto t2 = std::chrono::steady_clock::now();
+    CHECK(aligner.align_reference(frame.img, keypoints, &reference) == ESP_OK);
+    auto t3 = std::chrono::steady_clock::now();
+    diff.fast_us += std::chrono::duration<double, std::micro>(t1 - t0).count();
+    diff.scalar_us += std::chrono::duration<double, std::micro>(t2 - t1).count();
+    diff.reference_us += std::chrono::duration<double, std::micro>(t3 - t2).count();
+    diff.runs++;
+
+    const int8_t *a = (const int8_t *)fast.data;
+    const int8_t *s = (const int8_t *)scalar.data;
+    const int8_t *b = (const int8_t *)reference.data;
+    for (int i = 0; i < fast.size; i++) {
+        // Both take the same span of a row inside the frame
+        diff.scalar_worst = std::max(diff.scalar_worst, abs(a[i] - s[i]));
+        diff.scalar_diffs += a[i] != s[i];
+    }
+    for (int i = 0; i < fast.size; i++) {
+        int d = abs(a[i] - b[i]);
+        if (d > 2 && (a[i] == BLACK || b[i] == BLACK)) {
+            diff.edge++;
+            continue;
+        }
+        diff.worst = std::max(diff.worst, d);
+        diff.sum += d;
+        diff.count++;
+    }
+}
+
+static void report(const char *name, const diff_t &diff)
+{
+    printf("  %-22s worst %d mean %.3f edge %d, to scalar worst %d in %.2f%%, align %.1f us scalar %.1f us "
+           "reference %.1f us\n",
+           name, diff.worst, (double)diff.sum / diff.count, diff.edge, diff.scalar_worst,
+           100.0 * diff.scalar_diffs / ((double)diff.runs * SIZE * SIZE * 3), diff.fast_us / diff.runs,
+           diff.scalar_us / diff.runs, diff.reference_us / diff.runs);
+}
+
+// Faces inside the frame, for each pixel format and byte and channel order
+static void test_formats()
+{
+    static const struct {
+        const char *name;
+        dl::image::pix_type_t pix_type;
+        uint32_t caps;
+    } formats[] = {
+        {"RGB888", dl::image::DL_IMAGE_PIX_TYPE_RGB888, 0},
+        {"RGB888 swapped", dl::image::DL_IMAGE_PIX_TYPE_RGB888, DL_IMAGE_CAP_RGB_SWAP},
+        {"RGB565 LE", dl::image::DL_IMAGE_PIX_TYPE_RGB565, 0},
+        {"RGB565 LE swapped", dl::image::DL_IMAGE_PIX_TYPE_RGB565, DL_IMAGE_CAP_RGB_SWAP},
+        {"RGB565 BE", dl::image::DL_IMAGE_PIX_TYPE_RGB565, DL_IMAGE_CAP_RGB565_BIG_ENDIAN},
+        {"RGB565 BE swapped", dl::image::DL_IMAGE_PIX_TYPE_RGB565,
+         DL_IMAGE_CAP_RGB565_BIG_ENDIAN | DL_IMAGE_CAP_RGB_SWAP},
+    };
+    std::mt19937 rng(1);
+    frame_t frame;
+    for (const auto &format : formats) {
+        diff_t diff;
+        for (int i = 0; i < 50; i++) {
+            int width = 320 + rng() % 320, height = 240 + rng() % 240;
+            make_frame(frame, format.pix_type, width, height, rng);
+            // The rotated crop reaches SIZE * scale / sqrt(2) from its centre
+            float scale = 0.5f + (rng() % 70) / 100.0f;
+            float margin = 0.75f * SIZE * scale;
+            float cx = margin + rng() % (int)(width - 2 * margin);
+            float cy = margin + rng() % (int)(height - 2 * margin);
+            float angle = ((int)(rng() % 60) - 30) / 100.0f;
+            compare(frame, format.caps, make_keypoints(cx, cy, scale, angle, rng), diff);
+        }
+        report(format.name, diff);
+        CHECK(diff.worst <= 2);
+        CHECK(diff.edge == 0);
+        CHECK(diff.scalar_worst <= 2 && diff.scalar_diffs * 100 < (long)diff.runs * SIZE * SIZE * 3);
+    }
+}
+
+// Faces near, across and past the edges of the frame sample the black border
+static void test_edges()
+{
+    std::mt19937 rng(2);
+    frame_t frame;
+    for (int format = 0; format < 2; format++) {
+        dl::image::pix_type_t pix_type = format ? dl::image::DL_IMAGE_PIX_TYPE_RGB565 : dl::image::DL_IMAGE_PIX_TYPE_RGB888;
+        diff_t diff;
+        int images = 0;
+        for (int i = 0; i < 100; i++) {
+            int width = 100 + rng() % 400, height = 80 + rng() % 300;
+            make_frame(frame, pix_type, width, height, rng);
+            float scale = 0.3f + (rng() % 300) / 100.0f;
+            float reach = SIZE * scale;
+            // Centres from a crop outside the frame to one just inside it
+            float cx = (rng() % 2) ? -reach + rng() % (int)(2 * reach) : width - reach + rng() % (int)(2 * reach);
+            float cy = (rng() % 2) ? -reach + rng() % (int)(2 * reach) : height - reach + rng() % (int)(2 * reach);
+            if (rng() % 2) {
+                cy = rng() % height;
+            }
+            float angle = ((int)(rng() % 100) - 50) / 100.0f;
+            uint32_t caps = rng() % 4;
+            int edge = diff.edge;
+            compare(frame, caps, make_keypoints(cx, cy, scale, angle, rng), diff);
+            // Only single pixels along the edges of the frame, no more than
+            // two edges of SIZE pixels cross the crop
+            CHECK(diff.edge - edge <= 2 * SIZE * 3);
+            images++;
+        }
+        report(format ? "RGB565 at the edges" : "RGB888 at the edges", diff);
+        CHECK(diff.worst <= 2);
+        CHECK(diff.edge < (long)images * SIZE * SIZE * 3 / 100);
+        CHECK(diff.scalar_worst <= 2 && diff.scalar_diffs * 100 < (long)diff.runs * SIZE * SIZE * 3);
+    }
+}
+
+// A face entirely outside the frame is black in both
+static void test_outside()
+{
+    std::mt19937 rng(3);
+    frame_t frame;
+    make_frame(frame, dl::image::DL_IMAGE_PIX_TYPE_RGB888, 320, 240, rng);
+    diff_t diff;
+    compare(frame, 0, make_keypoints(-400, 120, 1.0f, 0.0f, rng), diff);
+    compare(frame, 0, make_keypoints(160, 800, 1.0f, 0.3f, rng), diff);
+    CHECK(diff.worst == 0 && diff.edge == 0 && diff.scalar_worst == 0);
+}
+
+int main()
+{
+    CHECK(FaceAligner::vectorized());
+    // Host timings only; they show the ratio of the two on this machine and
+    // say nothing about the speed on an ESP32-S3
+    test_formats();
+    test_edges();
+    test_outside();
+    return 0;
+}
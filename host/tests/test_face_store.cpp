@@ -0,0 +1,243 @@
+// FaceStore and DataBase::reembed(): stored crops and switching feature models.
+#include "host_test.hpp"
+#include "mp_esp_dl_recognition_database.hpp"
+#include <cstring>
+#include <vector>
+
+using mp_esp_dl::recognition::DataBase;
+using mp_esp_dl::recognition::FaceStore;
+
+static const int OLD_LEN = 4;
+static const int NEW_LEN = 8;
+
+static bool has_name(DataBase &db, uint16_t id, const char *expected)
+{
+    char name[MAX_NAME_LENGTH];
+    return db.get_name(id, name) && strcmp(name, expected) == 0;
+}
+
+// A crop filled with one value, so the embedding tells which face it was
+static std::vector<uint8_t> crop_of(uint8_t value)
+{
+    return std::vector<uint8_t>(FaceStore::CROP_BYTES, value);
+}
+
+// The embedding of a crop_of() crop for the new feature model
+static void embedding_of(uint8_t value, float *feat)
+{
+    memset(feat, 0, sizeof(float) * NEW_LEN);
+    feat[value % NEW_LEN] = 1.0f;
+}
+
+// Faces are read back in the order they were appended
+static void test_append_and_read()
+{
+    host_remove_db("store.db");
+    for (uint16_t id = 1; id <= 3; id++) {
+        CHECK(FaceStore::append("store.db.faces", id, crop_of(id * 10).data()) == ESP_OK);
+    }
+    mp_file_t *f = mp_try_open("store.db.faces", "rb");
+    CHECK(f);
+    CHECK(FaceStore::read_header(f) == ESP_OK);
+    std::vector<uint8_t> crop(FaceStore::CROP_BYTES);
+    uint16_t id;
+    for (uint16_t expected = 1; expected <= 3; expected++) {
+        CHECK(FaceStore::read_next(f, &id, crop.data()) == ESP_OK);
+        CHECK(id == expected && crop == crop_of(expected * 10));
+    }
+    CHECK(FaceStore::read_next(f, &id, crop.data()) == ESP_ERR_NOT_FOUND);
+    mp_try_close(f);
+
+    // Not a face store
+    f = mp_try_open("store.db.faces", "wb");
+    mp_try_write(f, "nope", 4);
+    mp_try_close(f);
+    f = mp_try_open("store.db.faces", "rb");
+    CHECK(FaceStore::read_header(f) != ESP_OK);
+    mp_try_close(f);
+}
+
+// A frame which already is a face on the template comes out nearly
+// unchanged: the stored landmarks are rounded, so the crop is moved by less
+// than a pixel and the pixels along the edges may fall off the frame.
+static void test_align_identity()
+{
+    const int size = FaceStore::SIZE;
+    std::vector<uint8_t> frame(size * size * 3);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            for (int c = 0; c < 3; c++) {
+                frame[(y * size + x) * 3 + c] = (uint8_t)((x + y) / 2 + c * 20);
+            }
+        }
+    }
+    dl::image::img_t img;
+    img.data = frame.data();
+    img.width = size;
+    img.height = size;
+    img.pix_type = dl::image::DL_IMAGE_PIX_TYPE_RGB888;
+    std::vector<uint8_t> crop(FaceStore::CROP_BYTES);
+    FaceStore::align(img, FaceStore::keypoint(), crop.data());
+    int worst = 0;
+    for (int y = 2; y < size - 2; y++) {
+        for (int x = 2; x < size - 2; x++) {
+            for (int c = 0; c < 3; c++) {
+                int i = (y * size + x) * 3 + c;
+                worst = std::max(worst, abs(crop[i] - frame[i]));
+            }
+        }
+    }
+    CHECK(worst <= 1);
+}
+
+// RGB565 frames of either byte order give the crop of the RGB888 frame they
+// were made from; the byte order comes from the caps of the recognizer
+static void test_align_rgb565()
+{
+    const int size = FaceStore::SIZE;
+    std::vector<uint8_t> rgb(size * size * 3), little(size * size * 2), big(size * size * 2);
+    for (int i = 0; i < size * size; i++) {
+        int x = i % size, y = i / size;
+        // Values which RGB565 holds exactly and whose two bytes differ
+        uint8_t r = ((x * 2) & 0x1f) << 3, g = ((x + y) & 0x3f) << 2, b = (y & 0x1f) << 3;
+        rgb[i * 3] = r | (r >> 5);
+        rgb[i * 3 + 1] = g | (g >> 6);
+        rgb[i * 3 + 2] = b | (b >> 5);
+        uint16_t v = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+        little[i * 2] = v & 0xff;
+        little[i * 2 + 1] = v >> 8;
+        big[i * 2] = v >> 8;
+        big[i * 2 + 1] = v & 0xff;
+    }
+    dl::image::img_t img;
+    img.width = size;
+    img.height = size;
+    img.pix_type = dl::image::DL_IMAGE_PIX_TYPE_RGB888;
+    img.data = rgb.data();
+    std::vector<uint8_t> expected(FaceStore::CROP_BYTES), crop(FaceStore::CROP_BYTES);
+    FaceStore::align(img, FaceStore::keypoint(), expected.data());
+
+    img.pix_type = dl::image::DL_IMAGE_PIX_TYPE_RGB565;
+    img.data = little.data();
+    FaceStore::align(img, FaceStore::keypoint(), crop.data());
+    CHECK(crop == expected);
+    img.data = big.data();
+    FaceStore::align(img, FaceStore::keypoint(), crop.data(), DL_IMAGE_CAP_RGB565_BIG_ENDIAN);
+    CHECK(crop == expected);
+    // Read the wrong way round the colors are scrambled
+    FaceStore::align(img, FaceStore::keypoint(), crop.data());
+    CHECK(crop != expected);
+}
+
+static DataBase::embed_fn_t embed_fn(std::vector<float> &feat, int *calls)
+{
+    feat.resize(NEW_LEN);
+    return [&feat, calls](const uint8_t *crop) -> const float * {
+        (*calls)++;
+        embedding_of(crop[0], feat.data());
+        return feat.data();
+    };
+}
+
+// Records with a stored face get the embedding of the new model and keep
+// their id and name, records without one are dropped; the change log and the
+// projection start over
+static void test_reembed()
+{
+    host_remove_db("re.db");
+    {
+        DataBase db("re.db", OLD_LEN);
+        float feat[OLD_LEN] = {1, 0, 0, 0};
+        const char *names[] = {"ann", "bob", "cid", "dan", "eve"};
+        uint16_t id;
+        for (int i = 0; i < 5; i++) {
+            CHECK(db.enroll_feat(feat, names[i], &id) == ESP_OK && id == i + 1);
+            // cid enrolled without store_faces
+            if (id != 3) {
+                CHECK(db.store_face(id, crop_of(id).data()) == ESP_OK);
+            }
+        }
+        CHECK(db.delete_feat(5) == ESP_OK);
+        CHECK(db.has_faces());
+
+        std::vector<float> embedding;
+        int calls = 0;
+        int last_done = 0;
+        DataBase::reembed_stats_t stats;
+        auto progress = [&last_done](int done, int total, int64_t elapsed_us) {
+            CHECK(done == last_done + 1 && total == 5 && elapsed_us >= 0);
+            last_done = done;
+            return true;
+        };
+        CHECK(db.reembed(NEW_LEN, embed_fn(embedding, &calls), progress, &stats) == ESP_OK);
+        CHECK(stats.reembedded == 3 && stats.dropped == 1 && calls == 3 && last_done == 5);
+        CHECK(db.get_feat_len() == NEW_LEN && db.get_num_feats() == 3);
+        CHECK(db.get_projection_dims() == 0);
+
+        float query[NEW_LEN];
+        for (uint16_t expected : {1, 2, 4}) {
+            embedding_of(expected, query);
+            auto results = db.query_feat(query, 0.9f, 1);
+            CHECK(results.size() == 1 && results[0].id == expected);
+        }
+        CHECK(has_name(db, 2, "bob") && has_name(db, 4, "dan"));
+        CHECK(!has_name(db, 3, "cid") && !has_name(db, 5, "eve"));
+
+        // The log holds the new embeddings only
+        std::vector<uint8_t> blob;
+        CHECK(db.export_changes(0, blob) == ESP_OK);
+        DataBase replica("replica.db", NEW_LEN);
+        int applied;
+        CHECK(replica.apply_changes(blob.data(), blob.size(), &applied) == ESP_OK);
+        CHECK(replica.get_num_feats() == 3 && has_name(replica, 4, "dan"));
+        host_remove_db("replica.db");
+    }
+    DataBase db("re.db", NEW_LEN);
+    CHECK(db.get_num_feats() == 3 && has_name(db, 1, "ann"));
+}
+
+// A job stopped by its progress callback or a failing embedding leaves the
+// database as it was
+static void test_reembed_stopped()
+{
+    host_remove_db("stop.db");
+    DataBase db("stop.db", OLD_LEN);
+    float feat[OLD_LEN] = {0, 1, 0, 0};
+    uint16_t id;
+    for (int i = 0; i < 3; i++) {
+        CHECK(db.enroll_feat(feat, "s", &id) == ESP_OK);
+        CHECK(db.store_face(id, crop_of(id).data()) == ESP_OK);
+    }
+    std::vector<float> embedding;
+    int calls = 0;
+    DataBase::reembed_stats_t stats;
+    auto stop = [](int done, int, int64_t) { return done < 2; };
+    CHECK(db.reembed(NEW_LEN, embed_fn(embedding, &calls), stop, &stats) != ESP_OK);
+    CHECK(db.get_feat_len() == OLD_LEN && db.get_num_feats() == 3);
+
+    // The embedding of the second face fails
+    auto fail = [&embedding](const uint8_t *crop) -> const float * {
+        embedding_of(crop[0], embedding.data());
+        return crop[0] == 2 ? nullptr : embedding.data();
+    };
+    CHECK(db.reembed(NEW_LEN, fail, nullptr, &stats) != ESP_OK);
+    CHECK(db.get_feat_len() == OLD_LEN && db.get_sequence() == 3);
+    auto results = db.query_feat(feat, 0.9f, 3);
+    CHECK(results.size() == 3);
+
+    host_remove_db("none.db");
+    DataBase none("none.db", OLD_LEN);
+    CHECK(none.enroll_feat(feat, "n", &id) == ESP_OK);
+    CHECK(!none.has_faces());
+    CHECK(none.reembed(NEW_LEN, fail, nullptr, &stats) == ESP_ERR_NOT_FOUND);
+}
+
+int main()
+{
+    test_append_and_read();
+    test_align_identity();
+    test_align_rgb565();
+    test_reembed();
+    test_reembed_stopped();
+    return 0;
+}
@@ -0,0 +1,120 @@
+// InputScaler: crops clipped to the frame, downscaling and mapping back.
+#include "host_test.hpp"
+#include "mp_esp_dl_input_scaler.hpp"
+#include <cstring>
+#include <vector>
+
+using mp_esp_dl::Arena;
+using mp_esp_dl::InputScaler;
+
+static const int WIDTH = 64;
+static const int HEIGHT = 48;
+
+// Every pixel holds its own coordinates, so a crop tells where it came from
+static dl::image::img_t make_frame(std::vector<uint8_t> &buf)
+{
+    buf.resize(WIDTH * HEIGHT * 3);
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            uint8_t *p = &buf[(y * WIDTH + x) * 3];
+            p[0] = x;
+            p[1] = y;
+            p[2] = 200;
+        }
+    }
+    dl::image::img_t img;
+    img.data = buf.data();
+    img.width = WIDTH;
+    img.height = HEIGHT;
+    img.pix_type = dl::image::DL_IMAGE_PIX_TYPE_RGB888;
+    return img;
+}
+
+static bool crop_is(const dl::image::img_t &crop, int x1, int y1, int width, int height)
+{
+    if (!crop.data || crop.width != width || crop.height != height) {
+        return false;
+    }
+    const uint8_t *p = (const uint8_t *)crop.data;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++, p += 3) {
+            if (p[0] != x1 + x || p[1] != y1 + y || p[2] != 200) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Rectangles inside, partly outside and without pixels in the frame
+static void test_crop()
+{
+    std::vector<uint8_t> buf;
+    dl::image::img_t frame = make_frame(buf);
+    Arena arena;
+    arena.reset();
+    InputScaler scaler(&arena);
+
+    CHECK(crop_is(scaler.crop(frame, 10, 5, 30, 25), 10, 5, 20, 20));
+    CHECK(!InputScaler::empty(scaler.crop(frame, 10, 5, 30, 25)));
+    // Clipped on every side
+    CHECK(crop_is(scaler.crop(frame, -10, -5, 8, 6), 0, 0, 8, 6));
+    CHECK(crop_is(scaler.crop(frame, 50, 40, WIDTH + 20, HEIGHT + 20), 50, 40, WIDTH - 50, HEIGHT - 40));
+    CHECK(crop_is(scaler.crop(frame, -1, -1, WIDTH + 1, HEIGHT + 1), 0, 0, WIDTH, HEIGHT));
+
+    // Empty, inverted and fully outside rectangles have no pixels to run on
+    const int rects[][4] = {
+        {10, 10, 10, 20}, {10, 10, 20, 10}, {30, 30, 20, 40}, {30, 30, 40, 20},
+        {-20, 10, -1, 20}, {10, -20, 20, 0}, {WIDTH, 10, WIDTH + 10, 20}, {10, HEIGHT + 5, 20, HEIGHT + 30},
+    };
+    for (const auto &r : rects) {
+        const dl::image::img_t &crop = scaler.crop(frame, r[0], r[1], r[2], r[3]);
+        CHECK(InputScaler::empty(crop) && !crop.data);
+    }
+    // The crop buffer is still usable after an empty crop
+    CHECK(crop_is(scaler.crop(frame, 1, 2, 4, 5), 1, 2, 3, 3));
+
+    // A new run invalidates the buffer, the next crop takes a new one
+    arena.reset();
+    CHECK(crop_is(scaler.crop(frame, 20, 20, 60, 40), 20, 20, 40, 20));
+}
+
+// Halving a frame of 2 x 2 blocks gives one pixel per block
+static void test_resize()
+{
+    std::vector<uint8_t> buf(WIDTH * HEIGHT * 3);
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            memset(&buf[(y * WIDTH + x) * 3], (x / 2 + y / 2) & 0xff, 3);
+        }
+    }
+    dl::image::img_t frame;
+    frame.data = buf.data();
+    frame.width = WIDTH;
+    frame.height = HEIGHT;
+    frame.pix_type = dl::image::DL_IMAGE_PIX_TYPE_RGB888;
+    Arena arena;
+    arena.reset();
+    InputScaler scaler(&arena);
+    const dl::image::img_t &small = scaler.resize(frame, WIDTH / 2, HEIGHT / 2);
+    CHECK(small.data && small.width == WIDTH / 2 && small.height == HEIGHT / 2);
+    const uint8_t *p = (const uint8_t *)small.data;
+    for (int y = 0; y < HEIGHT / 2; y++) {
+        for (int x = 0; x < WIDTH / 2; x++, p += 3) {
+            CHECK(p[0] == x + y && p[1] == x + y && p[2] == x + y);
+        }
+    }
+
+    dl::detect::result_t res;
+    res.box = {1, 2, 10, 20};
+    res.keypoint = {4, 5};
+    InputScaler::to_source(res, 2.0f, 2.0f, 3, 4);
+    CHECK((res.box == std::vector<int>{5, 8, 23, 44}) && (res.keypoint == std::vector<int>{11, 14}));
+}
+
+int main()
+{
+    test_crop();
+    test_resize();
+    return 0;
+}
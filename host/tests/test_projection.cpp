@@ -0,0 +1,161 @@
+// Projection: agreement with the exact search on a full-rank gallery, storage.
+#include "host_test.hpp"
+#include "mp_esp_dl_recognition_database.hpp"
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using mp_esp_dl::recognition::DataBase;
+
+static const int FEAT_LEN = 512;
+static const int GALLERY = 1000;
+static const int QUERIES = 200;
+
+static void random_unit(float *feat, std::mt19937 &rng)
+{
+    std::normal_distribution<float> normal;
+    float norm = 0;
+    for (int k = 0; k < FEAT_LEN; k++) {
+        feat[k] = normal(rng);
+        norm += feat[k] * feat[k];
+    }
+    norm = sqrtf(norm);
+    for (int k = 0; k < FEAT_LEN; k++) {
+        feat[k] /= norm;
+    }
+}
+
+// Records with independent coordinates, so the variance is spread over all
+// dimensions: the worst case for a projection, an embedding of a face model
+// has most of its variance in fewer dimensions
+static void make_gallery(DataBase &db, std::vector<float> &feats, std::mt19937 &rng)
+{
+    feats.resize(GALLERY * FEAT_LEN);
+    uint16_t id;
+    for (int i = 0; i < GALLERY; i++) {
+        random_unit(&feats[i * FEAT_LEN], rng);
+        CHECK(db.enroll_feat(&feats[i * FEAT_LEN], "p", &id) == ESP_OK);
+    }
+}
+
+// Queries with the given cosine similarity to every GALLERY / QUERIES-th record
+static std::vector<float> make_queries(const std::vector<float> &feats, float similarity, std::mt19937 &rng)
+{
+    std::vector<float> queries(QUERIES * FEAT_LEN);
+    std::vector<float> noise(FEAT_LEN);
+    float weight = sqrtf(1 - similarity * similarity);
+    for (int q = 0; q < QUERIES; q++) {
+        const float *feat = &feats[q * (GALLERY / QUERIES) * FEAT_LEN];
+        random_unit(noise.data(), rng);
+        // Noise orthogonal to the record, so the similarity is exact
+        float dot = 0;
+        for (int k = 0; k < FEAT_LEN; k++) {
+            dot += noise[k] * feat[k];
+        }
+        float norm = 0;
+        for (int k = 0; k < FEAT_LEN; k++) {
+            noise[k] -= dot * feat[k];
+            norm += noise[k] * noise[k];
+        }
+        norm = sqrtf(norm);
+        for (int k = 0; k < FEAT_LEN; k++) {
+            queries[q * FEAT_LEN + k] = similarity * feat[k] + weight * noise[k] / norm;
+        }
+    }
+    return queries;
+}
+
+static std::vector<int> search_all(DataBase &db, const std::vector<float> &queries, double *us)
+{
+    std::vector<int> top(QUERIES);
+    auto t0 = std::chrono::steady_clock::now();
+    for (int q = 0; q < QUERIES; q++) {
+        auto results = db.query_feat(&queries[q * FEAT_LEN], 0.3f, 1);
+        top[q] = results.empty() ? -1 : results[0].id;
+    }
+    *us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() / QUERIES;
+    return top;
+}
+
+// The share of queries with the same best match as the exact search, for
+// queries with a similarity from a near copy of the record down to another
+// photo of the same face. Printed for every dims/candidates pair, with the
+// search time on the host relative to the exact search.
+static void test_full_rank_agreement()
+{
+    host_remove_db("full.db");
+    DataBase db("full.db", FEAT_LEN);
+    std::mt19937 rng(1);
+    std::vector<float> feats;
+    make_gallery(db, feats, rng);
+    const float similarities[] = {0.95f, 0.7f, 0.5f};
+    const int N = sizeof(similarities) / sizeof(similarities[0]);
+    std::vector<float> queries[N];
+    std::vector<int> exact[N];
+    double exact_us[N];
+    for (int s = 0; s < N; s++) {
+        queries[s] = make_queries(feats, similarities[s], rng);
+        exact[s] = search_all(db, queries[s], &exact_us[s]);
+        for (int q = 0; q < QUERIES; q++) {
+            CHECK(exact[s][q] == q * (GALLERY / QUERIES) + 1);
+        }
+    }
+    for (int dims : {32, 64, 128}) {
+        for (int candidates : {16, 32, 64}) {
+            CHECK(db.train_projection(dims, candidates) == ESP_OK);
+            printf("  dims %3d candidates %2d:", dims, candidates);
+            for (int s = 0; s < N; s++) {
+                double us;
+                std::vector<int> top = search_all(db, queries[s], &us);
+                int agree = 0;
+                for (int q = 0; q < QUERIES; q++) {
+                    agree += top[q] == exact[s][q];
+                }
+                printf("  %.2f: %.3f 1/%.1f", similarities[s], (double)agree / QUERIES, exact_us[s] / us);
+                // The setting of the README example
+                if (dims >= 64 && candidates >= 32) {
+                    CHECK(agree >= QUERIES * 99 / 100);
+                }
+            }
+            printf("\n");
+        }
+    }
+}
+
+// The projection is stored with the database, cleared and rejected when it
+// does not fit the gallery
+static void test_storage()
+{
+    host_remove_db("pca.db");
+    std::mt19937 rng(2);
+    std::vector<float> feats;
+    std::vector<float> queries;
+    std::vector<int> trained;
+    {
+        DataBase db("pca.db", FEAT_LEN);
+        make_gallery(db, feats, rng);
+        queries = make_queries(feats, 0.95f, rng);
+        CHECK(db.train_projection(FEAT_LEN + 1, 32) != ESP_OK);
+        CHECK(db.get_projection_dims() == 0);
+        CHECK(db.train_projection(64, 32) == ESP_OK);
+        double us;
+        trained = search_all(db, queries, &us);
+    }
+    {
+        DataBase db("pca.db", FEAT_LEN);
+        CHECK(db.get_projection_dims() == 64);
+        double us;
+        CHECK(search_all(db, queries, &us) == trained);
+        CHECK(db.clear_projection() == ESP_OK);
+    }
+    DataBase db("pca.db", FEAT_LEN);
+    CHECK(db.get_projection_dims() == 0);
+}
+
+int main()
+{
+    test_full_rank_agreement();
+    test_storage();
+    return 0;
+}
@@ -0,0 +1,222 @@
+#include "mp_esp_dl.hpp"
+#include "lib/mp_esp_dl_overlay.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+namespace mp_esp_dl::draw {
+
+using mp_esp_dl::Overlay;
+
+static const int MAX_DEPTH = 8;
+static const size_t MAX_LABEL = 32;
+// Names are cut so that " 100%" still fits into the label behind them
+static const size_t MAX_LABEL_NAME = MAX_LABEL - 5;
+
+struct style_t {
+    Overlay::color_t color;
+    Overlay::color_t text_color;
+    int thickness;
+    bool keypoints;
+    bool labels;
+};
+
+static Overlay::color_t get_color(mp_obj_t obj) {
+    mp_obj_t *items;
+    mp_obj_get_array_fixed_n(obj, 3, &items);
+    Overlay::color_t color;
+    color.r = (uint8_t)std::min<mp_int_t>(std::max<mp_int_t>(mp_obj_get_int(items[0]), 0), 255);
+    color.g = (uint8_t)std::min<mp_int_t>(std::max<mp_int_t>(mp_obj_get_int(items[1]), 0), 255);
+    color.b = (uint8_t)std::min<mp_int_t>(std::max<mp_int_t>(mp_obj_get_int(items[2]), 0), 255);
+    return color;
+}
+
+static mp_obj_t dict_get(mp_obj_t dict, qstr key) {
+    mp_map_elem_t *elem = mp_map_lookup(mp_obj_dict_get_map(dict), MP_OBJ_NEW_QSTR(key), MP_MAP_LOOKUP);
+    return elem ? elem->value : mp_const_none;
+}
+
+static int percent(mp_obj_t value) {
+    return (int)std::lround(std::min(std::max((float)mp_obj_get_float(value), 0.0f), 1.0f) * 100);
+}
+
+// The label sits on a filled bar on top of the box, or inside it at the top
+// edge of the frame
+static void label(Overlay &overlay, const style_t &style, int x, int y, const char *str, size_t len) {
+    len = std::min(len, MAX_LABEL);
+    const int width = Overlay::text_width(len, 1);
+    const int height = Overlay::text_height(1);
+    if (y - height >= 0) {
+        y -= height;
+    }
+    overlay.fill_rect(x, y, x + width, y + height, style.color);
+    overlay.text(x + 1, y + 1, str, len, 1, style.text_color);
+}
+
+// "name 87%" or "id 3 87%" for a known person, the score otherwise
+static size_t face_label(mp_obj_t dict, char *buf, size_t size) {
+    mp_obj_t person = dict_get(dict, MP_QSTR_person);
+    int written;
+    if (mp_obj_is_type(person, &mp_type_dict)) {
+        mp_obj_t name = dict_get(person, MP_QSTR_name);
+        int similarity = percent(dict_get(person, MP_QSTR_similarity));
+        size_t len = 0;
+        const char *str = mp_obj_is_str(name) ? mp_obj_str_get_data(name, &len) : "";
+        if (len) {
+            written = snprintf(buf, size, "%.*s %d%%", (int)std::min(len, MAX_LABEL_NAME), str, similarity);
+        } else {
+            written = snprintf(buf, size, "id %d %d%%", (int)mp_obj_get_int(dict_get(person, MP_QSTR_id)), similarity);
+        }
+    } else {
+        mp_obj_t score = dict_get(dict, MP_QSTR_score);
+        if (score == mp_const_none) {
+            return 0;
+        }
+        written = snprintf(buf, size, "%d%%", percent(score));
+    }
+    return written > 0 ? std::min((size_t)written, size - 1) : 0;
+}
+
+static void draw_records(Overlay &overlay, const style_t &style, mp_obj_t results, int depth);
+
+static void draw_record(Overlay &overlay, const style_t &style, mp_obj_t dict, int depth) {
+    mp_obj_t box = dict_get(dict, MP_QSTR_box);
+    mp_obj_t features = dict_get(dict, MP_QSTR_features);
+    mp_obj_t faces = dict_get(dict, MP_QSTR_faces);
+    if (box != mp_const_none) {
+        mp_obj_t *items;
+        mp_obj_get_array_fixed_n(box, 4, &items);
+        int x1 = mp_obj_get_int(items[0]);
+        int y1 = mp_obj_get_int(items[1]);
+        int x2 = mp_obj_get_int(items[2]);
+        int y2 = mp_obj_get_int(items[3]);
+        overlay.rect(x1, y1, x2, y2, style.thickness, style.color);
+        // A pipeline person gets its box only, its faces carry the labels
+        if (style.labels && faces == mp_const_none) {
+            char buf[MAX_LABEL + 16];
+            size_t len = face_label(dict, buf, sizeof(buf));
+            if (len) {
+                label(overlay, style, x1, y1, buf, len);
+            }
+        }
+    }
+    if (style.keypoints && features != mp_const_none) {
+        mp_obj_t *items;
+        mp_obj_get_array_fixed_n(features, 10, &items);
+        for (int i = 0; i < 5; i++) {
+            overlay.point(mp_obj_get_int(items[2 * i]), mp_obj_get_int(items[2 * i + 1]), style.thickness, style.color);
+        }
+    }
+    if (faces != mp_const_none) {
+        draw_records(overlay, style, faces, depth + 1);
+    }
+}
+
+static void draw_records(Overlay &overlay, const style_t &style, mp_obj_t results, int depth) {
+    if (depth > MAX_DEPTH) {
+        mp_raise_ValueError(MP_ERROR_TEXT("Results are nested too deep."));
+    }
+    if (results == mp_const_none) {
+        return;
+    }
+    size_t len;
+    mp_obj_t *items;
+    mp_obj_get_array(results, &len, &items);
+    // ImageNet.run() returns label (or index) and score pairs in one flat
+    // list, they are listed in the top left corner
+    if (len > 0 && !mp_obj_is_type(items[0], &mp_type_dict)) {
+        if (!style.labels) {
+            return;
+        }
+        const int height = Overlay::text_height(1);
+        for (size_t i = 0; i + 1 < len; i += 2) {
+            char buf[MAX_LABEL + 16];
+            int written;
+            if (mp_obj_is_int(items[i])) {
+                written = snprintf(buf, sizeof(buf), "#%d %d%%", (int)mp_obj_get_int(items[i]), percent(items[i + 1]));
+            } else {
+                size_t name_len;
+                const char *name = mp_obj_str_get_data(items[i], &name_len);
+                written = snprintf(buf, sizeof(buf), "%.*s %d%%", (int)std::min(name_len, MAX_LABEL_NAME), name, percent(items[i + 1]));
+            }
+            if (written > 0) {
+                label(overlay, style, 0, (int)(i / 2) * height, buf, std::min((size_t)written, sizeof(buf) - 1));
+            }
+        }
+        return;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (mp_obj_is_type(items[i], &mp_type_dict)) {
+            draw_record(overlay, style, items[i], depth);
+        }
+    }
+}
+
+// draw(framebuffer, results, width, height, *, color=(0, 255, 0), thickness=2,
+//      keypoints=True, labels=True, big_endian=False)
+static mp_obj_t draw(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    MP_DL_TRACE_SCOPE("draw");
+    enum { ARG_framebuffer, ARG_results, ARG_width, ARG_height, ARG_color, ARG_thickness, ARG_keypoints, ARG_labels, ARG_big_endian };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_framebuffer, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_results, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_width, MP_ARG_REQUIRED | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_height, MP_ARG_REQUIRED | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_color, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_thickness, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 2} },
+        { MP_QSTR_keypoints, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = true} },
+        { MP_QSTR_labels, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = true} },
+        { MP_QSTR_big_endian, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_int_t width = args[ARG_width].u_int;
+    mp_int_t height = args[ARG_height].u_int;
+    if (width <= 0 || height <= 0) {
+        mp_raise_ValueError(MP_ERROR_TEXT("Width and height must be positive."));
+    }
+
+    // No frame of that size fits into memory, and the sizes below would overflow
+    if ((size_t)width > SIZE_MAX / 3 / (size_t)height) {
+        mp_raise_ValueError(MP_ERROR_TEXT("Width and height are too large."));
+    }
+    size_t pixels = (size_t)width * (size_t)height;
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[ARG_framebuffer].u_obj, &bufinfo, MP_BUFFER_WRITE);
+
+    // The pixel format follows from the size, as the frames of the camera are
+    // either RGB888 or RGB565
+    dl::image::img_t img;
+    img.data = bufinfo.buf;
+    img.width = width;
+    img.height = height;
+    if (bufinfo.len == pixels * 3) {
+        img.pix_type = dl::image::DL_IMAGE_PIX_TYPE_RGB888;
+    } else if (bufinfo.len == pixels * 2) {
+        img.pix_type = dl::image::DL_IMAGE_PIX_TYPE_RGB565;
+    } else {
+        mp_raise_ValueError(MP_ERROR_TEXT("Frame buffer size does not match an RGB888 or RGB565 image of width x height."));
+    }
+
+    style_t style;
+    style.color = args[ARG_color].u_obj == mp_const_none ? Overlay::color_t{0, 255, 0} : get_color(args[ARG_color].u_obj);
+    // Black text on light colors, white on dark ones
+    int luma = (style.color.r * 77 + style.color.g * 150 + style.color.b * 29) >> 8;
+    style.text_color = luma >= 128 ? Overlay::color_t{0, 0, 0} : Overlay::color_t{255, 255, 255};
+    style.thickness = std::max<mp_int_t>(std::min<mp_int_t>(args[ARG_thickness].u_int, 32), 1);
+    style.keypoints = args[ARG_keypoints].u_bool;
+    style.labels = args[ARG_labels].u_bool;
+
+    Overlay overlay(img, args[ARG_big_endian].u_bool);
+    draw_records(overlay, style, args[ARG_results].u_obj, 0);
+    return mp_const_none;
+}
+
+} // namespace mp_esp_dl::draw
+
+extern "C" {
+MP_DEFINE_CONST_FUN_OBJ_KW_CXX(mp_esp_dl_draw_obj, 4, mp_esp_dl::draw::draw);
+}
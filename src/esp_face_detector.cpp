@@ -11,11 +11,14 @@ struct MP_FaceDetector : public MP_DetectorBase<HumanFaceDetect> {
 
 // Constructor
 static mp_obj_t face_detector_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
-    enum { ARG_img_width, ARG_img_height, ARG_return_features };
+    enum { ARG_img_width, ARG_img_height, ARG_return_features, ARG_scale, ARG_max_input, ARG_refine };
     static const mp_arg_t allowed_args[] = {
         { MP_QSTR_width, MP_ARG_INT, {.u_int = 320} },
         { MP_QSTR_height, MP_ARG_INT, {.u_int = 240} },
         { MP_QSTR_features, MP_ARG_BOOL, {.u_bool = true} },
+        { MP_QSTR_scale, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_max_input, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_refine, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false} },
     };
 
     mp_arg_val_t parsed_args[MP_ARRAY_SIZE(allowed_args)];
@@ -26,6 +29,10 @@ static mp_obj_t face_detector_make_new(const mp_obj_type_t *type, size_t n_args,
         parsed_args[ARG_img_width].u_int, 
         parsed_args[ARG_img_height].u_int);
     self->return_features = parsed_args[ARG_return_features].u_bool;
+    mp_esp_dl::set_input_scale(self,
+        parsed_args[ARG_scale].u_obj == mp_const_none ? 1.0f : mp_obj_get_float(parsed_args[ARG_scale].u_obj),
+        parsed_args[ARG_max_input].u_int,
+        parsed_args[ARG_refine].u_bool);
 
     return MP_OBJ_FROM_PTR(self);
 }
@@ -34,25 +41,39 @@ static mp_obj_t face_detector_make_new(const mp_obj_type_t *type, size_t n_args,
 static mp_obj_t face_detector_del(mp_obj_t self_in) {
     MP_FaceDetector *self = static_cast<MP_FaceDetector *>(MP_OBJ_TO_PTR(self_in));
     self->model = nullptr;
+    self->scaler = nullptr;
+    self->arena = nullptr;
     return mp_const_none;
 }
 static MP_DEFINE_CONST_FUN_OBJ_1_CXX(face_detector_del_obj, face_detector_del);
 
 // Get and set methods
 static void face_detector_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest){
-    mp_esp_dl::espdl_obj_property<MP_FaceDetector>(self_in, attr, dest);
+    mp_esp_dl::detector_obj_property<MP_FaceDetector>(self_in, attr, dest);
 }
 
-// Detect method
-static mp_obj_t face_detector_detect(mp_obj_t self_in, mp_obj_t framebuffer_obj) {
-    MP_FaceDetector *self = mp_esp_dl::get_and_validate_framebuffer<MP_FaceDetector>(self_in, framebuffer_obj);
+// Detect method. The filter keywords override the filter options of the object for this call.
+static mp_obj_t face_detector_detect(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_self, ARG_framebuffer, ARG_score_threshold };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // framebuffer
+        MP_DL_FILTER_ARGS,
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    MP_FaceDetector *self = mp_esp_dl::get_and_validate_framebuffer<MP_FaceDetector>(args[ARG_self].u_obj, args[ARG_framebuffer].u_obj);
+    mp_esp_dl::ResultFilter filter = mp_esp_dl::filter_from_args(self, &args[ARG_score_threshold]);
 
-    auto &detect_results = self->model->run(self->img);
+    auto &detect_results = mp_esp_dl::detect(self, &filter);
 
     if (detect_results.size() == 0) {
         return mp_const_none;
     }
 
+    MP_DL_TRACE_SCOPE("results");
     mp_obj_t list = mp_obj_new_list(0, NULL);
     for (const auto &res : detect_results) {
         mp_obj_t dict = mp_obj_new_dict(3);
@@ -78,11 +99,19 @@ static mp_obj_t face_detector_detect(mp_obj_t self_in, mp_obj_t framebuffer_obj)
     }
     return list;
 }
-static MP_DEFINE_CONST_FUN_OBJ_2_CXX(face_detector_detect_obj, face_detector_detect);
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(face_detector_detect_obj, 2, face_detector_detect);
+
+// Batch detect method
+static mp_obj_t face_detector_run_batch(mp_obj_t self_in, mp_obj_t framebuffers_obj) {
+    MP_FaceDetector *self = static_cast<MP_FaceDetector *>(MP_OBJ_TO_PTR(self_in));
+    return mp_esp_dl::detect_batch<MP_FaceDetector>(self_in, framebuffers_obj, self->return_features);
+}
+static MP_DEFINE_CONST_FUN_OBJ_2_CXX(face_detector_run_batch_obj, face_detector_run_batch);
 
 // Local dict
 static const mp_rom_map_elem_t face_detector_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_run), MP_ROM_PTR(&face_detector_detect_obj) },
+    { MP_ROM_QSTR(MP_QSTR_run_batch), MP_ROM_PTR(&face_detector_run_batch_obj) },
     { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&face_detector_del_obj) },
 };
 static MP_DEFINE_CONST_DICT(face_detector_locals_dict, face_detector_locals_dict_table);
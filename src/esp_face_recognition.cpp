@@ -4,6 +4,10 @@
 #include "human_face_detect.hpp"
 #include "lib/mp_esp_dl_human_face_recognition.hpp"
 
+extern "C" {
+    #include "py/objtuple.h"
+}
+
 #if MP_DL_FACE_RECOGNITION_ENABLED
 
 namespace mp_esp_dl::recognition {
@@ -13,17 +17,70 @@ struct MP_FaceRecognizer : public MP_DetectorBase<HumanFaceDetect> {
     std::shared_ptr<HumanFaceFeat> FaceFeat = nullptr;
     std::shared_ptr<HumanFaceRecognizer> FaceRecognizer = nullptr;
     bool return_features;
+    bool load_scheduled;
     char db_path[64];
+    mp_uint_t deadline_misses;     // runs which returned truncated results
 };
 
+// Database records read per step of an asynchronous load
+#define DB_LOAD_CHUNK_RECORDS 16
+
+static mp_obj_t face_recognizer_load_step(mp_obj_t self_in);
+static MP_DEFINE_CONST_FUN_OBJ_1_CXX(face_recognizer_load_step_obj, face_recognizer_load_step);
+
+// Queues the next step of an asynchronous database load. The scheduler runs
+// it between bytecodes, so the REPL and other code keep running meanwhile.
+static void schedule_load(MP_FaceRecognizer *self) {
+    self->load_scheduled = !self->FaceRecognizer->all_loaded() &&
+        mp_sched_schedule(MP_OBJ_FROM_PTR(&face_recognizer_load_step_obj), MP_OBJ_FROM_PTR(self));
+}
+
+static mp_obj_t face_recognizer_load_step(mp_obj_t self_in) {
+    MP_FaceRecognizer *self = static_cast<MP_FaceRecognizer *>(MP_OBJ_TO_PTR(self_in));
+    self->load_scheduled = false;
+    if (!self->FaceRecognizer) {
+        return mp_const_none;
+    }
+    self->FaceRecognizer->load_next_chunk(DB_LOAD_CHUNK_RECORDS);
+    schedule_load(self);
+    return mp_const_none;
+}
+
+// Moves a pending load on if no step is queued, e.g. because the scheduler queue was full
+static void continue_load(MP_FaceRecognizer *self) {
+    if (!self->load_scheduled && !self->FaceRecognizer->all_loaded()) {
+        face_recognizer_load_step(MP_OBJ_FROM_PTR(self));
+    }
+}
+
+// Returns the gallery named by gallery_in, or nullptr for None (the own
+// database). The reference keeps the gallery alive if another thread removes
+// it meanwhile; the callers let it go at the end of a block, before they
+// raise, as an exception would skip its destructor.
+static std::shared_ptr<const HumanFaceRecognizer::gallery_t> get_gallery(MP_FaceRecognizer *self, mp_obj_t gallery_in) {
+    if (gallery_in == mp_const_none) {
+        return nullptr;
+    }
+    auto gallery = self->FaceRecognizer->get_gallery(mp_obj_str_get_str(gallery_in));
+    if (!gallery) {
+        mp_raise_ValueError("Unknown gallery.");
+    }
+    return gallery;
+}
+
 // Constructor
 static mp_obj_t face_recognizer_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
-    enum { ARG_img_width, ARG_img_height, ARG_features, ARG_db_path, ARG_model };
+    enum { ARG_img_width, ARG_img_height, ARG_features, ARG_db_path, ARG_scale, ARG_max_input, ARG_refine, ARG_async_load, ARG_store_faces, ARG_model };
     static const mp_arg_t allowed_args[] = {
         { MP_QSTR_width, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 320} },
         { MP_QSTR_height, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 240} },
         { MP_QSTR_features, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = true} },
         { MP_QSTR_db_path, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_scale, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_max_input, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_refine, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false} },
+        { MP_QSTR_async_load, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false} },
+        { MP_QSTR_store_faces, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false} },
     #if CONFIG_HUMAN_FACE_FEAT_MFN_S8_V1 && CONFIG_HUMAN_FACE_FEAT_MBF_S8_V1
         { MP_QSTR_model, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
     #endif
@@ -59,13 +116,21 @@ static mp_obj_t face_recognizer_make_new(const mp_obj_type_t *type, size_t n_arg
         }
     }
 #endif
-    self->FaceRecognizer = std::make_shared<HumanFaceRecognizer>(self->FaceFeat.get(), self->db_path);
+    self->FaceRecognizer = std::make_shared<HumanFaceRecognizer>(
+        self->FaceFeat.get(), self->db_path, 0.5, 1, parsed_args[ARG_async_load].u_bool);
 
     if ((!self->FaceFeat) || (!self->FaceRecognizer)) {
         mp_raise_msg(&mp_type_RuntimeError, "Failed to create model instances");
     }
+    schedule_load(self);
+    self->FaceRecognizer->set_store_faces(parsed_args[ARG_store_faces].u_bool);
 
     self->return_features = parsed_args[ARG_features].u_bool;
+    self->deadline_misses = 0;
+    mp_esp_dl::set_input_scale(self,
+        parsed_args[ARG_scale].u_obj == mp_const_none ? 1.0f : mp_obj_get_float(parsed_args[ARG_scale].u_obj),
+        parsed_args[ARG_max_input].u_int,
+        parsed_args[ARG_refine].u_bool);
 
     return MP_OBJ_FROM_PTR(self);
 }
@@ -76,23 +141,84 @@ static mp_obj_t face_recognizer_del(mp_obj_t self_in) {
     self->model = nullptr;
     self->FaceFeat = nullptr;
     self->FaceRecognizer = nullptr;
+    self->scaler = nullptr;
+    self->arena = nullptr;
     return mp_const_none;
 }
 static MP_DEFINE_CONST_FUN_OBJ_1_CXX(face_recognizer_del_obj, face_recognizer_del);
 
 // Get and set methods
 static void face_recognizer_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
-    mp_esp_dl::espdl_obj_property<MP_FaceRecognizer>(self_in, attr, dest);
+    MP_FaceRecognizer *self = static_cast<MP_FaceRecognizer *>(MP_OBJ_TO_PTR(self_in));
+    if (dest[0] == MP_OBJ_NULL && attr == MP_QSTR_embedding_size) {
+        dest[0] = mp_obj_new_int(self->FaceRecognizer->get_feat_len());
+        return;
+    }
+    if (dest[0] == MP_OBJ_NULL && attr == MP_QSTR_ready) {
+        dest[0] = mp_obj_new_bool(self->FaceRecognizer->all_loaded());
+        return;
+    }
+    if (attr == MP_QSTR_store_faces) {
+        if (dest[0] == MP_OBJ_NULL) {
+            dest[0] = mp_obj_new_bool(self->FaceRecognizer->get_store_faces());
+        } else if (dest[1] != MP_OBJ_NULL) {
+            self->FaceRecognizer->set_store_faces(mp_obj_is_true(dest[1]));
+            dest[0] = MP_OBJ_NULL;
+        }
+        return;
+    }
+    if (attr == MP_QSTR_deadline_misses) {
+        if (dest[0] == MP_OBJ_NULL) {
+            dest[0] = mp_obj_new_int_from_uint(self->deadline_misses);
+        } else if (dest[1] != MP_OBJ_NULL) {
+            self->deadline_misses = mp_obj_get_int(dest[1]);
+            dest[0] = MP_OBJ_NULL;
+        }
+        return;
+    }
+    if (dest[0] == MP_OBJ_NULL && attr == MP_QSTR_identities) {
+        dest[0] = mp_obj_new_int(self->FaceRecognizer->get_num_identities());
+        return;
+    }
+    if (dest[0] == MP_OBJ_NULL && attr == MP_QSTR_projection) {
+        dest[0] = mp_obj_new_int(self->FaceRecognizer->get_projection_dims());
+        return;
+    }
+    if (dest[0] == MP_OBJ_NULL && attr == MP_QSTR_galleries) {
+        // The names are copied out before any object is created
+        size_t len = 0;
+        char *names = nullptr;
+        {
+            auto galleries = self->FaceRecognizer->get_galleries();
+            len = galleries.size();
+            names = m_new_maybe(char, len * MAX_NAME_LENGTH);
+            for (size_t i = 0; names && i < len; i++) {
+                memcpy(names + i * MAX_NAME_LENGTH, galleries[i]->name, MAX_NAME_LENGTH);
+            }
+        }
+        if (!names && len > 0) {
+            mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Not enough memory for the gallery names."));
+        }
+        mp_obj_tuple_t *tuple = static_cast<mp_obj_tuple_t *>(MP_OBJ_TO_PTR(mp_obj_new_tuple(len, NULL)));
+        for (size_t i = 0; i < len; i++) {
+            tuple->items[i] = mp_obj_new_str_from_cstr(names + i * MAX_NAME_LENGTH);
+        }
+        m_del(char, names, len * MAX_NAME_LENGTH);
+        dest[0] = MP_OBJ_FROM_PTR(tuple);
+        return;
+    }
+    mp_esp_dl::detector_obj_property<MP_FaceRecognizer>(self_in, attr, dest);
 }
 
 // Enroll method
 static mp_obj_t face_recognizer_enroll(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
-    enum { ARG_self, ARG_framebuffer, ARG_validate, ARG_name };
+    enum { ARG_self, ARG_framebuffer, ARG_validate, ARG_name, ARG_gallery };
     static const mp_arg_t allowed_args[] = {
-        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ },  // self
-        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ },  // framebuffer
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // framebuffer
         { MP_QSTR_validate, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false} },
         { MP_QSTR_name, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_gallery, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
     };
 
     mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
@@ -101,7 +227,13 @@ static mp_obj_t face_recognizer_enroll(size_t n_args, const mp_obj_t *pos_args,
     MP_FaceRecognizer *self = mp_esp_dl::get_and_validate_framebuffer<MP_FaceRecognizer>(args[ARG_self].u_obj, args[ARG_framebuffer].u_obj);
     bool validate = args[ARG_validate].u_bool;
 
-    auto &detect_results = self->model->run(self->img);
+    const char* name = "";
+    if (args[ARG_name].u_obj != mp_const_none) {
+        name = mp_obj_str_get_str(args[ARG_name].u_obj);
+    }
+
+    auto &detect_results = mp_esp_dl::detect(self);
+    self->FaceRecognizer->clear_cache();
 
     if (detect_results.size() == 0) {
         mp_raise_ValueError("No face detected.");
@@ -109,14 +241,56 @@ static mp_obj_t face_recognizer_enroll(size_t n_args, const mp_obj_t *pos_args,
     if (detect_results.size() > 1) {
         mp_raise_ValueError("Only one face can be enrolled at a time.");
     }
-    
-    // Only validate if explicitly requested
-    if (validate) {
-        auto recon_results = self->FaceRecognizer->recognize(self->img, detect_results);
-        if (!recon_results.empty() && recon_results[0].similarity > 0.9) {
-            mp_warning("espdl", "Face already enrolled. id: %d, similarity: %f", recon_results[0].id, recon_results[0].similarity);
-            return mp_const_none;
+
+    mp_esp_dl::recognition::result_t enrolled = {};
+    uint16_t new_id = 0;
+    esp_err_t err = ESP_OK;
+    {
+        auto gallery = get_gallery(self, args[ARG_gallery].u_obj);
+        // Validation has to see the whole database
+        (gallery ? gallery->db.get() : self->FaceRecognizer.get())->finish_loading();
+
+        // Only validate if explicitly requested
+        if (validate) {
+            auto recon_results = self->FaceRecognizer->recognize(self->img, detect_results, gallery.get());
+            if (!recon_results.empty() && recon_results[0].similarity > 0.9f) {
+                enrolled = recon_results[0];
+            }
         }
+        if (enrolled.id == 0) {
+            err = self->FaceRecognizer->enroll(self->img, detect_results, name, &new_id, gallery.get());
+        }
+    }
+    if (enrolled.id != 0) {
+        mp_warning("espdl", "Face already enrolled. id: %d, similarity: %f", enrolled.id, (double)enrolled.similarity);
+        return mp_const_none;
+    }
+    if (err != ESP_OK) {
+        mp_raise_ValueError("Failed to enroll face.");
+    }
+
+    return mp_obj_new_int(new_id);
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(face_recognizer_enroll_obj, 2, face_recognizer_enroll);
+
+// Enroll embedding method
+static mp_obj_t face_recognizer_enroll_embedding(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_self, ARG_embedding, ARG_name, ARG_gallery };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // embedding
+        { MP_QSTR_name, MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_gallery, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    MP_FaceRecognizer *self = static_cast<MP_FaceRecognizer *>(MP_OBJ_TO_PTR(args[ARG_self].u_obj));
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[ARG_embedding].u_obj, &bufinfo, MP_BUFFER_READ);
+    if (bufinfo.len != self->FaceRecognizer->get_feat_len() * sizeof(float)) {
+        mp_raise_ValueError("Embedding size does not match the database.");
     }
 
     const char* name = "";
@@ -125,38 +299,522 @@ static mp_obj_t face_recognizer_enroll(size_t n_args, const mp_obj_t *pos_args,
     }
 
     uint16_t new_id;
-    if (self->FaceRecognizer->enroll(self->img, detect_results, name, &new_id) != ESP_OK) {
-        mp_raise_ValueError("Failed to enroll face.");
+    esp_err_t err;
+    {
+        auto gallery = get_gallery(self, args[ARG_gallery].u_obj);
+        mp_esp_dl::recognition::DataBase *db = gallery ? gallery->db.get() : self->FaceRecognizer.get();
+        err = db->enroll_feat((const float *)bufinfo.buf, name, &new_id);
+    }
+    if (err != ESP_OK) {
+        mp_raise_ValueError("Failed to enroll embedding.");
     }
-
     return mp_obj_new_int(new_id);
 }
-static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(face_recognizer_enroll_obj, 2, face_recognizer_enroll);
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(face_recognizer_enroll_embedding_obj, 2, face_recognizer_enroll_embedding);
+
+// Embed method
+static mp_obj_t face_recognizer_embed(mp_obj_t self_in, mp_obj_t framebuffer_obj) {
+    MP_FaceRecognizer *self = mp_esp_dl::get_and_validate_framebuffer<MP_FaceRecognizer>(self_in, framebuffer_obj);
+
+    auto &detect_results = mp_esp_dl::detect(self);
+    self->FaceRecognizer->clear_cache();
+
+    if (detect_results.size() == 0) {
+        return mp_const_none;
+    }
+
+    // The embeddings of all faces back to back, in the order of the run() results
+    size_t feat_len = self->FaceRecognizer->get_feat_len();
+    float *embeddings = m_new(float, detect_results.size() * feat_len);
+    float *dst = embeddings;
+    for (const auto &res : detect_results) {
+        const float *feat = self->FaceRecognizer->extract(self->img, res);
+        if (!feat) {
+            mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("Failed to extract the embedding."));
+        }
+        memcpy(dst, feat, feat_len * sizeof(float));
+        dst += feat_len;
+    }
+    return mp_obj_new_memoryview('f', detect_results.size() * feat_len, embeddings);
+}
+static MP_DEFINE_CONST_FUN_OBJ_2_CXX(face_recognizer_embed_obj, face_recognizer_embed);
 
 // Delete feature method
-static mp_obj_t face_recognizer_delete_feature(mp_obj_t self_in, mp_obj_t id) {
-    MP_FaceRecognizer *self = static_cast<MP_FaceRecognizer *>(MP_OBJ_TO_PTR(self_in));
-    int id_num = mp_obj_get_int(id);
-    if (self->FaceRecognizer->delete_feat(id_num) != ESP_OK) {
+static mp_obj_t face_recognizer_delete_feature(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_self, ARG_id, ARG_gallery };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_id, MP_ARG_REQUIRED | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_gallery, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    MP_FaceRecognizer *self = static_cast<MP_FaceRecognizer *>(MP_OBJ_TO_PTR(args[ARG_self].u_obj));
+    esp_err_t err;
+    {
+        auto gallery = get_gallery(self, args[ARG_gallery].u_obj);
+        mp_esp_dl::recognition::DataBase *db = gallery ? gallery->db.get() : self->FaceRecognizer.get();
+        err = db->delete_feat(args[ARG_id].u_int);
+    }
+    if (err != ESP_OK) {
         mp_raise_ValueError("Failed to delete feature.");
     }
     return mp_const_none;
 }
-static MP_DEFINE_CONST_FUN_OBJ_2_CXX(face_recognizer_delete_feature_obj, face_recognizer_delete_feature);
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(face_recognizer_delete_feature_obj, 2, face_recognizer_delete_feature);
 
-// Recognize method
-static mp_obj_t face_recognizer_recognize(mp_obj_t self_in, mp_obj_t framebuffer_obj) {
-    MP_FaceRecognizer *self = mp_esp_dl::get_and_validate_framebuffer<MP_FaceRecognizer>(self_in, framebuffer_obj);
+// Rename face method
+static mp_obj_t face_recognizer_rename_face(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_self, ARG_id, ARG_name, ARG_gallery };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_id, MP_ARG_REQUIRED | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_name, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_gallery, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
 
-    auto &detect_results = self->model->run(self->img);
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    MP_FaceRecognizer *self = static_cast<MP_FaceRecognizer *>(MP_OBJ_TO_PTR(args[ARG_self].u_obj));
+    const char *name = mp_obj_str_get_str(args[ARG_name].u_obj);
+    esp_err_t err;
+    {
+        auto gallery = get_gallery(self, args[ARG_gallery].u_obj);
+        mp_esp_dl::recognition::DataBase *db = gallery ? gallery->db.get() : self->FaceRecognizer.get();
+        err = db->rename_feat(args[ARG_id].u_int, name);
+    }
+    if (err != ESP_OK) {
+        mp_raise_ValueError("Failed to rename face.");
+    }
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(face_recognizer_rename_face_obj, 3, face_recognizer_rename_face);
+
+// Sequence method, the number of the last change in the change log
+static mp_obj_t face_recognizer_sequence(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_self, ARG_gallery };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_gallery, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    MP_FaceRecognizer *self = static_cast<MP_FaceRecognizer *>(MP_OBJ_TO_PTR(args[ARG_self].u_obj));
+    uint32_t seq;
+    {
+        auto gallery = get_gallery(self, args[ARG_gallery].u_obj);
+        mp_esp_dl::recognition::DataBase *db = gallery ? gallery->db.get() : self->FaceRecognizer.get();
+        seq = db->get_sequence();
+    }
+    return mp_obj_new_int_from_uint(seq);
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(face_recognizer_sequence_obj, 1, face_recognizer_sequence);
+
+// Export changes method
+static mp_obj_t face_recognizer_export_changes(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_self, ARG_since, ARG_gallery };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_since, MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_gallery, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    MP_FaceRecognizer *self = static_cast<MP_FaceRecognizer *>(MP_OBJ_TO_PTR(args[ARG_self].u_obj));
+    if (args[ARG_since].u_int < 0) {
+        mp_raise_ValueError("since must not be negative.");
+    }
+
+    // The blob is copied to the GC heap before anything raises, the vector
+    // would leak otherwise
+    esp_err_t err;
+    uint8_t *data = nullptr;
+    size_t len = 0;
+    {
+        auto gallery = get_gallery(self, args[ARG_gallery].u_obj);
+        mp_esp_dl::recognition::DataBase *db = gallery ? gallery->db.get() : self->FaceRecognizer.get();
+        std::vector<uint8_t> blob;
+        err = db->export_changes(args[ARG_since].u_int, blob);
+        if (err == ESP_OK) {
+            len = blob.size();
+            data = m_new_maybe(uint8_t, len);
+            if (data) {
+                memcpy(data, blob.data(), len);
+            }
+        }
+    }
+    if (err == ESP_ERR_INVALID_STATE) {
+        mp_raise_ValueError("The changes after since were compacted.");
+    } else if (err != ESP_OK) {
+        mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Failed to read the change log."));
+    } else if (!data) {
+        mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Not enough memory for the delta."));
+    }
+    mp_obj_t delta = mp_obj_new_bytes(data, len);
+    m_del(uint8_t, data, len);
+    return delta;
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(face_recognizer_export_changes_obj, 1, face_recognizer_export_changes);
+
+// Apply changes method
+static mp_obj_t face_recognizer_apply_changes(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_self, ARG_delta, ARG_gallery };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // delta
+        { MP_QSTR_gallery, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    MP_FaceRecognizer *self = static_cast<MP_FaceRecognizer *>(MP_OBJ_TO_PTR(args[ARG_self].u_obj));
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[ARG_delta].u_obj, &bufinfo, MP_BUFFER_READ);
+
+    int applied = 0;
+    esp_err_t err;
+    {
+        auto gallery = get_gallery(self, args[ARG_gallery].u_obj);
+        mp_esp_dl::recognition::DataBase *db = gallery ? gallery->db.get() : self->FaceRecognizer.get();
+        err = db->apply_changes((const uint8_t *)bufinfo.buf, bufinfo.len, &applied);
+    }
+    if (err == ESP_ERR_INVALID_STATE) {
+        mp_raise_ValueError("The delta does not continue this database.");
+    } else if (err == ESP_ERR_INVALID_ARG || err == ESP_ERR_INVALID_SIZE) {
+        mp_raise_ValueError("Invalid delta.");
+    } else if (err != ESP_OK) {
+        mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Failed to apply the delta."));
+    }
+    return mp_obj_new_int(applied);
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(face_recognizer_apply_changes_obj, 2, face_recognizer_apply_changes);
+
+// Compact changes method, drops the changes every replica has applied
+static mp_obj_t face_recognizer_compact_changes(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_self, ARG_upto, ARG_gallery };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_upto, MP_ARG_REQUIRED | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_gallery, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    MP_FaceRecognizer *self = static_cast<MP_FaceRecognizer *>(MP_OBJ_TO_PTR(args[ARG_self].u_obj));
+    if (args[ARG_upto].u_int < 0) {
+        mp_raise_ValueError("upto must not be negative.");
+    }
+
+    esp_err_t err;
+    {
+        auto gallery = get_gallery(self, args[ARG_gallery].u_obj);
+        mp_esp_dl::recognition::DataBase *db = gallery ? gallery->db.get() : self->FaceRecognizer.get();
+        err = db->compact_changes(args[ARG_upto].u_int);
+    }
+    if (err == ESP_ERR_INVALID_ARG) {
+        mp_raise_ValueError("upto is after the last change.");
+    } else if (err != ESP_OK) {
+        mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Failed to compact the change log."));
+    }
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(face_recognizer_compact_changes_obj, 2, face_recognizer_compact_changes);
+
+// Search method, matches an embedding against a database without a frame
+static mp_obj_t face_recognizer_search(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_self, ARG_embedding, ARG_gallery };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // embedding
+        { MP_QSTR_gallery, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    MP_FaceRecognizer *self = static_cast<MP_FaceRecognizer *>(MP_OBJ_TO_PTR(args[ARG_self].u_obj));
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[ARG_embedding].u_obj, &bufinfo, MP_BUFFER_READ);
+    if (bufinfo.len != self->FaceRecognizer->get_feat_len() * sizeof(float)) {
+        mp_raise_ValueError("Embedding size does not match the database.");
+    }
+
+    // The matches are copied out before any object is created
+    mp_esp_dl::recognition::result_t *matches = nullptr;
+    size_t n_matches = 0;
+    {
+        auto gallery = get_gallery(self, args[ARG_gallery].u_obj);
+        auto results = self->FaceRecognizer->recognize((const float *)bufinfo.buf, gallery.get());
+        n_matches = results.size();
+        matches = m_new_maybe(mp_esp_dl::recognition::result_t, n_matches);
+        if (matches) {
+            std::copy(results.begin(), results.end(), matches);
+        }
+    }
+    if (!matches && n_matches > 0) {
+        mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Not enough memory for the matches."));
+    }
+
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    for (size_t i = 0; i < n_matches; i++) {
+        const auto &res = matches[i];
+        mp_obj_t match_dict = mp_obj_new_dict(3);
+        mp_obj_dict_store(match_dict, mp_obj_new_str_from_cstr("id"), mp_obj_new_int(res.id));
+        mp_obj_dict_store(match_dict, mp_obj_new_str_from_cstr("similarity"), mp_obj_new_float(res.similarity));
+        mp_obj_dict_store(match_dict, mp_obj_new_str_from_cstr("name"),
+            res.name[0] != '\0' ? mp_obj_new_str_from_cstr(res.name) : mp_const_none);
+        mp_obj_list_append(list, match_dict);
+    }
+    m_del(mp_esp_dl::recognition::result_t, matches, n_matches);
+    return list;
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(face_recognizer_search_obj, 2, face_recognizer_search);
+
+// Train projection method
+static mp_obj_t face_recognizer_train_projection(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_self, ARG_dims, ARG_candidates, ARG_gallery };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_dims, MP_ARG_INT, {.u_int = 64} },
+        { MP_QSTR_candidates, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 32} },
+        { MP_QSTR_gallery, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    MP_FaceRecognizer *self = static_cast<MP_FaceRecognizer *>(MP_OBJ_TO_PTR(args[ARG_self].u_obj));
+    esp_err_t err;
+    {
+        auto gallery = get_gallery(self, args[ARG_gallery].u_obj);
+        mp_esp_dl::recognition::DataBase *db = gallery ? gallery->db.get() : self->FaceRecognizer.get();
+        err = db->train_projection(args[ARG_dims].u_int, args[ARG_candidates].u_int);
+    }
+    if (err == ESP_ERR_INVALID_ARG) {
+        mp_raise_ValueError("dims must be less than the embedding size and at most 256, candidates at least 1.");
+    } else if (err == ESP_ERR_INVALID_STATE) {
+        mp_raise_ValueError("The database needs more faces than dims.");
+    } else if (err == ESP_ERR_NO_MEM) {
+        mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Failed to allocate the projection."));
+    } else if (err != ESP_OK) {
+        mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Failed to save the projection."));
+    }
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(face_recognizer_train_projection_obj, 1, face_recognizer_train_projection);
+
+// Clear projection method
+static mp_obj_t face_recognizer_clear_projection(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_self, ARG_gallery };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_gallery, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    MP_FaceRecognizer *self = static_cast<MP_FaceRecognizer *>(MP_OBJ_TO_PTR(args[ARG_self].u_obj));
+    esp_err_t err;
+    {
+        auto gallery = get_gallery(self, args[ARG_gallery].u_obj);
+        mp_esp_dl::recognition::DataBase *db = gallery ? gallery->db.get() : self->FaceRecognizer.get();
+        err = db->clear_projection();
+    }
+    if (err != ESP_OK) {
+        mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Failed to clear the projection."));
+    }
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(face_recognizer_clear_projection_obj, 1, face_recognizer_clear_projection);
+
+// Identity search method
+static mp_obj_t face_recognizer_identity_search(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_self, ARG_candidates, ARG_gallery };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_candidates, MP_ARG_INT, {.u_int = 4} },
+        { MP_QSTR_gallery, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    MP_FaceRecognizer *self = static_cast<MP_FaceRecognizer *>(MP_OBJ_TO_PTR(args[ARG_self].u_obj));
+    esp_err_t err;
+    int identities;
+    {
+        auto gallery = get_gallery(self, args[ARG_gallery].u_obj);
+        mp_esp_dl::recognition::DataBase *db = gallery ? gallery->db.get() : self->FaceRecognizer.get();
+        err = db->set_identity_search(args[ARG_candidates].u_int);
+        identities = db->get_num_identities();
+    }
+    if (err != ESP_OK) {
+        mp_raise_ValueError("candidates must not be negative.");
+    }
+    return mp_obj_new_int(identities);
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(face_recognizer_identity_search_obj, 1, face_recognizer_identity_search);
+
+// Reembed method. An exception of the progress callback stops the job and
+// is raised once the database is unlocked again.
+static mp_obj_t face_recognizer_reembed(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_self, ARG_progress, ARG_gallery };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_progress, MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_gallery, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    MP_FaceRecognizer *self = static_cast<MP_FaceRecognizer *>(MP_OBJ_TO_PTR(args[ARG_self].u_obj));
+    mp_obj_t callback = args[ARG_progress].u_obj;
+    mp_obj_t exc = MP_OBJ_NULL;
+    auto progress = [callback, &exc](int done, int total, int64_t elapsed_us) -> bool {
+        if (callback == mp_const_none) {
+            return true;
+        }
+        nlr_buf_t nlr;
+        if (nlr_push(&nlr) == 0) {
+            mp_obj_t call_args[3] = {
+                mp_obj_new_int(done),
+                mp_obj_new_int(total),
+                mp_obj_new_float(elapsed_us > 0 ? done * 1e6f / elapsed_us : 0.0f),
+            };
+            mp_call_function_n_kw(callback, 3, 0, call_args);
+            nlr_pop();
+            return true;
+        }
+        exc = MP_OBJ_FROM_PTR(nlr.ret_val);
+        return false;
+    };
+
+    mp_esp_dl::recognition::DataBase::reembed_stats_t stats;
+    esp_err_t err;
+    {
+        auto gallery = get_gallery(self, args[ARG_gallery].u_obj);
+        err = self->FaceRecognizer->reembed(progress, &stats, gallery.get());
+    }
+    if (exc != MP_OBJ_NULL) {
+        nlr_raise(exc);
+    }
+    if (err == ESP_ERR_NOT_FOUND) {
+        mp_raise_ValueError("No faces are stored for the database, enroll with store_faces=True.");
+    } else if (err == ESP_ERR_NO_MEM) {
+        mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Failed to allocate the reembedding buffers."));
+    } else if (err != ESP_OK) {
+        mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Failed to reembed the database."));
+    }
+
+    mp_obj_t dict = mp_obj_new_dict(4);
+    mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("reembedded"), mp_obj_new_int(stats.reembedded));
+    mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("dropped"), mp_obj_new_int(stats.dropped));
+    mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("ms"), mp_obj_new_int(stats.us / 1000));
+    mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("faces_per_s"),
+        mp_obj_new_float(stats.us > 0 ? stats.reembedded * 1e6f / stats.us : 0.0f));
+    return dict;
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(face_recognizer_reembed_obj, 1, face_recognizer_reembed);
+
+// Add gallery method
+static mp_obj_t face_recognizer_add_gallery(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_self, ARG_name, ARG_db_path, ARG_threshold, ARG_top_k, ARG_async_load };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_name, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_db_path, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_threshold, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_top_k, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 1} },
+        { MP_QSTR_async_load, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    MP_FaceRecognizer *self = static_cast<MP_FaceRecognizer *>(MP_OBJ_TO_PTR(args[ARG_self].u_obj));
+    float threshold = args[ARG_threshold].u_obj == mp_const_none ? 0.5f : mp_obj_get_float(args[ARG_threshold].u_obj);
+    if (args[ARG_top_k].u_int < 1) {
+        mp_raise_ValueError("top_k must be at least 1.");
+    }
+
+    char db_path[64];
+    snprintf(db_path, sizeof(db_path), "/%s", mp_obj_str_get_str(args[ARG_db_path].u_obj));
+    esp_err_t err = self->FaceRecognizer->add_gallery(mp_obj_str_get_str(args[ARG_name].u_obj), db_path,
+        threshold, args[ARG_top_k].u_int, args[ARG_async_load].u_bool);
+    if (err == ESP_ERR_INVALID_SIZE) {
+        mp_raise_ValueError("The gallery was created with another feature model.");
+    } else if (err != ESP_OK) {
+        mp_raise_ValueError("Gallery name is invalid or already in use.");
+    }
+    if (!self->load_scheduled) {
+        schedule_load(self);
+    }
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(face_recognizer_add_gallery_obj, 3, face_recognizer_add_gallery);
+
+// Remove gallery method
+static mp_obj_t face_recognizer_remove_gallery(mp_obj_t self_in, mp_obj_t name_in) {
+    MP_FaceRecognizer *self = static_cast<MP_FaceRecognizer *>(MP_OBJ_TO_PTR(self_in));
+    if (self->FaceRecognizer->remove_gallery(mp_obj_str_get_str(name_in)) != ESP_OK) {
+        mp_raise_ValueError("Unknown gallery.");
+    }
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_2_CXX(face_recognizer_remove_gallery_obj, face_recognizer_remove_gallery);
+
+// Recognize method. With deadline_ms, the feature extraction of every face
+// and the database and gallery searches are only started before the deadline;
+// the faces which were not completed are returned with truncated set.
+static mp_obj_t face_recognizer_recognize(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_self, ARG_framebuffer, ARG_deadline_ms };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // framebuffer
+        { MP_QSTR_deadline_ms, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_int_t deadline_ms = 0;
+    if (args[ARG_deadline_ms].u_obj != mp_const_none) {
+        deadline_ms = mp_obj_get_int(args[ARG_deadline_ms].u_obj);
+        if (deadline_ms <= 0) {
+            mp_raise_ValueError("deadline_ms must be positive.");
+        }
+    }
+    mp_esp_dl::Deadline deadline(deadline_ms);
+
+    MP_FaceRecognizer *self = mp_esp_dl::get_and_validate_framebuffer<MP_FaceRecognizer>(args[ARG_self].u_obj, args[ARG_framebuffer].u_obj);
+
+    continue_load(self);
+    bool partial = !self->FaceRecognizer->all_loaded();
+    auto &detect_results = mp_esp_dl::detect(self);
+    self->FaceRecognizer->clear_cache();
+    bool truncated = deadline.passed();
 
     if (detect_results.size() == 0) {
+        self->deadline_misses += truncated;
         return mp_const_none;
     }
 
+    MP_DL_TRACE_SCOPE("results");
+    bool with_galleries = self->FaceRecognizer->has_galleries();
     mp_obj_t list = mp_obj_new_list(0, NULL);
     for (const auto &res : detect_results) {
-        mp_obj_t dict = mp_obj_new_dict(4);
+        mp_obj_t dict = mp_obj_new_dict(7);
         mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("score"), mp_obj_new_float(res.score));
 
         mp_obj_t tuple[4];
@@ -176,8 +834,17 @@ static mp_obj_t face_recognizer_recognize(mp_obj_t self_in, mp_obj_t framebuffer
             mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("features"), mp_const_none);
         }
         
-        std::list<dl::detect::result_t> single_result_list = { res };
-        auto recon_results = self->FaceRecognizer->recognize(self->img, single_result_list);
+        // Feature extraction and search of this face, as far as the deadline allows
+        const float *feat = nullptr;
+        std::vector<mp_esp_dl::recognition::result_t> recon_results;
+        truncated = truncated || deadline.passed();
+        if (!truncated) {
+            feat = self->FaceRecognizer->extract(self->img, res);
+            truncated = deadline.passed();
+        }
+        if (feat && !truncated) {
+            recon_results = self->FaceRecognizer->recognize(feat);
+        }
         if(recon_results.size() == 0) {
             mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("person"), mp_const_none);
         } else {
@@ -195,16 +862,81 @@ static mp_obj_t face_recognizer_recognize(mp_obj_t self_in, mp_obj_t framebuffer
             
             mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("person"), person_dict);
         }
+        if (with_galleries) {
+            mp_obj_t matches = mp_obj_new_list(0, NULL);
+            truncated = truncated || deadline.passed();
+            if (feat && !truncated) {
+                for (const auto &match : self->FaceRecognizer->search_galleries(feat)) {
+                    mp_obj_t match_dict = mp_obj_new_dict(4);
+                    mp_obj_dict_store(match_dict, mp_obj_new_str_from_cstr("gallery"), mp_obj_new_str_from_cstr(match.gallery));
+                    mp_obj_dict_store(match_dict, mp_obj_new_str_from_cstr("id"), mp_obj_new_int(match.result.id));
+                    mp_obj_dict_store(match_dict, mp_obj_new_str_from_cstr("similarity"), mp_obj_new_float(match.result.similarity));
+                    mp_obj_dict_store(match_dict, mp_obj_new_str_from_cstr("name"),
+                        match.result.name[0] != '\0' ? mp_obj_new_str_from_cstr(match.result.name) : mp_const_none);
+                    mp_obj_list_append(matches, match_dict);
+                }
+            }
+            mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("matches"), matches);
+        }
+        mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("partial"), mp_obj_new_bool(partial));
+        mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("truncated"), mp_obj_new_bool(truncated));
         mp_obj_list_append(list, dict);
     }
+    self->deadline_misses += truncated;
     return list;
 }
-static MP_DEFINE_CONST_FUN_OBJ_2_CXX(face_recognizer_recognize_obj, face_recognizer_recognize);
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(face_recognizer_recognize_obj, 2, face_recognizer_recognize);
+
+// Batch recognize method. Every face is stored as score, x1, y1, x2, y2, id, similarity,
+// partial; id is 0 if the face did not match the database, partial is 1 if the
+// database was still loading, as with run().
+static mp_obj_t face_recognizer_run_batch(mp_obj_t self_in, mp_obj_t framebuffers_obj) {
+    size_t n_items;
+    mp_obj_t *items;
+    mp_obj_get_array(framebuffers_obj, &n_items, &items);
+
+    MP_FaceRecognizer *recognizer = static_cast<MP_FaceRecognizer *>(MP_OBJ_TO_PTR(self_in));
+    continue_load(recognizer);
+    // Load steps are scheduled callbacks, which do not run during the call;
+    // the flag is computed once as in run()
+    float partial = recognizer->FaceRecognizer->all_loaded() ? 0.0f : 1.0f;
+    // Nothing raises while the results of recognize() are live
+    mp_esp_dl::BatchResult batch(n_items, 8);
+    for (size_t i = 0; i < n_items; i++) {
+        MP_FaceRecognizer *self = mp_esp_dl::get_and_validate_framebuffer<MP_FaceRecognizer>(self_in, items[i]);
+        batch.next_item();
+        self->FaceRecognizer->clear_cache();
+        for (const auto &res : mp_esp_dl::detect(self)) {
+            float *values = batch.add();
+            values[0] = res.score;
+            for (int k = 0; k < 4; k++) {
+                values[1 + k] = res.box[k];
+            }
+            values[5] = 0;
+            values[6] = 0.0f;
+            values[7] = partial;
+            const float *feat = self->FaceRecognizer->extract(self->img, res);
+            if (feat) {
+                auto recon_results = self->FaceRecognizer->recognize(feat);
+                if (!recon_results.empty()) {
+                    values[5] = recon_results[0].id;
+                    values[6] = recon_results[0].similarity;
+                }
+            }
+        }
+    }
+    return batch.to_obj();
+}
+static MP_DEFINE_CONST_FUN_OBJ_2_CXX(face_recognizer_run_batch_obj, face_recognizer_run_batch);
 
 // Print Database
 static mp_obj_t face_recognizer_print_database(mp_obj_t self_in) {
     MP_FaceRecognizer *self = static_cast<MP_FaceRecognizer *>(MP_OBJ_TO_PTR(self_in));
     self->FaceRecognizer->print();
+    for (const auto &gallery : self->FaceRecognizer->get_galleries()) {
+        mp_printf(&mp_plat_print, "[Gallery %s]\n", gallery->name);
+        gallery->db->print();
+    }
     return mp_const_none;
 }
 static MP_DEFINE_CONST_FUN_OBJ_1_CXX(face_recognizer_print_database_obj, face_recognizer_print_database);
@@ -212,8 +944,23 @@ static MP_DEFINE_CONST_FUN_OBJ_1_CXX(face_recognizer_print_database_obj, face_re
 // Local dict
 static const mp_rom_map_elem_t face_recognizer_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_run), MP_ROM_PTR(&face_recognizer_recognize_obj) },
+    { MP_ROM_QSTR(MP_QSTR_run_batch), MP_ROM_PTR(&face_recognizer_run_batch_obj) },
     { MP_ROM_QSTR(MP_QSTR_enroll), MP_ROM_PTR(&face_recognizer_enroll_obj) },
+    { MP_ROM_QSTR(MP_QSTR_enroll_embedding), MP_ROM_PTR(&face_recognizer_enroll_embedding_obj) },
+    { MP_ROM_QSTR(MP_QSTR_embed), MP_ROM_PTR(&face_recognizer_embed_obj) },
     { MP_ROM_QSTR(MP_QSTR_delete_face), MP_ROM_PTR(&face_recognizer_delete_feature_obj) },
+    { MP_ROM_QSTR(MP_QSTR_rename_face), MP_ROM_PTR(&face_recognizer_rename_face_obj) },
+    { MP_ROM_QSTR(MP_QSTR_sequence), MP_ROM_PTR(&face_recognizer_sequence_obj) },
+    { MP_ROM_QSTR(MP_QSTR_export_changes), MP_ROM_PTR(&face_recognizer_export_changes_obj) },
+    { MP_ROM_QSTR(MP_QSTR_apply_changes), MP_ROM_PTR(&face_recognizer_apply_changes_obj) },
+    { MP_ROM_QSTR(MP_QSTR_compact_changes), MP_ROM_PTR(&face_recognizer_compact_changes_obj) },
+    { MP_ROM_QSTR(MP_QSTR_search), MP_ROM_PTR(&face_recognizer_search_obj) },
+    { MP_ROM_QSTR(MP_QSTR_train_projection), MP_ROM_PTR(&face_recognizer_train_projection_obj) },
+    { MP_ROM_QSTR(MP_QSTR_clear_projection), MP_ROM_PTR(&face_recognizer_clear_projection_obj) },
+    { MP_ROM_QSTR(MP_QSTR_identity_search), MP_ROM_PTR(&face_recognizer_identity_search_obj) },
+    { MP_ROM_QSTR(MP_QSTR_reembed), MP_ROM_PTR(&face_recognizer_reembed_obj) },
+    { MP_ROM_QSTR(MP_QSTR_add_gallery), MP_ROM_PTR(&face_recognizer_add_gallery_obj) },
+    { MP_ROM_QSTR(MP_QSTR_remove_gallery), MP_ROM_PTR(&face_recognizer_remove_gallery_obj) },
     { MP_ROM_QSTR(MP_QSTR_print_database), MP_ROM_PTR(&face_recognizer_print_database_obj) },
     { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&face_recognizer_del_obj) },
 };
@@ -1,30 +1,37 @@
 #include "mp_esp_dl.hpp"
 #include "freertos/idf_additions.h"
-#include "pedestrian_detect.hpp"
+#include "lib/mp_esp_dl_pedestrian_detect.hpp"
 
 #if MP_DL_PEDESTRISN_DETECTOR_ENABLED
 
 namespace mp_esp_dl::HumanDetector {
 
 // Object
-struct MP_HumanDetector : public MP_DetectorBase<PedestrianDetect> {
+struct MP_HumanDetector : public MP_DetectorBase<PedestrianDetector> {
 };
 
 // Constructor
 static mp_obj_t human_detector_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
-    enum { ARG_img_width, ARG_img_height };
+    enum { ARG_img_width, ARG_img_height, ARG_scale, ARG_max_input, ARG_refine };
     static const mp_arg_t allowed_args[] = {
         { MP_QSTR_width, MP_ARG_INT, {.u_int = 320} },
         { MP_QSTR_height, MP_ARG_INT, {.u_int = 240} },
+        { MP_QSTR_scale, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_max_input, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_refine, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false} },
     };
 
     mp_arg_val_t parsed_args[MP_ARRAY_SIZE(allowed_args)];
     mp_arg_parse_all_kw_array(n_args, n_kw, args, MP_ARRAY_SIZE(allowed_args), allowed_args, parsed_args);
 
-    MP_HumanDetector *self = mp_esp_dl::make_new<MP_HumanDetector, PedestrianDetect>(
+    MP_HumanDetector *self = mp_esp_dl::make_new<MP_HumanDetector, PedestrianDetector>(
         &mp_human_detector_type, 
         parsed_args[ARG_img_width].u_int, 
         parsed_args[ARG_img_height].u_int);
+    mp_esp_dl::set_input_scale(self,
+        parsed_args[ARG_scale].u_obj == mp_const_none ? 1.0f : mp_obj_get_float(parsed_args[ARG_scale].u_obj),
+        parsed_args[ARG_max_input].u_int,
+        parsed_args[ARG_refine].u_bool);
 
     return MP_OBJ_FROM_PTR(self);
 }
@@ -33,25 +40,24 @@ static mp_obj_t human_detector_make_new(const mp_obj_type_t *type, size_t n_args
 static mp_obj_t human_detector_del(mp_obj_t self_in) {
     MP_HumanDetector *self = static_cast<MP_HumanDetector *>(MP_OBJ_TO_PTR(self_in));
     self->model = nullptr;
+    self->scaler = nullptr;
+    self->arena = nullptr;
     return mp_const_none;
 }
 static MP_DEFINE_CONST_FUN_OBJ_1_CXX(human_detector_del_obj, human_detector_del);
 
 // Get and set methods
 static void human_detector_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
-    mp_esp_dl::espdl_obj_property<MP_HumanDetector>(self_in, attr, dest);
+    mp_esp_dl::detector_obj_property<MP_HumanDetector>(self_in, attr, dest);
 }
 
-// Detect method
-static mp_obj_t human_detector_detect(mp_obj_t self_in, mp_obj_t framebuffer_obj) {
-    MP_HumanDetector *self = mp_esp_dl::get_and_validate_framebuffer<MP_HumanDetector>(self_in, framebuffer_obj);
-
-    auto &detect_results = self->model->run(self->img);
-
+// Results as a list of dicts with score and box, or None without results
+static mp_obj_t results_to_list(const std::list<dl::detect::result_t> &detect_results) {
     if (detect_results.size() == 0) {
         return mp_const_none;
     }
 
+    MP_DL_TRACE_SCOPE("results");
     mp_obj_t list = mp_obj_new_list(0, NULL);
     for (const auto &res : detect_results) {
         mp_obj_t dict = mp_obj_new_dict(2);
@@ -67,11 +73,68 @@ static mp_obj_t human_detector_detect(mp_obj_t self_in, mp_obj_t framebuffer_obj
     }
     return list;
 }
-static MP_DEFINE_CONST_FUN_OBJ_2_CXX(human_detector_detect_obj, human_detector_detect);
+
+// Detect method. The filter keywords override the filter options of the object for this call.
+static mp_obj_t human_detector_detect(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_self, ARG_framebuffer, ARG_score_threshold };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // framebuffer
+        MP_DL_FILTER_ARGS,
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    MP_HumanDetector *self = mp_esp_dl::get_and_validate_framebuffer<MP_HumanDetector>(args[ARG_self].u_obj, args[ARG_framebuffer].u_obj);
+    mp_esp_dl::ResultFilter filter = mp_esp_dl::filter_from_args(self, &args[ARG_score_threshold]);
+
+    return results_to_list(mp_esp_dl::detect(self, &filter));
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(human_detector_detect_obj, 2, human_detector_detect);
+
+// Detect JPEG method. The JPEG is decoded block by block straight into the
+// model input, so it does not have to match width and height.
+static mp_obj_t human_detector_detect_jpeg(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_self, ARG_jpeg, ARG_score_threshold };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // jpeg
+        MP_DL_FILTER_ARGS,
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    MP_HumanDetector *self = static_cast<MP_HumanDetector *>(MP_OBJ_TO_PTR(args[ARG_self].u_obj));
+    mp_esp_dl::ResultFilter filter = mp_esp_dl::filter_from_args(self, &args[ARG_score_threshold]);
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[ARG_jpeg].u_obj, &bufinfo, MP_BUFFER_READ);
+
+    self->arena->reset();
+    MP_DL_TRACE_BEGIN("model");
+    auto detect_results = self->model->run_jpeg((const uint8_t *)bufinfo.buf, bufinfo.len, self->arena.get());
+    MP_DL_TRACE_END("model");
+    if (!detect_results) {
+        mp_raise_ValueError("Failed to decode the JPEG.");
+    }
+    filter.apply(*detect_results);
+    return results_to_list(*detect_results);
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(human_detector_detect_jpeg_obj, 2, human_detector_detect_jpeg);
+
+// Batch detect method
+static mp_obj_t human_detector_run_batch(mp_obj_t self_in, mp_obj_t framebuffers_obj) {
+    return mp_esp_dl::detect_batch<MP_HumanDetector>(self_in, framebuffers_obj, false);
+}
+static MP_DEFINE_CONST_FUN_OBJ_2_CXX(human_detector_run_batch_obj, human_detector_run_batch);
 
 // Local dict
 static const mp_rom_map_elem_t human_detector_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_run), MP_ROM_PTR(&human_detector_detect_obj) },
+    { MP_ROM_QSTR(MP_QSTR_run_jpeg), MP_ROM_PTR(&human_detector_detect_jpeg_obj) },
+    { MP_ROM_QSTR(MP_QSTR_run_batch), MP_ROM_PTR(&human_detector_run_batch_obj) },
     { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&human_detector_del_obj) },
 };
 static MP_DEFINE_CONST_DICT(human_detector_locals_dict, human_detector_locals_dict_table);
@@ -1,30 +1,60 @@
 #include "mp_esp_dl.hpp"
 #include "freertos/idf_additions.h"
-#include "imagenet_cls.hpp"
+#include "lib/mp_esp_dl_imagenet_cls.hpp"
+#include "lib/mp_esp_dl_recognition_database.hpp"
+#include <cmath>
 
 #if MP_DL_IMAGENET_CLS_ENABLED
 
 namespace mp_esp_dl::imagenet {
 
 // Object
-struct MP_ImageNetCls : public MP_DetectorBase<ImageNetCls> {
+struct MP_ImageNetCls : public MP_DetectorBase<ImageNetClassifier> {
+    // Custom classes, one record per prototype: the mean embedding of the
+    // frames of one enroll_class() call
+    std::shared_ptr<mp_esp_dl::recognition::DataBase> classes;
+    // Result options of run() and run_jpeg()
+    int top_k;
+    float score_threshold;
+    bool labels;
 };
 
+// Classes returned with labels, the number of results of the postprocessor
+#define IMAGENET_MAX_LABELS 5
+
 // Constructor
 static mp_obj_t image_net_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
-    enum { ARG_img_width, ARG_img_height };
+    enum { ARG_img_width, ARG_img_height, ARG_classes, ARG_embedding_layer };
     static const mp_arg_t allowed_args[] = {
         { MP_QSTR_width, MP_ARG_INT, {.u_int = 320} },
         { MP_QSTR_height, MP_ARG_INT, {.u_int = 240} },
+        { MP_QSTR_classes, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_embedding_layer, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
     };
 
     mp_arg_val_t parsed_args[MP_ARRAY_SIZE(allowed_args)];
     mp_arg_parse_all_kw_array(n_args, n_kw, args, MP_ARRAY_SIZE(allowed_args), allowed_args, parsed_args);
 
-    MP_ImageNetCls *self = mp_esp_dl::make_new<MP_ImageNetCls, ImageNetCls>(
+    MP_ImageNetCls *self = mp_esp_dl::make_new<MP_ImageNetCls, ImageNetClassifier>(
         &mp_image_net_type, 
         parsed_args[ARG_img_width].u_int, 
         parsed_args[ARG_img_height].u_int);
+
+    if (parsed_args[ARG_embedding_layer].u_obj != mp_const_none) {
+        self->model->set_embedding_layer(mp_obj_str_get_str(parsed_args[ARG_embedding_layer].u_obj));
+    }
+    if (parsed_args[ARG_classes].u_obj != mp_const_none) {
+        int embedding_len = self->model->get_embedding_len();
+        if (embedding_len == 0) {
+            mp_raise_ValueError("The model has no embedding layer of that name.");
+        }
+        char db_path[64];
+        snprintf(db_path, sizeof(db_path), "/%s", mp_obj_str_get_str(parsed_args[ARG_classes].u_obj));
+        self->classes = std::make_shared<mp_esp_dl::recognition::DataBase>(db_path, embedding_len);
+    }
+    self->top_k = IMAGENET_MAX_LABELS;
+    self->score_threshold = 0.0f;
+    self->labels = true;
     return MP_OBJ_FROM_PTR(self);
 }
 
@@ -32,37 +62,396 @@ static mp_obj_t image_net_make_new(const mp_obj_type_t *type, size_t n_args, siz
 static mp_obj_t image_net_del(mp_obj_t self_in) {
     MP_ImageNetCls *self = static_cast<MP_ImageNetCls *>(MP_OBJ_TO_PTR(self_in));
     self->model = nullptr;
+    self->arena = nullptr;
+    self->classes = nullptr;
     return mp_const_none;
 }
 static MP_DEFINE_CONST_FUN_OBJ_1_CXX(image_net_del_obj, image_net_del);
 
 // Get and set methods
 static void image_net_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
+    MP_ImageNetCls *self = static_cast<MP_ImageNetCls *>(MP_OBJ_TO_PTR(self_in));
+    if (dest[0] == MP_OBJ_NULL && attr == MP_QSTR_embedding_size) {
+        dest[0] = mp_obj_new_int(self->model ? self->model->get_embedding_len() : 0);
+        return;
+    }
+    if (dest[0] == MP_OBJ_NULL && attr == MP_QSTR_num_classes) {
+        dest[0] = mp_obj_new_int(self->classes ? self->classes->get_num_feats() : 0);
+        return;
+    }
+    if (attr == MP_QSTR_top_k || attr == MP_QSTR_score_threshold || attr == MP_QSTR_labels) {
+        if (dest[0] == MP_OBJ_NULL) {
+            dest[0] = attr == MP_QSTR_top_k ? mp_obj_new_int(self->top_k) :
+                attr == MP_QSTR_score_threshold ? mp_obj_new_float(self->score_threshold) : mp_obj_new_bool(self->labels);
+        } else if (dest[1] != MP_OBJ_NULL) {
+            if (attr == MP_QSTR_top_k) {
+                self->top_k = mp_obj_get_int(dest[1]);
+                if (self->top_k < 1) {
+                    mp_raise_ValueError("top_k must be at least 1.");
+                }
+            } else if (attr == MP_QSTR_score_threshold) {
+                self->score_threshold = mp_obj_get_float(dest[1]);
+            } else {
+                self->labels = mp_obj_is_true(dest[1]);
+            }
+            dest[0] = MP_OBJ_NULL;
+        }
+        return;
+    }
     mp_esp_dl::espdl_obj_property<MP_ImageNetCls>(self_in, attr, dest);
 }
 
-// classify method
-static mp_obj_t image_net_classify(mp_obj_t self_in, mp_obj_t framebuffer_obj) {
+static mp_esp_dl::recognition::DataBase *get_classes(MP_ImageNetCls *self) {
+    if (!self->classes) {
+        mp_raise_ValueError("No class database, pass classes to the constructor.");
+    }
+    return self->classes.get();
+}
+
+// Embedding of the framebuffer currently set in self->img
+static const float *embed_frame(MP_ImageNetCls *self) {
+    MP_DL_TRACE_BEGIN("model");
+    const float *embedding = self->model->embed(self->img, {});
+    MP_DL_TRACE_END("model");
+    if (!embedding) {
+        mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("Failed to compute the embedding."));
+    }
+    return embedding;
+}
+
+// Embed method
+static mp_obj_t image_net_embed(mp_obj_t self_in, mp_obj_t framebuffer_obj) {
     MP_ImageNetCls *self = mp_esp_dl::get_and_validate_framebuffer<MP_ImageNetCls>(self_in, framebuffer_obj);
+    const float *embedding = embed_frame(self);
+    size_t embedding_len = self->model->get_embedding_len();
+    float *copy = m_new(float, embedding_len);
+    memcpy(copy, embedding, embedding_len * sizeof(float));
+    return mp_obj_new_memoryview('f', embedding_len, copy);
+}
+static MP_DEFINE_CONST_FUN_OBJ_2_CXX(image_net_embed_obj, image_net_embed);
 
-    auto &classify_results = self->model->run(self->img);
+// Enroll class method. The normalized mean of the embeddings of the frames is
+// enrolled as one prototype of the class.
+static mp_obj_t image_net_enroll_class(mp_obj_t self_in, mp_obj_t framebuffers_obj, mp_obj_t name_obj) {
+    MP_ImageNetCls *self = static_cast<MP_ImageNetCls *>(MP_OBJ_TO_PTR(self_in));
+    mp_esp_dl::recognition::DataBase *classes = get_classes(self);
+    const char *name = mp_obj_str_get_str(name_obj);
+
+    size_t n_items;
+    mp_obj_t *items;
+    if (mp_obj_is_type(framebuffers_obj, &mp_type_list) || mp_obj_is_type(framebuffers_obj, &mp_type_tuple)) {
+        mp_obj_get_array(framebuffers_obj, &n_items, &items);
+    } else {
+        n_items = 1;
+        items = &framebuffers_obj;
+    }
+    if (n_items == 0) {
+        mp_raise_ValueError("No frames given.");
+    }
+    // All frames are checked before the first inference; the mean is on the
+    // GC heap, so a failing embedding raises without leaking it
+    for (size_t i = 0; i < n_items; i++) {
+        mp_esp_dl::get_and_validate_framebuffer<MP_ImageNetCls>(self_in, items[i]);
+    }
+
+    size_t feat_len = classes->get_feat_len();
+    float *mean = m_new(float, feat_len);
+    std::fill(mean, mean + feat_len, 0.0f);
+    for (size_t i = 0; i < n_items; i++) {
+        mp_esp_dl::get_and_validate_framebuffer<MP_ImageNetCls>(self_in, items[i]);
+        const float *embedding = embed_frame(self);
+        for (size_t j = 0; j < feat_len; j++) {
+            mean[j] += embedding[j];
+        }
+    }
+    float norm = 0;
+    for (size_t j = 0; j < feat_len; j++) {
+        norm += mean[j] * mean[j];
+    }
+    norm = sqrtf(norm);
+    if (norm > 0) {
+        for (size_t j = 0; j < feat_len; j++) {
+            mean[j] /= norm;
+        }
+    }
 
-    if (classify_results.size() == 0) {
-        return mp_const_none;
+    uint16_t new_id;
+    esp_err_t err = classes->enroll_feat(mean, name, &new_id);
+    m_del(float, mean, feat_len);
+    if (err != ESP_OK) {
+        mp_raise_ValueError("Failed to enroll class.");
     }
+    return mp_obj_new_int(new_id);
+}
+static MP_DEFINE_CONST_FUN_OBJ_3_CXX(image_net_enroll_class_obj, image_net_enroll_class);
 
+// Classify method for the custom classes. Every class is reported once, with
+// the similarity of its best prototype.
+static mp_obj_t image_net_classify_classes(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_self, ARG_framebuffer, ARG_top_k, ARG_threshold };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // framebuffer
+        { MP_QSTR_top_k, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 1} },
+        { MP_QSTR_threshold, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    MP_ImageNetCls *self = mp_esp_dl::get_and_validate_framebuffer<MP_ImageNetCls>(args[ARG_self].u_obj, args[ARG_framebuffer].u_obj);
+    mp_esp_dl::recognition::DataBase *classes = get_classes(self);
+    int top_k = args[ARG_top_k].u_int;
+    if (top_k < 1) {
+        mp_raise_ValueError("top_k must be at least 1.");
+    }
+    float threshold = args[ARG_threshold].u_obj == mp_const_none ? 0.0f : mp_obj_get_float(args[ARG_threshold].u_obj);
+
+    const float *embedding = embed_frame(self);
+    // The best match of every class is copied out of the query results
+    // before any object is created, so nothing raises while they are live
+    top_k = std::min(top_k, std::max(classes->get_num_feats(), 1));
+    mp_esp_dl::recognition::result_t *best = m_new(mp_esp_dl::recognition::result_t, top_k);
+    int n_best = 0;
+    {
+        // The gallery holds a few prototypes per class, so all of them are ranked
+        auto matches = classes->query_feat(embedding, threshold, std::max(classes->get_num_feats(), 1));
+        for (const auto &match : matches) {
+            if (n_best == top_k) {
+                break;
+            }
+            bool seen = false;
+            for (int i = 0; i < n_best && !seen; i++) {
+                seen = strcmp(best[i].name, match.name) == 0;
+            }
+            if (!seen) {
+                best[n_best++] = match;
+            }
+        }
+    }
+
+    MP_DL_TRACE_SCOPE("results");
     mp_obj_t list = mp_obj_new_list(0, NULL);
-    for (const auto &res : classify_results) {
-        mp_obj_list_append(list, mp_obj_new_str_from_cstr(res.cat_name));
-        mp_obj_list_append(list, mp_obj_new_float(res.score));
+    for (int i = 0; i < n_best; i++) {
+        mp_obj_t dict = mp_obj_new_dict(3);
+        mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("id"), mp_obj_new_int(best[i].id));
+        mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("similarity"), mp_obj_new_float(best[i].similarity));
+        mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("name"), mp_obj_new_str_from_cstr(best[i].name));
+        mp_obj_list_append(list, dict);
     }
     return list;
 }
-static MP_DEFINE_CONST_FUN_OBJ_2_CXX(image_net_classify_obj, image_net_classify);
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(image_net_classify_classes_obj, 2, image_net_classify_classes);
+
+// Delete class prototype method
+static mp_obj_t image_net_delete_class(mp_obj_t self_in, mp_obj_t id_obj) {
+    MP_ImageNetCls *self = static_cast<MP_ImageNetCls *>(MP_OBJ_TO_PTR(self_in));
+    if (get_classes(self)->delete_feat(mp_obj_get_int(id_obj)) != ESP_OK) {
+        mp_raise_ValueError("Failed to delete class.");
+    }
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_2_CXX(image_net_delete_class_obj, image_net_delete_class);
+
+// Result options of run() and run_jpeg(), the ones of the object unless given as keywords
+struct result_options_t {
+    int top_k;
+    float score_threshold;
+    bool labels;
+};
+
+#define IMAGENET_RESULT_ARGS \
+    { MP_QSTR_top_k, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} }, \
+    { MP_QSTR_score_threshold, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} }, \
+    { MP_QSTR_labels, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} }
+
+static result_options_t result_options(MP_ImageNetCls *self, const mp_arg_val_t *args) {
+    result_options_t options = { self->top_k, self->score_threshold, self->labels };
+    if (args[0].u_obj != mp_const_none) {
+        options.top_k = mp_obj_get_int(args[0].u_obj);
+        if (options.top_k < 1) {
+            mp_raise_ValueError("top_k must be at least 1.");
+        }
+    }
+    if (args[1].u_obj != mp_const_none) {
+        options.score_threshold = mp_obj_get_float(args[1].u_obj);
+    }
+    if (args[2].u_obj != mp_const_none) {
+        options.labels = mp_obj_is_true(args[2].u_obj);
+    }
+    return options;
+}
+
+// The best classes of the last run as alternating label (or class index) and
+// score, cut to top_k and score_threshold before any object is created.
+// Without labels the scores are read from the model output, so no label
+// strings are allocated.
+static mp_obj_t results_to_list(MP_ImageNetCls *self, const std::vector<dl::cls::result_t> &results,
+                                const result_options_t &options) {
+    MP_DL_TRACE_SCOPE("results");
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    if (options.labels) {
+        int n = 0;
+        for (const auto &res : results) {
+            if (n++ == options.top_k || res.score < options.score_threshold) {
+                break;
+            }
+            mp_obj_list_append(list, mp_obj_new_str_from_cstr(res.cat_name));
+            mp_obj_list_append(list, mp_obj_new_float(res.score));
+        }
+    } else {
+        int k = std::min(options.top_k, self->model->get_num_classes());
+        int *indices = m_new(int, k);
+        float *scores = m_new(float, k);
+        k = self->model->topk(k, indices, scores);
+        for (int i = 0; i < k && scores[i] >= options.score_threshold; i++) {
+            mp_obj_list_append(list, MP_OBJ_NEW_SMALL_INT(indices[i]));
+            mp_obj_list_append(list, mp_obj_new_float(scores[i]));
+        }
+    }
+    size_t len;
+    mp_obj_t *items;
+    mp_obj_list_get(list, &len, &items);
+    return len == 0 ? mp_const_none : list;
+}
+
+// classify method
+static mp_obj_t image_net_classify(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_self, ARG_framebuffer, ARG_top_k };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // framebuffer
+        IMAGENET_RESULT_ARGS,
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    MP_ImageNetCls *self = mp_esp_dl::get_and_validate_framebuffer<MP_ImageNetCls>(args[ARG_self].u_obj, args[ARG_framebuffer].u_obj);
+    result_options_t options = result_options(self, &args[ARG_top_k]);
+
+    MP_DL_TRACE_BEGIN("model");
+    auto &classify_results = self->model->run(self->img);
+    MP_DL_TRACE_END("model");
+
+    return results_to_list(self, classify_results, options);
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(image_net_classify_obj, 2, image_net_classify);
+
+// classify JPEG method. The JPEG is decoded block by block straight into the model input.
+static mp_obj_t image_net_classify_jpeg(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_self, ARG_jpeg, ARG_top_k };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // jpeg
+        IMAGENET_RESULT_ARGS,
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    MP_ImageNetCls *self = static_cast<MP_ImageNetCls *>(MP_OBJ_TO_PTR(args[ARG_self].u_obj));
+    result_options_t options = result_options(self, &args[ARG_top_k]);
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[ARG_jpeg].u_obj, &bufinfo, MP_BUFFER_READ);
+
+    self->arena->reset();
+    MP_DL_TRACE_BEGIN("model");
+    auto classify_results = self->model->run_jpeg((const uint8_t *)bufinfo.buf, bufinfo.len, self->arena.get());
+    MP_DL_TRACE_END("model");
+    if (!classify_results) {
+        mp_raise_ValueError("Failed to decode the JPEG.");
+    }
+    return results_to_list(self, *classify_results, options);
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(image_net_classify_jpeg_obj, 2, image_net_classify_jpeg);
+
+// Batch classify method. Either classifies a list of framebuffers, or with rois
+// the rectangles (x1, y1, x2, y2) of a single framebuffer, which are read in
+// place by the preprocessor. Every result is stored as class index, score.
+static mp_obj_t image_net_run_batch(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_self, ARG_framebuffers, ARG_rois, ARG_top_k };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // framebuffers or framebuffer
+        { MP_QSTR_rois, MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_top_k, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 1} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mp_obj_t self_in = args[ARG_self].u_obj;
+    MP_ImageNetCls *self = static_cast<MP_ImageNetCls *>(MP_OBJ_TO_PTR(self_in));
+    int top_k = args[ARG_top_k].u_int;
+    if (top_k < 1) {
+        mp_raise_ValueError("top_k must be at least 1.");
+    }
+    top_k = std::min(top_k, self->model->get_num_classes());
+
+    // All framebuffers and rois are checked before the first inference, and
+    // the batch is sized for every result, so nothing raises while crop_area
+    // is live
+    size_t n_items;
+    mp_obj_t *items;
+    int *rois = nullptr;    // x1, y1, x2, y2 per item, clipped to the frame
+    if (args[ARG_rois].u_obj == mp_const_none) {
+        mp_obj_get_array(args[ARG_framebuffers].u_obj, &n_items, &items);
+        for (size_t i = 0; i < n_items; i++) {
+            mp_esp_dl::get_and_validate_framebuffer<MP_ImageNetCls>(self_in, items[i]);
+        }
+    } else {
+        mp_esp_dl::get_and_validate_framebuffer<MP_ImageNetCls>(self_in, args[ARG_framebuffers].u_obj);
+        mp_obj_get_array(args[ARG_rois].u_obj, &n_items, &items);
+        rois = m_new(int, 4 * n_items);
+        for (size_t i = 0; i < n_items; i++) {
+            mp_obj_t *box;
+            mp_obj_get_array_fixed_n(items[i], 4, &box);
+            int *roi = &rois[4 * i];
+            roi[0] = std::max((int)mp_obj_get_int(box[0]), 0);
+            roi[1] = std::max((int)mp_obj_get_int(box[1]), 0);
+            roi[2] = std::min((int)mp_obj_get_int(box[2]), (int)self->img.width);
+            roi[3] = std::min((int)mp_obj_get_int(box[3]), (int)self->img.height);
+            if (roi[2] <= roi[0] || roi[3] <= roi[1]) {
+                mp_raise_ValueError("ROI is empty or outside the framebuffer.");
+            }
+        }
+    }
+    int *indices = m_new(int, top_k);
+    float *scores = m_new(float, top_k);
+    mp_esp_dl::BatchResult batch(n_items, 2, n_items * top_k);
+
+    {
+        std::vector<int> crop_area(rois ? 4 : 0);
+        for (size_t i = 0; i < n_items; i++) {
+            if (rois) {
+                std::copy(&rois[4 * i], &rois[4 * i + 4], crop_area.begin());
+            } else {
+                mp_esp_dl::get_and_validate_framebuffer<MP_ImageNetCls>(self_in, items[i]);
+            }
+            batch.next_item();
+            int n = self->model->run_topk(self->img, crop_area, top_k, indices, scores);
+            for (int k = 0; k < n; k++) {
+                float *values = batch.add();
+                values[0] = indices[k];
+                values[1] = scores[k];
+            }
+        }
+    }
+    return batch.to_obj();
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(image_net_run_batch_obj, 2, image_net_run_batch);
 
 // Local dict
 static const mp_rom_map_elem_t image_net_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_run), MP_ROM_PTR(&image_net_classify_obj) },
+    { MP_ROM_QSTR(MP_QSTR_run_batch), MP_ROM_PTR(&image_net_run_batch_obj) },
+    { MP_ROM_QSTR(MP_QSTR_run_jpeg), MP_ROM_PTR(&image_net_classify_jpeg_obj) },
+    { MP_ROM_QSTR(MP_QSTR_embed), MP_ROM_PTR(&image_net_embed_obj) },
+    { MP_ROM_QSTR(MP_QSTR_enroll_class), MP_ROM_PTR(&image_net_enroll_class_obj) },
+    { MP_ROM_QSTR(MP_QSTR_classify), MP_ROM_PTR(&image_net_classify_classes_obj) },
+    { MP_ROM_QSTR(MP_QSTR_delete_class), MP_ROM_PTR(&image_net_delete_class_obj) },
     { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&image_net_del_obj) },
 };
 static MP_DEFINE_CONST_DICT(image_net_locals_dict, image_net_locals_dict_table);
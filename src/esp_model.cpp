@@ -0,0 +1,269 @@
+#include "mp_esp_dl.hpp"
+#include "lib/mp_esp_dl_model.hpp"
+
+extern "C" {
+    #include "py/objarray.h"
+    #include "py/objtuple.h"
+}
+
+namespace mp_esp_dl::model {
+
+// Object
+struct MP_Model {
+    mp_obj_base_t base;
+    std::shared_ptr<ModelRunner> runner;
+    mp_obj_t data;      // keeps a model given as buffer alive
+    mp_obj_t inputs;    // tuple of memoryviews over the input tensors
+    mp_obj_t outputs;   // tuple of memoryviews over the output tensors
+};
+
+static byte tensor_typecode(dl::TensorBase *tensor) {
+    switch (tensor->dtype) {
+        case dl::DATA_TYPE_FLOAT:
+            return 'f';
+        case dl::DATA_TYPE_INT8:
+            return 'b';
+        case dl::DATA_TYPE_UINT8:
+            return 'B';
+        case dl::DATA_TYPE_INT16:
+            return 'h';
+        case dl::DATA_TYPE_UINT16:
+            return 'H';
+        case dl::DATA_TYPE_INT32:
+            return 'i';
+        case dl::DATA_TYPE_UINT32:
+            return 'I';
+        default:
+            mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("Unsupported tensor data type."));
+    }
+}
+
+static mp_obj_t new_views(const std::vector<dl::TensorBase *> &tensors) {
+    mp_obj_t views = mp_obj_new_tuple(tensors.size(), NULL);
+    mp_obj_tuple_t *tuple = static_cast<mp_obj_tuple_t *>(MP_OBJ_TO_PTR(views));
+    for (size_t i = 0; i < tensors.size(); i++) {
+        tuple->items[i] = mp_obj_new_memoryview(tensor_typecode(tensors[i]), tensors[i]->get_size(), tensors[i]->data);
+    }
+    return views;
+}
+
+// The views are the only references to the tensors Python code gets. Once
+// the runner is freed they are emptied, so access raises IndexError instead
+// of reading freed memory.
+static void invalidate_views(mp_obj_t views) {
+    mp_obj_tuple_t *tuple = static_cast<mp_obj_tuple_t *>(MP_OBJ_TO_PTR(views));
+    for (size_t i = 0; i < tuple->len; i++) {
+        mp_obj_array_t *view = static_cast<mp_obj_array_t *>(MP_OBJ_TO_PTR(tuple->items[i]));
+        view->len = 0;
+    }
+}
+
+static mp_obj_t new_infos(const std::vector<std::string> &names, const std::vector<dl::TensorBase *> &tensors) {
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    for (size_t i = 0; i < tensors.size(); i++) {
+        mp_obj_t dict = mp_obj_new_dict(4);
+        mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("name"), mp_obj_new_str_from_cstr(names[i].c_str()));
+        mp_obj_t shape = mp_obj_new_tuple(tensors[i]->shape.size(), NULL);
+        mp_obj_tuple_t *tuple = static_cast<mp_obj_tuple_t *>(MP_OBJ_TO_PTR(shape));
+        for (size_t k = 0; k < tensors[i]->shape.size(); k++) {
+            tuple->items[k] = mp_obj_new_int(tensors[i]->shape[k]);
+        }
+        mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("shape"), shape);
+        char typecode[2] = { (char)tensor_typecode(tensors[i]), '\0' };
+        mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("dtype"), mp_obj_new_str_from_cstr(typecode));
+        mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("exponent"), mp_obj_new_int(tensors[i]->exponent));
+        mp_obj_list_append(list, dict);
+    }
+    return list;
+}
+
+// Constructor
+static mp_obj_t model_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    enum { ARG_path, ARG_partition, ARG_data, ARG_name };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_path, MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_partition, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_data, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_name, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+
+    mp_arg_val_t parsed_args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, args, MP_ARRAY_SIZE(allowed_args), allowed_args, parsed_args);
+
+    int n_sources = (parsed_args[ARG_path].u_obj != mp_const_none)
+        + (parsed_args[ARG_partition].u_obj != mp_const_none)
+        + (parsed_args[ARG_data].u_obj != mp_const_none);
+    if (n_sources != 1) {
+        mp_raise_ValueError("Exactly one of path, partition and data must be given.");
+    }
+    const char *name = nullptr;
+    if (parsed_args[ARG_name].u_obj != mp_const_none) {
+        name = mp_obj_str_get_str(parsed_args[ARG_name].u_obj);
+    }
+
+    MP_Model *self = mp_obj_malloc_with_finaliser(MP_Model, type);
+    self->data = mp_const_none;
+    self->inputs = mp_const_empty_tuple;
+    self->outputs = mp_const_empty_tuple;
+    if (parsed_args[ARG_path].u_obj != mp_const_none) {
+        self->runner = std::shared_ptr<ModelRunner>(
+            ModelRunner::from_file(mp_obj_str_get_str(parsed_args[ARG_path].u_obj), name));
+    } else if (parsed_args[ARG_partition].u_obj != mp_const_none) {
+        self->runner = std::make_shared<ModelRunner>(
+            mp_obj_str_get_str(parsed_args[ARG_partition].u_obj), fbs::MODEL_LOCATION_IN_FLASH_PARTITION, name);
+    } else {
+        // The model reads its flatbuffers in place, the buffer must outlive it
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(parsed_args[ARG_data].u_obj, &bufinfo, MP_BUFFER_READ);
+        self->data = parsed_args[ARG_data].u_obj;
+        self->runner = std::make_shared<ModelRunner>(
+            (const char *)bufinfo.buf, fbs::MODEL_LOCATION_IN_FLASH_RODATA, name);
+    }
+
+    if (!self->runner || !self->runner->is_loaded()) {
+        self->runner = nullptr;
+        mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("Failed to load the model."));
+    }
+    self->inputs = new_views(self->runner->inputs());
+    self->outputs = new_views(self->runner->outputs());
+
+    return MP_OBJ_FROM_PTR(self);
+}
+
+// Destructor
+static mp_obj_t model_del(mp_obj_t self_in) {
+    MP_Model *self = static_cast<MP_Model *>(MP_OBJ_TO_PTR(self_in));
+    if (self->runner) {
+        invalidate_views(self->inputs);
+        invalidate_views(self->outputs);
+    }
+    self->runner = nullptr;
+    self->inputs = mp_const_empty_tuple;
+    self->outputs = mp_const_empty_tuple;
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1_CXX(model_del_obj, model_del);
+
+static MP_Model *get_loaded(mp_obj_t self_in) {
+    MP_Model *self = static_cast<MP_Model *>(MP_OBJ_TO_PTR(self_in));
+    if (!self->runner) {
+        mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("Model is deleted."));
+    }
+    return self;
+}
+
+// Get methods
+static void model_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
+    if (dest[0] != MP_OBJ_NULL) {
+        dest[1] = MP_OBJ_SENTINEL;
+        return;
+    }
+    switch (attr) {
+        case MP_QSTR_inputs: {
+            MP_Model *self = get_loaded(self_in);
+            dest[0] = new_infos(self->runner->input_names(), self->runner->inputs());
+            break;
+        }
+        case MP_QSTR_outputs: {
+            MP_Model *self = get_loaded(self_in);
+            dest[0] = new_infos(self->runner->output_names(), self->runner->outputs());
+            break;
+        }
+        default:
+            dest[1] = MP_OBJ_SENTINEL;
+    }
+}
+
+// Looks up a tensor by index or name
+static mp_obj_t get_view(mp_obj_t views, const std::vector<std::string> &names, mp_obj_t key) {
+    mp_obj_tuple_t *tuple = static_cast<mp_obj_tuple_t *>(MP_OBJ_TO_PTR(views));
+    if (mp_obj_is_str(key)) {
+        const char *name = mp_obj_str_get_str(key);
+        for (size_t i = 0; i < names.size(); i++) {
+            if (names[i] == name) {
+                return tuple->items[i];
+            }
+        }
+        mp_raise_msg(&mp_type_KeyError, MP_ERROR_TEXT("No tensor with this name."));
+    }
+    mp_int_t index = mp_obj_get_int(key);
+    if (index < 0 || (size_t)index >= tuple->len) {
+        mp_raise_msg(&mp_type_IndexError, MP_ERROR_TEXT("Tensor index out of range."));
+    }
+    return tuple->items[index];
+}
+
+// Input method
+static mp_obj_t model_input(size_t n_args, const mp_obj_t *args) {
+    MP_Model *self = get_loaded(args[0]);
+    return get_view(self->inputs, self->runner->input_names(), n_args > 1 ? args[1] : MP_OBJ_NEW_SMALL_INT(0));
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN_CXX(model_input_obj, 1, 2, model_input);
+
+// Output method
+static mp_obj_t model_output(size_t n_args, const mp_obj_t *args) {
+    MP_Model *self = get_loaded(args[0]);
+    return get_view(self->outputs, self->runner->output_names(), n_args > 1 ? args[1] : MP_OBJ_NEW_SMALL_INT(0));
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN_CXX(model_output_obj, 1, 2, model_output);
+
+// Run method. Inputs written through input() are used in place; buffers
+// passed here are copied into the input tensors first.
+static mp_obj_t model_run(size_t n_args, const mp_obj_t *args) {
+    MP_Model *self = get_loaded(args[0]);
+    const auto &inputs = self->runner->inputs();
+    if (n_args > 1 && n_args - 1 != inputs.size()) {
+        mp_raise_ValueError("Number of buffers does not match the number of model inputs.");
+    }
+    for (size_t i = 1; i < n_args; i++) {
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(args[i], &bufinfo, MP_BUFFER_READ);
+        if (bufinfo.len != inputs[i - 1]->get_bytes()) {
+            mp_raise_ValueError("Buffer size does not match the input tensor.");
+        }
+        if (bufinfo.buf != inputs[i - 1]->data) {
+            memcpy(inputs[i - 1]->data, bufinfo.buf, bufinfo.len);
+        }
+    }
+
+    MP_DL_TRACE_BEGIN("model");
+    self->runner->run();
+    MP_DL_TRACE_END("model");
+
+    mp_obj_tuple_t *outputs = static_cast<mp_obj_tuple_t *>(MP_OBJ_TO_PTR(self->outputs));
+    return outputs->len == 1 ? outputs->items[0] : self->outputs;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_CXX(model_run_obj, 1, model_run);
+
+// Local dict
+static const mp_rom_map_elem_t model_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_run), MP_ROM_PTR(&model_run_obj) },
+    { MP_ROM_QSTR(MP_QSTR_input), MP_ROM_PTR(&model_input_obj) },
+    { MP_ROM_QSTR(MP_QSTR_output), MP_ROM_PTR(&model_output_obj) },
+    { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&model_del_obj) },
+};
+static MP_DEFINE_CONST_DICT(model_locals_dict, model_locals_dict_table);
+
+// Print
+static void print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    MP_Model *self = static_cast<MP_Model *>(MP_OBJ_TO_PTR(self_in));
+    if (!self->runner) {
+        mp_printf(print, "Model object (deleted)");
+        return;
+    }
+    mp_printf(print, "Model object with %d inputs and %d outputs",
+        (int)self->runner->inputs().size(), (int)self->runner->outputs().size());
+}
+
+} //namespace
+
+// Type
+MP_DEFINE_CONST_OBJ_TYPE(
+    mp_model_type,
+    MP_QSTR_Model,
+    MP_TYPE_FLAG_NONE,
+    make_new, (const void *)mp_esp_dl::model::model_make_new,
+    print, (const void *)mp_esp_dl::model::print,
+    attr, (const void *)mp_esp_dl::model::model_attr,
+    locals_dict, &mp_esp_dl::model::model_locals_dict
+);
@@ -0,0 +1,262 @@
+#include "mp_esp_dl.hpp"
+#include "freertos/idf_additions.h"
+#include "human_face_detect.hpp"
+#include "pedestrian_detect.hpp"
+#if MP_DL_FACE_RECOGNITION_ENABLED
+#include "lib/mp_esp_dl_human_face_recognition.hpp"
+#endif
+
+#if MP_DL_PEDESTRISN_DETECTOR_ENABLED
+
+namespace mp_esp_dl::pipeline {
+
+// Object. The person detection uses the members of MP_DetectorBase, the face
+// detection runs on crops of the person boxes at the framebuffer resolution.
+struct MP_Pipeline : public MP_DetectorBase<PedestrianDetect> {
+    std::shared_ptr<HumanFaceDetect> face_model;
+#if MP_DL_FACE_RECOGNITION_ENABLED
+    std::shared_ptr<HumanFaceFeat> FaceFeat;
+    std::shared_ptr<HumanFaceRecognizer> FaceRecognizer;
+    char db_path[64];
+#endif
+    float face_region;
+    bool return_features;
+};
+
+// Constructor
+static mp_obj_t pipeline_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    enum { ARG_img_width, ARG_img_height, ARG_features, ARG_face_region, ARG_recognize, ARG_db_path, ARG_scale, ARG_max_input, ARG_refine };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_width, MP_ARG_INT, {.u_int = 320} },
+        { MP_QSTR_height, MP_ARG_INT, {.u_int = 240} },
+        { MP_QSTR_features, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = true} },
+        { MP_QSTR_face_region, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_recognize, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false} },
+        { MP_QSTR_db_path, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_scale, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_max_input, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 320} },
+        { MP_QSTR_refine, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false} },
+    };
+
+    mp_arg_val_t parsed_args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, args, MP_ARRAY_SIZE(allowed_args), allowed_args, parsed_args);
+
+    MP_Pipeline *self = mp_esp_dl::make_new<MP_Pipeline, PedestrianDetect>(
+        &mp_pipeline_type,
+        parsed_args[ARG_img_width].u_int,
+        parsed_args[ARG_img_height].u_int);
+    self->face_model = std::make_shared<HumanFaceDetect>();
+    if (!self->face_model) {
+        mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("Failed to create model instance."));
+    }
+
+    self->face_region = 0.5f;
+    if (parsed_args[ARG_face_region].u_obj != mp_const_none) {
+        self->face_region = mp_obj_get_float(parsed_args[ARG_face_region].u_obj);
+    }
+    if (self->face_region <= 0.0f || self->face_region > 1.0f) {
+        mp_raise_ValueError("face_region must be in the range (0, 1].");
+    }
+
+    if (parsed_args[ARG_recognize].u_bool) {
+#if MP_DL_FACE_RECOGNITION_ENABLED
+        strncpy(self->db_path, "/face.db", sizeof(self->db_path));
+        if (parsed_args[ARG_db_path].u_obj != mp_const_none) {
+            snprintf(self->db_path, sizeof(self->db_path), "/%s", mp_obj_str_get_str(parsed_args[ARG_db_path].u_obj));
+        }
+        self->FaceFeat = std::make_shared<HumanFaceFeat>();
+        self->FaceRecognizer = std::make_shared<HumanFaceRecognizer>(self->FaceFeat.get(), self->db_path);
+        if ((!self->FaceFeat) || (!self->FaceRecognizer)) {
+            mp_raise_msg(&mp_type_RuntimeError, "Failed to create model instances");
+        }
+#else
+        mp_raise_ValueError("Face recognition is not enabled in this firmware.");
+#endif
+    }
+
+    self->return_features = parsed_args[ARG_features].u_bool;
+    mp_esp_dl::set_input_scale(self,
+        parsed_args[ARG_scale].u_obj == mp_const_none ? 1.0f : mp_obj_get_float(parsed_args[ARG_scale].u_obj),
+        parsed_args[ARG_max_input].u_int,
+        parsed_args[ARG_refine].u_bool);
+
+    return MP_OBJ_FROM_PTR(self);
+}
+
+// Destructor
+static mp_obj_t pipeline_del(mp_obj_t self_in) {
+    MP_Pipeline *self = static_cast<MP_Pipeline *>(MP_OBJ_TO_PTR(self_in));
+    self->model = nullptr;
+    self->face_model = nullptr;
+#if MP_DL_FACE_RECOGNITION_ENABLED
+    self->FaceFeat = nullptr;
+    self->FaceRecognizer = nullptr;
+#endif
+    self->scaler = nullptr;
+    self->arena = nullptr;
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1_CXX(pipeline_del_obj, pipeline_del);
+
+// Get and set methods
+static void pipeline_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
+    MP_Pipeline *self = static_cast<MP_Pipeline *>(MP_OBJ_TO_PTR(self_in));
+    if (attr == MP_QSTR_face_region) {
+        if (dest[0] == MP_OBJ_NULL) {
+            dest[0] = mp_obj_new_float(self->face_region);
+        } else if (dest[1] != MP_OBJ_NULL) {
+            float face_region = mp_obj_get_float(dest[1]);
+            if (face_region <= 0.0f || face_region > 1.0f) {
+                mp_raise_ValueError("face_region must be in the range (0, 1].");
+            }
+            self->face_region = face_region;
+            dest[0] = MP_OBJ_NULL;
+        }
+        return;
+    }
+    mp_esp_dl::detector_obj_property<MP_Pipeline>(self_in, attr, dest);
+}
+
+static mp_obj_t new_box(const std::vector<int> &box) {
+    mp_obj_t tuple[4];
+    for (int i = 0; i < 4; ++i) {
+        tuple[i] = mp_obj_new_int(box[i]);
+    }
+    return mp_obj_new_tuple(4, tuple);
+}
+
+// Face detection on the upper face_region of the person box, clipped to the
+// frame. The face results are returned in framebuffer coordinates, nullptr
+// if no row or column of the region is in the frame.
+static std::list<dl::detect::result_t> *detect_faces(MP_Pipeline *self, const std::vector<int> &person_box) {
+    int x1 = std::max(person_box[0], 0);
+    int y1 = std::max(person_box[1], 0);
+    int x2 = std::min(person_box[2], (int)self->img.width);
+    int bottom = std::min(person_box[3], (int)self->img.height);
+    int y2 = y1 + (int)((bottom - y1) * self->face_region + 0.5f);
+    if (x2 <= x1 || y2 <= y1) {
+        return nullptr;
+    }
+
+    // img_t has no row stride, so only regions spanning the full frame width
+    // can be viewed in place; all others are gathered row by row.
+    dl::image::img_t region;
+    if (x1 == 0 && x2 == self->img.width) {
+        region.data = (uint8_t *)self->img.data + y1 * self->img.width * dl::image::get_pix_byte_size(self->img.pix_type);
+        region.width = self->img.width;
+        region.height = y2 - y1;
+        region.pix_type = self->img.pix_type;
+    } else {
+        if (!self->scaler) {
+            self->scaler = std::make_shared<InputScaler>(self->arena.get());
+        }
+        region = self->scaler->crop(self->img, x1, y1, x2, y2);
+        if (!region.data) {
+            mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Failed to allocate the face region."));
+        }
+    }
+
+    MP_DL_TRACE_BEGIN("face_model");
+    auto &faces = self->face_model->run(region);
+    MP_DL_TRACE_END("face_model");
+    for (auto &face : faces) {
+        InputScaler::to_source(face, 1.0f, 1.0f, x1, y1);
+    }
+    return &faces;
+}
+
+// Detect method
+static mp_obj_t pipeline_run(mp_obj_t self_in, mp_obj_t framebuffer_obj) {
+    MP_Pipeline *self = mp_esp_dl::get_and_validate_framebuffer<MP_Pipeline>(self_in, framebuffer_obj);
+
+    auto &person_results = mp_esp_dl::detect(self);
+#if MP_DL_FACE_RECOGNITION_ENABLED
+    if (self->FaceRecognizer) {
+        self->FaceRecognizer->clear_cache();
+    }
+#endif
+
+    if (person_results.size() == 0) {
+        return mp_const_none;
+    }
+
+    MP_DL_TRACE_SCOPE("results");
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    for (const auto &person : person_results) {
+        mp_obj_t person_dict = mp_obj_new_dict(3);
+        mp_obj_dict_store(person_dict, mp_obj_new_str_from_cstr("score"), mp_obj_new_float(person.score));
+        mp_obj_dict_store(person_dict, mp_obj_new_str_from_cstr("box"), new_box(person.box));
+
+        mp_obj_t face_list = mp_obj_new_list(0, NULL);
+        std::list<dl::detect::result_t> *faces = detect_faces(self, person.box);
+        if (faces) {
+            for (const auto &face : *faces) {
+                mp_obj_t face_dict = mp_obj_new_dict(4);
+                mp_obj_dict_store(face_dict, mp_obj_new_str_from_cstr("score"), mp_obj_new_float(face.score));
+                mp_obj_dict_store(face_dict, mp_obj_new_str_from_cstr("box"), new_box(face.box));
+                if (self->return_features) {
+                    mp_obj_t features[10];
+                    for (int i = 0; i < 10; ++i) {
+                        features[i] = mp_obj_new_int(face.keypoint[i]);
+                    }
+                    mp_obj_dict_store(face_dict, mp_obj_new_str_from_cstr("features"), mp_obj_new_tuple(10, features));
+                } else {
+                    mp_obj_dict_store(face_dict, mp_obj_new_str_from_cstr("features"), mp_const_none);
+                }
+#if MP_DL_FACE_RECOGNITION_ENABLED
+                if (self->FaceRecognizer) {
+                    // The feature model aligns the face on the full frame, no crop needed
+                    const float *feat = self->FaceRecognizer->extract(self->img, face);
+                    auto recon_results = feat ? self->FaceRecognizer->recognize(feat) : std::vector<mp_esp_dl::recognition::result_t>();
+                    if (recon_results.size() == 0) {
+                        mp_obj_dict_store(face_dict, mp_obj_new_str_from_cstr("person"), mp_const_none);
+                    } else {
+                        mp_obj_t id_dict = mp_obj_new_dict(3);
+                        mp_obj_dict_store(id_dict, mp_obj_new_str_from_cstr("id"), mp_obj_new_int(recon_results[0].id));
+                        mp_obj_dict_store(id_dict, mp_obj_new_str_from_cstr("similarity"), mp_obj_new_float(recon_results[0].similarity));
+                        if (recon_results[0].name[0] != '\0') {
+                            mp_obj_dict_store(id_dict, mp_obj_new_str_from_cstr("name"),
+                                            mp_obj_new_str(recon_results[0].name, strlen(recon_results[0].name)));
+                        } else {
+                            mp_obj_dict_store(id_dict, mp_obj_new_str_from_cstr("name"), mp_const_none);
+                        }
+                        mp_obj_dict_store(face_dict, mp_obj_new_str_from_cstr("person"), id_dict);
+                    }
+                }
+#endif
+                mp_obj_list_append(face_list, face_dict);
+            }
+        }
+        mp_obj_dict_store(person_dict, mp_obj_new_str_from_cstr("faces"), face_list);
+        mp_obj_list_append(list, person_dict);
+    }
+    return list;
+}
+static MP_DEFINE_CONST_FUN_OBJ_2_CXX(pipeline_run_obj, pipeline_run);
+
+// Local dict
+static const mp_rom_map_elem_t pipeline_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_run), MP_ROM_PTR(&pipeline_run_obj) },
+    { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&pipeline_del_obj) },
+};
+static MP_DEFINE_CONST_DICT(pipeline_locals_dict, pipeline_locals_dict_table);
+
+// Print
+static void print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    mp_printf(print, "Person and face pipeline object");
+}
+
+} //namespace
+
+// Type
+MP_DEFINE_CONST_OBJ_TYPE(
+    mp_pipeline_type,
+    MP_QSTR_Pipeline,
+    MP_TYPE_FLAG_NONE,
+    make_new, (const void *)mp_esp_dl::pipeline::pipeline_make_new,
+    print, (const void *)mp_esp_dl::pipeline::print,
+    attr, (const void *)mp_esp_dl::pipeline::pipeline_attr,
+    locals_dict, &mp_esp_dl::pipeline::pipeline_locals_dict
+);
+
+#endif // MP_DL_PEDESTRISN_DETECTOR_ENABLED
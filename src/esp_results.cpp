@@ -0,0 +1,322 @@
+#include "mp_esp_dl.hpp"
+#include <cmath>
+
+extern "C" {
+    #include "py/objarray.h"
+}
+
+namespace mp_esp_dl::results {
+
+static const uint8_t BIN_VERSION = 1;
+static const int MAX_DEPTH = 8;
+
+// Record flags of the binary format, the fields follow in this order
+enum : uint8_t {
+    BIN_SCORE = 0x01,       // uint16, score * 65535
+    BIN_BOX = 0x02,         // 4 x int16
+    BIN_FEATURES = 0x04,    // 10 x int16
+    BIN_IDENTITY = 0x08,    // uint16 id, int16 similarity * 32767
+    BIN_NAME = 0x10,        // uint8 length, then the UTF-8 bytes
+    BIN_INDEX = 0x20,       // uint16 class index
+    BIN_FACES = 0x40,       // uint8 count, then the face records
+    BIN_TRUNCATED = 0x80,
+};
+
+// Writes into a bytearray, which is emptied first and keeps its allocation,
+// so encoding into the same bytearray every frame does not allocate once it
+// has grown to the largest message
+class ByteArrayWriter {
+public:
+    explicit ByteArrayWriter(mp_obj_t buf) : m_array(static_cast<mp_obj_array_t *>(MP_OBJ_TO_PTR(buf))) {
+        m_array->free += m_array->len;
+        m_array->len = 0;
+    }
+
+    void write(const void *data, size_t len) {
+        if (len > m_array->free) {
+            size_t alloc = m_array->len + m_array->free;
+            size_t new_alloc = std::max(alloc * 2, m_array->len + len + 64);
+            m_array->items = m_renew(byte, m_array->items, alloc, new_alloc);
+            m_array->free = new_alloc - m_array->len;
+        }
+        memcpy((byte *)m_array->items + m_array->len, data, len);
+        m_array->len += len;
+        m_array->free -= len;
+    }
+    void put(char c) { write(&c, 1); }
+    void put(const char *str) { write(str, strlen(str)); }
+    void put_u8(uint8_t v) { write(&v, 1); }
+    void put_u16(uint16_t v) {
+        uint8_t b[2] = {(uint8_t)v, (uint8_t)(v >> 8)};
+        write(b, 2);
+    }
+    void put_i16(mp_int_t v) { put_u16((uint16_t)(int16_t)std::min<mp_int_t>(std::max<mp_int_t>(v, -32768), 32767)); }
+    void put_int(mp_int_t v) {
+        char digits[24];
+        char *p = digits + sizeof(digits);
+        mp_uint_t u = v < 0 ? -(mp_uint_t)v : (mp_uint_t)v;
+        do {
+            *--p = '0' + u % 10;
+            u /= 10;
+        } while (u);
+        if (v < 0) {
+            *--p = '-';
+        }
+        write(p, digits + sizeof(digits) - p);
+    }
+
+private:
+    mp_obj_array_t *m_array;
+};
+
+static mp_obj_t get_buffer(mp_obj_t buf) {
+    if (buf == mp_const_none) {
+        return mp_obj_new_bytearray(0, NULL);
+    }
+    if (!mp_obj_is_type(buf, &mp_type_bytearray)) {
+        mp_raise_TypeError(MP_ERROR_TEXT("buf must be a bytearray."));
+    }
+    return buf;
+}
+
+// Results are None, lists and tuples of dicts and the values in them
+static bool is_sequence(mp_obj_t obj) {
+    return mp_obj_is_type(obj, &mp_type_list) || mp_obj_is_type(obj, &mp_type_tuple);
+}
+
+// Floats with up to 4 decimals, which is all a score or similarity needs
+static void json_float(ByteArrayWriter &out, mp_float_t f) {
+    if (!std::isfinite(f) || std::fabs(f) >= 200000.0f) {
+        if (std::isfinite(f)) {
+            out.put_int((mp_int_t)f);
+        } else {
+            out.put("null");
+        }
+        return;
+    }
+    mp_int_t scaled = (mp_int_t)std::lround(f * 10000);
+    if (scaled < 0) {
+        out.put('-');
+        scaled = -scaled;
+    }
+    out.put_int(scaled / 10000);
+    int frac = scaled % 10000;
+    if (frac) {
+        char digits[6] = {'.', char('0' + frac / 1000), char('0' + frac / 100 % 10), char('0' + frac / 10 % 10),
+                          char('0' + frac % 10), 0};
+        int len = 5;
+        while (digits[len - 1] == '0') {
+            len--;
+        }
+        out.write(digits, len);
+    }
+}
+
+static void json_str(ByteArrayWriter &out, const char *str, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    out.put('"');
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = str[i];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out.write(str + start, i - start);
+        start = i + 1;
+        if (c == '"' || c == '\\') {
+            char esc[2] = {'\\', (char)c};
+            out.write(esc, 2);
+        } else {
+            char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+            out.write(esc, 6);
+        }
+    }
+    out.write(str + start, len - start);
+    out.put('"');
+}
+
+static void json_value(ByteArrayWriter &out, mp_obj_t obj, int depth) {
+    if (depth > MAX_DEPTH) {
+        mp_raise_ValueError(MP_ERROR_TEXT("Results are nested too deep."));
+    }
+    if (obj == mp_const_none) {
+        out.put("null");
+    } else if (obj == mp_const_true || obj == mp_const_false) {
+        out.put(obj == mp_const_true ? "true" : "false");
+    } else if (mp_obj_is_int(obj)) {
+        out.put_int(mp_obj_get_int(obj));
+    } else if (mp_obj_is_float(obj)) {
+        json_float(out, mp_obj_get_float(obj));
+    } else if (mp_obj_is_str(obj)) {
+        size_t len;
+        const char *str = mp_obj_str_get_data(obj, &len);
+        json_str(out, str, len);
+    } else if (is_sequence(obj)) {
+        size_t len;
+        mp_obj_t *items;
+        mp_obj_get_array(obj, &len, &items);
+        out.put('[');
+        for (size_t i = 0; i < len; i++) {
+            if (i) {
+                out.put(',');
+            }
+            json_value(out, items[i], depth + 1);
+        }
+        out.put(']');
+    } else if (mp_obj_is_type(obj, &mp_type_dict)) {
+        mp_map_t *map = mp_obj_dict_get_map(obj);
+        out.put('{');
+        bool first = true;
+        for (size_t i = 0; i < map->alloc; i++) {
+            if (!mp_map_slot_is_filled(map, i)) {
+                continue;
+            }
+            if (!mp_obj_is_str(map->table[i].key)) {
+                mp_raise_TypeError(MP_ERROR_TEXT("Result keys must be strings."));
+            }
+            if (!first) {
+                out.put(',');
+            }
+            first = false;
+            size_t len;
+            const char *key = mp_obj_str_get_data(map->table[i].key, &len);
+            json_str(out, key, len);
+            out.put(':');
+            json_value(out, map->table[i].value, depth + 1);
+        }
+        out.put('}');
+    } else {
+        mp_raise_TypeError(MP_ERROR_TEXT("Unsupported type in results."));
+    }
+}
+
+static mp_obj_t dict_get(mp_obj_t dict, qstr key) {
+    mp_map_elem_t *elem = mp_map_lookup(mp_obj_dict_get_map(dict), MP_OBJ_NEW_QSTR(key), MP_MAP_LOOKUP);
+    return elem ? elem->value : mp_const_none;
+}
+
+static void bin_name(ByteArrayWriter &out, mp_obj_t name) {
+    size_t len;
+    const char *str = mp_obj_str_get_data(name, &len);
+    len = std::min<size_t>(len, 255);
+    out.put_u8(len);
+    out.write(str, len);
+}
+
+static void bin_record(ByteArrayWriter &out, mp_obj_t dict, int depth);
+
+// A list of result dicts with a uint16 count, or a uint8 count for nested faces
+static void bin_records(ByteArrayWriter &out, mp_obj_t list, bool nested, int depth) {
+    size_t len = 0;
+    mp_obj_t *items = nullptr;
+    if (list != mp_const_none) {
+        mp_obj_get_array(list, &len, &items);
+    }
+    // ImageNet.run() returns label (or index) and score pairs in one flat list
+    bool pairs = len > 0 && !mp_obj_is_type(items[0], &mp_type_dict);
+    size_t count = std::min<size_t>(pairs ? len / 2 : len, nested ? 255 : 65535);
+    if (nested) {
+        out.put_u8(count);
+    } else {
+        out.put_u16(count);
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!pairs) {
+            bin_record(out, items[i], depth + 1);
+            continue;
+        }
+        mp_obj_t label = items[2 * i];
+        bool is_index = mp_obj_is_int(label);
+        out.put_u8(BIN_SCORE | (is_index ? BIN_INDEX : BIN_NAME));
+        out.put_u16((uint16_t)std::lround(std::min(std::max((float)mp_obj_get_float(items[2 * i + 1]), 0.0f), 1.0f) * 65535));
+        if (is_index) {
+            out.put_u16(mp_obj_get_int(label));
+        } else {
+            bin_name(out, label);
+        }
+    }
+}
+
+static void bin_record(ByteArrayWriter &out, mp_obj_t dict, int depth) {
+    if (depth > MAX_DEPTH) {
+        mp_raise_ValueError(MP_ERROR_TEXT("Results are nested too deep."));
+    }
+    if (!mp_obj_is_type(dict, &mp_type_dict)) {
+        mp_raise_TypeError(MP_ERROR_TEXT("Results must be dicts."));
+    }
+    mp_obj_t score = dict_get(dict, MP_QSTR_score);
+    mp_obj_t box = dict_get(dict, MP_QSTR_box);
+    mp_obj_t features = dict_get(dict, MP_QSTR_features);
+    mp_obj_t faces = dict_get(dict, MP_QSTR_faces);
+    // The identity of a face is in "person", classes carry it themselves
+    mp_obj_t identity = dict_get(dict, MP_QSTR_person);
+    if (identity == mp_const_none && dict_get(dict, MP_QSTR_id) != mp_const_none) {
+        identity = dict;
+    }
+    mp_obj_t name = identity != mp_const_none ? dict_get(identity, MP_QSTR_name) : mp_const_none;
+
+    uint8_t flags = 0;
+    flags |= score != mp_const_none ? BIN_SCORE : 0;
+    flags |= box != mp_const_none ? BIN_BOX : 0;
+    flags |= features != mp_const_none ? BIN_FEATURES : 0;
+    flags |= identity != mp_const_none ? BIN_IDENTITY : 0;
+    flags |= mp_obj_is_str(name) ? BIN_NAME : 0;
+    flags |= faces != mp_const_none ? BIN_FACES : 0;
+    flags |= mp_obj_is_true(dict_get(dict, MP_QSTR_truncated)) ? BIN_TRUNCATED : 0;
+    out.put_u8(flags);
+
+    if (flags & BIN_SCORE) {
+        out.put_u16((uint16_t)std::lround(std::min(std::max((float)mp_obj_get_float(score), 0.0f), 1.0f) * 65535));
+    }
+    if (flags & BIN_BOX) {
+        mp_obj_t *items;
+        mp_obj_get_array_fixed_n(box, 4, &items);
+        for (int i = 0; i < 4; i++) {
+            out.put_i16(mp_obj_get_int(items[i]));
+        }
+    }
+    if (flags & BIN_FEATURES) {
+        mp_obj_t *items;
+        mp_obj_get_array_fixed_n(features, 10, &items);
+        for (int i = 0; i < 10; i++) {
+            out.put_i16(mp_obj_get_int(items[i]));
+        }
+    }
+    if (flags & BIN_IDENTITY) {
+        float similarity = mp_obj_get_float(dict_get(identity, MP_QSTR_similarity));
+        out.put_u16(mp_obj_get_int(dict_get(identity, MP_QSTR_id)));
+        out.put_i16(std::lround(std::min(std::max(similarity, -1.0f), 1.0f) * 32767));
+    }
+    if (flags & BIN_NAME) {
+        bin_name(out, name);
+    }
+    if (flags & BIN_FACES) {
+        bin_records(out, faces, true, depth);
+    }
+}
+
+// results_to_json(results, buf=None)
+static mp_obj_t results_to_json(size_t n_args, const mp_obj_t *args) {
+    MP_DL_TRACE_SCOPE("results_to_json");
+    mp_obj_t buf = get_buffer(n_args > 1 ? args[1] : mp_const_none);
+    ByteArrayWriter out(buf);
+    json_value(out, args[0], 0);
+    return buf;
+}
+
+// results_to_bin(results, buf=None)
+static mp_obj_t results_to_bin(size_t n_args, const mp_obj_t *args) {
+    MP_DL_TRACE_SCOPE("results_to_bin");
+    mp_obj_t buf = get_buffer(n_args > 1 ? args[1] : mp_const_none);
+    ByteArrayWriter out(buf);
+    out.put_u8(BIN_VERSION);
+    bin_records(out, args[0], false, 0);
+    return buf;
+}
+
+} // namespace mp_esp_dl::results
+
+extern "C" {
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN_CXX(mp_esp_dl_results_to_json_obj, 1, 2, mp_esp_dl::results::results_to_json);
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN_CXX(mp_esp_dl_results_to_bin_obj, 1, 2, mp_esp_dl::results::results_to_bin);
+}
@@ -0,0 +1,275 @@
+#include "mp_esp_dl.hpp"
+#include "py/mphal.h"
+
+namespace mp_esp_dl::scheduler {
+
+// One registered model. Lives in GC memory so the referenced objects stay alive.
+struct sched_entry_t {
+    mp_obj_t run[2];        // run method and model, as loaded by mp_load_method
+    mp_obj_t name;
+    mp_obj_t last_result;
+    mp_int_t priority;
+    mp_uint_t period_us;    // 0 runs the model whenever the budget allows
+    mp_uint_t last_run_us;
+    float cost_us;          // moving average of the measured run time
+    mp_uint_t runs;
+    mp_uint_t skips;
+    bool has_run;
+#if MP_DL_TRACE_ENABLED
+    const char *trace_name;
+#endif
+};
+
+// Object
+struct MP_Scheduler {
+    mp_obj_base_t base;
+    sched_entry_t *entries;
+    size_t n_entries;
+    float budget_ms;
+    float smoothing;
+};
+
+#if MP_DL_TRACE_ENABLED
+// Trace event name of a model. Interned as a qstr, so it lives as long as the
+// firmware; cut to 32 characters which need no escaping in the JSON.
+static const char *trace_name(mp_obj_t name) {
+    char buf[32];
+    size_t len = 0;
+    if (mp_obj_is_str(name)) {
+        size_t n;
+        const char *str = mp_obj_str_get_data(name, &n);
+        for (; len < n && len < sizeof(buf); len++) {
+            char c = str[len];
+            buf[len] = c >= 0x20 && c < 0x7f && c != '"' && c != '\\' ? c : '_';
+        }
+    }
+    if (len == 0) {
+        return "model";
+    }
+    return qstr_str(qstr_from_strn(buf, len));
+}
+#endif
+
+// Constructor
+static mp_obj_t scheduler_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    enum { ARG_budget_ms, ARG_smoothing };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_budget_ms, MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_smoothing, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+
+    mp_arg_val_t parsed_args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, args, MP_ARRAY_SIZE(allowed_args), allowed_args, parsed_args);
+
+    MP_Scheduler *self = mp_obj_malloc(MP_Scheduler, type);
+    self->entries = nullptr;
+    self->n_entries = 0;
+    self->budget_ms = 0.0f;
+    if (parsed_args[ARG_budget_ms].u_obj != mp_const_none) {
+        self->budget_ms = mp_obj_get_float(parsed_args[ARG_budget_ms].u_obj);
+    }
+    self->smoothing = 0.2f;
+    if (parsed_args[ARG_smoothing].u_obj != mp_const_none) {
+        self->smoothing = mp_obj_get_float(parsed_args[ARG_smoothing].u_obj);
+    }
+    if (self->budget_ms < 0.0f) {
+        mp_raise_ValueError("budget_ms must not be negative.");
+    }
+    if (self->smoothing <= 0.0f || self->smoothing > 1.0f) {
+        mp_raise_ValueError("smoothing must be in the range (0, 1].");
+    }
+    return MP_OBJ_FROM_PTR(self);
+}
+
+// Get and set methods
+static void scheduler_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
+    MP_Scheduler *self = static_cast<MP_Scheduler *>(MP_OBJ_TO_PTR(self_in));
+    if (attr != MP_QSTR_budget_ms) {
+        dest[1] = MP_OBJ_SENTINEL;
+        return;
+    }
+    if (dest[0] == MP_OBJ_NULL) {
+        dest[0] = mp_obj_new_float(self->budget_ms);
+    } else if (dest[1] != MP_OBJ_NULL) {
+        float budget_ms = mp_obj_get_float(dest[1]);
+        if (budget_ms < 0.0f) {
+            mp_raise_ValueError("budget_ms must not be negative.");
+        }
+        self->budget_ms = budget_ms;
+        dest[0] = MP_OBJ_NULL;
+    }
+}
+
+// Add method
+static mp_obj_t scheduler_add(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_self, ARG_model, ARG_rate, ARG_priority, ARG_name };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // self
+        { MP_QSTR_, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },  // model
+        { MP_QSTR_rate, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_priority, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_name, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    MP_Scheduler *self = static_cast<MP_Scheduler *>(MP_OBJ_TO_PTR(args[ARG_self].u_obj));
+    mp_obj_t model = args[ARG_model].u_obj;
+
+    float rate = 0.0f;
+    if (args[ARG_rate].u_obj != mp_const_none) {
+        rate = mp_obj_get_float(args[ARG_rate].u_obj);
+    }
+    if (rate < 0.0f) {
+        mp_raise_ValueError("rate must not be negative.");
+    }
+
+    mp_obj_t name = args[ARG_name].u_obj;
+    if (name == mp_const_none) {
+        name = mp_obj_new_str_from_cstr(mp_obj_get_type_str(model));
+    }
+    for (size_t i = 0; i < self->n_entries; i++) {
+        if (mp_obj_equal(self->entries[i].name, name)) {
+            mp_raise_ValueError("A model with this name is already registered.");
+        }
+    }
+
+    self->entries = m_renew(sched_entry_t, self->entries, self->n_entries, self->n_entries + 1);
+    sched_entry_t *entry = &self->entries[self->n_entries++];
+    mp_load_method(model, MP_QSTR_run, entry->run);
+    entry->name = name;
+    entry->last_result = mp_const_none;
+    entry->priority = args[ARG_priority].u_int;
+    entry->period_us = rate > 0.0f ? (mp_uint_t)(1000000.0f / rate) : 0;
+    entry->last_run_us = 0;
+    entry->cost_us = 0.0f;
+    entry->runs = 0;
+    entry->skips = 0;
+    entry->has_run = false;
+#if MP_DL_TRACE_ENABLED
+    entry->trace_name = trace_name(name);
+#endif
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW_CXX(scheduler_add_obj, 2, scheduler_add);
+
+// Order in which the due models get the budget: priority first, raised by one
+// for every full period a model is overdue so that nothing starves.
+// Models which never ran go first, their cost is not known yet.
+static mp_int_t urgency(const sched_entry_t *entry, mp_uint_t now) {
+    if (!entry->has_run || entry->period_us == 0) {
+        return entry->priority + (entry->has_run ? 0 : 1000);
+    }
+    mp_uint_t elapsed = now - entry->last_run_us;
+    return entry->priority + (mp_int_t)(elapsed / entry->period_us) - 1;
+}
+
+// Run method
+static mp_obj_t scheduler_run(mp_obj_t self_in, mp_obj_t framebuffer_obj) {
+    MP_Scheduler *self = static_cast<MP_Scheduler *>(MP_OBJ_TO_PTR(self_in));
+    mp_uint_t now = mp_hal_ticks_us();
+
+    // Due models, most urgent first. GC memory, as a model raising an
+    // exception unwinds without running C++ destructors.
+    size_t *due = m_new(size_t, self->n_entries + 1);
+    mp_int_t *due_urgency = m_new(mp_int_t, self->n_entries + 1);
+    size_t n_due = 0;
+    for (size_t i = 0; i < self->n_entries; i++) {
+        sched_entry_t *entry = &self->entries[i];
+        if (entry->has_run && now - entry->last_run_us < entry->period_us) {
+            continue;
+        }
+        mp_int_t u = urgency(entry, now);
+        size_t k = n_due++;
+        for (; k > 0 && due_urgency[k - 1] < u; k--) {
+            due[k] = due[k - 1];
+            due_urgency[k] = due_urgency[k - 1];
+        }
+        due[k] = i;
+        due_urgency[k] = u;
+    }
+
+    float budget_us = self->budget_ms * 1000.0f;
+    float spent_us = 0.0f;
+    bool ran_any = false;
+    for (size_t k = 0; k < n_due; k++) {
+        sched_entry_t *entry = &self->entries[due[k]];
+        // Without a budget everything due runs; with one at least the most urgent model runs
+        if (budget_us > 0.0f && ran_any && spent_us + entry->cost_us > budget_us) {
+            entry->skips++;
+            continue;
+        }
+
+        mp_obj_t call_args[3] = { entry->run[0], entry->run[1], framebuffer_obj };
+        MP_DL_TRACE_BEGIN(entry->trace_name);
+        mp_uint_t start = mp_hal_ticks_us();
+        mp_obj_t result = mp_call_method_n_kw(1, 0, call_args);
+        mp_uint_t cost = mp_hal_ticks_us() - start;
+        entry = &self->entries[due[k]];  // add() may have moved the entries
+        MP_DL_TRACE_END(entry->trace_name);
+        entry->last_result = result;
+
+        // Follow changes of the inference time with an exponential moving average
+        entry->cost_us = entry->runs == 0 ? cost : entry->cost_us + self->smoothing * (cost - entry->cost_us);
+        entry->last_run_us = start;
+        entry->runs++;
+        entry->has_run = true;
+        spent_us += cost;
+        ran_any = true;
+    }
+    m_del(size_t, due, self->n_entries + 1);
+    m_del(mp_int_t, due_urgency, self->n_entries + 1);
+
+    // Skipped models carry their last results forward
+    mp_obj_t results = mp_obj_new_dict(self->n_entries);
+    for (size_t i = 0; i < self->n_entries; i++) {
+        mp_obj_dict_store(results, self->entries[i].name, self->entries[i].last_result);
+    }
+    return results;
+}
+static MP_DEFINE_CONST_FUN_OBJ_2_CXX(scheduler_run_obj, scheduler_run);
+
+// Stats method
+static mp_obj_t scheduler_stats(mp_obj_t self_in) {
+    MP_Scheduler *self = static_cast<MP_Scheduler *>(MP_OBJ_TO_PTR(self_in));
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    for (size_t i = 0; i < self->n_entries; i++) {
+        const sched_entry_t *entry = &self->entries[i];
+        mp_obj_t dict = mp_obj_new_dict(4);
+        mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("name"), entry->name);
+        mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("cost_ms"), mp_obj_new_float(entry->cost_us / 1000.0f));
+        mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("runs"), mp_obj_new_int_from_uint(entry->runs));
+        mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("skips"), mp_obj_new_int_from_uint(entry->skips));
+        mp_obj_list_append(list, dict);
+    }
+    return list;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1_CXX(scheduler_stats_obj, scheduler_stats);
+
+// Local dict
+static const mp_rom_map_elem_t scheduler_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_add), MP_ROM_PTR(&scheduler_add_obj) },
+    { MP_ROM_QSTR(MP_QSTR_run), MP_ROM_PTR(&scheduler_run_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stats), MP_ROM_PTR(&scheduler_stats_obj) },
+};
+static MP_DEFINE_CONST_DICT(scheduler_locals_dict, scheduler_locals_dict_table);
+
+// Print
+static void print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    MP_Scheduler *self = static_cast<MP_Scheduler *>(MP_OBJ_TO_PTR(self_in));
+    mp_printf(print, "Model scheduler object with %d models", (int)self->n_entries);
+}
+
+} //namespace
+
+// Type
+MP_DEFINE_CONST_OBJ_TYPE(
+    mp_scheduler_type,
+    MP_QSTR_Scheduler,
+    MP_TYPE_FLAG_NONE,
+    make_new, (const void *)mp_esp_dl::scheduler::scheduler_make_new,
+    print, (const void *)mp_esp_dl::scheduler::print,
+    attr, (const void *)mp_esp_dl::scheduler::scheduler_attr,
+    locals_dict, &mp_esp_dl::scheduler::scheduler_locals_dict
+);
@@ -0,0 +1,84 @@
+#include "mp_esp_dl_arena.hpp"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include <algorithm>
+
+static const char *TAG = "mp_esp_dl::Arena";
+
+static constexpr size_t ALIGNMENT = 16;
+
+static inline size_t align_up(size_t size)
+{
+    return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+namespace mp_esp_dl {
+
+Arena::Arena() :
+    m_buf(nullptr),
+    m_capacity(0),
+    m_offset(0),
+    m_requested(0),
+    m_used(0),
+    m_high_water(0),
+    m_overflows(0),
+    m_generation(0)
+{
+}
+
+Arena::~Arena()
+{
+    for (void *buf : m_overflow_bufs) {
+        heap_caps_free(buf);
+    }
+    heap_caps_free(m_buf);
+}
+
+void Arena::reserve(size_t size)
+{
+    m_requested = std::max(m_requested, align_up(size));
+}
+
+void Arena::reset()
+{
+    for (void *buf : m_overflow_bufs) {
+        heap_caps_free(buf);
+    }
+    m_overflow_bufs.clear();
+
+    size_t wanted = std::max(m_requested, m_high_water);
+    if (wanted > m_capacity) {
+        heap_caps_free(m_buf);
+        m_buf = (uint8_t *)heap_caps_aligned_alloc(ALIGNMENT, wanted, MALLOC_CAP_SPIRAM);
+        m_capacity = m_buf ? wanted : 0;
+        if (!m_buf) {
+            ESP_LOGE(TAG, "Failed to allocate %d bytes.", (int)wanted);
+        }
+    }
+    m_offset = 0;
+    m_used = 0;
+    m_generation++;
+}
+
+void *Arena::alloc(size_t size)
+{
+    size = align_up(size);
+    m_used += size;
+    m_high_water = std::max(m_high_water, m_used);
+    if (m_offset + size <= m_capacity) {
+        void *ptr = m_buf + m_offset;
+        m_offset += size;
+        return ptr;
+    }
+
+    m_overflows++;
+    void *ptr = heap_caps_aligned_alloc(ALIGNMENT, size, MALLOC_CAP_SPIRAM);
+    if (!ptr) {
+        ESP_LOGE(TAG, "Failed to allocate %d bytes.", (int)size);
+        return nullptr;
+    }
+    m_overflow_bufs.push_back(ptr);
+    return ptr;
+}
+
+} // namespace mp_esp_dl
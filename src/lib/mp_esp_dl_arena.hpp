@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mp_esp_dl {
+
+// Bump allocator for the scratch buffers of one inference. Everything
+// allocated is released at once by reset(), which is called at the start of
+// every run(). Requests which do not fit are served from the heap and make
+// the next reset() grow the arena to the high-water mark, so in steady state
+// a run does not touch the heap at all.
+class Arena {
+public:
+    Arena();
+    ~Arena();
+
+    // Makes the arena hold at least size bytes from the next reset() on
+    void reserve(size_t size);
+    void reset();
+    // 16 byte aligned memory valid until the next reset(), nullptr if out of memory
+    void *alloc(size_t size);
+
+    // Incremented by every reset(), lets users tell whether a buffer is still valid
+    uint32_t generation() const { return m_generation; }
+    size_t capacity() const { return m_capacity; }
+    size_t used() const { return m_used; }
+    size_t high_water() const { return m_high_water; }
+    size_t overflows() const { return m_overflows; }
+
+private:
+    uint8_t *m_buf;
+    size_t m_capacity;
+    size_t m_offset;
+    size_t m_requested;
+    size_t m_used;          // bytes handed out since the last reset, including overflows
+    size_t m_high_water;
+    size_t m_overflows;     // allocations which did not fit, since creation
+    uint32_t m_generation;
+    std::vector<void *> m_overflow_bufs;
+};
+
+} // namespace mp_esp_dl
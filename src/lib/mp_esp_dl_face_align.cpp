@@ -0,0 +1,417 @@
+#include "mp_esp_dl_face_align.hpp"
+#include "esp_log.h"
+#include <algorithm>
+#include <cmath>
+#if MP_DL_ALIGN_VECTOR
+#include "dsps_add.h"
+#include "dsps_mul.h"
+#endif
+
+static const char *TAG = "mp_esp_dl::recognition::FaceAligner";
+
+namespace mp_esp_dl {
+namespace recognition {
+
+const float FaceAligner::TEMPLATE[10] = {
+    38.2946f, 51.6963f, 41.5493f, 92.3655f, 56.0252f, 71.7366f, 73.5318f, 51.5014f, 70.7299f, 92.2041f,
+};
+
+namespace {
+
+// The pixel formats load RGB888, RGB565 is widened to 8 bit per channel
+struct rgb888_t {
+    static constexpr int bytes = 3;
+    static inline void load(const uint8_t *p, uint32_t *c)
+    {
+        c[0] = p[0];
+        c[1] = p[1];
+        c[2] = p[2];
+    }
+};
+
+template <bool BIG_ENDIAN_565>
+struct rgb565_t {
+    static constexpr int bytes = 2;
+    static inline void load(const uint8_t *p, uint32_t *c)
+    {
+        uint32_t v = BIG_ENDIAN_565 ? (p[0] << 8) | p[1] : p[0] | (p[1] << 8);
+        c[0] = ((v >> 11) << 3) | (v >> 13);
+        c[1] = (((v >> 5) & 0x3f) << 2) | ((v >> 9) & 0x3);
+        c[2] = ((v & 0x1f) << 3) | ((v >> 2) & 0x7);
+    }
+};
+
+inline int64_t floor_div(int64_t n, int64_t d)
+{
+    int64_t q = n / d;
+    return (n % d != 0 && (n < 0) != (d < 0)) ? q - 1 : q;
+}
+
+// Narrows [*begin, *end) to the u with lo <= f0 + u * d < hi
+void clip_span(int64_t f0, int64_t d, int64_t lo, int64_t hi, int *begin, int *end)
+{
+    if (d == 0) {
+        if (f0 < lo || f0 >= hi) {
+            *end = *begin;
+        }
+        return;
+    }
+    int64_t first, last;
+    if (d > 0) {
+        first = -floor_div(f0 - lo, d);
+        last = -floor_div(f0 - hi, d);
+    } else {
+        first = floor_div(f0 - hi, -d) + 1;
+        last = floor_div(f0 - lo, -d) + 1;
+    }
+    *begin = (int)std::max<int64_t>(*begin, std::min<int64_t>(first, *end));
+    *end = (int)std::min<int64_t>(*end, std::max<int64_t>(last, *begin));
+}
+
+// The warp in 16.16 fixed point, m holds a, b, tx and ty. The source position
+// of a row is linear in u, so the span of the row inside the frame is solved
+// for up front and only the border outside of it is filled with black.
+template <typename P, bool SWAP>
+void warp(const dl::image::img_t &img, const int64_t *m, int size, const int8_t (*lut)[256], int8_t *dst)
+{
+    const uint8_t *src = (const uint8_t *)img.data;
+    const int stride = img.width * P::bytes;
+    const int32_t dx = (int32_t)m[0];
+    const int32_t dy = (int32_t)m[1];
+    const int8_t black[3] = {lut[0][0], lut[1][0], lut[2][0]};
+    for (int v = 0; v < size; v++) {
+        const int64_t x0 = m[2] - m[1] * v;
+        const int64_t y0 = m[3] + m[0] * v;
+        int begin = 0, end = size;
+        clip_span(x0, dx, 0, (int64_t)(img.width - 1) << 16, &begin, &end);
+        clip_span(y0, dy, 0, (int64_t)(img.height - 1) << 16, &begin, &end);
+
+        int u = 0;
+        for (; u < begin; u++, dst += 3) {
+            dst[0] = black[0];
+            dst[1] = black[1];
+            dst[2] = black[2];
+        }
+        int32_t x = (int32_t)(x0 + (int64_t)dx * begin);
+        int32_t y = (int32_t)(y0 + (int64_t)dy * begin);
+        uint32_t c00[3], c01[3], c10[3], c11[3], val[3];
+        for (; u < end; u++, dst += 3) {
+            const uint8_t *p = src + (y >> 16) * stride + (x >> 16) * P::bytes;
+            const uint32_t wx1 = (x >> 8) & 0xff;
+            const uint32_t wx0 = 256 - wx1;
+            const uint32_t wy1 = (y >> 8) & 0xff;
+            const uint32_t wy0 = 256 - wy1;
+            P::load(p, c00);
+            P::load(p + P::bytes, c01);
+            P::load(p + stride, c10);
+            P::load(p + stride + P::bytes, c11);
+            for (int ch = 0; ch < 3; ch++) {
+                uint32_t top = c00[ch] * wx0 + c01[ch] * wx1;
+                uint32_t bottom = c10[ch] * wx0 + c11[ch] * wx1;
+                val[ch] = (top * wy0 + bottom * wy1 + (1 << 15)) >> 16;
+            }
+            dst[0] = lut[0][val[SWAP ? 2 : 0]];
+            dst[1] = lut[1][val[1]];
+            dst[2] = lut[2][val[SWAP ? 0 : 2]];
+            x += dx;
+            y += dy;
+        }
+        for (; u < size; u++, dst += 3) {
+            dst[0] = black[0];
+            dst[1] = black[1];
+            dst[2] = black[2];
+        }
+    }
+}
+
+template <bool SWAP>
+void warp_frame(const dl::image::img_t &img, bool big_endian, const int64_t *m, int size, const int8_t (*lut)[256], int8_t *dst)
+{
+    if (img.pix_type == dl::image::DL_IMAGE_PIX_TYPE_RGB888) {
+        warp<rgb888_t, SWAP>(img, m, size, lut, dst);
+    } else if (big_endian) {
+        warp<rgb565_t<true>, SWAP>(img, m, size, lut, dst);
+    } else {
+        warp<rgb565_t<false>, SWAP>(img, m, size, lut, dst);
+    }
+}
+
+#if MP_DL_ALIGN_VECTOR
+// The same warp with the bilinear blend done by the esp-dsp int16 kernels,
+// which use the 128 bit PIE instructions on the S3, 8 values at a time. The
+// neighbours and the weights of the span of a row inside the frame are
+// gathered into planes of RGB values first, then blended in 7 passes over the
+// planes. esp-dsp multiplies in 32 bit and shifts before it stores 16 bit, so
+// with values in 7 fractional bits the 8 bit weights of the scalar warp fit:
+//   top = (c00 << 7) + ((c01 - c00) * wx1 >> 1), bottom likewise
+//   sum = (top * wy0 >> 8) + (bottom * wy1 >> 8)
+// and the pixel value is (sum + 64) >> 7, rounded while the LUT is looked up.
+// The truncations are below 1/32 of a value, so a pixel value differs from
+// the one of the scalar warp by at most 1, and only where that is close to
+// a half.
+template <typename P, bool SWAP>
+void warp_vector(const dl::image::img_t &img, const int64_t *m, int size, const int8_t (*lut)[256], int16_t *planes,
+                 int plane_len, int8_t *dst)
+{
+    const uint8_t *src = (const uint8_t *)img.data;
+    const int stride = img.width * P::bytes;
+    const int32_t dx = (int32_t)m[0];
+    const int32_t dy = (int32_t)m[1];
+    const int8_t black[3] = {lut[0][0], lut[1][0], lut[2][0]};
+    int16_t *top = planes, *top_dx = top + plane_len, *bottom = top_dx + plane_len, *bottom_dx = bottom + plane_len;
+    int16_t *wx1 = bottom_dx + plane_len, *wy0 = wx1 + plane_len, *wy1 = wy0 + plane_len;
+    for (int v = 0; v < size; v++) {
+        const int64_t x0 = m[2] - m[1] * v;
+        const int64_t y0 = m[3] + m[0] * v;
+        int begin = 0, end = size;
+        clip_span(x0, dx, 0, (int64_t)(img.width - 1) << 16, &begin, &end);
+        clip_span(y0, dy, 0, (int64_t)(img.height - 1) << 16, &begin, &end);
+
+        int u = 0;
+        for (; u < begin; u++, dst += 3) {
+            dst[0] = black[0];
+            dst[1] = black[1];
+            dst[2] = black[2];
+        }
+        int32_t x = (int32_t)(x0 + (int64_t)dx * begin);
+        int32_t y = (int32_t)(y0 + (int64_t)dy * begin);
+        uint32_t c00[3], c01[3], c10[3], c11[3];
+        int n = 0;
+        for (; u < end; u++, n += 3) {
+            const uint8_t *p = src + (y >> 16) * stride + (x >> 16) * P::bytes;
+            const int16_t wx = (x >> 8) & 0xff;
+            const int16_t wy = (y >> 8) & 0xff;
+            P::load(p, c00);
+            P::load(p + P::bytes, c01);
+            P::load(p + stride, c10);
+            P::load(p + stride + P::bytes, c11);
+            for (int ch = 0; ch < 3; ch++) {
+                top[n + ch] = c00[ch] << 7;
+                top_dx[n + ch] = (int16_t)(c01[ch] - c00[ch]);
+                bottom[n + ch] = c10[ch] << 7;
+                bottom_dx[n + ch] = (int16_t)(c11[ch] - c10[ch]);
+                wx1[n + ch] = wx;
+                wy0[n + ch] = 256 - wy;
+                wy1[n + ch] = wy;
+            }
+            x += dx;
+            y += dy;
+        }
+        if (n > 0) {
+            dsps_mul_s16(top_dx, wx1, top_dx, n, 1, 1, 1, 1);
+            dsps_add_s16(top, top_dx, top, n, 1, 1, 1, 0);
+            dsps_mul_s16(bottom_dx, wx1, bottom_dx, n, 1, 1, 1, 1);
+            dsps_add_s16(bottom, bottom_dx, bottom, n, 1, 1, 1, 0);
+            dsps_mul_s16(top, wy0, top, n, 1, 1, 1, 8);
+            dsps_mul_s16(bottom, wy1, bottom, n, 1, 1, 1, 8);
+            dsps_add_s16(top, bottom, top, n, 1, 1, 1, 0);
+            for (int k = 0; k < n; k += 3, dst += 3) {
+                dst[0] = lut[0][(top[k + (SWAP ? 2 : 0)] + 64) >> 7];
+                dst[1] = lut[1][(top[k + 1] + 64) >> 7];
+                dst[2] = lut[2][(top[k + (SWAP ? 0 : 2)] + 64) >> 7];
+            }
+        }
+        for (; u < size; u++, dst += 3) {
+            dst[0] = black[0];
+            dst[1] = black[1];
+            dst[2] = black[2];
+        }
+    }
+}
+
+template <bool SWAP>
+void warp_frame_vector(const dl::image::img_t &img, bool big_endian, const int64_t *m, int size,
+                       const int8_t (*lut)[256], int16_t *planes, int plane_len, int8_t *dst)
+{
+    if (img.pix_type == dl::image::DL_IMAGE_PIX_TYPE_RGB888) {
+        warp_vector<rgb888_t, SWAP>(img, m, size, lut, planes, plane_len, dst);
+    } else if (big_endian) {
+        warp_vector<rgb565_t<true>, SWAP>(img, m, size, lut, planes, plane_len, dst);
+    } else {
+        warp_vector<rgb565_t<false>, SWAP>(img, m, size, lut, planes, plane_len, dst);
+    }
+}
+#endif
+
+} // namespace
+
+FaceAligner::FaceAligner(const std::vector<float> &mean, const std::vector<float> &std, uint32_t caps) :
+    m_mean(mean), m_std(std), m_caps(caps), m_lut_exponent(0), m_lut_valid(false)
+{
+}
+
+void FaceAligner::prepare_lut(int exponent)
+{
+    if (m_lut_valid && m_lut_exponent == exponent) {
+        return;
+    }
+    float inv_scale = ldexpf(1.0f, -exponent);
+    for (int ch = 0; ch < 3; ch++) {
+        for (int v = 0; v < 256; v++) {
+            int q = (int)roundf((v - m_mean[ch]) / m_std[ch] * inv_scale);
+            m_lut[ch][v] = (int8_t)std::min(std::max(q, -128), 127);
+        }
+    }
+    m_lut_exponent = exponent;
+    m_lut_valid = true;
+}
+
+bool FaceAligner::supports(const dl::image::img_t &img, const dl::TensorBase *input)
+{
+    return (img.pix_type == dl::image::DL_IMAGE_PIX_TYPE_RGB888 || img.pix_type == dl::image::DL_IMAGE_PIX_TYPE_RGB565) &&
+        img.width >= 2 && img.height >= 2 && input->dtype == dl::DATA_TYPE_INT8 && input->shape.size() == 4 &&
+        input->shape[1] == input->shape[2] && input->shape[3] == 3;
+}
+
+void FaceAligner::transform(const std::vector<int> &keypoint, int size, float *m)
+{
+    const float scale = (float)size / TEMPLATE_SIZE;
+    float mu = 0, mv = 0, mx = 0, my = 0;
+    for (int i = 0; i < 5; i++) {
+        mu += TEMPLATE[2 * i] * scale;
+        mv += TEMPLATE[2 * i + 1] * scale;
+        mx += keypoint[2 * i];
+        my += keypoint[2 * i + 1];
+    }
+    mu /= 5;
+    mv /= 5;
+    mx /= 5;
+    my /= 5;
+    float num_a = 0, num_b = 0, den = 0;
+    for (int i = 0; i < 5; i++) {
+        float u = TEMPLATE[2 * i] * scale - mu;
+        float v = TEMPLATE[2 * i + 1] * scale - mv;
+        float x = keypoint[2 * i] - mx;
+        float y = keypoint[2 * i + 1] - my;
+        num_a += u * x + v * y;
+        num_b += u * y - v * x;
+        den += u * u + v * v;
+    }
+    m[0] = num_a / den;
+    m[1] = num_b / den;
+    m[2] = mx - (m[0] * mu - m[1] * mv);
+    m[3] = my - (m[1] * mu + m[0] * mv);
+}
+
+esp_err_t FaceAligner::prepare(const dl::image::img_t &img, const std::vector<int> &keypoint, dl::TensorBase *input,
+                               int64_t *fixed)
+{
+    if (!supports(img, input) || keypoint.size() < 10) {
+        ESP_LOGE(TAG, "Unsupported image or input tensor.");
+        return ESP_ERR_INVALID_ARG;
+    }
+    float m[4];
+    transform(keypoint, input->shape[1], m);
+    // A step of 2^15 pixels and more does not fit the fixed point, such
+    // landmarks are no face anyway
+    if (!(fabsf(m[0]) < 32768.0f && fabsf(m[1]) < 32768.0f && fabsf(m[2]) < 1e9f && fabsf(m[3]) < 1e9f)) {
+        ESP_LOGE(TAG, "Invalid landmarks.");
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < 4; i++) {
+        fixed[i] = llroundf(m[i] * 65536.0f);
+    }
+    prepare_lut(input->exponent);
+    return ESP_OK;
+}
+
+bool FaceAligner::vectorized()
+{
+    return MP_DL_ALIGN_VECTOR;
+}
+
+esp_err_t FaceAligner::align(const dl::image::img_t &img, const std::vector<int> &keypoint, dl::TensorBase *input)
+{
+#if MP_DL_ALIGN_VECTOR
+    int64_t fixed[4];
+    esp_err_t ret = prepare(img, keypoint, input, fixed);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    // 7 planes of one row of RGB values, each 16 byte aligned for the PIE loads
+    const int size = input->shape[1];
+    const int plane_len = (size * 3 + 7) & ~7;
+    m_planes.resize(7 * plane_len + 8);
+    int16_t *planes = (int16_t *)(((uintptr_t)m_planes.data() + 15) & ~(uintptr_t)15);
+    const bool big_endian = m_caps & DL_IMAGE_CAP_RGB565_BIG_ENDIAN;
+    if (m_caps & DL_IMAGE_CAP_RGB_SWAP) {
+        warp_frame_vector<true>(img, big_endian, fixed, size, m_lut, planes, plane_len, (int8_t *)input->data);
+    } else {
+        warp_frame_vector<false>(img, big_endian, fixed, size, m_lut, planes, plane_len, (int8_t *)input->data);
+    }
+    return ESP_OK;
+#else
+    return align_scalar(img, keypoint, input);
+#endif
+}
+
+esp_err_t FaceAligner::align_scalar(const dl::image::img_t &img, const std::vector<int> &keypoint, dl::TensorBase *input)
+{
+    int64_t fixed[4];
+    esp_err_t ret = prepare(img, keypoint, input, fixed);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    const bool big_endian = m_caps & DL_IMAGE_CAP_RGB565_BIG_ENDIAN;
+    if (m_caps & DL_IMAGE_CAP_RGB_SWAP) {
+        warp_frame<true>(img, big_endian, fixed, input->shape[1], m_lut, (int8_t *)input->data);
+    } else {
+        warp_frame<false>(img, big_endian, fixed, input->shape[1], m_lut, (int8_t *)input->data);
+    }
+    return ESP_OK;
+}
+
+esp_err_t FaceAligner::align_reference(const dl::image::img_t &img, const std::vector<int> &keypoint, dl::TensorBase *input)
+{
+    if (!supports(img, input) || keypoint.size() < 10) {
+        ESP_LOGE(TAG, "Unsupported image or input tensor.");
+        return ESP_ERR_INVALID_ARG;
+    }
+    const int size = input->shape[1];
+    float m[4];
+    transform(keypoint, size, m);
+    const bool big_endian = m_caps & DL_IMAGE_CAP_RGB565_BIG_ENDIAN;
+    const bool swap = m_caps & DL_IMAGE_CAP_RGB_SWAP;
+    const float inv_scale = ldexpf(1.0f, -input->exponent);
+    auto load = [&](int x, int y, uint32_t *c) {
+        if (img.pix_type == dl::image::DL_IMAGE_PIX_TYPE_RGB888) {
+            rgb888_t::load((const uint8_t *)img.data + (y * img.width + x) * 3, c);
+        } else if (big_endian) {
+            rgb565_t<true>::load((const uint8_t *)img.data + (y * img.width + x) * 2, c);
+        } else {
+            rgb565_t<false>::load((const uint8_t *)img.data + (y * img.width + x) * 2, c);
+        }
+    };
+    int8_t *dst = (int8_t *)input->data;
+    for (int v = 0; v < size; v++) {
+        for (int u = 0; u < size; u++, dst += 3) {
+            float x = m[0] * u - m[1] * v + m[2];
+            float y = m[1] * u + m[0] * v + m[3];
+            int x0 = (int)std::floor(x);
+            int y0 = (int)std::floor(y);
+            float val[3] = {0, 0, 0};
+            if (x0 >= 0 && y0 >= 0 && x0 + 1 < img.width && y0 + 1 < img.height) {
+                float fx = x - x0;
+                float fy = y - y0;
+                uint32_t p00[3], p01[3], p10[3], p11[3];
+                load(x0, y0, p00);
+                load(x0 + 1, y0, p01);
+                load(x0, y0 + 1, p10);
+                load(x0 + 1, y0 + 1, p11);
+                for (int ch = 0; ch < 3; ch++) {
+                    float top = p00[ch] + ((float)p01[ch] - p00[ch]) * fx;
+                    float bottom = p10[ch] + ((float)p11[ch] - p10[ch]) * fx;
+                    val[ch] = top + (bottom - top) * fy;
+                }
+            }
+            for (int ch = 0; ch < 3; ch++) {
+                int q = (int)roundf((val[swap ? 2 - ch : ch] - m_mean[ch]) / m_std[ch] * inv_scale);
+                dst[ch] = (int8_t)std::min(std::max(q, -128), 127);
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+} // namespace recognition
+} // namespace mp_esp_dl
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "dl_image_define.hpp"
+#include "dl_tensor_base.hpp"
+#include "esp_err.h"
+#include <cstdint>
+#include <vector>
+
+// The bilinear blend of align() runs on the esp-dsp int16 kernels, which use
+// the PIE SIMD instructions of the S3; without esp-dsp align() is the scalar
+// warp
+#ifndef MP_DL_ALIGN_VECTOR
+#if CONFIG_IDF_TARGET_ESP32S3 && __has_include("dsps_mul.h")
+#define MP_DL_ALIGN_VECTOR 1
+#else
+#define MP_DL_ALIGN_VECTOR 0
+#endif
+#endif
+
+namespace mp_esp_dl {
+namespace recognition {
+
+// Face alignment for the feature models in a single pass: the face is warped
+// onto the landmark template, sampled bilinearly, the channels are swapped if
+// the model wants it and normalized with the mean and std of the model,
+// straight into the int8 input tensor. The inverse map and the bilinear
+// weights are fixed point and every row is split into the span inside the
+// frame and the black border around it, so the inner loop has neither
+// branches nor float math. On the S3 the bilinear blend of the span runs on
+// the SIMD kernels of esp-dsp.
+class FaceAligner {
+public:
+    // Landmarks of the 112x112 template of the esp-dl feature models, in the
+    // order of the detector keypoints: left eye, left mouth corner, nose, right
+    // eye, right mouth corner
+    static constexpr int TEMPLATE_SIZE = 112;
+    static const float TEMPLATE[10];
+
+    // caps as for the esp-dl preprocessors, DL_IMAGE_CAP_RGB_SWAP and
+    // DL_IMAGE_CAP_RGB565_BIG_ENDIAN
+    FaceAligner(const std::vector<float> &mean, const std::vector<float> &std, uint32_t caps = 0);
+
+    // RGB888 and RGB565 frames into square int8 NHWC tensors with 3 channels
+    static bool supports(const dl::image::img_t &img, const dl::TensorBase *input);
+    // keypoint are the landmarks of a detector result. Vectorized if
+    // vectorized(), the pixel values are then within 1 of align_scalar().
+    esp_err_t align(const dl::image::img_t &img, const std::vector<int> &keypoint, dl::TensorBase *input);
+    // The fixed point warp a pixel at a time, the reference of the vectorized one
+    esp_err_t align_scalar(const dl::image::img_t &img, const std::vector<int> &keypoint, dl::TensorBase *input);
+    // The same in float, pixel by pixel, to check both against
+    esp_err_t align_reference(const dl::image::img_t &img, const std::vector<int> &keypoint, dl::TensorBase *input);
+    static bool vectorized();
+
+    // Least squares similarity transform from the template, scaled to
+    // size x size, to image coordinates: x = a u - b v + tx, y = b u + a v + ty
+    // with m = {a, b, tx, ty}
+    static void transform(const std::vector<int> &keypoint, int size, float *m);
+
+private:
+    std::vector<float> m_mean;
+    std::vector<float> m_std;
+    uint32_t m_caps;
+    // (pixel - mean) / std quantized to the tensor exponent, per model channel and value
+    int8_t m_lut[3][256];
+    int m_lut_exponent;
+    bool m_lut_valid;
+    // Rows of neighbours and weights for the vectorized blend
+    std::vector<int16_t> m_planes;
+
+    void prepare_lut(int exponent);
+    // Checks the arguments, the fixed point transform m and the LUT
+    esp_err_t prepare(const dl::image::img_t &img, const std::vector<int> &keypoint, dl::TensorBase *input, int64_t *m);
+};
+
+} // namespace recognition
+} // namespace mp_esp_dl
@@ -0,0 +1,132 @@
+#include "mp_esp_dl_face_store.hpp"
+#include "mp_esp_dl_face_align.hpp"
+#include "esp_log.h"
+#include <cmath>
+#include <cstring>
+
+static const char *TAG = "mp_esp_dl::recognition::FaceStore";
+
+static const char FACE_STORE_MAGIC[4] = {'E', 'D', 'L', 'F'};
+static const uint16_t FACE_STORE_VERSION = 1;
+
+// RGB888 of the pixel at x, y
+static inline void load_pixel(const dl::image::img_t &img, bool big_endian, int x, int y, float *c)
+{
+    if (img.pix_type == dl::image::DL_IMAGE_PIX_TYPE_RGB565) {
+        const uint8_t *p = (const uint8_t *)img.data + (y * img.width + x) * 2;
+        uint16_t v = big_endian ? (p[0] << 8) | p[1] : p[0] | (p[1] << 8);
+        c[0] = ((v >> 11) << 3) | (v >> 13);
+        c[1] = (((v >> 5) & 0x3f) << 2) | ((v >> 9) & 0x3);
+        c[2] = ((v & 0x1f) << 3) | ((v >> 2) & 0x7);
+    } else {
+        const uint8_t *p = (const uint8_t *)img.data + (y * img.width + x) * 3;
+        c[0] = p[0];
+        c[1] = p[1];
+        c[2] = p[2];
+    }
+}
+
+namespace mp_esp_dl {
+namespace recognition {
+
+void FaceStore::align(const dl::image::img_t &img, const std::vector<int> &keypoint, uint8_t *crop, uint32_t caps)
+{
+    const bool big_endian = caps & DL_IMAGE_CAP_RGB565_BIG_ENDIAN;
+    float m[4];
+    FaceAligner::transform(keypoint, SIZE, m);
+    const float a = m[0], b = m[1], tx = m[2], ty = m[3];
+
+    // Bilinear sampling, black outside of the frame
+    for (int v = 0; v < SIZE; v++) {
+        for (int u = 0; u < SIZE; u++) {
+            float x = a * u - b * v + tx;
+            float y = b * u + a * v + ty;
+            uint8_t *out = crop + (v * SIZE + u) * 3;
+            int x0 = (int)std::floor(x);
+            int y0 = (int)std::floor(y);
+            if (x0 < 0 || y0 < 0 || x0 + 1 >= img.width || y0 + 1 >= img.height) {
+                out[0] = out[1] = out[2] = 0;
+                continue;
+            }
+            float fx = x - x0;
+            float fy = y - y0;
+            float p00[3], p01[3], p10[3], p11[3];
+            load_pixel(img, big_endian, x0, y0, p00);
+            load_pixel(img, big_endian, x0 + 1, y0, p01);
+            load_pixel(img, big_endian, x0, y0 + 1, p10);
+            load_pixel(img, big_endian, x0 + 1, y0 + 1, p11);
+            for (int ch = 0; ch < 3; ch++) {
+                float top = p00[ch] + (p01[ch] - p00[ch]) * fx;
+                float bottom = p10[ch] + (p11[ch] - p10[ch]) * fx;
+                out[ch] = (uint8_t)(top + (bottom - top) * fy + 0.5f);
+            }
+        }
+    }
+}
+
+const std::vector<int> &FaceStore::keypoint()
+{
+    static const std::vector<int> keypoint = [] {
+        std::vector<int> rounded(10);
+        for (int i = 0; i < 10; i++) {
+            rounded[i] = (int)std::lround(FaceAligner::TEMPLATE[i]);
+        }
+        return rounded;
+    }();
+    return keypoint;
+}
+
+esp_err_t FaceStore::append(const char *path, uint16_t id, const uint8_t *crop)
+{
+    bool exists = mp_isfile(path);
+    mp_file_t *f = mp_try_open(path, exists ? "rb+" : "wb");
+    if (!f) {
+        ESP_LOGE(TAG, "Failed to open face store.");
+        return ESP_FAIL;
+    }
+    bool ok = true;
+    if (exists) {
+        // A torn face at the end is overwritten
+        const off_t record = sizeof(id) + CROP_BYTES;
+        off_t end = mp_try_seek(f, 0, SEEK_END);
+        off_t complete = end < (off_t)sizeof(face_store_header) ? -1 :
+            sizeof(face_store_header) + (end - sizeof(face_store_header)) / record * record;
+        ok = complete >= 0 && mp_try_seek(f, complete, SEEK_SET) >= 0;
+    } else {
+        face_store_header hdr;
+        memcpy(hdr.magic, FACE_STORE_MAGIC, sizeof(hdr.magic));
+        hdr.version = FACE_STORE_VERSION;
+        hdr.size = SIZE;
+        ok = mp_try_write(f, &hdr, sizeof(hdr)) == sizeof(hdr);
+    }
+    ok = ok && mp_try_write(f, &id, sizeof(id)) == sizeof(id) && mp_try_write(f, crop, CROP_BYTES) == (mp_int_t)CROP_BYTES;
+    mp_try_close(f);
+    if (!ok) {
+        ESP_LOGE(TAG, "Failed to write face.");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t FaceStore::read_header(mp_file_t *f)
+{
+    face_store_header hdr;
+    if (mp_try_readinto(f, &hdr, sizeof(hdr)) != sizeof(hdr) || memcmp(hdr.magic, FACE_STORE_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.version != FACE_STORE_VERSION || hdr.size != SIZE) {
+        ESP_LOGE(TAG, "Invalid face store.");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t FaceStore::read_next(mp_file_t *f, uint16_t *id, uint8_t *crop)
+{
+    // A torn face at the end, from a reset while it was appended, ends the file
+    if (mp_try_readinto(f, id, sizeof(*id)) != sizeof(*id) || mp_try_readinto(f, crop, CROP_BYTES) != (mp_int_t)CROP_BYTES) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
+} // namespace recognition
+} // namespace mp_esp_dl
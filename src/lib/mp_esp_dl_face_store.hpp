@@ -0,0 +1,48 @@
+#pragma once
+
+#include "dl_image_define.hpp"
+#include "esp_err.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+    #include "mpfile.h"
+}
+
+namespace mp_esp_dl {
+namespace recognition {
+
+// Aligned face crops, kept next to a database as <db>.faces so the
+// embeddings can be computed again with another feature model. The faces are
+// appended in the order of their ids:
+//   face_store_header, then per face the id (uint16_t) and SIZE x SIZE RGB888
+class FaceStore {
+public:
+    static constexpr int SIZE = 112;
+    static constexpr size_t CROP_BYTES = SIZE * SIZE * 3;
+
+    // Warps the face with the landmarks keypoint (in the order of the detector
+    // results) of img onto the landmark template of the feature models. RGB565
+    // frames are big endian if caps has DL_IMAGE_CAP_RGB565_BIG_ENDIAN, as for
+    // the esp-dl preprocessors.
+    static void align(const dl::image::img_t &img, const std::vector<int> &keypoint, uint8_t *crop, uint32_t caps = 0);
+    // The landmarks of the template, for running a feature model on a crop
+    static const std::vector<int> &keypoint();
+
+    static esp_err_t append(const char *path, uint16_t id, const uint8_t *crop);
+    // Checks the header and leaves f at the first face
+    static esp_err_t read_header(mp_file_t *f);
+    // ESP_ERR_NOT_FOUND at the end of the file
+    static esp_err_t read_next(mp_file_t *f, uint16_t *id, uint8_t *crop);
+
+private:
+    struct face_store_header {
+        char magic[4];
+        uint16_t version;
+        uint16_t size;
+    };
+};
+
+} // namespace recognition
+} // namespace mp_esp_dl
@@ -1,4 +1,5 @@
 #include "mp_esp_dl_human_face_recognition.hpp"
+#include "mp_esp_dl_trace.h"
 
 #if CONFIG_HUMAN_FACE_FEAT_MODEL_IN_FLASH_RODATA
 extern const uint8_t human_face_feat_espdl[] asm("_binary_human_face_feat_espdl_start");
@@ -10,9 +11,15 @@ static const char *path = "human_face_feat";
 #define CONFIG_BSP_SD_MOUNT_POINT "/sdcard"
 #endif
 #endif
+#if CONFIG_IDF_TARGET_ESP32P4
+static const uint32_t s_caps = DL_IMAGE_CAP_RGB_SWAP | DL_IMAGE_CAP_RGB565_BIG_ENDIAN;
+#else
+static const uint32_t s_caps = 0;
+#endif
+
 namespace human_face_recognition {
 
-MFN::MFN(const char *model_name)
+MFN::MFN(const char *model_name) : m_aligner({127.5, 127.5, 127.5}, {127.5, 127.5, 127.5}, s_caps)
 {
 #if !CONFIG_HUMAN_FACE_FEAT_MODEL_IN_SDCARD
     m_model =
@@ -27,16 +34,28 @@ MFN::MFN(const char *model_name)
              model_name);
     m_model = new dl::Model(sd_path, static_cast<fbs::model_location_type_t>(CONFIG_HUMAN_FACE_FEAT_MODEL_LOCATION));
 #endif
-#if CONFIG_IDF_TARGET_ESP32P4
-    m_image_preprocessor = new dl::image::FeatImagePreprocessor(
-        m_model, {127.5, 127.5, 127.5}, {127.5, 127.5, 127.5}, DL_IMAGE_CAP_RGB_SWAP | DL_IMAGE_CAP_RGB565_BIG_ENDIAN);
-#elif CONFIG_IDF_TARGET_ESP32S3
-    m_image_preprocessor = new dl::image::FeatImagePreprocessor(m_model, {127.5, 127.5, 127.5}, {127.5, 127.5, 127.5});
-#endif
+    m_image_preprocessor =
+        new dl::image::FeatImagePreprocessor(m_model, {127.5, 127.5, 127.5}, {127.5, 127.5, 127.5}, s_caps);
     m_postprocessor = new dl::feat::FeatPostprocessor(m_model);
     m_feat_len = m_model->get_outputs().begin()->second->get_size();
 }
 
+dl::TensorBase *MFN::run(const dl::image::img_t &img, const std::vector<int> &landmarks)
+{
+    dl::TensorBase *input = m_model->get_inputs().begin()->second;
+    if (!mp_esp_dl::recognition::FaceAligner::supports(img, input)) {
+        return FeatImpl::run(img, landmarks);
+    }
+    MP_DL_TRACE_BEGIN("face_align");
+    esp_err_t ret = m_aligner.align(img, landmarks, input);
+    MP_DL_TRACE_END("face_align");
+    if (ret != ESP_OK) {
+        return FeatImpl::run(img, landmarks);
+    }
+    m_model->run();
+    return m_postprocessor->postprocess();
+}
+
 } // namespace human_face_recognition
 
 HumanFaceFeat::HumanFaceFeat(model_type_t model_type)
@@ -62,44 +81,254 @@ HumanFaceFeat::HumanFaceFeat(model_type_t model_type)
     m_feat_len = m_model->m_feat_len;
 }
 
-std::vector<mp_esp_dl::recognition::result_t> HumanFaceRecognizer::recognize(const dl::image::img_t &img,
-                                                                      std::list<dl::detect::result_t> &detect_res)
+const dl::detect::result_t *HumanFaceRecognizer::select_face(std::list<dl::detect::result_t> &detect_res)
 {
-    std::vector<std::vector<mp_esp_dl::recognition::result_t>> res;
     if (detect_res.empty()) {
+        return nullptr;
+    } else if (detect_res.size() == 1) {
+        return &detect_res.back();
+    }
+    auto max_detect_res =
+        std::max_element(detect_res.begin(),
+                         detect_res.end(),
+                         [](const dl::detect::result_t &a, const dl::detect::result_t &b) -> bool {
+                             return a.box_area() > b.box_area();
+                         });
+    return &(*max_detect_res);
+}
+
+const float *HumanFaceRecognizer::extract(const dl::image::img_t &img, const dl::detect::result_t &face)
+{
+    const int feat_len = get_feat_len();
+    for (int i = 0; i < FEAT_CACHE_SIZE; i++) {
+        if (m_cache[i].valid && m_cache[i].keypoint == face.keypoint) {
+            return &m_cache_feats[i * feat_len];
+        }
+    }
+
+    MP_DL_TRACE_BEGIN("feat_model");
+    auto feat = m_feat_extract->run(img, face.keypoint);
+    MP_DL_TRACE_END("feat_model");
+    if (feat->dtype != dl::DATA_TYPE_FLOAT || feat->size != feat_len) {
+        ESP_LOGE("HumanFaceRecognizer", "Feature does not match the database.");
+        return nullptr;
+    }
+    int slot = m_cache_next;
+    m_cache_next = (m_cache_next + 1) % FEAT_CACHE_SIZE;
+    m_cache[slot].keypoint = face.keypoint;
+    m_cache[slot].valid = true;
+    float *cached = &m_cache_feats[slot * feat_len];
+    memcpy(cached, feat->data, feat_len * sizeof(float));
+    return cached;
+}
+
+void HumanFaceRecognizer::clear_cache()
+{
+    for (auto &cached : m_cache) {
+        cached.valid = false;
+    }
+    m_cache_next = 0;
+}
+
+std::vector<mp_esp_dl::recognition::result_t> HumanFaceRecognizer::recognize(const dl::image::img_t &img,
+                                                                      std::list<dl::detect::result_t> &detect_res,
+                                                                      const gallery_t *gallery)
+{
+    MP_DL_TRACE_SCOPE("recognize");
+    const dl::detect::result_t *face = select_face(detect_res);
+    if (!face) {
         ESP_LOGW("HumanFaceRecognizer", "Failed to recognize. No face detected.");
         return {};
-    } else if (detect_res.size() == 1) {
-        auto feat = m_feat_extract->run(img, detect_res.back().keypoint);
-        return query_feat(feat, m_thr, m_top_k);
-    } else {
-        auto max_detect_res =
-            std::max_element(detect_res.begin(),
-                             detect_res.end(),
-                             [](const dl::detect::result_t &a, const dl::detect::result_t &b) -> bool {
-                                 return a.box_area() > b.box_area();
-                             });
-        auto feat = m_feat_extract->run(img, max_detect_res->keypoint);
-        return query_feat(feat, m_thr, m_top_k);
     }
+    const float *feat = extract(img, *face);
+    if (!feat) {
+        return {};
+    }
+    return recognize(feat, gallery);
 }
 
-esp_err_t HumanFaceRecognizer::enroll(const dl::image::img_t &img, std::list<dl::detect::result_t> &detect_res, const char *name, uint16_t *new_id)
+std::vector<mp_esp_dl::recognition::result_t> HumanFaceRecognizer::recognize(const float *feat, const gallery_t *gallery)
 {
-    if (detect_res.empty()) {
+    if (gallery) {
+        return gallery->db->query_feat(feat, gallery->thr, gallery->top_k);
+    }
+    return query_feat(feat, m_thr, m_top_k);
+}
+
+esp_err_t HumanFaceRecognizer::enroll(const dl::image::img_t &img, std::list<dl::detect::result_t> &detect_res, const char *name, uint16_t *new_id,
+                                      const gallery_t *gallery)
+{
+    MP_DL_TRACE_SCOPE("enroll");
+    const dl::detect::result_t *face = select_face(detect_res);
+    if (!face) {
         ESP_LOGW("HumanFaceRecognizer", "Failed to enroll. No face detected.");
         return ESP_FAIL;
-    } else if (detect_res.size() == 1) {
-        auto feat = m_feat_extract->run(img, detect_res.back().keypoint);
-        return enroll_feat(feat, name, new_id);
-    } else {
-        auto max_detect_res =
-            std::max_element(detect_res.begin(),
-                             detect_res.end(),
-                             [](const dl::detect::result_t &a, const dl::detect::result_t &b) -> bool {
-                                 return a.box_area() > b.box_area();
-                             });
-        auto feat = m_feat_extract->run(img, max_detect_res->keypoint);
-        return enroll_feat(feat, name, new_id);
     }
+    const float *feat = extract(img, *face);
+    if (!feat) {
+        return ESP_FAIL;
+    }
+    mp_esp_dl::recognition::DataBase *db = gallery ? gallery->db.get() : this;
+    esp_err_t ret = db->enroll_feat(feat, name, new_id);
+    if (ret != ESP_OK || !m_store_faces) {
+        return ret;
+    }
+    // The face is enrolled either way, without the crop it cannot be reembedded later
+    m_face_crop.resize(mp_esp_dl::recognition::FaceStore::CROP_BYTES);
+    mp_esp_dl::recognition::FaceStore::align(img, face->keypoint, m_face_crop.data(), s_caps);
+    if (db->store_face(*new_id, m_face_crop.data()) != ESP_OK) {
+        ESP_LOGW("HumanFaceRecognizer", "Failed to store the face of id %d.", *new_id);
+    }
+    return ESP_OK;
+}
+
+esp_err_t HumanFaceRecognizer::reembed(const mp_esp_dl::recognition::DataBase::progress_fn_t &progress,
+                                       mp_esp_dl::recognition::DataBase::reembed_stats_t *stats, const gallery_t *gallery)
+{
+    // The database may still have the length of the model it was made with
+    const int feat_len = m_feat_extract->m_feat_len;
+    dl::image::img_t crop_img;
+    crop_img.width = mp_esp_dl::recognition::FaceStore::SIZE;
+    crop_img.height = mp_esp_dl::recognition::FaceStore::SIZE;
+    crop_img.pix_type = dl::image::DL_IMAGE_PIX_TYPE_RGB888;
+    auto embed = [&](const uint8_t *crop) -> const float * {
+        crop_img.data = (void *)crop;
+        MP_DL_TRACE_BEGIN("feat_model");
+        auto feat = m_feat_extract->run(crop_img, mp_esp_dl::recognition::FaceStore::keypoint());
+        MP_DL_TRACE_END("feat_model");
+        if (feat->dtype != dl::DATA_TYPE_FLOAT || feat->size != feat_len) {
+            return nullptr;
+        }
+        return (const float *)feat->data;
+    };
+    mp_esp_dl::recognition::DataBase *db = gallery ? gallery->db.get() : this;
+    return db->reembed(feat_len, embed, progress, stats);
+}
+
+esp_err_t HumanFaceRecognizer::add_gallery(const char *name, const char *db_path, float thr, int top_k, bool async_load)
+{
+    if (strlen(name) == 0 || strlen(name) >= MAX_NAME_LENGTH) {
+        ESP_LOGE("HumanFaceRecognizer", "Invalid gallery name.");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (get_gallery(name)) {
+        ESP_LOGE("HumanFaceRecognizer", "Gallery %s already exists.", name);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // The database is opened before the list is locked, searches go on meanwhile
+    auto gallery = std::make_shared<gallery_t>();
+    strncpy(gallery->name, name, MAX_NAME_LENGTH);
+    gallery->db = std::make_shared<mp_esp_dl::recognition::DataBase>(db_path, get_feat_len(), async_load);
+    gallery->thr = thr;
+    gallery->top_k = top_k;
+    if (gallery->db->get_feat_len() != get_feat_len()) {
+        ESP_LOGE("HumanFaceRecognizer", "Gallery %s was created with another feature model.", name);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    std::unique_lock<std::shared_mutex> lock(m_galleries_lock, std::defer_lock);
+    mp_esp_dl::recognition::lock_releasing_gil(lock);
+    // Another thread may have added the name while the database was opened
+    for (const auto &other : m_galleries) {
+        if (strcmp(other->name, name) == 0) {
+            ESP_LOGE("HumanFaceRecognizer", "Gallery %s already exists.", name);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    m_galleries.push_back(gallery);
+    return ESP_OK;
+}
+
+esp_err_t HumanFaceRecognizer::remove_gallery(const char *name)
+{
+    std::shared_ptr<gallery_t> removed;
+    {
+        std::unique_lock<std::shared_mutex> lock(m_galleries_lock, std::defer_lock);
+        mp_esp_dl::recognition::lock_releasing_gil(lock);
+        for (auto it = m_galleries.begin(); it != m_galleries.end(); it++) {
+            if (strcmp((*it)->name, name) == 0) {
+                removed = *it;
+                m_galleries.erase(it);
+                break;
+            }
+        }
+    }
+    // Closed after the list is unlocked, unless a caller still holds it
+    return removed ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+std::shared_ptr<const HumanFaceRecognizer::gallery_t> HumanFaceRecognizer::get_gallery(const char *name)
+{
+    std::shared_lock<std::shared_mutex> lock(m_galleries_lock, std::defer_lock);
+    mp_esp_dl::recognition::lock_releasing_gil(lock);
+    for (const auto &gallery : m_galleries) {
+        if (strcmp(gallery->name, name) == 0) {
+            return gallery;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<std::shared_ptr<const HumanFaceRecognizer::gallery_t>> HumanFaceRecognizer::get_galleries()
+{
+    std::shared_lock<std::shared_mutex> lock(m_galleries_lock, std::defer_lock);
+    mp_esp_dl::recognition::lock_releasing_gil(lock);
+    return std::vector<std::shared_ptr<const gallery_t>>(m_galleries.begin(), m_galleries.end());
+}
+
+bool HumanFaceRecognizer::has_galleries()
+{
+    std::shared_lock<std::shared_mutex> lock(m_galleries_lock, std::defer_lock);
+    mp_esp_dl::recognition::lock_releasing_gil(lock);
+    return !m_galleries.empty();
+}
+
+std::vector<HumanFaceRecognizer::gallery_result_t> HumanFaceRecognizer::search_galleries(const float *feat)
+{
+    std::vector<gallery_result_t> results;
+    std::shared_lock<std::shared_mutex> lock(m_galleries_lock, std::defer_lock);
+    mp_esp_dl::recognition::lock_releasing_gil(lock);
+    for (const auto &gallery : m_galleries) {
+        for (const auto &res : gallery->db->query_feat(feat, gallery->thr, gallery->top_k)) {
+            results.emplace_back();
+            strncpy(results.back().gallery, gallery->name, MAX_NAME_LENGTH);
+            results.back().result = res;
+        }
+    }
+    return results;
+}
+
+bool HumanFaceRecognizer::all_loaded()
+{
+    if (!is_loaded()) {
+        return false;
+    }
+    std::shared_lock<std::shared_mutex> lock(m_galleries_lock, std::defer_lock);
+    mp_esp_dl::recognition::lock_releasing_gil(lock);
+    for (const auto &gallery : m_galleries) {
+        if (!gallery->db->is_loaded()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+esp_err_t HumanFaceRecognizer::load_next_chunk(int max_records)
+{
+    if (!is_loaded()) {
+        return load_chunk(max_records);
+    }
+    std::shared_ptr<gallery_t> loading;
+    {
+        std::shared_lock<std::shared_mutex> lock(m_galleries_lock, std::defer_lock);
+        mp_esp_dl::recognition::lock_releasing_gil(lock);
+        for (const auto &gallery : m_galleries) {
+            if (!gallery->db->is_loaded()) {
+                loading = gallery;
+                break;
+            }
+        }
+    }
+    // Loaded without the list locked, add_gallery() and remove_gallery() are not held up
+    return loading ? loading->db->load_chunk(max_records) : ESP_OK;
 }
@@ -6,13 +6,22 @@
 #include "freertos/event_groups.h"
 #include "freertos/idf_additions.h"
 #include "mp_esp_dl_recognition_database.hpp"
+#include "mp_esp_dl_face_align.hpp"
 #include "dl_detect_define.hpp"
 #include "dl_feat_base.hpp"
 #include "dl_tensor_base.hpp"
+#include <memory>
+#include <shared_mutex>
 namespace human_face_recognition {
 class MFN : public dl::feat::FeatImpl {
 public:
     MFN(const char *model_name);
+    // Aligns RGB888 and RGB565 faces with the fused kernel of FaceAligner,
+    // other images go through the esp-dl preprocessor
+    dl::TensorBase *run(const dl::image::img_t &img, const std::vector<int> &landmarks) override;
+
+private:
+    mp_esp_dl::recognition::FaceAligner m_aligner;
 };
 
 using MBF = MFN;
@@ -28,21 +37,96 @@ public:
 };
 
 class HumanFaceRecognizer : public mp_esp_dl::recognition::DataBase {
+public:
+    // A further database which is searched with the same embeddings as the own one
+    struct gallery_t {
+        char name[MAX_NAME_LENGTH];
+        std::shared_ptr<mp_esp_dl::recognition::DataBase> db;
+        float thr;
+        int top_k;
+    };
+    struct gallery_result_t {
+        char gallery[MAX_NAME_LENGTH];  // name of the gallery
+        mp_esp_dl::recognition::result_t result;
+    };
+
 private:
     HumanFaceFeat *m_feat_extract;
     float m_thr;
     int m_top_k;
 
+    // Embeddings of the faces seen in the current call, keyed by the face
+    // landmarks. A ring of fixed slots allocated once, so steady state
+    // recognition does not allocate.
+    struct cached_feat_t {
+        std::vector<int> keypoint;
+        bool valid;
+    };
+    static constexpr int FEAT_CACHE_SIZE = 8;
+    std::vector<cached_feat_t> m_cache;
+    std::vector<float> m_cache_feats;
+    int m_cache_next;
+    // Searches take m_galleries_lock shared, add_gallery() and
+    // remove_gallery() exclusively. The galleries are shared with the callers
+    // of get_gallery(), a removed gallery lives on until they let it go.
+    std::vector<std::shared_ptr<gallery_t>> m_galleries;
+    std::shared_mutex m_galleries_lock;
+    bool m_store_faces;
+    std::vector<uint8_t> m_face_crop;
+
+    const dl::detect::result_t *select_face(std::list<dl::detect::result_t> &detect_res);
+
 public:
-    HumanFaceRecognizer(HumanFaceFeat *feat_model, char *db_path, float thr = 0.5, int top_k = 1) :
-        mp_esp_dl::recognition::DataBase(db_path, feat_model->m_feat_len),
+    HumanFaceRecognizer(HumanFaceFeat *feat_model, char *db_path, float thr = 0.5, int top_k = 1, bool async_load = false) :
+        mp_esp_dl::recognition::DataBase(db_path, feat_model->m_feat_len, async_load),
         m_feat_extract(feat_model),
         m_thr(thr),
-        m_top_k(top_k)
+        m_top_k(top_k),
+        m_cache(FEAT_CACHE_SIZE),
+        m_cache_feats(FEAT_CACHE_SIZE * feat_model->m_feat_len),
+        m_cache_next(0),
+        m_store_faces(false)
     {
+        clear_cache();
     }
 
+    // Returns the embedding of the face, or nullptr on failure. The feature model only runs
+    // if the face was not extracted since the last clear_cache(), so recognize() followed by
+    // enroll() on the same detection extracts the features once.
+    const float *extract(const dl::image::img_t &img, const dl::detect::result_t &face);
+    // Called at the start of every call with a new frame. The frame buffer
+    // of a camera is reused, so neither its address nor the landmarks tell
+    // frames apart.
+    void clear_cache();
+
+    // Without gallery, the own database is searched or changed
     std::vector<mp_esp_dl::recognition::result_t> recognize(const dl::image::img_t &img,
-                                                     std::list<dl::detect::result_t> &detect_res);
-    esp_err_t enroll(const dl::image::img_t &img, std::list<dl::detect::result_t> &detect_res, const char *name, uint16_t *new_id);
+                                                     std::list<dl::detect::result_t> &detect_res,
+                                                     const gallery_t *gallery = nullptr);
+    std::vector<mp_esp_dl::recognition::result_t> recognize(const float *feat, const gallery_t *gallery = nullptr);
+    // With store_faces, the aligned face is kept next to the database, see reembed()
+    esp_err_t enroll(const dl::image::img_t &img, std::list<dl::detect::result_t> &detect_res, const char *name, uint16_t *new_id,
+                     const gallery_t *gallery = nullptr);
+
+    void set_store_faces(bool store_faces) { m_store_faces = store_faces; }
+    bool get_store_faces() { return m_store_faces; }
+    // Computes the embeddings of the database or gallery again with the
+    // current feature model, from the faces stored at enrollment
+    esp_err_t reembed(const mp_esp_dl::recognition::DataBase::progress_fn_t &progress,
+                      mp_esp_dl::recognition::DataBase::reembed_stats_t *stats, const gallery_t *gallery = nullptr);
+
+    esp_err_t add_gallery(const char *name, const char *db_path, float thr, int top_k, bool async_load = false);
+    esp_err_t remove_gallery(const char *name);
+    // nullptr if there is no gallery of that name. The reference keeps the
+    // gallery alive while another thread removes it; an exception skips its
+    // destructor, so let it go before raising.
+    std::shared_ptr<const gallery_t> get_gallery(const char *name);
+    std::vector<std::shared_ptr<const gallery_t>> get_galleries();
+    bool has_galleries();
+    // Searches feat in every gallery
+    std::vector<gallery_result_t> search_galleries(const float *feat);
+
+    // Loading state of the own database and all galleries together
+    bool all_loaded();
+    esp_err_t load_next_chunk(int max_records);
 };
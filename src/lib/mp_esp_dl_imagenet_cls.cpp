@@ -0,0 +1,184 @@
+#include "mp_esp_dl_imagenet_cls.hpp"
+#include "imagenet_cls_postprocessor.hpp"
+#include "esp_log.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+
+#if CONFIG_IMAGENET_CLS_MODEL_IN_FLASH_RODATA
+extern const uint8_t imagenet_cls_espdl[] asm("_binary_imagenet_cls_espdl_start");
+static const char *path = (const char *)imagenet_cls_espdl;
+#elif CONFIG_IMAGENET_CLS_MODEL_IN_FLASH_PARTITION
+static const char *path = "imagenet_cls";
+#else
+#if !defined(CONFIG_BSP_SD_MOUNT_POINT)
+#define CONFIG_BSP_SD_MOUNT_POINT "/sdcard"
+#endif
+#endif
+namespace imagenet_classification {
+
+static const std::vector<float> s_mean = {123.675, 116.28, 103.53};
+static const std::vector<float> s_std = {58.395, 57.12, 57.375};
+
+// Converts the quantized tensor to floats, out has to hold tensor->get_size() values
+static bool dequantize(dl::TensorBase *tensor, float *out)
+{
+    int size = tensor->get_size();
+    float scale = ldexpf(1.0f, tensor->exponent);
+    switch (tensor->dtype) {
+    case dl::DATA_TYPE_INT8:
+        for (int i = 0; i < size; i++) {
+            out[i] = ((int8_t *)tensor->data)[i] * scale;
+        }
+        return true;
+    case dl::DATA_TYPE_INT16:
+        for (int i = 0; i < size; i++) {
+            out[i] = ((int16_t *)tensor->data)[i] * scale;
+        }
+        return true;
+    case dl::DATA_TYPE_FLOAT:
+        std::copy((float *)tensor->data, (float *)tensor->data + size, out);
+        return true;
+    default:
+        ESP_LOGE("ImageNetClassifier", "Unsupported output data type.");
+        return false;
+    }
+}
+
+MobileNetV2::MobileNetV2(const char *model_name, const int topk) :
+    m_jpeg_loader(s_mean, s_std), m_embedding_layer(MP_DL_IMAGENET_EMBEDDING_LAYER)
+{
+#if !CONFIG_IMAGENET_CLS_MODEL_IN_SDCARD
+    m_model =
+        new dl::Model(path, model_name, static_cast<fbs::model_location_type_t>(CONFIG_IMAGENET_CLS_MODEL_LOCATION));
+#else
+    char sd_path[256];
+    snprintf(sd_path,
+             sizeof(sd_path),
+             "%s/%s/%s",
+             CONFIG_BSP_SD_MOUNT_POINT,
+             CONFIG_IMAGENET_CLS_MODEL_SDCARD_DIR,
+             model_name);
+    m_model = new dl::Model(sd_path, static_cast<fbs::model_location_type_t>(CONFIG_IMAGENET_CLS_MODEL_LOCATION));
+#endif
+#if CONFIG_IDF_TARGET_ESP32P4
+    m_image_preprocessor =
+        new dl::image::ImagePreprocessor(m_model, s_mean, s_std, DL_IMAGE_CAP_RGB_SWAP | DL_IMAGE_CAP_RGB565_BIG_ENDIAN);
+#else
+    m_image_preprocessor = new dl::image::ImagePreprocessor(m_model, s_mean, s_std);
+#endif
+    m_postprocessor =
+        new dl::cls::ImageNetClsPostprocessor(m_model, topk, std::numeric_limits<float>::lowest(), true);
+}
+
+std::vector<dl::cls::result_t> &MobileNetV2::run(const dl::image::img_t &img, const std::vector<int> &crop_area)
+{
+    m_image_preprocessor->preprocess(img, crop_area);
+    m_model->run();
+    return m_postprocessor->postprocess();
+}
+
+std::vector<dl::cls::result_t> *MobileNetV2::run_jpeg(const uint8_t *jpeg, size_t jpeg_len, mp_esp_dl::Arena *arena)
+{
+    if (m_jpeg_loader.load(jpeg, jpeg_len, m_model->get_inputs().begin()->second, arena) != ESP_OK) {
+        return nullptr;
+    }
+    m_model->run();
+    return &m_postprocessor->postprocess();
+}
+
+int MobileNetV2::run_topk(
+    const dl::image::img_t &img, const std::vector<int> &crop_area, int k, int *indices, float *scores)
+{
+    m_image_preprocessor->preprocess(img, crop_area);
+    m_model->run();
+    return topk(k, indices, scores);
+}
+
+int MobileNetV2::topk(int k, int *indices, float *scores)
+{
+    dl::TensorBase *output = m_model->get_outputs().begin()->second;
+    int num_classes = output->get_size();
+    m_scores.resize(num_classes);
+    if (!dequantize(output, m_scores.data())) {
+        return 0;
+    }
+
+    // Softmax; only the selected scores need to be normalized
+    float max_score = *std::max_element(m_scores.begin(), m_scores.end());
+    float sum = 0;
+    for (auto &score : m_scores) {
+        score = expf(score - max_score);
+        sum += score;
+    }
+
+    k = std::min(k, num_classes);
+    for (int i = 0; i < k; i++) {
+        int best = std::max_element(m_scores.begin(), m_scores.end()) - m_scores.begin();
+        indices[i] = best;
+        scores[i] = m_scores[best] / sum;
+        m_scores[best] = -1.0f;
+    }
+    return k;
+}
+
+int MobileNetV2::get_embedding_len()
+{
+    dl::TensorBase *embedding = m_model->get_intermediate(m_embedding_layer);
+    return embedding ? embedding->get_size() : 0;
+}
+
+const float *MobileNetV2::embed(const dl::image::img_t &img, const std::vector<int> &crop_area)
+{
+    dl::TensorBase *layer = m_model->get_intermediate(m_embedding_layer);
+    if (!layer) {
+        ESP_LOGE("ImageNetClassifier", "No layer %s in the model.", m_embedding_layer.c_str());
+        return nullptr;
+    }
+    if (!m_embedding_output) {
+        m_embedding_output.reset(new dl::TensorBase(layer->shape, nullptr, layer->exponent, layer->dtype));
+    }
+    m_image_preprocessor->preprocess(img, crop_area);
+    std::map<std::string, dl::TensorBase *> outputs = {{m_embedding_layer, m_embedding_output.get()}};
+    m_model->run(m_model->get_inputs(), dl::RUNTIME_MODE_SINGLE_CORE, outputs);
+
+    m_embedding.resize(m_embedding_output->get_size());
+    if (!dequantize(m_embedding_output.get(), m_embedding.data())) {
+        return nullptr;
+    }
+    float norm = 0;
+    for (float value : m_embedding) {
+        norm += value * value;
+    }
+    norm = sqrtf(norm);
+    if (norm > 0) {
+        for (float &value : m_embedding) {
+            value /= norm;
+        }
+    }
+    return m_embedding.data();
+}
+
+} // namespace imagenet_classification
+
+ImageNetClassifier::ImageNetClassifier(model_type_t model_type, const int topk) : m_model(nullptr)
+{
+    switch (model_type) {
+    case model_type_t::MOBILENETV2_S8_V1:
+        m_model = new imagenet_classification::MobileNetV2("imagenet_cls_mobilenetv2_s8_v1.espdl", topk);
+        break;
+    default:
+        ESP_LOGE("imagenet_cls", "Unknown model type.");
+    }
+}
+
+ImageNetClassifier::~ImageNetClassifier()
+{
+    delete m_model;
+}
+
+int ImageNetClassifier::get_num_classes()
+{
+    return m_model->get_model()->get_outputs().begin()->second->get_size();
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "dl_cls_base.hpp"
+#include "dl_image_define.hpp"
+#include "dl_tensor_base.hpp"
+#include "mp_esp_dl_jpeg_input.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+// Output of the global average pooling in front of the classifier of the
+// ImageNet MobileNetV2, the penultimate layer of the model
+#ifndef MP_DL_IMAGENET_EMBEDDING_LAYER
+#define MP_DL_IMAGENET_EMBEDDING_LAYER "/GlobalAveragePool_output_0"
+#endif
+
+namespace imagenet_classification {
+class MobileNetV2 : public dl::cls::ClsImpl {
+public:
+    MobileNetV2(const char *model_name, const int topk);
+    dl::Model *get_model() { return m_model; }
+
+    // Classifies the rectangle crop_area = [x1, y1, x2, y2] of img without copying it out.
+    // An empty crop_area classifies the whole image.
+    std::vector<dl::cls::result_t> &run(const dl::image::img_t &img, const std::vector<int> &crop_area);
+    using dl::cls::ClsImpl::run;
+    // Same as run(), but returns the class indices and softmax scores of the best k classes
+    int run_topk(const dl::image::img_t &img, const std::vector<int> &crop_area, int k, int *indices, float *scores);
+    // The class indices and softmax scores of the best k classes of the last run
+    int topk(int k, int *indices, float *scores);
+    // Classifies a JPEG which is decoded straight into the input tensor. Returns nullptr on failure.
+    std::vector<dl::cls::result_t> *run_jpeg(const uint8_t *jpeg, size_t jpeg_len, mp_esp_dl::Arena *arena = nullptr);
+    // Runs the model on crop_area of img and returns the L2 normalized output of
+    // the embedding layer, get_embedding_len() floats. Returns nullptr if the
+    // model has no such layer.
+    const float *embed(const dl::image::img_t &img, const std::vector<int> &crop_area);
+    int get_embedding_len();
+    void set_embedding_layer(const char *name)
+    {
+        m_embedding_layer = name;
+        m_embedding_output.reset();
+    }
+
+private:
+    std::vector<float> m_scores;
+    std::vector<float> m_embedding;
+    // The embedding layer is requested as an output of the run, the model
+    // copies it here before later layers can reuse its buffer
+    std::unique_ptr<dl::TensorBase> m_embedding_output;
+    mp_esp_dl::JpegTensorLoader m_jpeg_loader;
+    std::string m_embedding_layer;
+};
+} // namespace imagenet_classification
+
+class ImageNetClassifier : public dl::cls::Cls {
+public:
+    typedef enum {
+        MOBILENETV2_S8_V1,
+    } model_type_t;
+    ImageNetClassifier(model_type_t model_type = MOBILENETV2_S8_V1, const int topk = 5);
+    ~ImageNetClassifier() override;
+
+    std::vector<dl::cls::result_t> &run(const dl::image::img_t &img) override { return m_model->run(img); }
+    std::vector<dl::cls::result_t> &run(const dl::image::img_t &img, const std::vector<int> &crop_area)
+    {
+        return m_model->run(img, crop_area);
+    }
+    int run_topk(const dl::image::img_t &img, const std::vector<int> &crop_area, int k, int *indices, float *scores)
+    {
+        return m_model->run_topk(img, crop_area, k, indices, scores);
+    }
+    int topk(int k, int *indices, float *scores) { return m_model->topk(k, indices, scores); }
+    std::vector<dl::cls::result_t> *run_jpeg(const uint8_t *jpeg, size_t jpeg_len, mp_esp_dl::Arena *arena = nullptr)
+    {
+        return m_model->run_jpeg(jpeg, jpeg_len, arena);
+    }
+    const float *embed(const dl::image::img_t &img, const std::vector<int> &crop_area)
+    {
+        return m_model->embed(img, crop_area);
+    }
+    int get_embedding_len() { return m_model->get_embedding_len(); }
+    void set_embedding_layer(const char *name) { m_model->set_embedding_layer(name); }
+    int get_num_classes();
+
+private:
+    imagenet_classification::MobileNetV2 *m_model;
+};
@@ -0,0 +1,193 @@
+#include "mp_esp_dl_input_scaler.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace mp_esp_dl {
+
+namespace {
+
+struct rgb888_t {
+    static constexpr int bytes = 3;
+    static inline void load(const uint8_t *p, uint32_t *c)
+    {
+        c[0] = p[0];
+        c[1] = p[1];
+        c[2] = p[2];
+    }
+    static inline void store(uint8_t *p, const uint32_t *c)
+    {
+        p[0] = c[0];
+        p[1] = c[1];
+        p[2] = c[2];
+    }
+};
+
+// Little endian RGB565, which is what the esp-dl preprocessor expects on the S3
+struct rgb565_t {
+    static constexpr int bytes = 2;
+    static inline void load(const uint8_t *p, uint32_t *c)
+    {
+        uint16_t v = p[0] | (p[1] << 8);
+        c[0] = v >> 11;
+        c[1] = (v >> 5) & 0x3f;
+        c[2] = v & 0x1f;
+    }
+    static inline void store(uint8_t *p, const uint32_t *c)
+    {
+        uint16_t v = (c[0] << 11) | (c[1] << 5) | c[2];
+        p[0] = v & 0xff;
+        p[1] = v >> 8;
+    }
+};
+
+// One destination row of a bilinear resize with 8 bit fixed point weights.
+// No branches in the inner loop; the column tables are precomputed.
+template <typename P>
+void resize_row(const uint8_t *row0,
+                const uint8_t *row1,
+                uint32_t wy,
+                uint8_t *dst,
+                const uint16_t *x0,
+                const uint16_t *x1,
+                const uint16_t *wx,
+                int dst_width)
+{
+    const uint32_t wy0 = 256 - wy;
+    uint32_t a[3], b[3], c[3], d[3], out[3];
+    for (int dx = 0; dx < dst_width; dx++) {
+        const uint32_t w1 = wx[dx];
+        const uint32_t w0 = 256 - w1;
+        P::load(row0 + P::bytes * x0[dx], a);
+        P::load(row0 + P::bytes * x1[dx], b);
+        P::load(row1 + P::bytes * x0[dx], c);
+        P::load(row1 + P::bytes * x1[dx], d);
+        for (int ch = 0; ch < 3; ch++) {
+            uint32_t top = a[ch] * w0 + b[ch] * w1;
+            uint32_t bottom = c[ch] * w0 + d[ch] * w1;
+            out[ch] = (top * wy0 + bottom * wy + (1 << 15)) >> 16;
+        }
+        P::store(dst, out);
+        dst += P::bytes;
+    }
+}
+
+// Maps destination index i to a source position in 24.8 fixed point, pixel centers aligned
+inline int source_pos(int i, int src_len, int dst_len)
+{
+    int pos = (int)(((int64_t)(2 * i + 1) * src_len * 256) / (2 * dst_len)) - 128;
+    return std::max(pos, 0);
+}
+
+} // namespace
+
+InputScaler::InputScaler(Arena *arena) :
+    m_arena(arena),
+    m_crop_buf(nullptr),
+    m_crop_buf_size(0),
+    m_crop_generation(0),
+    m_resized(),
+    m_cropped(),
+    m_src_width(0),
+    m_dst_width(0)
+{
+}
+
+void InputScaler::prepare_columns(int src_width, int dst_width)
+{
+    if (src_width == m_src_width && dst_width == m_dst_width) {
+        return;
+    }
+    m_x0.resize(dst_width);
+    m_x1.resize(dst_width);
+    m_wx.resize(dst_width);
+    for (int dx = 0; dx < dst_width; dx++) {
+        int pos = source_pos(dx, src_width, dst_width);
+        m_x0[dx] = std::min(pos >> 8, src_width - 1);
+        m_x1[dx] = std::min(m_x0[dx] + 1, src_width - 1);
+        m_wx[dx] = pos & 0xff;
+    }
+    m_src_width = src_width;
+    m_dst_width = dst_width;
+}
+
+const dl::image::img_t &InputScaler::resize(const dl::image::img_t &src, int dst_width, int dst_height)
+{
+    m_resized.width = dst_width;
+    m_resized.height = dst_height;
+    m_resized.pix_type = src.pix_type;
+    uint8_t *resize_buf = (uint8_t *)m_arena->alloc(dl::image::get_img_byte_size(m_resized));
+    m_resized.data = resize_buf;
+    if (!resize_buf) {
+        return m_resized;
+    }
+
+    prepare_columns(src.width, dst_width);
+    const size_t pix_bytes = dl::image::get_pix_byte_size(src.pix_type);
+    const size_t src_stride = src.width * pix_bytes;
+    const size_t dst_stride = dst_width * pix_bytes;
+    const uint8_t *src_data = (const uint8_t *)src.data;
+    for (int dy = 0; dy < dst_height; dy++) {
+        int pos = source_pos(dy, src.height, dst_height);
+        int y0 = std::min(pos >> 8, src.height - 1);
+        int y1 = std::min(y0 + 1, src.height - 1);
+        const uint8_t *row0 = src_data + y0 * src_stride;
+        const uint8_t *row1 = src_data + y1 * src_stride;
+        uint8_t *dst = resize_buf + dy * dst_stride;
+        if (src.pix_type == dl::image::DL_IMAGE_PIX_TYPE_RGB565) {
+            resize_row<rgb565_t>(row0, row1, pos & 0xff, dst, m_x0.data(), m_x1.data(), m_wx.data(), dst_width);
+        } else {
+            resize_row<rgb888_t>(row0, row1, pos & 0xff, dst, m_x0.data(), m_x1.data(), m_wx.data(), dst_width);
+        }
+    }
+    return m_resized;
+}
+
+const dl::image::img_t &InputScaler::crop(const dl::image::img_t &src, int x1, int y1, int x2, int y2)
+{
+    x1 = std::max(x1, 0);
+    y1 = std::max(y1, 0);
+    x2 = std::min(x2, (int)src.width);
+    y2 = std::min(y2, (int)src.height);
+    m_cropped.pix_type = src.pix_type;
+    if (x2 <= x1 || y2 <= y1) {
+        m_cropped.data = nullptr;
+        m_cropped.width = 0;
+        m_cropped.height = 0;
+        return m_cropped;
+    }
+    m_cropped.width = x2 - x1;
+    m_cropped.height = y2 - y1;
+    size_t size = dl::image::get_img_byte_size(m_cropped);
+    if (m_crop_generation != m_arena->generation() || size > m_crop_buf_size) {
+        m_crop_buf = (uint8_t *)m_arena->alloc(size);
+        m_crop_buf_size = m_crop_buf ? size : 0;
+        m_crop_generation = m_arena->generation();
+    }
+    m_cropped.data = m_crop_buf;
+    if (!m_crop_buf) {
+        return m_cropped;
+    }
+
+    const size_t pix_bytes = dl::image::get_pix_byte_size(src.pix_type);
+    const size_t src_stride = src.width * pix_bytes;
+    const size_t row_bytes = m_cropped.width * pix_bytes;
+    const uint8_t *src_data = (const uint8_t *)src.data + y1 * src_stride + x1 * pix_bytes;
+    for (int y = 0; y < m_cropped.height; y++) {
+        memcpy(m_crop_buf + y * row_bytes, src_data + y * src_stride, row_bytes);
+    }
+    return m_cropped;
+}
+
+void InputScaler::to_source(dl::detect::result_t &res, float scale_x, float scale_y, int offset_x, int offset_y)
+{
+    for (size_t i = 0; i + 1 < res.box.size(); i += 2) {
+        res.box[i] = (int)(res.box[i] * scale_x + 0.5f) + offset_x;
+        res.box[i + 1] = (int)(res.box[i + 1] * scale_y + 0.5f) + offset_y;
+    }
+    for (size_t i = 0; i + 1 < res.keypoint.size(); i += 2) {
+        res.keypoint[i] = (int)(res.keypoint[i] * scale_x + 0.5f) + offset_x;
+        res.keypoint[i + 1] = (int)(res.keypoint[i + 1] * scale_y + 0.5f) + offset_y;
+    }
+}
+
+} // namespace mp_esp_dl
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "dl_image_define.hpp"
+#include "dl_detect_define.hpp"
+#include "mp_esp_dl_arena.hpp"
+#include <cstdint>
+#include <list>
+#include <vector>
+
+namespace mp_esp_dl {
+
+// Resizes and crops framebuffers into buffers from the arena of the model,
+// so the detectors can run on a smaller input than the camera delivers.
+class InputScaler {
+public:
+    InputScaler(Arena *arena);
+
+    // Bilinear downscale of src to dst_width x dst_height. The coordinate and
+    // weight tables are only rebuilt when the geometry changes.
+    const dl::image::img_t &resize(const dl::image::img_t &src, int dst_width, int dst_height);
+    // Copies the rectangle [x1, y1, x2, y2) of src, clipped to the frame, into
+    // the crop buffer. The crop buffer is reused by further crops until the
+    // arena is reset. A rectangle without pixels in the frame gives a 0 x 0
+    // image (see empty()), data is nullptr otherwise only if out of memory.
+    const dl::image::img_t &crop(const dl::image::img_t &src, int x1, int y1, int x2, int y2);
+
+    static bool empty(const dl::image::img_t &img) { return img.width == 0 || img.height == 0; }
+
+    // Maps a result from scaled/cropped coordinates back to the source image.
+    static void to_source(dl::detect::result_t &res, float scale_x, float scale_y, int offset_x, int offset_y);
+
+    std::list<dl::detect::result_t> results;
+
+private:
+    Arena *m_arena;
+    uint8_t *m_crop_buf;
+    size_t m_crop_buf_size;
+    uint32_t m_crop_generation;
+    dl::image::img_t m_resized;
+    dl::image::img_t m_cropped;
+
+    // Per destination column: left source column, right source column, weight of the right one (0..256)
+    std::vector<uint16_t> m_x0;
+    std::vector<uint16_t> m_x1;
+    std::vector<uint16_t> m_wx;
+    int m_src_width;
+    int m_dst_width;
+
+    void prepare_columns(int src_width, int dst_width);
+};
+
+} // namespace mp_esp_dl
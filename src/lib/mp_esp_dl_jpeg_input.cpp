@@ -0,0 +1,128 @@
+#include "mp_esp_dl_jpeg_input.hpp"
+#include "esp_jpeg_dec.h"
+#include "esp_log.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const char *TAG = "mp_esp_dl::JpegTensorLoader";
+
+namespace mp_esp_dl {
+
+JpegTensorLoader::JpegTensorLoader(const std::vector<float> &mean, const std::vector<float> &std) :
+    m_mean(mean), m_std(std), m_lut_exponent(0), m_lut_valid(false)
+{
+}
+
+void JpegTensorLoader::prepare_lut(int exponent)
+{
+    if (m_lut_valid && m_lut_exponent == exponent) {
+        return;
+    }
+    float inv_scale = ldexpf(1.0f, -exponent);
+    for (int ch = 0; ch < 3; ch++) {
+        for (int v = 0; v < 256; v++) {
+            int q = (int)roundf((v - m_mean[ch]) / m_std[ch] * inv_scale);
+            m_lut[ch][v] = (int8_t)std::min(std::max(q, -128), 127);
+        }
+    }
+    m_lut_exponent = exponent;
+    m_lut_valid = true;
+}
+
+esp_err_t JpegTensorLoader::load(
+    const uint8_t *jpeg, size_t jpeg_len, dl::TensorBase *input, Arena *arena, int *width, int *height)
+{
+    if (input->dtype != dl::DATA_TYPE_INT8 || input->shape.size() != 4 || input->shape[3] != 3) {
+        ESP_LOGE(TAG, "Only int8 NHWC input tensors with 3 channels are supported.");
+        return ESP_FAIL;
+    }
+    const int dst_height = input->shape[1];
+    const int dst_width = input->shape[2];
+    prepare_lut(input->exponent);
+
+    jpeg_dec_config_t config = DEFAULT_JPEG_DEC_CONFIG();
+    config.output_type = JPEG_PIXEL_FORMAT_RGB888;
+    config.block_enable = true;
+    jpeg_dec_handle_t dec = nullptr;
+    if (jpeg_dec_open(&config, &dec) != JPEG_ERR_OK) {
+        ESP_LOGE(TAG, "Failed to open the JPEG decoder.");
+        return ESP_FAIL;
+    }
+
+    esp_err_t ret = ESP_FAIL;
+    uint8_t *block = nullptr;
+    jpeg_dec_io_t io = {};
+    jpeg_dec_header_info_t info = {};
+    int block_len = 0;
+    int blocks = 0;
+    io.inbuf = (uint8_t *)jpeg;
+    io.inbuf_len = jpeg_len;
+    if (jpeg_dec_parse_header(dec, &io, &info) != JPEG_ERR_OK || jpeg_dec_get_outbuf_len(dec, &block_len) != JPEG_ERR_OK ||
+        jpeg_dec_get_process_count(dec, &blocks) != JPEG_ERR_OK || info.width <= 0 || info.height <= 0) {
+        ESP_LOGE(TAG, "Failed to parse the JPEG header.");
+        goto exit;
+    }
+    block = (uint8_t *)(arena ? arena->alloc(block_len) : jpeg_calloc_align(block_len, 16));
+    if (!block) {
+        ESP_LOGE(TAG, "Failed to allocate %d bytes.", block_len);
+        goto exit;
+    }
+
+    {
+        m_x.resize(dst_width);
+        for (int dx = 0; dx < dst_width; dx++) {
+            m_x[dx] = std::min((int)(((2 * dx + 1) * info.width) / (2 * dst_width)), info.width - 1);
+        }
+
+        // Every tensor row takes the source row nearest to its center. The
+        // source rows arrive in order, so each block fills the next few rows.
+        const int block_rows = block_len / (info.width * 3);
+        int8_t *dst = (int8_t *)input->data;
+        int dy = 0;
+        int block_y = 0;
+        io.outbuf = block;
+        for (int b = 0; b < blocks && dy < dst_height; b++) {
+            if (jpeg_dec_process(dec, &io) != JPEG_ERR_OK) {
+                ESP_LOGE(TAG, "Failed to decode the JPEG.");
+                goto exit;
+            }
+            for (; dy < dst_height; dy++) {
+                int sy = std::min(((2 * dy + 1) * info.height) / (2 * dst_height), info.height - 1);
+                if (sy >= block_y + block_rows) {
+                    break;
+                }
+                const uint8_t *row = block + (sy - block_y) * info.width * 3;
+                int8_t *out = dst + dy * dst_width * 3;
+                for (int dx = 0; dx < dst_width; dx++) {
+                    const uint8_t *p = row + m_x[dx] * 3;
+                    out[0] = m_lut[0][p[0]];
+                    out[1] = m_lut[1][p[1]];
+                    out[2] = m_lut[2][p[2]];
+                    out += 3;
+                }
+            }
+            block_y += block_rows;
+        }
+        if (dy < dst_height) {
+            ESP_LOGE(TAG, "JPEG ended before the input was filled.");
+            goto exit;
+        }
+    }
+    if (width) {
+        *width = info.width;
+    }
+    if (height) {
+        *height = info.height;
+    }
+    ret = ESP_OK;
+
+exit:
+    if (block && !arena) {
+        jpeg_free_align(block);
+    }
+    jpeg_dec_close(dec);
+    return ret;
+}
+
+} // namespace mp_esp_dl
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "dl_tensor_base.hpp"
+#include "esp_err.h"
+#include "mp_esp_dl_arena.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace mp_esp_dl {
+
+// Decodes a JPEG straight into the quantized input tensor of a model. The
+// decoder runs in block mode and hands out one MCU row at a time, which is
+// resized (nearest neighbour) and normalized into the tensor right away, so
+// no full RGB888 frame is ever held in memory.
+class JpegTensorLoader {
+public:
+    JpegTensorLoader(const std::vector<float> &mean, const std::vector<float> &std);
+
+    // Fills input, an int8 NHWC tensor with 3 channels, from the JPEG data.
+    // The decode buffer comes from arena if given, else from the heap. The
+    // size of the JPEG is returned in width and height if not nullptr.
+    esp_err_t load(const uint8_t *jpeg,
+                   size_t jpeg_len,
+                   dl::TensorBase *input,
+                   Arena *arena = nullptr,
+                   int *width = nullptr,
+                   int *height = nullptr);
+
+private:
+    std::vector<float> m_mean;
+    std::vector<float> m_std;
+    // (pixel - mean) / std quantized to the tensor exponent, per channel and value
+    int8_t m_lut[3][256];
+    int m_lut_exponent;
+    bool m_lut_valid;
+    // Source column per tensor column
+    std::vector<uint16_t> m_x;
+
+    void prepare_lut(int exponent);
+};
+
+} // namespace mp_esp_dl
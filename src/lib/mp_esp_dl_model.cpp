@@ -0,0 +1,81 @@
+#include "mp_esp_dl_model.hpp"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+extern "C" {
+    #include "mpfile.h"
+}
+
+static const char *TAG = "mp_esp_dl::ModelRunner";
+
+namespace mp_esp_dl {
+
+ModelRunner::ModelRunner(const char *address_or_label, fbs::model_location_type_t location, const char *model_name) :
+    m_model(nullptr), m_file_buf(nullptr)
+{
+    if (model_name) {
+        m_model = new dl::Model(address_or_label, model_name, location);
+    } else {
+        m_model = new dl::Model(address_or_label, location);
+    }
+    collect_tensors();
+}
+
+ModelRunner::ModelRunner(uint8_t *file_buf, const char *model_name) :
+    ModelRunner((const char *)file_buf, fbs::MODEL_LOCATION_IN_FLASH_RODATA, model_name)
+{
+    m_file_buf = file_buf;
+}
+
+ModelRunner::~ModelRunner()
+{
+    delete m_model;
+    heap_caps_free(m_file_buf);
+}
+
+// Uses the non-raising file functions: a raise would skip the cleanup and
+// leak the file and the PSRAM buffer
+ModelRunner *ModelRunner::from_file(const char *path, const char *model_name)
+{
+    mp_file_t *f = mp_try_open(path, "rb");
+    if (!f) {
+        ESP_LOGE(TAG, "Failed to open %s.", path);
+        return nullptr;
+    }
+    off_t size = mp_try_seek(f, 0, MP_SEEK_END);
+    if (size <= 0 || mp_try_seek(f, 0, MP_SEEK_SET) != 0) {
+        ESP_LOGE(TAG, "Failed to get the size of %s.", path);
+        mp_try_close(f);
+        return nullptr;
+    }
+
+    // The flatbuffers of the model are read in place, so keep them aligned
+    uint8_t *buf = (uint8_t *)heap_caps_aligned_alloc(16, size, MALLOC_CAP_SPIRAM);
+    if (!buf) {
+        ESP_LOGE(TAG, "Failed to allocate %d bytes.", (int)size);
+        mp_try_close(f);
+        return nullptr;
+    }
+    mp_int_t nbytes = mp_try_readinto(f, buf, size);
+    mp_try_close(f);
+    if (nbytes != size) {
+        ESP_LOGE(TAG, "Failed to read %s.", path);
+        heap_caps_free(buf);
+        return nullptr;
+    }
+    return new ModelRunner(buf, model_name);
+}
+
+void ModelRunner::collect_tensors()
+{
+    for (auto &it : m_model->get_inputs()) {
+        m_input_names.push_back(it.first);
+        m_inputs.push_back(it.second);
+    }
+    for (auto &it : m_model->get_outputs()) {
+        m_output_names.push_back(it.first);
+        m_outputs.push_back(it.second);
+    }
+}
+
+} // namespace mp_esp_dl
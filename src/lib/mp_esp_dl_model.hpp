@@ -0,0 +1,45 @@
+#pragma once
+
+#include "dl_model_base.hpp"
+#include "dl_tensor_base.hpp"
+#include "esp_err.h"
+#include <string>
+#include <vector>
+
+namespace mp_esp_dl {
+
+// Any .espdl model with its input and output tensors. The tensors are
+// allocated by the model at load time and stay resident between runs, so
+// callers can read and write them in place.
+class ModelRunner {
+public:
+    // The model is loaded from a flash partition label, or from the memory at
+    // address with MODEL_LOCATION_IN_FLASH_RODATA. model_name selects one
+    // model of a file with several models and may be nullptr.
+    ModelRunner(const char *address_or_label, fbs::model_location_type_t location, const char *model_name);
+    ~ModelRunner();
+
+    // Reads the model file from the MicroPython VFS into PSRAM and loads it from there.
+    static ModelRunner *from_file(const char *path, const char *model_name);
+
+    bool is_loaded() { return !m_inputs.empty() && !m_outputs.empty(); }
+    void run() { m_model->run(); }
+
+    const std::vector<std::string> &input_names() { return m_input_names; }
+    const std::vector<std::string> &output_names() { return m_output_names; }
+    const std::vector<dl::TensorBase *> &inputs() { return m_inputs; }
+    const std::vector<dl::TensorBase *> &outputs() { return m_outputs; }
+
+private:
+    dl::Model *m_model;
+    uint8_t *m_file_buf;
+    std::vector<std::string> m_input_names;
+    std::vector<std::string> m_output_names;
+    std::vector<dl::TensorBase *> m_inputs;
+    std::vector<dl::TensorBase *> m_outputs;
+
+    ModelRunner(uint8_t *file_buf, const char *model_name);
+    void collect_tensors();
+};
+
+} // namespace mp_esp_dl
@@ -0,0 +1,149 @@
+#include "mp_esp_dl_overlay.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace mp_esp_dl {
+
+// 5x7 font of ASCII 32 to 126, one byte per column, the least significant bit
+// is the top row
+static const uint8_t FONT[95][Overlay::FONT_WIDTH] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5f, 0x00, 0x00}, {0x00, 0x07, 0x00, 0x07, 0x00},
+    {0x14, 0x7f, 0x14, 0x7f, 0x14}, {0x24, 0x2a, 0x7f, 0x2a, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62},
+    {0x36, 0x49, 0x55, 0x22, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00}, {0x00, 0x1c, 0x22, 0x41, 0x00},
+    {0x00, 0x41, 0x22, 0x1c, 0x00}, {0x14, 0x08, 0x3e, 0x08, 0x14}, {0x08, 0x08, 0x3e, 0x08, 0x08},
+    {0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08}, {0x00, 0x60, 0x60, 0x00, 0x00},
+    {0x20, 0x10, 0x08, 0x04, 0x02}, {0x3e, 0x51, 0x49, 0x45, 0x3e}, {0x00, 0x42, 0x7f, 0x40, 0x00},
+    {0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4b, 0x31}, {0x18, 0x14, 0x12, 0x7f, 0x10},
+    {0x27, 0x45, 0x45, 0x45, 0x39}, {0x3c, 0x4a, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03},
+    {0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1e}, {0x00, 0x36, 0x36, 0x00, 0x00},
+    {0x00, 0x56, 0x36, 0x00, 0x00}, {0x08, 0x14, 0x22, 0x41, 0x00}, {0x14, 0x14, 0x14, 0x14, 0x14},
+    {0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x51, 0x09, 0x06}, {0x32, 0x49, 0x79, 0x41, 0x3e},
+    {0x7e, 0x11, 0x11, 0x11, 0x7e}, {0x7f, 0x49, 0x49, 0x49, 0x36}, {0x3e, 0x41, 0x41, 0x41, 0x22},
+    {0x7f, 0x41, 0x41, 0x22, 0x1c}, {0x7f, 0x49, 0x49, 0x49, 0x41}, {0x7f, 0x09, 0x09, 0x09, 0x01},
+    {0x3e, 0x41, 0x49, 0x49, 0x7a}, {0x7f, 0x08, 0x08, 0x08, 0x7f}, {0x00, 0x41, 0x7f, 0x41, 0x00},
+    {0x20, 0x40, 0x41, 0x3f, 0x01}, {0x7f, 0x08, 0x14, 0x22, 0x41}, {0x7f, 0x40, 0x40, 0x40, 0x40},
+    {0x7f, 0x02, 0x0c, 0x02, 0x7f}, {0x7f, 0x04, 0x08, 0x10, 0x7f}, {0x3e, 0x41, 0x41, 0x41, 0x3e},
+    {0x7f, 0x09, 0x09, 0x09, 0x06}, {0x3e, 0x41, 0x51, 0x21, 0x5e}, {0x7f, 0x09, 0x19, 0x29, 0x46},
+    {0x46, 0x49, 0x49, 0x49, 0x31}, {0x01, 0x01, 0x7f, 0x01, 0x01}, {0x3f, 0x40, 0x40, 0x40, 0x3f},
+    {0x1f, 0x20, 0x40, 0x20, 0x1f}, {0x3f, 0x40, 0x38, 0x40, 0x3f}, {0x63, 0x14, 0x08, 0x14, 0x63},
+    {0x07, 0x08, 0x70, 0x08, 0x07}, {0x61, 0x51, 0x49, 0x45, 0x43}, {0x00, 0x7f, 0x41, 0x41, 0x00},
+    {0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x7f, 0x00}, {0x04, 0x02, 0x01, 0x02, 0x04},
+    {0x40, 0x40, 0x40, 0x40, 0x40}, {0x00, 0x01, 0x02, 0x04, 0x00}, {0x20, 0x54, 0x54, 0x54, 0x78},
+    {0x7f, 0x48, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x20}, {0x38, 0x44, 0x44, 0x48, 0x7f},
+    {0x38, 0x54, 0x54, 0x54, 0x18}, {0x08, 0x7e, 0x09, 0x01, 0x02}, {0x0c, 0x52, 0x52, 0x52, 0x3e},
+    {0x7f, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7d, 0x40, 0x00}, {0x20, 0x40, 0x44, 0x3d, 0x00},
+    {0x7f, 0x10, 0x28, 0x44, 0x00}, {0x00, 0x41, 0x7f, 0x40, 0x00}, {0x7c, 0x04, 0x18, 0x04, 0x78},
+    {0x7c, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38}, {0x7c, 0x14, 0x14, 0x14, 0x08},
+    {0x08, 0x14, 0x14, 0x18, 0x7c}, {0x7c, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x20},
+    {0x04, 0x3f, 0x44, 0x40, 0x20}, {0x3c, 0x40, 0x40, 0x20, 0x7c}, {0x1c, 0x20, 0x40, 0x20, 0x1c},
+    {0x3c, 0x40, 0x30, 0x40, 0x3c}, {0x44, 0x28, 0x10, 0x28, 0x44}, {0x0c, 0x50, 0x50, 0x50, 0x3c},
+    {0x44, 0x64, 0x54, 0x4c, 0x44}, {0x00, 0x08, 0x36, 0x41, 0x00}, {0x00, 0x00, 0x7f, 0x00, 0x00},
+    {0x00, 0x41, 0x36, 0x08, 0x00}, {0x10, 0x08, 0x08, 0x10, 0x08},
+};
+
+Overlay::Overlay(const dl::image::img_t &img, bool big_endian) :
+    m_data((uint8_t *)img.data),
+    m_width(img.width),
+    m_height(img.height),
+    m_bytes(dl::image::get_pix_byte_size(img.pix_type)),
+    m_big_endian(big_endian)
+{
+}
+
+void Overlay::pixel_bytes(color_t color, uint8_t *pixel)
+{
+    if (m_bytes == 2) {
+        uint16_t v = ((color.r >> 3) << 11) | ((color.g >> 2) << 5) | (color.b >> 3);
+        pixel[m_big_endian ? 1 : 0] = v & 0xff;
+        pixel[m_big_endian ? 0 : 1] = v >> 8;
+    } else {
+        pixel[0] = color.r;
+        pixel[1] = color.g;
+        pixel[2] = color.b;
+    }
+}
+
+void Overlay::span(int x1, int x2, int y, const uint8_t *pixel)
+{
+    x1 = std::max(x1, 0);
+    x2 = std::min(x2, m_width);
+    if (x1 >= x2 || y < 0 || y >= m_height) {
+        return;
+    }
+    uint8_t *row = m_data + ((size_t)y * m_width + x1) * m_bytes;
+    const size_t len = (size_t)(x2 - x1) * m_bytes;
+    if (pixel[0] == pixel[1] && (m_bytes == 2 || pixel[1] == pixel[2])) {
+        memset(row, pixel[0], len);
+        return;
+    }
+    // One pixel, then the filled part is copied onto the rest doubling each time
+    memcpy(row, pixel, m_bytes);
+    for (size_t done = m_bytes; done < len; done *= 2) {
+        memcpy(row + done, row, std::min(done, len - done));
+    }
+}
+
+void Overlay::fill_rect(int x1, int y1, int x2, int y2, color_t color)
+{
+    uint8_t pixel[3];
+    pixel_bytes(color, pixel);
+    for (int y = std::max(y1, 0); y < std::min(y2, m_height); y++) {
+        span(x1, x2, y, pixel);
+    }
+}
+
+void Overlay::rect(int x1, int y1, int x2, int y2, int thickness, color_t color)
+{
+    uint8_t pixel[3];
+    pixel_bytes(color, pixel);
+    thickness = std::max(std::min({thickness, (x2 - x1 + 1) / 2, (y2 - y1 + 1) / 2}), 1);
+    for (int y = std::max(y1, 0); y < std::min(y2, m_height); y++) {
+        if (y < y1 + thickness || y >= y2 - thickness) {
+            span(x1, x2, y, pixel);
+        } else {
+            span(x1, x1 + thickness, y, pixel);
+            span(x2 - thickness, x2, y, pixel);
+        }
+    }
+}
+
+void Overlay::point(int x, int y, int radius, color_t color)
+{
+    fill_rect(x - radius, y - radius, x + radius + 1, y + radius + 1, color);
+}
+
+void Overlay::text(int x, int y, const char *str, size_t len, int scale, color_t color)
+{
+    uint8_t pixel[3];
+    pixel_bytes(color, pixel);
+    scale = std::max(scale, 1);
+    // Row by row over the whole string, runs of set font pixels become one span
+    for (int row = 0; row < FONT_HEIGHT; row++) {
+        for (int sy = 0; sy < scale; sy++) {
+            const int py = y + row * scale + sy;
+            if (py < 0 || py >= m_height) {
+                continue;
+            }
+            int run_start = -1;
+            int px = x;
+            for (size_t i = 0; i < len; i++) {
+                uint8_t c = str[i];
+                const uint8_t *glyph = FONT[(c >= 32 && c < 127 ? c : '?') - 32];
+                for (int col = 0; col <= FONT_WIDTH; col++, px += scale) {
+                    bool set = col < FONT_WIDTH && (glyph[col] >> row) & 1;
+                    if (set && run_start < 0) {
+                        run_start = px;
+                    } else if (!set && run_start >= 0) {
+                        span(run_start, px, py, pixel);
+                        run_start = -1;
+                    }
+                }
+                if (px >= m_width) {
+                    break;
+                }
+            }
+        }
+    }
+}
+
+} // namespace mp_esp_dl
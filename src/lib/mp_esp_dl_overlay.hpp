@@ -0,0 +1,48 @@
+#pragma once
+
+#include "dl_image_define.hpp"
+#include <cstddef>
+#include <cstdint>
+
+namespace mp_esp_dl {
+
+// Draws boxes, keypoints and text in place into RGB888 and RGB565 frames, so
+// an annotated frame can be encoded and streamed right away. Everything is
+// clipped to the frame and made of horizontal spans which are filled a row at
+// a time, with memset where the pixel bytes are all the same.
+class Overlay {
+public:
+    struct color_t {
+        uint8_t r, g, b;
+    };
+    static constexpr int FONT_WIDTH = 5;
+    static constexpr int FONT_HEIGHT = 7;
+
+    // RGB565 is little endian as in the input scaler unless big_endian
+    Overlay(const dl::image::img_t &img, bool big_endian = false);
+
+    // Fills [x1, x2) x [y1, y2)
+    void fill_rect(int x1, int y1, int x2, int y2, color_t color);
+    // Outline of [x1, x2) x [y1, y2), thickness pixels wide on the inside
+    void rect(int x1, int y1, int x2, int y2, int thickness, color_t color);
+    // Square of 2 * radius + 1 pixels around x, y
+    void point(int x, int y, int radius, color_t color);
+    // ASCII text in a 5x7 font with the top left corner at x, y, every font
+    // pixel scale x scale pixels; other characters are drawn as '?'
+    void text(int x, int y, const char *str, size_t len, int scale, color_t color);
+    // Size of text() with a column and a row of spacing around every character
+    static int text_width(size_t len, int scale) { return (int)len * (FONT_WIDTH + 1) * scale + scale; }
+    static int text_height(int scale) { return (FONT_HEIGHT + 2) * scale; }
+
+private:
+    uint8_t *m_data;
+    int m_width;
+    int m_height;
+    int m_bytes;
+    bool m_big_endian;
+
+    void pixel_bytes(color_t color, uint8_t *pixel);
+    void span(int x1, int x2, int y, const uint8_t *pixel);
+};
+
+} // namespace mp_esp_dl
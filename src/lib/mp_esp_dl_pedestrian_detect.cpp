@@ -0,0 +1,79 @@
+#include "mp_esp_dl_pedestrian_detect.hpp"
+#include "dl_detect_pico_postprocessor.hpp"
+#include "esp_log.h"
+
+#if CONFIG_PEDESTRIAN_DETECT_MODEL_IN_FLASH_RODATA
+extern const uint8_t pedestrian_detect_espdl[] asm("_binary_pedestrian_detect_espdl_start");
+static const char *path = (const char *)pedestrian_detect_espdl;
+#elif CONFIG_PEDESTRIAN_DETECT_MODEL_IN_FLASH_PARTITION
+static const char *path = "pedestrian_det";
+#else
+#if !defined(CONFIG_BSP_SD_MOUNT_POINT)
+#define CONFIG_BSP_SD_MOUNT_POINT "/sdcard"
+#endif
+#endif
+namespace pedestrian_detect {
+
+static const std::vector<float> s_mean = {0, 0, 0};
+static const std::vector<float> s_std = {1, 1, 1};
+
+Pico::Pico(const char *model_name) : m_jpeg_loader(s_mean, s_std)
+{
+#if !CONFIG_PEDESTRIAN_DETECT_MODEL_IN_SDCARD
+    m_model = new dl::Model(
+        path, model_name, static_cast<fbs::model_location_type_t>(CONFIG_PEDESTRIAN_DETECT_MODEL_LOCATION));
+#else
+    char sd_path[256];
+    snprintf(sd_path,
+             sizeof(sd_path),
+             "%s/%s/%s",
+             CONFIG_BSP_SD_MOUNT_POINT,
+             CONFIG_PEDESTRIAN_DETECT_MODEL_SDCARD_DIR,
+             model_name);
+    m_model = new dl::Model(sd_path, static_cast<fbs::model_location_type_t>(CONFIG_PEDESTRIAN_DETECT_MODEL_LOCATION));
+#endif
+    m_model->minimize();
+#if CONFIG_IDF_TARGET_ESP32P4
+    m_image_preprocessor =
+        new dl::image::ImagePreprocessor(m_model, s_mean, s_std, DL_IMAGE_CAP_RGB_SWAP | DL_IMAGE_CAP_RGB565_BIG_ENDIAN);
+#else
+    m_image_preprocessor = new dl::image::ImagePreprocessor(m_model, s_mean, s_std);
+#endif
+    m_postprocessor = new dl::detect::PicoPostprocessor(
+        m_model, 0.7f, 0.5f, 10, {{8, 8, 4, 4}, {16, 16, 8, 8}, {32, 32, 16, 16}});
+}
+
+std::list<dl::detect::result_t> *Pico::run_jpeg(const uint8_t *jpeg, size_t jpeg_len, mp_esp_dl::Arena *arena)
+{
+    dl::TensorBase *input = m_model->get_inputs().begin()->second;
+    int width, height;
+    if (m_jpeg_loader.load(jpeg, jpeg_len, input, arena, &width, &height) != ESP_OK) {
+        return nullptr;
+    }
+    m_model->run();
+    // The JPEG was resized to the whole input, as the image preprocessor does
+    // with a frame, so the boxes map back the same way
+    m_postprocessor->clear_result();
+    m_postprocessor->set_resize_scale_x((float)input->shape[2] / width);
+    m_postprocessor->set_resize_scale_y((float)input->shape[1] / height);
+    m_postprocessor->postprocess();
+    return &m_postprocessor->get_result(width, height);
+}
+
+} // namespace pedestrian_detect
+
+PedestrianDetector::PedestrianDetector(model_type_t model_type) : m_model(nullptr)
+{
+    switch (model_type) {
+    case model_type_t::PICO_S8_V1:
+        m_model = new pedestrian_detect::Pico("pedestrian_detect_pico_s8_v1.espdl");
+        break;
+    default:
+        ESP_LOGE("pedestrian_detect", "Unknown model type.");
+    }
+}
+
+PedestrianDetector::~PedestrianDetector()
+{
+    delete m_model;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "dl_detect_base.hpp"
+#include "dl_image_define.hpp"
+#include "mp_esp_dl_jpeg_input.hpp"
+#include <list>
+
+namespace pedestrian_detect {
+class Pico : public dl::detect::DetectImpl {
+public:
+    Pico(const char *model_name);
+
+    // Detects on a JPEG which is decoded straight into the input tensor. The
+    // boxes are in the coordinates of the JPEG. Returns nullptr on failure.
+    std::list<dl::detect::result_t> *run_jpeg(const uint8_t *jpeg, size_t jpeg_len, mp_esp_dl::Arena *arena = nullptr);
+
+private:
+    mp_esp_dl::JpegTensorLoader m_jpeg_loader;
+};
+} // namespace pedestrian_detect
+
+// The pedestrian detector of esp-dl, with the model owned here so JPEG input
+// can skip the RGB888 frame and the image preprocessor
+class PedestrianDetector : public dl::detect::Detect {
+public:
+    typedef enum {
+        PICO_S8_V1,
+    } model_type_t;
+    PedestrianDetector(model_type_t model_type = PICO_S8_V1);
+    ~PedestrianDetector() override;
+
+    std::list<dl::detect::result_t> &run(const dl::image::img_t &img) override { return m_model->run(img); }
+    std::list<dl::detect::result_t> *run_jpeg(const uint8_t *jpeg, size_t jpeg_len, mp_esp_dl::Arena *arena = nullptr)
+    {
+        return m_model->run_jpeg(jpeg, jpeg_len, arena);
+    }
+
+private:
+    pedestrian_detect::Pico *m_model;
+};
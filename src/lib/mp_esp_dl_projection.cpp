@@ -0,0 +1,286 @@
+#include "mp_esp_dl_projection.hpp"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+extern "C" {
+    #include "mpfile.h"
+}
+
+static const char *TAG = "mp_esp_dl::recognition::Projection";
+
+static const char PROJECTION_MAGIC[4] = {'E', 'D', 'L', 'P'};
+static const uint16_t PROJECTION_VERSION = 1;
+// Subspace iterations of train(). The leading components of face embeddings
+// are well separated, more iterations did not change the search results.
+static constexpr int TRAIN_ITERATIONS = 10;
+
+static inline float dot(const float *a, const float *b, int len)
+{
+    float sum = 0;
+    for (int i = 0; i < len; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+// Modified Gram-Schmidt on the rows. Rows which are linearly dependent on the
+// ones before are set to zero, their coordinate is then always 0.
+static void orthonormalize(float *rows, int count, int len)
+{
+    for (int j = 0; j < count; j++) {
+        float *row = rows + j * len;
+        for (int k = 0; k < j; k++) {
+            const float *prev = rows + k * len;
+            float d = dot(row, prev, len);
+            for (int i = 0; i < len; i++) {
+                row[i] -= d * prev[i];
+            }
+        }
+        float norm = std::sqrt(dot(row, row, len));
+        float scale = norm > 1e-6f ? 1.0f / norm : 0.0f;
+        for (int i = 0; i < len; i++) {
+            row[i] *= scale;
+        }
+    }
+}
+
+namespace mp_esp_dl {
+namespace recognition {
+
+Projection::Projection() :
+    m_feat_len(0),
+    m_dims(0),
+    m_candidates(0),
+    m_mean(nullptr),
+    m_rows(nullptr),
+    m_mean_proj(nullptr)
+{
+}
+
+Projection::~Projection()
+{
+    clear();
+}
+
+void Projection::clear()
+{
+    heap_caps_free(m_mean);
+    heap_caps_free(m_rows);
+    heap_caps_free(m_mean_proj);
+    m_mean = nullptr;
+    m_rows = nullptr;
+    m_mean_proj = nullptr;
+    m_dims = 0;
+    m_candidates = 0;
+}
+
+void Projection::swap(Projection &other)
+{
+    std::swap(m_feat_len, other.m_feat_len);
+    std::swap(m_dims, other.m_dims);
+    std::swap(m_candidates, other.m_candidates);
+    std::swap(m_mean, other.m_mean);
+    std::swap(m_rows, other.m_rows);
+    std::swap(m_mean_proj, other.m_mean_proj);
+}
+
+esp_err_t Projection::allocate(int feat_len, int dims)
+{
+    clear();
+    m_mean = (float *)heap_caps_malloc(feat_len * sizeof(float), MALLOC_CAP_SPIRAM);
+    m_rows = (float *)heap_caps_malloc(dims * feat_len * sizeof(float), MALLOC_CAP_SPIRAM);
+    m_mean_proj = (float *)heap_caps_malloc(dims * sizeof(float), MALLOC_CAP_SPIRAM);
+    if (!m_mean || !m_rows || !m_mean_proj) {
+        ESP_LOGE(TAG, "Failed to allocate projection.");
+        clear();
+        return ESP_ERR_NO_MEM;
+    }
+    m_feat_len = feat_len;
+    m_dims = dims;
+    return ESP_OK;
+}
+
+void Projection::update_mean_proj()
+{
+    for (int j = 0; j < m_dims; j++) {
+        m_mean_proj[j] = dot(m_rows + j * m_feat_len, m_mean, m_feat_len);
+    }
+}
+
+esp_err_t Projection::train(const std::list<database_feat> &feats, int feat_len, int dims, int candidates)
+{
+    if (dims < 1 || dims > MAX_DIMS || dims >= feat_len || candidates < 1) {
+        ESP_LOGE(TAG, "Invalid projection size.");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ((int)feats.size() <= dims) {
+        ESP_LOGE(TAG, "A projection to %d dims needs more than %d faces.", dims, dims);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    float *mean = (float *)heap_caps_calloc(feat_len, sizeof(float), MALLOC_CAP_SPIRAM);
+    float *rows = (float *)heap_caps_malloc(dims * feat_len * sizeof(float), MALLOC_CAP_SPIRAM);
+    float *next = (float *)heap_caps_malloc(dims * feat_len * sizeof(float), MALLOC_CAP_SPIRAM);
+    float *centered = (float *)heap_caps_malloc(feat_len * sizeof(float), MALLOC_CAP_SPIRAM);
+    if (!mean || !rows || !next || !centered) {
+        ESP_LOGE(TAG, "Failed to allocate projection.");
+        heap_caps_free(mean);
+        heap_caps_free(rows);
+        heap_caps_free(next);
+        heap_caps_free(centered);
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (const auto &feat : feats) {
+        for (int i = 0; i < feat_len; i++) {
+            mean[i] += feat.feat[i];
+        }
+    }
+    for (int i = 0; i < feat_len; i++) {
+        mean[i] /= feats.size();
+    }
+
+    // Deterministic start, so the same gallery always gives the same projection
+    uint32_t seed = 1;
+    for (int i = 0; i < dims * feat_len; i++) {
+        seed = seed * 1103515245 + 12345;
+        rows[i] = ((seed >> 16) & 0x7fff) / 16384.0f - 1.0f;
+    }
+    orthonormalize(rows, dims, feat_len);
+
+    // rows <- orth(C rows) with the covariance C = sum (x - mean)(x - mean)^T,
+    // computed one record at a time without forming C
+    float t[MAX_DIMS];
+    for (int iter = 0; iter < TRAIN_ITERATIONS; iter++) {
+        memset(next, 0, dims * feat_len * sizeof(float));
+        for (const auto &feat : feats) {
+            for (int i = 0; i < feat_len; i++) {
+                centered[i] = feat.feat[i] - mean[i];
+            }
+            for (int j = 0; j < dims; j++) {
+                t[j] = dot(rows + j * feat_len, centered, feat_len);
+            }
+            for (int j = 0; j < dims; j++) {
+                float *row = next + j * feat_len;
+                for (int i = 0; i < feat_len; i++) {
+                    row[i] += t[j] * centered[i];
+                }
+            }
+        }
+        orthonormalize(next, dims, feat_len);
+        std::swap(rows, next);
+    }
+    heap_caps_free(next);
+    heap_caps_free(centered);
+
+    clear();
+    m_mean = mean;
+    m_rows = rows;
+    m_mean_proj = (float *)heap_caps_malloc(dims * sizeof(float), MALLOC_CAP_SPIRAM);
+    if (!m_mean_proj) {
+        ESP_LOGE(TAG, "Failed to allocate projection.");
+        clear();
+        return ESP_ERR_NO_MEM;
+    }
+    m_feat_len = feat_len;
+    m_dims = dims;
+    m_candidates = candidates;
+    update_mean_proj();
+    ESP_LOGI(TAG, "Trained projection to %d dims on %d faces.", dims, (int)feats.size());
+    return ESP_OK;
+}
+
+esp_err_t Projection::load(const char *path, int feat_len)
+{
+    clear();
+    if (!mp_isfile(path)) {
+        return ESP_OK;
+    }
+    mp_file_t *f = mp_try_open(path, "rb");
+    if (!f) {
+        ESP_LOGE(TAG, "Failed to open projection.");
+        return ESP_FAIL;
+    }
+    projection_header hdr;
+    mp_int_t size = mp_try_readinto(f, &hdr, sizeof(hdr));
+    if (size == 0) {
+        // Cleared projection
+        mp_try_close(f);
+        return ESP_OK;
+    }
+    if (size != sizeof(hdr) || memcmp(hdr.magic, PROJECTION_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.version != PROJECTION_VERSION || hdr.dims < 1 || hdr.dims > MAX_DIMS) {
+        ESP_LOGE(TAG, "Invalid projection file.");
+        mp_try_close(f);
+        return ESP_FAIL;
+    }
+    if (hdr.feat_len != feat_len) {
+        ESP_LOGE(TAG, "Projection was made for another feature model.");
+        mp_try_close(f);
+        return ESP_FAIL;
+    }
+    esp_err_t ret = allocate(feat_len, hdr.dims);
+    if (ret != ESP_OK) {
+        mp_try_close(f);
+        return ret;
+    }
+    mp_int_t mean_size = feat_len * sizeof(float);
+    mp_int_t rows_size = hdr.dims * feat_len * sizeof(float);
+    bool ok = mp_try_readinto(f, m_mean, mean_size) == mean_size && mp_try_readinto(f, m_rows, rows_size) == rows_size;
+    mp_try_close(f);
+    if (!ok) {
+        ESP_LOGE(TAG, "Failed to read projection.");
+        clear();
+        return ESP_FAIL;
+    }
+    m_candidates = hdr.candidates;
+    update_mean_proj();
+    ESP_LOGI(TAG, "Loaded projection to %d dims.", m_dims);
+    return ESP_OK;
+}
+
+esp_err_t Projection::save(const char *path)
+{
+    mp_file_t *f = mp_try_open(path, "wb");
+    if (!f) {
+        ESP_LOGE(TAG, "Failed to open projection.");
+        return ESP_FAIL;
+    }
+    // An empty file marks a cleared projection, the file API cannot remove it
+    if (empty()) {
+        mp_try_close(f);
+        return ESP_OK;
+    }
+    projection_header hdr;
+    memcpy(hdr.magic, PROJECTION_MAGIC, sizeof(hdr.magic));
+    hdr.version = PROJECTION_VERSION;
+    hdr.feat_len = m_feat_len;
+    hdr.dims = m_dims;
+    hdr.candidates = m_candidates;
+    mp_int_t mean_size = m_feat_len * sizeof(float);
+    mp_int_t rows_size = m_dims * m_feat_len * sizeof(float);
+    bool ok = mp_try_write(f, &hdr, sizeof(hdr)) == sizeof(hdr) && mp_try_write(f, m_mean, mean_size) == mean_size &&
+              mp_try_write(f, m_rows, rows_size) == rows_size;
+    mp_try_close(f);
+    if (!ok) {
+        ESP_LOGE(TAG, "Failed to write projection.");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+float Projection::project(const float *feat, float *out) const
+{
+    float bias = 0;
+    for (int j = 0; j < m_dims; j++) {
+        out[j] = dot(m_rows + j * m_feat_len, feat, m_feat_len) - m_mean_proj[j];
+        bias += out[j] * m_mean_proj[j];
+    }
+    return bias;
+}
+
+} // namespace recognition
+} // namespace mp_esp_dl
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "dl_recognition_define.hpp"
+#include "esp_err.h"
+#include <cstdint>
+#include <list>
+#include <vector>
+
+namespace mp_esp_dl {
+namespace recognition {
+
+// Linear projection of embeddings onto their main principal components, used
+// for a coarse first pass over a face database. With the rows of W
+// orthonormal and a = W(x - mean), b = W(q - mean), the dot product of the
+// reconstructions of x and q is
+//   x'.q' = a.b + a.(W mean) + b.(W mean) + mean.mean
+// so for a fixed query a.b + a.(W mean) ranks the records like x'.q'.
+// project() returns that bias term next to the coordinates.
+//
+// The projection is stored next to the database as <db>.pca:
+//   projection_header, mean (feat_len floats), W (dims x feat_len floats)
+class Projection {
+public:
+    static constexpr int MAX_DIMS = 256;
+
+    Projection();
+    ~Projection();
+
+    bool empty() const { return m_dims == 0; }
+    int dims() const { return m_dims; }
+    int candidates() const { return m_candidates; }
+
+    // Principal components of feats by subspace iteration, candidates is the
+    // number of coarse matches which are scored at full dimension
+    esp_err_t train(const std::list<database_feat> &feats, int feat_len, int dims, int candidates);
+    // A missing or empty file leaves the projection empty
+    esp_err_t load(const char *path, int feat_len);
+    esp_err_t save(const char *path);
+    void clear();
+    void swap(Projection &other);
+
+    // Writes dims() coordinates of feat to out and returns the bias term
+    float project(const float *feat, float *out) const;
+
+private:
+    struct projection_header {
+        char magic[4];
+        uint16_t version;
+        uint16_t feat_len;
+        uint16_t dims;
+        uint16_t candidates;
+    };
+
+    int m_feat_len;
+    int m_dims;
+    int m_candidates;
+    float *m_mean;          // feat_len
+    float *m_rows;          // dims x feat_len, orthonormal
+    float *m_mean_proj;     // W mean, dims
+
+    esp_err_t allocate(int feat_len, int dims);
+    void update_mean_proj();
+};
+
+} // namespace recognition
+} // namespace mp_esp_dl
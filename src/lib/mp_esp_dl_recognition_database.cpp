@@ -1,4 +1,7 @@
 #include "mp_esp_dl_recognition_database.hpp"
+#include "mp_esp_dl_trace.h"
+#include "esp_timer.h"
+#include <cmath>
 #include <unistd.h>
 
 // extern "C" {
@@ -11,16 +14,38 @@ static const char *TAG = "mp_esp_dl::recognition::DataBase";
 
 namespace mp_esp_dl {
 namespace recognition {
-DataBase::DataBase(const char *db_path, int feat_len)
+DataBase::DataBase(const char *db_path, int feat_len, bool async_load) :
+    m_log_ready(false),
+    m_seq(0),
+    m_log_base(0),
+    m_log_end(0),
+    m_meta{0, 0, (uint16_t)feat_len},
+    m_loading(false),
+    m_load_next(0),
+    m_load_offset(0),
+    m_identity_candidates(0)
 {
     assert(db_path);
     int length = strlen(db_path) + 1;
     m_db_path = (char *)malloc(sizeof(char) * length);
     memcpy(m_db_path, db_path, length);
-    if (mp_isfile(db_path)) {
-        load_database_from_storage(feat_len);
-    } else {
+    m_log_path = (char *)malloc(length + 4);
+    snprintf(m_log_path, length + 4, "%s.log", db_path);
+    m_delta_path = (char *)malloc(length + 6);
+    snprintf(m_delta_path, length + 6, "%s.delta", db_path);
+    m_pca_path = (char *)malloc(length + 4);
+    snprintf(m_pca_path, length + 4, "%s.pca", db_path);
+    m_faces_path = (char *)malloc(length + 6);
+    snprintf(m_faces_path, length + 6, "%s.faces", db_path);
+    if (!mp_isfile(db_path)) {
         create_empty_database_in_storage(feat_len);
+        return;
+    }
+    m_projection.load(m_pca_path, feat_len);
+    if (async_load) {
+        begin_async_load(feat_len);
+    } else {
+        load_database_from_storage(feat_len);
     }
 }
 
@@ -28,12 +53,16 @@ DataBase::~DataBase()
 {
     clear_all_feats_in_memory();
     free(m_db_path);
+    free(m_log_path);
+    free(m_delta_path);
+    free(m_pca_path);
+    free(m_faces_path);
 }
 
 esp_err_t DataBase::create_empty_database_in_storage(int feat_len)
 {   
     ESP_LOGI(TAG, "Creating empty database in storage at location %s with feture len %d.", m_db_path, feat_len);
-    mp_file_t *f = mp_open(m_db_path, "wb");
+    mp_file_t *f = mp_try_open(m_db_path, "wb");
     if (!f) {
         ESP_LOGE(TAG, "Failed to open db.");
         return ESP_FAIL;
@@ -41,13 +70,13 @@ esp_err_t DataBase::create_empty_database_in_storage(int feat_len)
     m_meta.num_feats_total = 0;
     m_meta.num_feats_valid = 0;
     m_meta.feat_len = feat_len;
-    mp_int_t nbytes = mp_write(f, &m_meta, sizeof(mp_esp_dl::recognition::database_meta));
+    mp_int_t nbytes = mp_try_write(f, &m_meta, sizeof(mp_esp_dl::recognition::database_meta));
     if (nbytes != sizeof(mp_esp_dl::recognition::database_meta)) {
         ESP_LOGE(TAG, "Failed to write database meta.");
-        mp_close(f);
+        mp_try_close(f);
         return ESP_FAIL;
     }
-    mp_close(f);
+    mp_try_close(f);
     return ESP_OK;
 }
 
@@ -57,93 +86,207 @@ void DataBase::clear_all_feats_in_memory()
         heap_caps_free(it->feat);
     }
     m_feats.clear();
+    m_coarse_feats.clear();
+    m_coarse.clear();
+    m_identities.clear();
+    m_centroids.clear();
     m_meta.num_feats_total = 0;
     m_meta.num_feats_valid = 0;
 }
 
-esp_err_t DataBase::load_database_from_storage(int feat_len)
+esp_err_t DataBase::read_meta(mp_file_t *f, int feat_len)
 {
-    ESP_LOGI(TAG, "Loading database from storage.");
-    clear_all_feats_in_memory();
-
-    // Öffne die Datei mit `mp_open`
-    mp_file_t *f = mp_open(m_db_path, "rb");
-    if (!f) {
-        ESP_LOGE(TAG, "Failed to open db.");
-        return ESP_FAIL;
-    }
-
     // Lese die Metadaten aus der Datei
-    mp_int_t size = mp_readinto(f, &m_meta, sizeof(database_meta));
+    mp_int_t size = mp_try_readinto(f, &m_meta, sizeof(database_meta));
     if (size != sizeof(database_meta)) {
         ESP_LOGE(TAG, "Failed to read database meta.");
-        mp_close(f);
         return ESP_FAIL;
     }
 
     // Überprüfe die Feature-Länge
     if (feat_len != m_meta.feat_len) {
         ESP_LOGE(TAG, "Feature len in storage does not match feature len in db.");
-        mp_close(f);
         return ESP_FAIL;
     }
+    return ESP_OK;
+}
 
+esp_err_t DataBase::read_next_feat(mp_file_t *f, std::list<database_feat> &feats)
+{
+    // Lese die Feature-ID
     uint16_t id;
-    for (int i = 0; i < m_meta.num_feats_total; i++) {
-        // Lese die Feature-ID
-        size = mp_readinto(f, &id, sizeof(uint16_t));
-        if (size != sizeof(uint16_t)) {
-            ESP_LOGE(TAG, "Failed to read feature id.");
-            mp_close(f);
+    mp_int_t size = mp_try_readinto(f, &id, sizeof(uint16_t));
+    if (size != sizeof(uint16_t)) {
+        ESP_LOGE(TAG, "Failed to read feature id.");
+        return ESP_FAIL;
+    }
+
+    // Überspringe ungültige IDs
+    if (id == 0) {
+        if (mp_try_seek(f, sizeof(float) * m_meta.feat_len + MAX_NAME_LENGTH, SEEK_CUR) < 0) {
+            ESP_LOGE(TAG, "Failed to seek db file.");
             return ESP_FAIL;
         }
+        return ESP_OK;
+    }
 
-        // Überspringe ungültige IDs
-        if (id == 0) {
-            if (mp_seek(f, sizeof(float) * m_meta.feat_len + MAX_NAME_LENGTH, SEEK_CUR) < 0) {
-                ESP_LOGE(TAG, "Failed to seek db file.");
-                mp_close(f);
-                return ESP_FAIL;
-            }
-            continue;
-        }
+    // Lese das Feature
+    float *feat = (float *)heap_caps_malloc(m_meta.feat_len * sizeof(float), MALLOC_CAP_SPIRAM);
+    if (!feat) {
+        ESP_LOGE(TAG, "Failed to allocate feature.");
+        return ESP_FAIL;
+    }
+    size = mp_try_readinto(f, feat, sizeof(float) * m_meta.feat_len);
+    if (size != (mp_int_t)(sizeof(float) * m_meta.feat_len)) {
+        ESP_LOGE(TAG, "Failed to read feature data.");
+        heap_caps_free(feat);
+        return ESP_FAIL;
+    }
 
-        // Lese das Feature
-        float *feat = (float *)heap_caps_malloc(m_meta.feat_len * sizeof(float), MALLOC_CAP_SPIRAM);
-        size = mp_readinto(f, feat, sizeof(float) * m_meta.feat_len);
-        if (size != (mp_int_t)(sizeof(float) * m_meta.feat_len)) {
-            ESP_LOGE(TAG, "Failed to read feature data.");
-            heap_caps_free(feat);
-            mp_close(f);
-            return ESP_FAIL;
-        }
+    // Lese den Namen
+    char name[MAX_NAME_LENGTH];
+    size = mp_try_readinto(f, name, MAX_NAME_LENGTH);
+    if (size != MAX_NAME_LENGTH) {
+        ESP_LOGE(TAG, "Failed to read name.");
+        heap_caps_free(feat);
+        return ESP_FAIL;
+    }
 
-        // Lese den Namen
-        char name[MAX_NAME_LENGTH];
-        size = mp_readinto(f, name, MAX_NAME_LENGTH);
-        if (size != MAX_NAME_LENGTH) {
-            ESP_LOGE(TAG, "Failed to read name.");
-            heap_caps_free(feat);
-            mp_close(f);
+    // Füge das Feature zur Liste hinzu
+    feats.emplace_back(id, feat, name);
+    return ESP_OK;
+}
+
+esp_err_t DataBase::load_database_from_storage(int feat_len)
+{
+    MP_DL_TRACE_SCOPE("db_load");
+    ESP_LOGI(TAG, "Loading database from storage.");
+    clear_all_feats_in_memory();
+
+    // Öffne die Datei mit `mp_open`
+    mp_file_t *f = mp_try_open(m_db_path, "rb");
+    if (!f) {
+        ESP_LOGE(TAG, "Failed to open db.");
+        return ESP_FAIL;
+    }
+
+    if (read_meta(f, feat_len) != ESP_OK) {
+        mp_try_close(f);
+        return ESP_FAIL;
+    }
+
+    for (int i = 0; i < m_meta.num_feats_total; i++) {
+        if (read_next_feat(f, m_feats) != ESP_OK) {
+            mp_try_close(f);
             return ESP_FAIL;
         }
-
-        // Füge das Feature zur internen Liste hinzu
-        m_feats.emplace_back(id, feat, name);
     }
 
     // Überprüfe die Anzahl der gültigen Features
     if (m_feats.size() != m_meta.num_feats_valid) {
         ESP_LOGE(TAG, "Incorrect valid feature num.");
-        mp_close(f);
+        mp_try_close(f);
         return ESP_FAIL;
     }
+    rebuild_index();
 
     // Schließe die Datei
-    mp_close(f);
+    mp_try_close(f);
     return ESP_OK;
 }
 
+esp_err_t DataBase::begin_async_load(int feat_len)
+{
+    ESP_LOGI(TAG, "Loading database from storage in the background.");
+    clear_all_feats_in_memory();
+
+    mp_file_t *f = mp_try_open(m_db_path, "rb");
+    if (!f) {
+        ESP_LOGE(TAG, "Failed to open db.");
+        return ESP_FAIL;
+    }
+    esp_err_t ret = read_meta(f, feat_len);
+    mp_try_close(f);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    m_load_next = 0;
+    m_load_offset = sizeof(database_meta);
+    m_loading = m_meta.num_feats_total > 0;
+    return ESP_OK;
+}
+
+esp_err_t DataBase::load_chunk(int max_records)
+{
+    MP_DL_TRACE_SCOPE("db_load_chunk");
+    std::unique_lock<std::mutex> writer(m_write_mutex, std::defer_lock);
+    lock_releasing_gil(writer);
+    if (!m_loading) {
+        return ESP_OK;
+    }
+
+    // The file is opened per chunk, the file object must not outlive the call
+    mp_file_t *f = mp_try_open(m_db_path, "rb");
+    if (!f) {
+        ESP_LOGE(TAG, "Failed to open db.");
+        m_loading = false;
+        return ESP_FAIL;
+    }
+    if (mp_try_seek(f, m_load_offset, SEEK_SET) < 0) {
+        ESP_LOGE(TAG, "Failed to seek db file.");
+        mp_try_close(f);
+        m_loading = false;
+        return ESP_FAIL;
+    }
+
+    // Read without the lock, queries only wait for the records to be appended
+    std::list<database_feat> chunk;
+    esp_err_t ret = ESP_OK;
+    int end = std::min(m_load_next + max_records, (int)m_meta.num_feats_total);
+    for (; m_load_next < end; m_load_next++) {
+        if (read_next_feat(f, chunk) != ESP_OK) {
+            ret = ESP_FAIL;
+            break;
+        }
+    }
+    m_load_offset = mp_try_tell(f);
+    mp_try_close(f);
+
+    std::unique_lock<std::shared_mutex> lock(m_lock, std::defer_lock);
+    lock_releasing_gil(lock);
+    if (!chunk.empty()) {
+        auto first = chunk.begin();
+        m_feats.splice(m_feats.end(), chunk);
+        for (auto it = first; it != m_feats.end(); it++) {
+            index_add(*it);
+        }
+    }
+    if (ret != ESP_OK) {
+        m_loading = false;
+        return ret;
+    }
+    if (m_load_next < m_meta.num_feats_total) {
+        return ESP_OK;
+    }
+    m_loading = false;
+    if (m_feats.size() != m_meta.num_feats_valid) {
+        ESP_LOGE(TAG, "Incorrect valid feature num.");
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Database loaded, %d features.", (int)m_feats.size());
+    return ESP_OK;
+}
+
+esp_err_t DataBase::finish_loading()
+{
+    if (!m_loading) {
+        return ESP_OK;
+    }
+    // More than what is left, the loader stops at num_feats_total
+    return load_chunk(m_meta.num_feats_total);
+}
+
 esp_err_t DataBase::enroll_feat(dl::TensorBase *feat, const char *name, uint16_t *new_id)
 {
     ESP_LOGI(TAG, "Enrolling feature.");
@@ -155,88 +298,135 @@ esp_err_t DataBase::enroll_feat(dl::TensorBase *feat, const char *name, uint16_t
         ESP_LOGE(TAG, "Feature len to enroll does not match feature len in db.");
         return ESP_FAIL;
     }
+    return enroll_feat((const float *)feat->data, name, new_id);
+}
 
+esp_err_t DataBase::enroll_feat(const float *feat, const char *name, uint16_t *new_id)
+{
+    // The loader reads up to num_feats_total, so finish it before a record is appended
+    finish_loading();
+    open_log();
+
+    // Writers are serialized, readers only wait while the list is updated
+    std::unique_lock<std::mutex> writer(m_write_mutex, std::defer_lock);
+    lock_releasing_gil(writer);
+    return enroll_locked(feat, name, new_id);
+}
+
+esp_err_t DataBase::enroll_locked(const float *feat, const char *name, uint16_t *new_id)
+{
+    MP_DL_TRACE_SCOPE("db_enroll");
     // Kopiere das Feature in den Speicher
     float *feat_copy = (float *)heap_caps_malloc(m_meta.feat_len * sizeof(float), MALLOC_CAP_SPIRAM);
-    memcpy(feat_copy, feat->data, feat->get_bytes());
+    if (!feat_copy) {
+        ESP_LOGE(TAG, "Failed to allocate feature.");
+        return ESP_FAIL;
+    }
+    memcpy(feat_copy, feat, m_meta.feat_len * sizeof(float));
 
     // Neue ID generieren
     uint16_t id = m_meta.num_feats_total + 1;
+    database_feat record(id, feat_copy, name);
+    database_meta meta;
 
     // Füge das Feature zur internen Liste hinzu
-    m_feats.emplace_back(id, feat_copy, name);
-    m_meta.num_feats_total++;
-    m_meta.num_feats_valid++;
+    {
+        std::unique_lock<std::shared_mutex> lock(m_lock, std::defer_lock);
+        lock_releasing_gil(lock);
+        m_feats.push_back(record);
+        index_add(m_feats.back());
+        m_meta.num_feats_total++;
+        m_meta.num_feats_valid++;
+        meta = m_meta;
+    }
 
     // Öffne die Datei mit `mp_open`
-    mp_file_t *f = mp_open(m_db_path, "rb+");
+    mp_file_t *f = mp_try_open(m_db_path, "rb+");
     if (!f) {
         ESP_LOGE(TAG, "Failed to open db.");
         return ESP_FAIL;
     }
 
     // Schreibe die Metadaten in die Datei
-    mp_int_t size = mp_write(f, &m_meta, sizeof(mp_esp_dl::recognition::database_meta));
+    mp_int_t size = mp_try_write(f, &meta, sizeof(mp_esp_dl::recognition::database_meta));
     if (size != sizeof(mp_esp_dl::recognition::database_meta)) {
         ESP_LOGE(TAG, "Failed to write database meta.");
-        mp_close(f);
+        mp_try_close(f);
         return ESP_FAIL;
     }
 
     // Setze die Position ans Ende der Datei
-    if (mp_seek(f, 0, SEEK_END) < 0) {
+    if (mp_try_seek(f, 0, SEEK_END) < 0) {
         ESP_LOGE(TAG, "Failed to seek db file.");
-        mp_close(f);
+        mp_try_close(f);
         return ESP_FAIL;
     }
 
     // Schreibe die Feature-ID in die Datei
-    size = mp_write(f, &m_feats.back().id, sizeof(uint16_t));
+    size = mp_try_write(f, &record.id, sizeof(uint16_t));
     if (size != sizeof(uint16_t)) {
         ESP_LOGE(TAG, "Failed to write feature id.");
-        mp_close(f);
+        mp_try_close(f);
         return ESP_FAIL;
     }
 
     // Schreibe das Feature in die Datei
-    size = mp_write(f, m_feats.back().feat, sizeof(float) * m_meta.feat_len);
-    if (size != (mp_int_t)(sizeof(float) * m_meta.feat_len)) {
+    size = mp_try_write(f, record.feat, sizeof(float) * meta.feat_len);
+    if (size != (mp_int_t)(sizeof(float) * meta.feat_len)) {
         ESP_LOGE(TAG, "Failed to write feature.");
-        mp_close(f);
+        mp_try_close(f);
         return ESP_FAIL;
     }
 
     // Schreibe den Namen in die Datei
-    size = mp_write(f, m_feats.back().name, MAX_NAME_LENGTH);
+    size = mp_try_write(f, record.name, MAX_NAME_LENGTH);
     if (size != MAX_NAME_LENGTH) {
         ESP_LOGE(TAG, "Failed to write name.");
-        mp_close(f);
+        mp_try_close(f);
         return ESP_FAIL;
     }
 
-    mp_close(f);
+    mp_try_close(f);
     
     // Setze die neue ID
     *new_id = id;
     
-    return ESP_OK;
+    return append_change(CHANGE_ENROLL, id, record.feat, record.name);
 }
 
 esp_err_t DataBase::delete_feat(uint16_t id)
 {
+    finish_loading();
+    open_log();
+
+    std::unique_lock<std::mutex> writer(m_write_mutex, std::defer_lock);
+    lock_releasing_gil(writer);
+    return delete_locked(id);
+}
+
+esp_err_t DataBase::delete_locked(uint16_t id)
+{
+    MP_DL_TRACE_SCOPE("db_delete");
     bool invalid_id = true;
+    database_meta meta;
 
     // Entferne das Feature aus der internen Liste
-    for (auto it = m_feats.begin(); it != m_feats.end();) {
-        if (it->id != id) {
-            it++;
-        } else {
-            heap_caps_free(it->feat);
-            it = m_feats.erase(it);
-            m_meta.num_feats_valid--;
-            invalid_id = false;
-            break;
+    {
+        std::unique_lock<std::shared_mutex> lock(m_lock, std::defer_lock);
+        lock_releasing_gil(lock);
+        for (auto it = m_feats.begin(); it != m_feats.end();) {
+            if (it->id != id) {
+                it++;
+            } else {
+                index_remove(*it);
+                heap_caps_free(it->feat);
+                it = m_feats.erase(it);
+                m_meta.num_feats_valid--;
+                invalid_id = false;
+                break;
+            }
         }
+        meta = m_meta;
     }
 
     if (invalid_id) {
@@ -245,63 +435,115 @@ esp_err_t DataBase::delete_feat(uint16_t id)
     }
 
     // Öffne die Datei mit `mp_open`
-    mp_file_t *f = mp_open(m_db_path, "rb+");
+    mp_file_t *f = mp_try_open(m_db_path, "rb+");
     if (!f) {
         ESP_LOGE(TAG, "Failed to open db.");
         return ESP_FAIL;
     }
 
     // Berechne den Offset für die zu löschende ID
-    off_t offset = sizeof(mp_esp_dl::recognition::database_meta) +
-                   (sizeof(uint16_t) + sizeof(float) * m_meta.feat_len + MAX_NAME_LENGTH) * (id - 1);
+    off_t offset = record_offset(id);
     uint16_t id_invalid = 0;
 
     // Setze die Position auf den Offset
-    if (mp_seek(f, offset, SEEK_SET) < 0) {
+    if (mp_try_seek(f, offset, SEEK_SET) < 0) {
         ESP_LOGE(TAG, "Failed to seek db file.");
-        mp_close(f);
+        mp_try_close(f);
         return ESP_FAIL;
     }
 
     // Schreibe die ungültige ID in die Datei
-    mp_int_t size = mp_write(f, &id_invalid, sizeof(uint16_t));
+    mp_int_t size = mp_try_write(f, &id_invalid, sizeof(uint16_t));
     if (size != sizeof(uint16_t)) {
         ESP_LOGE(TAG, "Failed to write feature id.");
-        mp_close(f);
+        mp_try_close(f);
         return ESP_FAIL;
     }
 
     // Aktualisiere die Anzahl der gültigen Features
     offset = sizeof(uint16_t);
-    if (mp_seek(f, offset, SEEK_SET) < 0) {
+    if (mp_try_seek(f, offset, SEEK_SET) < 0) {
         ESP_LOGE(TAG, "Failed to seek db file.");
-        mp_close(f);
+        mp_try_close(f);
         return ESP_FAIL;
     }
 
-    size = mp_write(f, &m_meta.num_feats_valid, sizeof(uint16_t));
+    size = mp_try_write(f, &meta.num_feats_valid, sizeof(uint16_t));
     if (size != sizeof(uint16_t)) {
         ESP_LOGE(TAG, "Failed to write valid feature num.");
-        mp_close(f);
+        mp_try_close(f);
         return ESP_FAIL;
     }
 
     // Schließe die Datei
-    mp_close(f);
-    return ESP_OK;
+    mp_try_close(f);
+    return append_change(CHANGE_DELETE, id, nullptr, nullptr);
 }
 
-esp_err_t DataBase::delete_last_feat()
+esp_err_t DataBase::rename_feat(uint16_t id, const char *name)
 {
-    if (m_feats.empty()) {
-        ESP_LOGW(TAG, "Empty db, nothing to delete");
+    finish_loading();
+    open_log();
+
+    std::unique_lock<std::mutex> writer(m_write_mutex, std::defer_lock);
+    lock_releasing_gil(writer);
+    return rename_locked(id, name);
+}
+
+esp_err_t DataBase::rename_locked(uint16_t id, const char *name)
+{
+    MP_DL_TRACE_SCOPE("db_rename");
+    database_feat record(id, nullptr, name);
+    {
+        std::unique_lock<std::shared_mutex> lock(m_lock, std::defer_lock);
+        lock_releasing_gil(lock);
+        auto it = std::find_if(m_feats.begin(), m_feats.end(), [id](const database_feat &feat) { return feat.id == id; });
+        if (it == m_feats.end()) {
+            ESP_LOGW(TAG, "Invalid id to rename.");
+            return ESP_FAIL;
+        }
+        // The record moves to the identity of its new name
+        if (m_identity_candidates > 0) {
+            identity_remove(*it);
+        }
+        memcpy(it->name, record.name, MAX_NAME_LENGTH);
+        if (m_identity_candidates > 0) {
+            identity_add(*it);
+        }
+    }
+
+    mp_file_t *f = mp_try_open(m_db_path, "rb+");
+    if (!f) {
+        ESP_LOGE(TAG, "Failed to open db.");
         return ESP_FAIL;
     }
-    uint16_t id = m_feats.back().id;
+    off_t offset = record_offset(id) + sizeof(uint16_t) + sizeof(float) * m_meta.feat_len;
+    if (mp_try_seek(f, offset, SEEK_SET) < 0 || mp_try_write(f, record.name, MAX_NAME_LENGTH) != MAX_NAME_LENGTH) {
+        ESP_LOGE(TAG, "Failed to write name.");
+        mp_try_close(f);
+        return ESP_FAIL;
+    }
+    mp_try_close(f);
+    return append_change(CHANGE_RENAME, id, nullptr, record.name);
+}
+
+esp_err_t DataBase::delete_last_feat()
+{
+    finish_loading();
+    uint16_t id;
+    {
+        std::shared_lock<std::shared_mutex> lock(m_lock, std::defer_lock);
+        lock_releasing_gil(lock);
+        if (m_feats.empty()) {
+            ESP_LOGW(TAG, "Empty db, nothing to delete");
+            return ESP_FAIL;
+        }
+        id = m_feats.back().id;
+    }
     return delete_feat(id);
 }
 
-float DataBase::cal_similarity(float *feat1, float *feat2)
+float DataBase::cal_similarity(const float *feat1, const float *feat2)
 {
     float sum = 0;
     for (int i = 0; i < m_meta.feat_len; i++) {
@@ -312,45 +554,113 @@ float DataBase::cal_similarity(float *feat1, float *feat2)
 
 std::vector<mp_esp_dl::recognition::result_t> DataBase::query_feat(dl::TensorBase *feat, float thr, int top_k)
 {
+    return query_feat((const float *)feat->data, thr, top_k);
+}
+
+std::vector<mp_esp_dl::recognition::result_t> DataBase::query_feat(const float *feat, float thr, int top_k)
+{
+    MP_DL_TRACE_SCOPE("db_query");
     if (top_k < 1) {
         ESP_LOGW(TAG, "Top_k should be greater than 0.");
         return {};
     }
     std::vector<mp_esp_dl::recognition::result_t> results;
     float sim;
-    for (auto it = m_feats.begin(); it != m_feats.end(); it++) {
-        sim = cal_similarity(it->feat, (float *)feat->data);
-        if (sim <= thr) {
-            continue;
+    std::shared_lock<std::shared_mutex> lock(m_lock, std::defer_lock);
+    lock_releasing_gil(lock);
+    if (m_identity_candidates > 0) {
+        // Centroids first, then the members of the best identities at full dimension
+        int feat_len = m_meta.feat_len;
+        std::vector<std::pair<float, const identity_t *>> ranked(m_identities.size());
+        for (size_t i = 0; i < ranked.size(); i++) {
+            ranked[i] = {cal_similarity(&m_centroids[i * feat_len], feat), &m_identities[i]};
+        }
+        size_t candidates = std::min(ranked.size(), (size_t)std::max(m_identity_candidates, top_k));
+        std::partial_sort(ranked.begin(), ranked.begin() + candidates, ranked.end(),
+                          [](const std::pair<float, const identity_t *> &a, const std::pair<float, const identity_t *> &b) {
+                              return a.first > b.first;
+                          });
+        for (size_t i = 0; i < candidates; i++) {
+            for (const database_feat *member : ranked[i].second->members) {
+                sim = cal_similarity(member->feat, feat);
+                if (sim <= thr) {
+                    continue;
+                }
+                results.emplace_back(member->id, sim, member->name);
+            }
+        }
+    } else if (m_projection.empty()) {
+        for (auto it = m_feats.begin(); it != m_feats.end(); it++) {
+            sim = cal_similarity(it->feat, feat);
+            if (sim <= thr) {
+                continue;
+            }
+            results.emplace_back(it->id, sim, it->name);
+        }
+    } else {
+        // Coarse pass over the projected records, then the best candidates at full dimension
+        int dims = m_projection.dims();
+        float query[Projection::MAX_DIMS];
+        m_projection.project(feat, query);
+        std::vector<std::pair<float, const database_feat *>> coarse(m_coarse_feats.size());
+        for (size_t i = 0; i < coarse.size(); i++) {
+            const float *entry = &m_coarse[i * (dims + 1)];
+            float score = entry[dims];
+            for (int j = 0; j < dims; j++) {
+                score += entry[j] * query[j];
+            }
+            coarse[i] = {score, m_coarse_feats[i]};
+        }
+        size_t candidates = std::min(coarse.size(), (size_t)std::max(m_projection.candidates(), top_k));
+        std::partial_sort(coarse.begin(), coarse.begin() + candidates, coarse.end(),
+                          [](const std::pair<float, const database_feat *> &a, const std::pair<float, const database_feat *> &b) {
+                              return a.first > b.first;
+                          });
+        for (size_t i = 0; i < candidates; i++) {
+            sim = cal_similarity(coarse[i].second->feat, feat);
+            if (sim <= thr) {
+                continue;
+            }
+            results.emplace_back(coarse[i].second->id, sim, coarse[i].second->name);
         }
-        results.emplace_back(it->id, sim, it->name);
     }
     std::sort(results.begin(), results.end(), [](const mp_esp_dl::recognition::result_t &a, const mp_esp_dl::recognition::result_t &b) -> bool {
         return a.similarity > b.similarity;
     });
-    if (results.size() > top_k) {
+    lock.unlock();
+    if (results.size() > (size_t)top_k) {
         results.resize(top_k);
     }
     return results;
 }
 
-const char* DataBase::get_name(uint16_t id)
+bool DataBase::get_name(uint16_t id, char *name)
 {
+    // Copied under the lock, a delete or rename frees or changes the record
+    std::shared_lock<std::shared_mutex> lock(m_lock, std::defer_lock);
+    lock_releasing_gil(lock);
     for (const auto &feat : m_feats) {
         if (feat.id == id) {
-            return feat.name;
+            memcpy(name, feat.name, MAX_NAME_LENGTH);
+            return true;
         }
     }
-    return "";
+    name[0] = '\0';
+    return false;
 }
 
 void DataBase::print()
 {
+    std::shared_lock<std::shared_mutex> lock(m_lock, std::defer_lock);
+    lock_releasing_gil(lock);
     mp_printf(&mp_plat_print, "\n");
     mp_printf(&mp_plat_print, "[Database Info]\n");
     mp_printf(&mp_plat_print, "Total faces: %d, Valid faces: %d\n\n", 
               m_meta.num_feats_total, 
               m_meta.num_feats_valid);
+    if (m_loading) {
+        mp_printf(&mp_plat_print, "Loading, %d of %d records read\n\n", m_load_next, m_meta.num_feats_total);
+    }
               
     if (!m_feats.empty()) {
         mp_printf(&mp_plat_print, "ID  | Name\n");
@@ -362,5 +672,849 @@ void DataBase::print()
     mp_printf(&mp_plat_print, "\n");
 }
 
+void DataBase::index_add(const database_feat &feat)
+{
+    if (m_identity_candidates > 0) {
+        identity_add(feat);
+    }
+    if (m_projection.empty()) {
+        return;
+    }
+    int dims = m_projection.dims();
+    size_t pos = m_coarse.size();
+    m_coarse.resize(pos + dims + 1);
+    m_coarse[pos + dims] = m_projection.project(feat.feat, &m_coarse[pos]);
+    m_coarse_feats.push_back(&feat);
+}
+
+void DataBase::index_remove(const database_feat &feat)
+{
+    if (m_identity_candidates > 0) {
+        identity_remove(feat);
+    }
+    int stride = m_projection.dims() + 1;
+    for (size_t i = 0; i < m_coarse_feats.size(); i++) {
+        if (m_coarse_feats[i] == &feat) {
+            m_coarse_feats.erase(m_coarse_feats.begin() + i);
+            m_coarse.erase(m_coarse.begin() + i * stride, m_coarse.begin() + (i + 1) * stride);
+            return;
+        }
+    }
+}
+
+void DataBase::rebuild_index()
+{
+    m_coarse_feats.clear();
+    m_coarse.clear();
+    m_identities.clear();
+    m_centroids.clear();
+    m_coarse_feats.reserve(m_feats.size());
+    m_coarse.reserve(m_feats.size() * (m_projection.dims() + 1));
+    for (const auto &feat : m_feats) {
+        index_add(feat);
+    }
+}
+
+void DataBase::identity_add(const database_feat &feat)
+{
+    size_t index = m_identities.size();
+    if (feat.name[0] != '\0') {
+        for (size_t i = 0; i < m_identities.size(); i++) {
+            if (strncmp(m_identities[i].name, feat.name, MAX_NAME_LENGTH) == 0) {
+                index = i;
+                break;
+            }
+        }
+    }
+    if (index == m_identities.size()) {
+        m_identities.emplace_back();
+        identity_t &identity = m_identities.back();
+        memcpy(identity.name, feat.name, MAX_NAME_LENGTH);
+        identity.sum.assign(m_meta.feat_len, 0.0f);
+        m_centroids.resize(m_centroids.size() + m_meta.feat_len);
+    }
+    identity_t &identity = m_identities[index];
+    identity.members.push_back(&feat);
+    for (int i = 0; i < m_meta.feat_len; i++) {
+        identity.sum[i] += feat.feat[i];
+    }
+    update_centroid(index);
+}
+
+void DataBase::identity_remove(const database_feat &feat)
+{
+    for (size_t i = 0; i < m_identities.size(); i++) {
+        identity_t &identity = m_identities[i];
+        auto member = std::find(identity.members.begin(), identity.members.end(), &feat);
+        if (member == identity.members.end()) {
+            continue;
+        }
+        identity.members.erase(member);
+        if (!identity.members.empty()) {
+            for (int j = 0; j < m_meta.feat_len; j++) {
+                identity.sum[j] -= feat.feat[j];
+            }
+            update_centroid(i);
+            return;
+        }
+        // The last identity takes the place of the empty one
+        size_t last = m_identities.size() - 1;
+        if (i != last) {
+            std::swap(m_identities[i], m_identities[last]);
+            std::copy(m_centroids.begin() + last * m_meta.feat_len, m_centroids.end(),
+                      m_centroids.begin() + i * m_meta.feat_len);
+        }
+        m_identities.pop_back();
+        m_centroids.resize(last * m_meta.feat_len);
+        return;
+    }
+}
+
+void DataBase::update_centroid(size_t index)
+{
+    const std::vector<float> &sum = m_identities[index].sum;
+    float norm = 0;
+    for (float value : sum) {
+        norm += value * value;
+    }
+    norm = norm > 0 ? 1.0f / sqrtf(norm) : 0.0f;
+    float *centroid = &m_centroids[index * m_meta.feat_len];
+    for (int i = 0; i < m_meta.feat_len; i++) {
+        centroid[i] = sum[i] * norm;
+    }
+}
+
+esp_err_t DataBase::set_identity_search(int candidates)
+{
+    if (candidates < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::unique_lock<std::mutex> writer(m_write_mutex, std::defer_lock);
+    lock_releasing_gil(writer);
+    std::unique_lock<std::shared_mutex> lock(m_lock, std::defer_lock);
+    lock_releasing_gil(lock);
+    bool rebuild = (candidates > 0) != (m_identity_candidates > 0);
+    m_identity_candidates = candidates;
+    if (rebuild) {
+        rebuild_index();
+    }
+    return ESP_OK;
+}
+
+int DataBase::get_num_identities()
+{
+    std::shared_lock<std::shared_mutex> lock(m_lock, std::defer_lock);
+    lock_releasing_gil(lock);
+    return m_identities.size();
+}
+
+esp_err_t DataBase::train_projection(int dims, int candidates)
+{
+    finish_loading();
+    std::unique_lock<std::mutex> writer(m_write_mutex, std::defer_lock);
+    lock_releasing_gil(writer);
+
+    // Training reads m_feats, which only writers change, so queries go on meanwhile.
+    // It takes seconds for large galleries, other threads get the GIL.
+    Projection trained;
+    esp_err_t ret;
+    MP_THREAD_GIL_EXIT();
+    ret = trained.train(m_feats, m_meta.feat_len, dims, candidates);
+    MP_THREAD_GIL_ENTER();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    {
+        std::unique_lock<std::shared_mutex> lock(m_lock, std::defer_lock);
+        lock_releasing_gil(lock);
+        m_projection.swap(trained);
+        rebuild_index();
+    }
+    return m_projection.save(m_pca_path);
+}
+
+esp_err_t DataBase::clear_projection()
+{
+    std::unique_lock<std::mutex> writer(m_write_mutex, std::defer_lock);
+    lock_releasing_gil(writer);
+    {
+        std::unique_lock<std::shared_mutex> lock(m_lock, std::defer_lock);
+        lock_releasing_gil(lock);
+        m_projection.clear();
+        rebuild_index();
+    }
+    if (!mp_isfile(m_pca_path)) {
+        return ESP_OK;
+    }
+    return m_projection.save(m_pca_path);
+}
+
+esp_err_t DataBase::store_face(uint16_t id, const uint8_t *crop)
+{
+    std::unique_lock<std::mutex> writer(m_write_mutex, std::defer_lock);
+    lock_releasing_gil(writer);
+    return FaceStore::append(m_faces_path, id, crop);
+}
+
+esp_err_t DataBase::write_reembedded(mp_file_t *out, int feat_len, const embed_fn_t &embed, const progress_fn_t &progress,
+                                     reembed_stats_t *stats)
+{
+    // The database is read as stored, its feature length may differ from the current one
+    mp_file_t *db = mp_try_open(m_db_path, "rb");
+    if (!db) {
+        ESP_LOGE(TAG, "Failed to open db.");
+        return ESP_FAIL;
+    }
+    mp_file_t *faces = mp_try_open(m_faces_path, "rb");
+    if (!faces) {
+        ESP_LOGE(TAG, "Failed to open face store.");
+        mp_try_close(db);
+        return ESP_FAIL;
+    }
+    uint8_t *crop = (uint8_t *)heap_caps_malloc(FaceStore::CROP_BYTES, MALLOC_CAP_SPIRAM);
+    float *empty = (float *)heap_caps_calloc(feat_len, sizeof(float), MALLOC_CAP_SPIRAM);
+
+    database_meta old_meta;
+    esp_err_t ret = ESP_OK;
+    if (!crop || !empty) {
+        ESP_LOGE(TAG, "Failed to allocate buffers.");
+        ret = ESP_ERR_NO_MEM;
+    } else if (mp_try_readinto(db, &old_meta, sizeof(old_meta)) != sizeof(old_meta)) {
+        ESP_LOGE(TAG, "Failed to read database meta.");
+        ret = ESP_FAIL;
+    } else {
+        ret = FaceStore::read_header(faces);
+    }
+
+    // The records keep their slots, so the ids stay valid. Both files are in
+    // id order and are read side by side.
+    database_meta meta = {ret == ESP_OK ? old_meta.num_feats_total : (uint16_t)0, 0, (uint16_t)feat_len};
+    if (ret == ESP_OK && mp_try_write(out, &meta, sizeof(meta)) != sizeof(meta)) {
+        ret = ESP_FAIL;
+    }
+    int64_t start = esp_timer_get_time();
+    uint16_t face_id = 0;
+    bool face_read = false;
+    bool faces_end = false;
+    for (int i = 0; ret == ESP_OK && i < meta.num_feats_total; i++) {
+        uint16_t id;
+        char name[MAX_NAME_LENGTH];
+        if (mp_try_readinto(db, &id, sizeof(id)) != sizeof(id) ||
+            mp_try_seek(db, sizeof(float) * old_meta.feat_len, SEEK_CUR) < 0 ||
+            mp_try_readinto(db, name, MAX_NAME_LENGTH) != MAX_NAME_LENGTH) {
+            ESP_LOGE(TAG, "Failed to read record %d.", i + 1);
+            ret = ESP_FAIL;
+            break;
+        }
+        while (id != 0 && !faces_end && (!face_read || face_id < id)) {
+            faces_end = FaceStore::read_next(faces, &face_id, crop) != ESP_OK;
+            face_read = !faces_end;
+        }
+
+        const float *feat = empty;
+        if (id != 0 && face_read && face_id == id) {
+            feat = embed(crop);
+            if (!feat) {
+                ESP_LOGE(TAG, "Failed to compute the embedding of id %d.", id);
+                ret = ESP_FAIL;
+                break;
+            }
+            stats->reembedded++;
+            meta.num_feats_valid++;
+        } else if (id != 0) {
+            ESP_LOGW(TAG, "No face stored for id %d, the record is dropped.", id);
+            stats->dropped++;
+            id = 0;
+        }
+        if (mp_try_write(out, &id, sizeof(id)) != sizeof(id) ||
+            mp_try_write(out, feat, sizeof(float) * feat_len) != (mp_int_t)(sizeof(float) * feat_len) ||
+            mp_try_write(out, name, MAX_NAME_LENGTH) != MAX_NAME_LENGTH) {
+            ESP_LOGE(TAG, "Failed to write record %d.", i + 1);
+            ret = ESP_FAIL;
+            break;
+        }
+        stats->us = esp_timer_get_time() - start;
+        if (progress && !progress(i + 1, meta.num_feats_total, stats->us)) {
+            ret = ESP_FAIL;
+        }
+    }
+    if (ret == ESP_OK && (mp_try_seek(out, 0, SEEK_SET) < 0 || mp_try_write(out, &meta, sizeof(meta)) != sizeof(meta))) {
+        ESP_LOGE(TAG, "Failed to write database meta.");
+        ret = ESP_FAIL;
+    }
+    heap_caps_free(crop);
+    heap_caps_free(empty);
+    mp_try_close(faces);
+    mp_try_close(db);
+    return ret;
+}
+
+esp_err_t DataBase::reembed(int feat_len, const embed_fn_t &embed, const progress_fn_t &progress, reembed_stats_t *stats)
+{
+    MP_DL_TRACE_SCOPE("db_reembed");
+    *stats = {0, 0, 0};
+    if (!mp_isfile(m_faces_path)) {
+        ESP_LOGE(TAG, "No faces are stored for %s.", m_db_path);
+        return ESP_ERR_NOT_FOUND;
+    }
+    finish_loading();
+    // Queries go on with the old records until the new database is complete
+    std::unique_lock<std::mutex> writer(m_write_mutex, std::defer_lock);
+    lock_releasing_gil(writer);
+
+    int length = strlen(m_db_path) + 5;
+    std::vector<char> tmp_path(length);
+    snprintf(tmp_path.data(), length, "%s.tmp", m_db_path);
+    mp_file_t *out = mp_try_open(tmp_path.data(), "wb");
+    if (!out) {
+        ESP_LOGE(TAG, "Failed to open %s.", tmp_path.data());
+        return ESP_FAIL;
+    }
+    esp_err_t ret = write_reembedded(out, feat_len, embed, progress, stats);
+    mp_try_close(out);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // The log, a pending delta and the projection hold old embeddings. They
+    // are emptied before the database is replaced: after a reset in between,
+    // the old database is logged again from the start.
+    const char *stale[] = {m_log_path, m_delta_path, m_pca_path};
+    for (const char *path : stale) {
+        if (mp_isfile(path)) {
+            mp_file_t *f = mp_try_open(path, "wb");
+            if (f) {
+                mp_try_close(f);
+            }
+        }
+    }
+    m_log_ready = false;
+    m_seq = 0;
+    m_log_base = 0;
+    m_log_end = 0;
+    if (!mp_try_rename(tmp_path.data(), m_db_path)) {
+        ESP_LOGE(TAG, "Failed to replace %s.", m_db_path);
+        return ESP_FAIL;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(m_lock, std::defer_lock);
+    lock_releasing_gil(lock);
+    m_projection.clear();
+    ret = load_database_from_storage(feat_len);
+    ESP_LOGI(TAG, "Reembedded %d faces in %d ms, %d records dropped.", stats->reembedded, (int)(stats->us / 1000),
+             stats->dropped);
+    return ret;
+}
+
+off_t DataBase::record_offset(uint16_t id)
+{
+    return sizeof(database_meta) + (sizeof(uint16_t) + sizeof(float) * m_meta.feat_len + MAX_NAME_LENGTH) * (id - 1);
+}
+
+// Change log
+//
+// <db>.log is a sequence of records, each a change_header followed by
+//   enroll: the feature (feat_len floats) and the name (MAX_NAME_LENGTH bytes)
+//   rename: the name
+//   delete: nothing
+// with the sequence numbers increasing by one. A compacted log starts with
+// a checkpoint record instead, its seq is the last dropped change, its id the
+// number of ids it covers and its body a bitmap of the ids which were live,
+// bit id - 1 for id.
+// A delta blob is a delta_header followed by change records in the same
+// format. <db>.delta holds a delta while it is applied, so an interrupted
+// apply is finished later.
+
+static const char DELTA_MAGIC[4] = {'E', 'D', 'L', 'D'};
+static const uint16_t DELTA_VERSION = 1;
+
+size_t DataBase::change_body_size(const change_header &hdr)
+{
+    switch (hdr.op) {
+    case CHANGE_ENROLL:
+        return sizeof(float) * m_meta.feat_len + MAX_NAME_LENGTH;
+    case CHANGE_RENAME:
+        return MAX_NAME_LENGTH;
+    case CHANGE_DELETE:
+        return 0;
+    case CHANGE_CHECKPOINT:
+        return (hdr.id + 7) / 8;
+    default:
+        return SIZE_MAX;
+    }
+}
+
+esp_err_t DataBase::write_change(mp_file_t *f, change_op_t op, uint16_t id, const float *feat, const char *name)
+{
+    change_header hdr = {m_seq + 1, id, op, 0};
+    bool ok = mp_try_write(f, &hdr, sizeof(hdr)) == sizeof(hdr);
+    if (ok && op == CHANGE_ENROLL) {
+        ok = mp_try_write(f, feat, sizeof(float) * m_meta.feat_len) == (mp_int_t)(sizeof(float) * m_meta.feat_len);
+    }
+    if (ok && op != CHANGE_DELETE) {
+        char padded[MAX_NAME_LENGTH] = {};
+        strncpy(padded, name, MAX_NAME_LENGTH - 1);
+        ok = mp_try_write(f, padded, MAX_NAME_LENGTH) == MAX_NAME_LENGTH;
+    }
+    if (!ok) {
+        ESP_LOGE(TAG, "Failed to write change log.");
+        return ESP_FAIL;
+    }
+    m_seq++;
+    m_log_end += sizeof(hdr) + change_body_size(hdr);
+    return ESP_OK;
+}
+
+esp_err_t DataBase::append_change(change_op_t op, uint16_t id, const float *feat, const char *name)
+{
+    MP_DL_TRACE_SCOPE("db_log_append");
+    // A torn record at the end of the log is overwritten
+    mp_file_t *f = mp_try_open(m_log_path, m_log_end > 0 ? "rb+" : "wb");
+    if (!f) {
+        ESP_LOGE(TAG, "Failed to open change log.");
+        return ESP_FAIL;
+    }
+    if (mp_try_seek(f, m_log_end, SEEK_SET) < 0) {
+        ESP_LOGE(TAG, "Failed to seek change log.");
+        mp_try_close(f);
+        return ESP_FAIL;
+    }
+    esp_err_t ret = write_change(f, op, id, feat, name);
+    mp_try_close(f);
+    return ret;
+}
+
+esp_err_t DataBase::open_log()
+{
+    MP_DL_TRACE_SCOPE("db_open_log");
+    std::unique_lock<std::mutex> writer(m_write_mutex, std::defer_lock);
+    lock_releasing_gil(writer);
+    if (m_log_ready) {
+        return ESP_OK;
+    }
+
+    // Find the last sequence number and the end of the last complete record,
+    // and which ids the log enrolls (1) and deletes (2)
+    std::vector<uint8_t> logged(m_meta.num_feats_total + 1, 0);
+    m_seq = 0;
+    m_log_base = 0;
+    m_log_end = 0;
+    if (mp_isfile(m_log_path)) {
+        mp_file_t *f = mp_try_open(m_log_path, "rb");
+        if (!f) {
+            ESP_LOGE(TAG, "Failed to open change log.");
+            return ESP_FAIL;
+        }
+        off_t log_size = mp_try_seek(f, 0, SEEK_END);
+        mp_try_seek(f, 0, SEEK_SET);
+        change_header hdr;
+        while (mp_try_readinto(f, &hdr, sizeof(hdr)) == sizeof(hdr)) {
+            size_t body = change_body_size(hdr);
+            off_t end = m_log_end + sizeof(hdr) + body;
+            if (m_log_end == 0 && hdr.op == CHANGE_CHECKPOINT && end <= log_size) {
+                std::vector<uint8_t> live(body);
+                if (mp_try_readinto(f, live.data(), body) != (mp_int_t)body) {
+                    break;
+                }
+                for (uint16_t id = 1; id <= hdr.id && id < logged.size(); id++) {
+                    logged[id] = live[(id - 1) / 8] & (1 << ((id - 1) % 8)) ? 1 : 2;
+                }
+                m_seq = m_log_base = hdr.seq;
+                m_log_end = end;
+                continue;
+            }
+            if (body == SIZE_MAX || hdr.op == CHANGE_CHECKPOINT || hdr.seq != m_seq + 1 || end > log_size) {
+                ESP_LOGW(TAG, "Change log ends with an incomplete record after sequence %u.", (unsigned)m_seq);
+                break;
+            }
+            if (hdr.id < logged.size() && hdr.op != CHANGE_RENAME) {
+                logged[hdr.id] = hdr.op == CHANGE_ENROLL ? 1 : 2;
+            }
+            m_seq = hdr.seq;
+            m_log_end = end;
+            mp_try_seek(f, end, SEEK_SET);
+        }
+        mp_try_close(f);
+    }
+    m_log_ready = true;
+
+    // Log the records of the database which are missing: all of them for a
+    // database from before the change log, otherwise a change which was
+    // written to the database but not to the log
+    std::vector<const database_feat *> by_id(m_meta.num_feats_total + 1, nullptr);
+    for (const auto &feat : m_feats) {
+        if (feat.id < by_id.size()) {
+            by_id[feat.id] = &feat;
+        }
+    }
+    bool missing = false;
+    for (uint16_t id = 1; id <= m_meta.num_feats_total; id++) {
+        missing |= logged[id] == 0 || (logged[id] == 1 && !by_id[id]);
+    }
+    if (missing) {
+        ESP_LOGI(TAG, "Adding the database records to the change log.");
+        mp_file_t *f = mp_try_open(m_log_path, m_log_end > 0 ? "rb+" : "wb");
+        if (!f || mp_try_seek(f, m_log_end, SEEK_SET) < 0) {
+            ESP_LOGE(TAG, "Failed to open change log.");
+            if (f) {
+                mp_try_close(f);
+            }
+            return ESP_FAIL;
+        }
+        // Deleted records are logged as an enroll of an empty feature followed by the delete
+        std::vector<float> empty(m_meta.feat_len, 0.0f);
+        esp_err_t ret = ESP_OK;
+        for (uint16_t id = 1; id <= m_meta.num_feats_total && ret == ESP_OK; id++) {
+            const database_feat *feat = by_id[id];
+            if (logged[id] == 0) {
+                ret = write_change(f, CHANGE_ENROLL, id, feat ? feat->feat : empty.data(), feat ? feat->name : "");
+            }
+            if (ret == ESP_OK && logged[id] != 2 && !feat) {
+                ret = write_change(f, CHANGE_DELETE, id, nullptr, nullptr);
+            }
+        }
+        mp_try_close(f);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    return recover_pending_changes();
+}
+
+uint32_t DataBase::get_sequence()
+{
+    finish_loading();
+    open_log();
+    // A writer on another thread may be logging a change
+    std::unique_lock<std::mutex> writer(m_write_mutex, std::defer_lock);
+    lock_releasing_gil(writer);
+    return m_seq;
+}
+
+esp_err_t DataBase::export_changes(uint32_t since, std::vector<uint8_t> &blob)
+{
+    finish_loading();
+    if (open_log() != ESP_OK) {
+        return ESP_FAIL;
+    }
+    std::unique_lock<std::mutex> writer(m_write_mutex, std::defer_lock);
+    lock_releasing_gil(writer);
+
+    delta_header delta;
+    memcpy(delta.magic, DELTA_MAGIC, sizeof(delta.magic));
+    delta.version = DELTA_VERSION;
+    delta.feat_len = m_meta.feat_len;
+    delta.count = 0;
+    blob.assign((const uint8_t *)&delta, (const uint8_t *)&delta + sizeof(delta));
+    if (since >= m_seq) {
+        return ESP_OK;
+    }
+    if (since < m_log_base) {
+        ESP_LOGE(TAG, "The changes up to %u were compacted.", (unsigned)m_log_base);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    mp_file_t *f = mp_try_open(m_log_path, "rb");
+    if (!f) {
+        ESP_LOGE(TAG, "Failed to open change log.");
+        return ESP_FAIL;
+    }
+    off_t offset = 0;
+    change_header hdr;
+    while (offset < m_log_end && mp_try_readinto(f, &hdr, sizeof(hdr)) == sizeof(hdr)) {
+        size_t body = change_body_size(hdr);
+        offset += sizeof(hdr) + body;
+        // The checkpoint has the sequence number m_log_base
+        if (hdr.seq <= since) {
+            mp_try_seek(f, offset, SEEK_SET);
+            continue;
+        }
+        size_t pos = blob.size();
+        blob.resize(pos + sizeof(hdr) + body);
+        memcpy(&blob[pos], &hdr, sizeof(hdr));
+        if (body > 0 && mp_try_readinto(f, &blob[pos + sizeof(hdr)], body) != (mp_int_t)body) {
+            ESP_LOGE(TAG, "Failed to read change log.");
+            mp_try_close(f);
+            return ESP_FAIL;
+        }
+        delta.count++;
+    }
+    mp_try_close(f);
+    memcpy(blob.data(), &delta, sizeof(delta));
+    return ESP_OK;
+}
+
+esp_err_t DataBase::validate_changes(const uint8_t *blob, size_t len)
+{
+    delta_header delta;
+    if (len < sizeof(delta)) {
+        ESP_LOGE(TAG, "Delta too short.");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(&delta, blob, sizeof(delta));
+    if (memcmp(delta.magic, DELTA_MAGIC, sizeof(delta.magic)) != 0 || delta.version != DELTA_VERSION) {
+        ESP_LOGE(TAG, "Not a database delta.");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (delta.feat_len != m_meta.feat_len) {
+        ESP_LOGE(TAG, "Delta was made with another feature model.");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    // Every change has at least a header, checked before count sizes anything
+    if (delta.count > (len - sizeof(delta)) / sizeof(change_header)) {
+        ESP_LOGE(TAG, "Delta is truncated.");
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Replay the ids: enrolls have to continue the ids of this database and
+    // deletes/renames have to hit an existing record
+    std::vector<bool> valid(m_meta.num_feats_total + 1 + delta.count, false);
+    for (const auto &feat : m_feats) {
+        valid[feat.id] = true;
+    }
+    uint16_t next_id = m_meta.num_feats_total + 1;
+    uint32_t expected_seq = 0;
+    bool first_new = true;
+    size_t offset = sizeof(delta);
+    for (uint32_t i = 0; i < delta.count; i++) {
+        change_header hdr;
+        if (offset + sizeof(hdr) > len) {
+            ESP_LOGE(TAG, "Delta is truncated.");
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(&hdr, blob + offset, sizeof(hdr));
+        size_t body = change_body_size(hdr);
+        if (body == SIZE_MAX || hdr.op == CHANGE_CHECKPOINT || offset + sizeof(hdr) + body > len) {
+            ESP_LOGE(TAG, "Delta is truncated or corrupt.");
+            return ESP_ERR_INVALID_SIZE;
+        }
+        offset += sizeof(hdr) + body;
+        if (i > 0 && hdr.seq != expected_seq) {
+            ESP_LOGE(TAG, "Delta sequence numbers are not consecutive.");
+            return ESP_ERR_INVALID_ARG;
+        }
+        expected_seq = hdr.seq + 1;
+
+        // Changes this database already has
+        if (hdr.seq <= m_seq) {
+            continue;
+        }
+        if (first_new && hdr.seq != m_seq + 1) {
+            ESP_LOGE(TAG, "Delta starts at %u, the database is at %u.", (unsigned)hdr.seq, (unsigned)m_seq);
+            return ESP_ERR_INVALID_STATE;
+        }
+        first_new = false;
+        if (hdr.op == CHANGE_ENROLL) {
+            if (hdr.id != next_id) {
+                ESP_LOGE(TAG, "Delta enrolls id %d, the next id is %d.", hdr.id, next_id);
+                return ESP_ERR_INVALID_STATE;
+            }
+            valid[next_id++] = true;
+        } else {
+            if (hdr.id >= valid.size() || !valid[hdr.id]) {
+                ESP_LOGE(TAG, "Delta changes the unknown id %d.", hdr.id);
+                return ESP_ERR_INVALID_STATE;
+            }
+            if (hdr.op == CHANGE_DELETE) {
+                valid[hdr.id] = false;
+            }
+        }
+    }
+    if (offset != len) {
+        ESP_LOGE(TAG, "Delta has trailing data.");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+esp_err_t DataBase::apply_locked(const uint8_t *blob, size_t len, int *applied)
+{
+    *applied = 0;
+    esp_err_t ret = validate_changes(blob, len);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    delta_header delta;
+    memcpy(&delta, blob, sizeof(delta));
+    size_t offset = sizeof(delta);
+    for (uint32_t i = 0; i < delta.count; i++) {
+        change_header hdr;
+        memcpy(&hdr, blob + offset, sizeof(hdr));
+        const uint8_t *body = blob + offset + sizeof(hdr);
+        offset += sizeof(hdr) + change_body_size(hdr);
+        if (hdr.seq <= m_seq) {
+            continue;
+        }
+
+        char name[MAX_NAME_LENGTH];
+        uint16_t id;
+        switch (hdr.op) {
+        case CHANGE_ENROLL: {
+            // The blob is not necessarily aligned for floats
+            std::vector<float> feat(m_meta.feat_len);
+            memcpy(feat.data(), body, sizeof(float) * m_meta.feat_len);
+            memcpy(name, body + sizeof(float) * m_meta.feat_len, MAX_NAME_LENGTH);
+            name[MAX_NAME_LENGTH - 1] = '\0';
+            ret = enroll_locked(feat.data(), name, &id);
+            break;
+        }
+        case CHANGE_DELETE:
+            ret = delete_locked(hdr.id);
+            break;
+        case CHANGE_RENAME:
+            memcpy(name, body, MAX_NAME_LENGTH);
+            name[MAX_NAME_LENGTH - 1] = '\0';
+            ret = rename_locked(hdr.id, name);
+            break;
+        }
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        (*applied)++;
+    }
+    return ESP_OK;
+}
+
+esp_err_t DataBase::apply_changes(const uint8_t *blob, size_t len, int *applied)
+{
+    finish_loading();
+    if (open_log() != ESP_OK) {
+        return ESP_FAIL;
+    }
+    std::unique_lock<std::mutex> writer(m_write_mutex, std::defer_lock);
+    lock_releasing_gil(writer);
+
+    *applied = 0;
+    esp_err_t ret = validate_changes(blob, len);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // Stage the delta first; if the device resets while it is applied, the
+    // rest is applied the next time the change log is opened
+    mp_file_t *f = mp_try_open(m_delta_path, "wb");
+    if (!f) {
+        ESP_LOGE(TAG, "Failed to open delta file.");
+        return ESP_FAIL;
+    }
+    bool staged = mp_try_write(f, blob, len) == (mp_int_t)len;
+    mp_try_close(f);
+    if (!staged) {
+        ESP_LOGE(TAG, "Failed to stage delta.");
+        return ESP_FAIL;
+    }
+
+    ret = apply_locked(blob, len, applied);
+    if (ret == ESP_OK) {
+        // An empty delta file means nothing is pending
+        f = mp_try_open(m_delta_path, "wb");
+        if (f) {
+            mp_try_close(f);
+        }
+    }
+    return ret;
+}
+
+esp_err_t DataBase::compact_changes(uint32_t upto)
+{
+    MP_DL_TRACE_SCOPE("db_log_compact");
+    finish_loading();
+    if (open_log() != ESP_OK) {
+        return ESP_FAIL;
+    }
+    std::unique_lock<std::mutex> writer(m_write_mutex, std::defer_lock);
+    lock_releasing_gil(writer);
+    if (upto > m_seq) {
+        ESP_LOGE(TAG, "Sequence %u is not in the change log.", (unsigned)upto);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (upto <= m_log_base) {
+        return ESP_OK;
+    }
+
+    // The live ids are those of the database, the log is complete after
+    // open_log(); ids changed after upto are set again by their records
+    change_header checkpoint = {upto, m_meta.num_feats_total, CHANGE_CHECKPOINT, 0};
+    std::vector<uint8_t> live(change_body_size(checkpoint), 0);
+    for (const auto &feat : m_feats) {
+        live[(feat.id - 1) / 8] |= 1 << ((feat.id - 1) % 8);
+    }
+
+    // The rest of the log is copied behind the checkpoint into a new file,
+    // which replaces the log when complete
+    int length = strlen(m_log_path) + 5;
+    std::vector<char> tmp_path(length);
+    snprintf(tmp_path.data(), length, "%s.tmp", m_log_path);
+    mp_file_t *in = mp_try_open(m_log_path, "rb");
+    mp_file_t *out = in ? mp_try_open(tmp_path.data(), "wb") : nullptr;
+    bool ok = out && mp_try_write(out, &checkpoint, sizeof(checkpoint)) == sizeof(checkpoint) &&
+              mp_try_write(out, live.data(), live.size()) == (mp_int_t)live.size();
+    off_t offset = 0;
+    off_t end = sizeof(checkpoint) + live.size();
+    change_header hdr;
+    std::vector<uint8_t> body;
+    while (ok && offset < m_log_end && mp_try_readinto(in, &hdr, sizeof(hdr)) == sizeof(hdr)) {
+        body.resize(change_body_size(hdr));
+        offset += sizeof(hdr) + body.size();
+        if (hdr.seq <= upto) {
+            ok = mp_try_seek(in, offset, SEEK_SET) == offset;
+            continue;
+        }
+        ok = mp_try_readinto(in, body.data(), body.size()) == (mp_int_t)body.size() &&
+             mp_try_write(out, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+             mp_try_write(out, body.data(), body.size()) == (mp_int_t)body.size();
+        end += sizeof(hdr) + body.size();
+    }
+    ok = ok && offset == m_log_end;
+    if (out) {
+        mp_try_close(out);
+    }
+    if (in) {
+        mp_try_close(in);
+    }
+    if (!ok || !mp_try_rename(tmp_path.data(), m_log_path)) {
+        ESP_LOGE(TAG, "Failed to compact the change log.");
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Compacted the change log from %d to %d bytes.", (int)m_log_end, (int)end);
+    m_log_base = upto;
+    m_log_end = end;
+    return ESP_OK;
+}
+
+esp_err_t DataBase::recover_pending_changes()
+{
+    if (!mp_isfile(m_delta_path)) {
+        return ESP_OK;
+    }
+    mp_file_t *f = mp_try_open(m_delta_path, "rb");
+    if (!f) {
+        return ESP_FAIL;
+    }
+    off_t len = mp_try_seek(f, 0, SEEK_END);
+    if (len <= 0) {
+        mp_try_close(f);
+        return ESP_OK;
+    }
+    std::vector<uint8_t> blob(len);
+    mp_try_seek(f, 0, SEEK_SET);
+    bool ok = mp_try_readinto(f, blob.data(), len) == len;
+    mp_try_close(f);
+
+    int applied = 0;
+    esp_err_t ret = ok ? apply_locked(blob.data(), len, &applied) : ESP_FAIL;
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to apply the pending delta.");
+        return ret;
+    }
+    ESP_LOGI(TAG, "Applied %d pending changes.", applied);
+    f = mp_try_open(m_delta_path, "wb");
+    if (f) {
+        mp_try_close(f);
+    }
+    return ESP_OK;
+}
+
 } // namespace recognition
-} // namespace mp_esp_dl
\ No newline at end of file
+} // namespace mp_esp_dl
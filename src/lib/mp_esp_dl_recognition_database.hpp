@@ -5,44 +5,206 @@
 #include "freertos/event_groups.h"
 #include "freertos/idf_additions.h"
 #include "dl_recognition_define.hpp"
+#include "mp_esp_dl_face_store.hpp"
+#include "mp_esp_dl_projection.hpp"
 #include "dl_tensor_base.hpp"
 #include "esp_check.h"
 #include "esp_system.h"
 #include <algorithm>
+#include <atomic>
+#include <functional>
 #include <list>
+#include <mutex>
+#include <shared_mutex>
 #include <vector>
 
 extern "C" {
     #include "py/runtime.h" // Für mp_load_method und mp_call_method_n_kw
     #include "py/obj.h" // Für mp_printf
+    #include "py/mpthread.h"
     #include "mpfile.h"
 }
 
 namespace mp_esp_dl {
 namespace recognition {
 
+// Takes lock, releasing the GIL while waiting. Otherwise a thread which holds
+// the GIL and waits here would block the lock holder forever, as soon as the
+// holder needs the GIL back, e.g. for a file write.
+template <typename TLock>
+static inline void lock_releasing_gil(TLock &lock)
+{
+    if (!lock.try_lock()) {
+        MP_THREAD_GIL_EXIT();
+        lock.lock();
+        MP_THREAD_GIL_ENTER();
+    }
+}
+
+// Safe for concurrent queries with one writer at a time. Queries take m_lock
+// shared; enroll/delete are serialized by m_write_mutex and only take m_lock
+// exclusively while the in-memory gallery is changed, the file is written
+// afterwards so recognition is not stalled by flash writes. The file is
+// accessed with the mp_try_* functions only, which return errors instead of
+// raising, so no exception can skip the unlock of a guard.
 class DataBase {
 public:
-    DataBase(const char *db_path, int feat_len);
+    // With async_load the constructor only reads the header of an existing
+    // database; the records are read by load_chunk() calls, queries only see
+    // the records loaded so far until is_loaded() returns true.
+    DataBase(const char *db_path, int feat_len, bool async_load = false);
     virtual ~DataBase();
     esp_err_t clear_all_feats();
     esp_err_t enroll_feat(dl::TensorBase *feat, const char *name, uint16_t *new_id);
+    // Enrolls a precomputed feature of get_feat_len() floats
+    esp_err_t enroll_feat(const float *feat, const char *name, uint16_t *new_id);
     esp_err_t delete_feat(uint16_t id);
     esp_err_t delete_last_feat();
+    esp_err_t rename_feat(uint16_t id, const char *name);
     std::vector<result_t> query_feat(dl::TensorBase *feat, float thr, int top_k);
-    const char* get_name(uint16_t id);
+    std::vector<result_t> query_feat(const float *feat, float thr, int top_k);
+    // Copies the name of id (MAX_NAME_LENGTH bytes), false for an unknown id
+    bool get_name(uint16_t id, char *name);
     void print();
     int get_num_feats() { return m_meta.num_feats_valid; }
+    int get_feat_len() { return m_meta.feat_len; }
+
+    bool is_loaded() { return !m_loading; }
+    // Reads the next max_records records of an asynchronous load
+    esp_err_t load_chunk(int max_records);
+    // Reads all remaining records, called before every change of the database
+    esp_err_t finish_loading();
+
+    // Change log for replication. Every enroll, delete and rename is appended
+    // to <db>.log with a sequence number; export_changes() returns the
+    // changes after a sequence number as a delta blob and apply_changes()
+    // replays such a blob from another device.
+    uint32_t get_sequence();
+    // ESP_ERR_INVALID_STATE if the changes after since were compacted
+    esp_err_t export_changes(uint32_t since, std::vector<uint8_t> &blob);
+    // applied is set to the number of changes which were new to this database
+    esp_err_t apply_changes(const uint8_t *blob, size_t len, int *applied);
+    // Drops the changes up to sequence number upto from the log, once every
+    // replica has applied them; they are replaced by a checkpoint record
+    // with the ids which were live. The sequence numbers go on unchanged.
+    esp_err_t compact_changes(uint32_t upto);
+
+    // With a projection, queries rank all records by their projected
+    // embeddings first and only compare the best candidates at full
+    // dimension. The projection is kept in <db>.pca.
+    esp_err_t train_projection(int dims, int candidates);
+    esp_err_t clear_projection();
+    int get_projection_dims() { return m_projection.dims(); }
+
+    // Identity search groups the records by name, records without a name are
+    // identities of their own. A normalized centroid is kept per identity and
+    // updated with every change; queries score the centroids first and only
+    // compare the members of the best candidates identities. 0 turns it off.
+    // Takes precedence over the projection while it is on.
+    esp_err_t set_identity_search(int candidates);
+    int get_identity_search() { return m_identity_candidates; }
+    int get_num_identities();
+
+    // Aligned face crops of the records are kept in <db>.faces, see FaceStore
+    esp_err_t store_face(uint16_t id, const uint8_t *crop);
+    bool has_faces() { return mp_isfile(m_faces_path); }
+
+    // Returns the embedding of an aligned face crop, nullptr on failure
+    typedef std::function<const float *(const uint8_t *crop)> embed_fn_t;
+    // Called after every record; returning false stops the job
+    typedef std::function<bool(int done, int total, int64_t elapsed_us)> progress_fn_t;
+    struct reembed_stats_t {
+        int reembedded;
+        int dropped;        // records without a stored face
+        int64_t us;
+    };
+    // Computes the embeddings of all records again from their stored faces,
+    // with feat_len floats each, in one pass over the database and the faces.
+    // The new database is written next to the old one and replaces it when
+    // complete. Ids and names are kept; the change log starts over and the
+    // projection is cleared, both depend on the embeddings.
+    esp_err_t reembed(int feat_len, const embed_fn_t &embed, const progress_fn_t &progress, reembed_stats_t *stats);
 
 private:
+    enum change_op_t : uint8_t {
+        CHANGE_ENROLL = 1,
+        CHANGE_DELETE = 2,
+        CHANGE_RENAME = 3,
+        CHANGE_CHECKPOINT = 4,  // only as the first record of a compacted log
+    };
+    struct change_header {
+        uint32_t seq;
+        uint16_t id;
+        uint8_t op;
+        uint8_t reserved;
+    };
+    struct delta_header {
+        char magic[4];
+        uint16_t version;
+        uint16_t feat_len;
+        uint32_t count;
+    };
+
     char *m_db_path;
+    char *m_log_path;
+    char *m_delta_path;
+    char *m_pca_path;
+    char *m_faces_path;
+    bool m_log_ready;
+    uint32_t m_seq;         // sequence number of the last logged change
+    uint32_t m_log_base;    // sequence number of the checkpoint, 0 for none
+    off_t m_log_end;        // end of the last complete record in the log
     std::list<database_feat> m_feats;
     database_meta m_meta;
+    std::shared_mutex m_lock;       // guards m_feats and m_meta
+    std::mutex m_write_mutex;       // serializes writers and the loader
+    std::atomic<bool> m_loading;
+    int m_load_next;        // index of the next record to read
+    off_t m_load_offset;    // file offset of the next record to read
+    // Projected records in the order of m_feats, dims + 1 floats each
+    // (coordinates and bias), guarded by m_lock
+    Projection m_projection;
+    std::vector<const database_feat *> m_coarse_feats;
+    std::vector<float> m_coarse;
+    // Identities with their members, the centroids are kept in m_centroids in
+    // the same order, feat_len floats each; guarded by m_lock
+    struct identity_t {
+        char name[MAX_NAME_LENGTH];
+        std::vector<float> sum;     // sum of the member embeddings
+        std::vector<const database_feat *> members;
+    };
+    int m_identity_candidates;
+    std::vector<identity_t> m_identities;
+    std::vector<float> m_centroids;
 
     esp_err_t create_empty_database_in_storage(int feat_len);
     esp_err_t load_database_from_storage(int feat_len);
+    esp_err_t read_meta(mp_file_t *f, int feat_len);
+    esp_err_t read_next_feat(mp_file_t *f, std::list<database_feat> &feats);
+    esp_err_t begin_async_load(int feat_len);
+    off_t record_offset(uint16_t id);
+
+    // The *_locked functions expect m_write_mutex to be held
+    esp_err_t enroll_locked(const float *feat, const char *name, uint16_t *new_id);
+    esp_err_t delete_locked(uint16_t id);
+    esp_err_t rename_locked(uint16_t id, const char *name);
+    esp_err_t open_log();
+    size_t change_body_size(const change_header &hdr);
+    esp_err_t write_change(mp_file_t *f, change_op_t op, uint16_t id, const float *feat, const char *name);
+    esp_err_t append_change(change_op_t op, uint16_t id, const float *feat, const char *name);
+    esp_err_t validate_changes(const uint8_t *blob, size_t len);
+    esp_err_t apply_locked(const uint8_t *blob, size_t len, int *applied);
+    esp_err_t recover_pending_changes();
+    esp_err_t write_reembedded(mp_file_t *out, int feat_len, const embed_fn_t &embed, const progress_fn_t &progress,
+                               reembed_stats_t *stats);
+    void index_add(const database_feat &feat);
+    void index_remove(const database_feat &feat);
+    void rebuild_index();
+    void identity_add(const database_feat &feat);
+    void identity_remove(const database_feat &feat);
+    void update_centroid(size_t index);
     void clear_all_feats_in_memory();
-    float cal_similarity(float *feat1, float *feat2);
+    float cal_similarity(const float *feat1, const float *feat2);
 };
 
 } // namespace recognition
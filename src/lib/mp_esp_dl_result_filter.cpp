@@ -0,0 +1,46 @@
+#include "mp_esp_dl_result_filter.hpp"
+#include <algorithm>
+
+namespace mp_esp_dl {
+
+static float iou(const dl::detect::result_t &a, const dl::detect::result_t &b)
+{
+    int x1 = std::max(a.box[0], b.box[0]);
+    int y1 = std::max(a.box[1], b.box[1]);
+    int x2 = std::min(a.box[2], b.box[2]);
+    int y2 = std::min(a.box[3], b.box[3]);
+    if (x2 <= x1 || y2 <= y1) {
+        return 0.0f;
+    }
+    float inter = (float)(x2 - x1) * (y2 - y1);
+    return inter / (a.box_area() + b.box_area() - inter);
+}
+
+void ResultFilter::apply(std::list<dl::detect::result_t> &results) const
+{
+    if (!active()) {
+        return;
+    }
+    results.remove_if([this](const dl::detect::result_t &res) {
+        return res.score < score_threshold || res.box[2] - res.box[0] < min_size || res.box[3] - res.box[1] < min_size;
+    });
+    results.sort([](const dl::detect::result_t &a, const dl::detect::result_t &b) { return a.score > b.score; });
+
+    // Greedy NMS over the sorted results, a kept result suppresses all worse
+    // ones it overlaps. It stops as soon as max_detections are kept.
+    int kept = 0;
+    for (auto it = results.begin(); it != results.end(); kept++) {
+        if (max_detections > 0 && kept == max_detections) {
+            results.erase(it, results.end());
+            break;
+        }
+        if (nms_threshold > 0.0f) {
+            for (auto other = std::next(it); other != results.end();) {
+                other = iou(*it, *other) > nms_threshold ? results.erase(other) : std::next(other);
+            }
+        }
+        ++it;
+    }
+}
+
+} // namespace mp_esp_dl
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "dl_detect_define.hpp"
+#include <list>
+
+namespace mp_esp_dl {
+
+// Filters the detections of a run before they are turned into Python objects.
+// Every option is off at its default.
+struct ResultFilter {
+    float score_threshold = 0.0f;   // drops results with a lower score
+    float nms_threshold = 0.0f;     // drops results overlapping a better one by more IoU, off at 0
+    int max_detections = 0;         // keeps the best results, all at 0
+    int min_size = 0;               // drops boxes narrower or lower than this
+
+    bool active() const
+    {
+        return score_threshold > 0.0f || nms_threshold > 0.0f || max_detections > 0 || min_size > 0;
+    }
+    // Filters results in place; the remaining results are sorted by score
+    void apply(std::list<dl::detect::result_t> &results) const;
+};
+
+} // namespace mp_esp_dl
@@ -0,0 +1,126 @@
+#include "mp_esp_dl_trace.h"
+
+#if MP_DL_TRACE_ENABLED
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "mpfile.h"
+#include "py/runtime.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+    const char *name;
+    int64_t ts;             // esp_timer_get_time(), us
+    uint32_t tid;
+    char phase;
+} trace_event_t;
+
+static trace_event_t s_events[MP_DL_TRACE_EVENTS];
+// Index of the next event; events are claimed with an atomic increment so
+// several threads can trace at once
+static uint32_t s_next;
+static volatile bool s_paused;
+
+void mp_esp_dl_trace_event(const char *name, char phase)
+{
+    if (s_paused) {
+        return;
+    }
+    uint32_t index = __atomic_fetch_add(&s_next, 1, __ATOMIC_RELAXED);
+    trace_event_t *event = &s_events[index % MP_DL_TRACE_EVENTS];
+    event->name = name;
+    event->ts = esp_timer_get_time();
+    event->tid = (uint32_t)(uintptr_t)xTaskGetCurrentTaskHandle();
+    event->phase = phase;
+}
+
+void mp_esp_dl_trace_clear(void)
+{
+    __atomic_store_n(&s_next, 0, __ATOMIC_RELAXED);
+}
+
+uint32_t mp_esp_dl_trace_count(void)
+{
+    return __atomic_load_n(&s_next, __ATOMIC_RELAXED);
+}
+
+// Appends to buf and writes it out when it is nearly full
+typedef struct {
+    mp_file_t *f;
+    char buf[1024];
+    size_t len;
+    bool ok;
+} trace_writer_t;
+
+static void writer_flush(trace_writer_t *w)
+{
+    if (w->len > 0 && mp_write(w->f, w->buf, w->len) != (mp_int_t)w->len) {
+        w->ok = false;
+    }
+    w->len = 0;
+}
+
+static void writer_append(trace_writer_t *w, const char *text, size_t len)
+{
+    if (w->len + len > sizeof(w->buf)) {
+        writer_flush(w);
+    }
+    memcpy(w->buf + w->len, text, len);
+    w->len += len;
+}
+
+static int write_events(const char *path)
+{
+    uint32_t total = mp_esp_dl_trace_count();
+    uint32_t count = total < MP_DL_TRACE_EVENTS ? total : MP_DL_TRACE_EVENTS;
+    uint32_t first = total - count;
+
+    trace_writer_t w;
+    w.f = mp_open(path, "wb");
+    w.len = 0;
+    w.ok = w.f != NULL;
+    if (!w.ok) {
+        return -1;
+    }
+
+    static const char head[] = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    writer_append(&w, head, sizeof(head) - 1);
+    for (uint32_t i = 0; i < count; i++) {
+        const trace_event_t *event = &s_events[(first + i) % MP_DL_TRACE_EVENTS];
+        char line[160];
+        int len = snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lld,\"pid\":1,\"tid\":%lu}",
+                           i > 0 ? ",\n" : "", event->name, event->phase, (long long)event->ts,
+                           (unsigned long)event->tid);
+        if (len > 0) {
+            writer_append(&w, line, len < (int)sizeof(line) ? (size_t)len : sizeof(line) - 1);
+        }
+    }
+    static const char tail[] = "\n]}\n";
+    writer_append(&w, tail, sizeof(tail) - 1);
+    writer_flush(&w);
+    mp_close(w.f);
+    return w.ok ? (int)count : -1;
+}
+
+int mp_esp_dl_trace_dump(const char *path)
+{
+    // The file functions raise on errors, tracing is resumed before the exception is passed on
+    s_paused = true;
+    int count;
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        count = write_events(path);
+        nlr_pop();
+    } else {
+        s_paused = false;
+        nlr_jump(nlr.ret_val);
+    }
+    s_paused = false;
+    return count;
+}
+
+#endif
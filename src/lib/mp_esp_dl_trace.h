@@ -0,0 +1,66 @@
+#pragma once
+
+// Event tracing for frame-by-frame timelines. Built in with
+// MP_DL_TRACE_ENABLED=1, otherwise the macros expand to nothing. Events are
+// kept in a ring of MP_DL_TRACE_EVENTS entries, the oldest are overwritten,
+// and are written as Chrome trace-event JSON by mp_esp_dl_trace_dump(), which
+// chrome://tracing and Perfetto open.
+//
+// Event names must be string literals or other strings which live as long as
+// the firmware, such as qstrs; only the pointer is stored.
+
+#include <stdint.h>
+
+#ifndef MP_DL_TRACE_ENABLED
+#define MP_DL_TRACE_ENABLED 0
+#endif
+
+#ifndef MP_DL_TRACE_EVENTS
+#define MP_DL_TRACE_EVENTS 4096
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if MP_DL_TRACE_ENABLED
+
+void mp_esp_dl_trace_event(const char *name, char phase);
+void mp_esp_dl_trace_clear(void);
+// Number of events recorded since the last clear, including overwritten ones
+uint32_t mp_esp_dl_trace_count(void);
+// Writes the events in the ring to path, returns their number or -1 if the
+// file could not be written. Events of the dump itself are not recorded.
+int mp_esp_dl_trace_dump(const char *path);
+
+#define MP_DL_TRACE_BEGIN(name) mp_esp_dl_trace_event(name, 'B')
+#define MP_DL_TRACE_END(name) mp_esp_dl_trace_event(name, 'E')
+
+#else
+
+#define MP_DL_TRACE_BEGIN(name) ((void)0)
+#define MP_DL_TRACE_END(name) ((void)0)
+
+#endif
+
+#ifdef __cplusplus
+}
+
+// Traces the enclosing scope. A MicroPython exception unwinds past the
+// destructor, the viewer then shows the span without an end.
+#if MP_DL_TRACE_ENABLED
+namespace mp_esp_dl {
+struct TraceScope {
+    const char *name;
+    TraceScope(const char *scope_name) : name(scope_name) { MP_DL_TRACE_BEGIN(name); }
+    ~TraceScope() { MP_DL_TRACE_END(name); }
+};
+} // namespace mp_esp_dl
+#define MP_DL_TRACE_CONCAT_(a, b) a##b
+#define MP_DL_TRACE_CONCAT(a, b) MP_DL_TRACE_CONCAT_(a, b)
+#define MP_DL_TRACE_SCOPE(name) mp_esp_dl::TraceScope MP_DL_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#else
+#define MP_DL_TRACE_SCOPE(name) ((void)0)
+#endif
+
+#endif
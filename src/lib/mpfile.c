@@ -28,6 +28,7 @@
  #include "py/misc.h"
  #include "py/runtime.h"
  #include "mpfile.h"
+ #include "mp_esp_dl_trace.h"
  
  #include "extmod/vfs.h"
  
@@ -81,9 +82,10 @@
  }
  
  off_t mp_seek(mp_file_t *file, off_t offset, int whence) {
-     return mp_obj_get_int(mp_call_function_2(file->seek_fn,
-                                              MP_OBJ_NEW_SMALL_INT(offset),
-                                              MP_OBJ_NEW_SMALL_INT(whence)));
+     mp_obj_t pos = mp_call_function_2(file->seek_fn,
+                                       MP_OBJ_NEW_SMALL_INT(offset),
+                                       MP_OBJ_NEW_SMALL_INT(whence));
+     return mp_obj_get_int(pos);
  }
  
  off_t mp_tell(mp_file_t *file) {
@@ -120,6 +122,69 @@
      mp_call_function_0(close_fn);
  }
  
+ void mp_rename(const char *from_path, const char *to_path) {
+     mp_vfs_rename(mp_obj_new_str(from_path, strlen(from_path)), mp_obj_new_str(to_path, strlen(to_path)));
+ }
+ 
+// Runs a file call under nlr; on an exception it is printed and fail is returned.
+// The call is traced here rather than in the raising functions, so its span
+// also ends when it raises.
+#define MP_TRY_FILE_CALL(name, type, call, fail) \
+    nlr_buf_t nlr; \
+    type volatile result = fail; \
+    MP_DL_TRACE_BEGIN(name); \
+    if (nlr_push(&nlr) == 0) { \
+        result = call; \
+        nlr_pop(); \
+    } else { \
+        mp_obj_print_exception(&mp_plat_print, MP_OBJ_FROM_PTR(nlr.ret_val)); \
+    } \
+    MP_DL_TRACE_END(name); \
+    return result
+
+mp_file_t *mp_try_open(const char *filename, const char *mode) {
+    MP_TRY_FILE_CALL("mp_open", mp_file_t *, mp_open(filename, mode), NULL);
+}
+
+mp_int_t mp_try_readinto(mp_file_t *file, void *buf, size_t num_bytes) {
+    MP_TRY_FILE_CALL("mp_readinto", mp_int_t, mp_readinto(file, buf, num_bytes), -1);
+}
+
+mp_int_t mp_try_write(mp_file_t *file, const void *buf, size_t num_bytes) {
+    MP_TRY_FILE_CALL("mp_write", mp_int_t, mp_write(file, buf, num_bytes), -1);
+}
+
+off_t mp_try_seek(mp_file_t *file, off_t offset, int whence) {
+    MP_TRY_FILE_CALL("mp_seek", off_t, mp_seek(file, offset, whence), -1);
+}
+
+off_t mp_try_tell(mp_file_t *file) {
+    MP_TRY_FILE_CALL("mp_tell", off_t, mp_tell(file), -1);
+}
+
+void mp_try_close(mp_file_t *file) {
+    nlr_buf_t nlr;
+    MP_DL_TRACE_BEGIN("mp_close");
+    if (nlr_push(&nlr) == 0) {
+        mp_close(file);
+        nlr_pop();
+    } else {
+        mp_obj_print_exception(&mp_plat_print, MP_OBJ_FROM_PTR(nlr.ret_val));
+    }
+    MP_DL_TRACE_END("mp_close");
+}
+
+bool mp_try_rename(const char *from_path, const char *to_path) {
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_rename(from_path, to_path);
+        nlr_pop();
+        return true;
+    }
+    mp_obj_print_exception(&mp_plat_print, MP_OBJ_FROM_PTR(nlr.ret_val));
+    return false;
+}
+
  static void mp_file_print(const mp_print_t *print, mp_obj_t self, mp_print_kind_t kind) {
      (void)kind;
      mp_printf(print, "<mp_file %p>", self);
@@ -53,6 +53,20 @@ mp_int_t mp_write(mp_file_t *file, const void *buf, size_t num_bytes);
 off_t mp_seek(mp_file_t *file, off_t offset, int whence);
 off_t mp_tell(mp_file_t *file);
 void mp_close(mp_file_t *file);
+// Replaces to_path if it exists; raises OSError on failure
+void mp_rename(const char *from_path, const char *to_path);
+
+// The functions above raise through nlr like any other MicroPython call. The
+// mp_try_* variants print the exception and return NULL, -1 or false instead,
+// for C++ callers: a raise skips destructors, so a lock guard or a container
+// which is live across the call would stay locked or leak.
+mp_file_t *mp_try_open(const char *filename, const char *mode);
+mp_int_t mp_try_readinto(mp_file_t *file, void *buf, size_t num_bytes);
+mp_int_t mp_try_write(mp_file_t *file, const void *buf, size_t num_bytes);
+off_t mp_try_seek(mp_file_t *file, off_t offset, int whence);
+off_t mp_try_tell(mp_file_t *file);
+void mp_try_close(mp_file_t *file);
+bool mp_try_rename(const char *from_path, const char *to_path);
 
 
 #endif // __MICROPY_INCLUDED_PY_MPFILE_H__
@@ -7,11 +7,24 @@ add_dependencies(usermod_mp_esp_dl human_face_detect)
 if (MP_DL_IMAGENET_CLS_ENABLED)
     target_compile_definitions(usermod_mp_esp_dl INTERFACE MP_DL_IMAGENET_CLS_ENABLED=1)
     add_dependencies(usermod_mp_esp_dl imagenet_cls)
+    target_sources(usermod_mp_esp_dl INTERFACE
+        ${CMAKE_CURRENT_LIST_DIR}/lib/mp_esp_dl_imagenet_cls.cpp
+    )
 endif()
 
 if (MP_DL_PEDESTRISN_DETECTOR_ENABLED)
     target_compile_definitions(usermod_mp_esp_dl INTERFACE MP_DL_PEDESTRISN_DETECTOR_ENABLED=1)
     add_dependencies(usermod_mp_esp_dl pedestrian_detect)
+    target_sources(usermod_mp_esp_dl INTERFACE
+        ${CMAKE_CURRENT_LIST_DIR}/lib/mp_esp_dl_pedestrian_detect.cpp
+    )
+endif()
+
+# ImageNet and the HumanDetector both take JPEG input
+if (MP_DL_IMAGENET_CLS_ENABLED OR MP_DL_PEDESTRISN_DETECTOR_ENABLED)
+    target_sources(usermod_mp_esp_dl INTERFACE
+        ${CMAKE_CURRENT_LIST_DIR}/lib/mp_esp_dl_jpeg_input.cpp
+    )
 endif()
 
 if (MP_DL_FACE_RECOGNITION_ENABLED)
@@ -19,18 +32,43 @@ if (MP_DL_FACE_RECOGNITION_ENABLED)
     add_dependencies(usermod_mp_esp_dl human_face_recognition)
     target_compile_options(usermod INTERFACE $<$<COMPILE_LANGUAGE:CXX>:-frtti>)
     target_sources(usermod_mp_esp_dl INTERFACE 
-        ${CMAKE_CURRENT_LIST_DIR}/lib/mp_esp_dl_recognition_database.cpp
         ${CMAKE_CURRENT_LIST_DIR}/lib/mp_esp_dl_human_face_recognition.cpp
-        ${CMAKE_CURRENT_LIST_DIR}/lib/mpfile.c
     )
 endif()
 
+# The recognition database also holds the custom classes of ImageNet
+if (MP_DL_FACE_RECOGNITION_ENABLED OR MP_DL_IMAGENET_CLS_ENABLED)
+    target_sources(usermod_mp_esp_dl INTERFACE
+        ${CMAKE_CURRENT_LIST_DIR}/lib/mp_esp_dl_recognition_database.cpp
+        ${CMAKE_CURRENT_LIST_DIR}/lib/mp_esp_dl_projection.cpp
+        ${CMAKE_CURRENT_LIST_DIR}/lib/mp_esp_dl_face_store.cpp
+        ${CMAKE_CURRENT_LIST_DIR}/lib/mp_esp_dl_face_align.cpp
+    )
+endif()
+
+if (MP_DL_TRACE_ENABLED)
+    target_compile_definitions(usermod_mp_esp_dl INTERFACE MP_DL_TRACE_ENABLED=1)
+endif()
+
 target_sources(usermod_mp_esp_dl INTERFACE
     ${CMAKE_CURRENT_LIST_DIR}/esp_face_detector.cpp
 	${CMAKE_CURRENT_LIST_DIR}/esp_face_recognition.cpp
     ${CMAKE_CURRENT_LIST_DIR}/esp_human_detector.cpp
     ${CMAKE_CURRENT_LIST_DIR}/esp_imagenet_cls.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/esp_pipeline.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/esp_scheduler.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/esp_model.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/esp_results.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/esp_draw.cpp
     ${CMAKE_CURRENT_LIST_DIR}/mp_esp_dl_module.c
+    ${CMAKE_CURRENT_LIST_DIR}/mp_esp_dl_api.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/lib/mp_esp_dl_arena.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/lib/mp_esp_dl_input_scaler.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/lib/mp_esp_dl_result_filter.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/lib/mp_esp_dl_overlay.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/lib/mp_esp_dl_model.cpp
+    ${CMAKE_CURRENT_LIST_DIR}/lib/mpfile.c
+    ${CMAKE_CURRENT_LIST_DIR}/lib/mp_esp_dl_trace.c
 )
 
 target_include_directories(usermod_mp_esp_dl INTERFACE
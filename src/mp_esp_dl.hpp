@@ -2,17 +2,33 @@
 
 #ifdef __cplusplus
 #include "dl_image_define.hpp"
+#include "dl_detect_define.hpp"
+#include "esp_timer.h"
+#include "lib/mp_esp_dl_arena.hpp"
+#include "lib/mp_esp_dl_input_scaler.hpp"
+#include "lib/mp_esp_dl_result_filter.hpp"
+#include "lib/mp_esp_dl_trace.h"
+#include <algorithm>
+#include <list>
 #include <memory>
+#include <vector>
 extern "C" {
 #endif
 
 #include "py/obj.h"
+#include "py/objarray.h"
 #include "py/runtime.h"
 
 extern const mp_obj_type_t mp_face_detector_type;
 extern const mp_obj_type_t mp_image_net_type;
 extern const mp_obj_type_t mp_human_detector_type;
 extern const mp_obj_type_t mp_face_recognizer_type;
+extern const mp_obj_type_t mp_pipeline_type;
+extern const mp_obj_type_t mp_scheduler_type;
+extern const mp_obj_type_t mp_model_type;
+extern const mp_obj_fun_builtin_var_t mp_esp_dl_results_to_json_obj;
+extern const mp_obj_fun_builtin_var_t mp_esp_dl_results_to_bin_obj;
+extern const mp_obj_fun_builtin_var_t mp_esp_dl_draw_obj;
 
 #define MP_DEFINE_CONST_FUN_OBJ_0_CXX(obj_name, fun_name) \
     const mp_obj_fun_builtin_fixed_t obj_name = {.base = &mp_type_fun_builtin_0, .fun = {._0 = fun_name }}
@@ -49,6 +65,24 @@ namespace mp_esp_dl {
         mp_obj_base_t base;
         dl::image::img_t img;
         std::shared_ptr<TModel> model;
+        float scale;
+        int max_input;
+        bool refine;
+        std::shared_ptr<InputScaler> scaler;
+        std::shared_ptr<Arena> arena;
+        ResultFilter filter;
+    };
+
+    // Deadline of a call on the esp_timer clock, checked between the stages of
+    // a run. A stage which has been started always completes. Without a
+    // positive number of milliseconds the deadline never passes.
+    class Deadline {
+    public:
+        explicit Deadline(mp_int_t ms) : m_end(ms > 0 ? esp_timer_get_time() + (int64_t)ms * 1000 : 0) {}
+        bool passed() const { return m_end != 0 && esp_timer_get_time() >= m_end; }
+
+    private:
+        int64_t m_end;
     };
 
     template <typename TDetector, typename TModel>
@@ -64,10 +98,153 @@ namespace mp_esp_dl {
         self->img.height = height;
         self->img.pix_type = pix_type;
         self->img.data = nullptr;
+        self->scale = 1.0f;
+        self->max_input = 0;
+        self->refine = false;
+        self->arena = std::make_shared<Arena>();
+        self->filter = ResultFilter();
     
         return self;
     }
 
+    // Scale factor of the detection input, from scale and max_input
+    template <typename T>
+    float input_scale(T *self) {
+        float scale = self->scale;
+        int longest = std::max(self->img.width, self->img.height);
+        if (self->max_input > 0 && longest * scale > self->max_input) {
+            scale = (float)self->max_input / longest;
+        }
+        return scale;
+    }
+
+    // Sizes the arena for the scratch buffers of one run up front. Called
+    // again whenever the frame size or the input scaling changes.
+    template <typename T>
+    void reserve_scratch(T *self) {
+        if (!self->arena) {
+            return;
+        }
+        size_t frame_bytes = dl::image::get_img_byte_size(self->img);
+        float effective = input_scale(self);
+        size_t peak = 0;
+        if (effective < 1.0f) {
+            peak += (size_t)(frame_bytes * effective * effective) + 2 * self->img.width * 4;
+            if (self->refine) {
+                peak += frame_bytes;
+            }
+        }
+        self->arena->reserve(peak);
+    }
+
+    template <typename T>
+    void set_input_scale(T *self, float scale, mp_int_t max_input, bool refine) {
+        if (scale <= 0.0f || scale > 1.0f) {
+            mp_raise_ValueError("scale must be in the range (0, 1].");
+        }
+        if (max_input < 0) {
+            mp_raise_ValueError("max_input must not be negative.");
+        }
+        self->scale = scale;
+        self->max_input = max_input;
+        self->refine = refine;
+        reserve_scratch(self);
+    }
+
+    // Runs the detection model, optionally on a downscaled copy of the frame.
+    // Boxes and keypoints are always returned in framebuffer coordinates. With
+    // refine enabled, every detection of the downscaled pass is detected again
+    // on a native resolution crop around it.
+    template <typename T>
+    std::list<dl::detect::result_t> *detect_unfiltered(T *self) {
+        MP_DL_TRACE_SCOPE("detect");
+        // A new run, the scratch buffers of the last one are no longer used
+        self->arena->reset();
+
+        float scale = input_scale(self);
+        if (scale >= 1.0f) {
+            MP_DL_TRACE_SCOPE("model");
+            return &self->model->run(self->img);
+        }
+
+        if (!self->scaler) {
+            self->scaler = std::make_shared<InputScaler>(self->arena.get());
+        }
+        int width = std::max((int)(self->img.width * scale + 0.5f), 1);
+        int height = std::max((int)(self->img.height * scale + 0.5f), 1);
+        MP_DL_TRACE_BEGIN("scale");
+        const dl::image::img_t &small = self->scaler->resize(self->img, width, height);
+        MP_DL_TRACE_END("scale");
+        if (!small.data) {
+            return nullptr;
+        }
+
+        MP_DL_TRACE_BEGIN("model");
+        auto &coarse = self->model->run(small);
+        MP_DL_TRACE_END("model");
+        float scale_x = (float)self->img.width / width;
+        float scale_y = (float)self->img.height / height;
+        for (auto &res : coarse) {
+            InputScaler::to_source(res, scale_x, scale_y, 0, 0);
+        }
+        if (!self->refine || coarse.empty()) {
+            return &coarse;
+        }
+
+        MP_DL_TRACE_SCOPE("refine");
+        // The model reuses its result list, so keep the coarse pass aside
+        std::list<dl::detect::result_t> regions(coarse.begin(), coarse.end());
+        auto &results = self->scaler->results;
+        results.clear();
+        for (auto &region : regions) {
+            int margin_x = (region.box[2] - region.box[0]) / 2;
+            int margin_y = (region.box[3] - region.box[1]) / 2;
+            int x1 = std::max(region.box[0] - margin_x, 0);
+            int y1 = std::max(region.box[1] - margin_y, 0);
+            const dl::image::img_t &crop = self->scaler->crop(
+                self->img, x1, y1, region.box[2] + margin_x, region.box[3] + margin_y);
+            // A degenerate box has nothing to refine
+            if (InputScaler::empty(crop)) {
+                results.push_back(region);
+                continue;
+            }
+            if (!crop.data) {
+                return nullptr;
+            }
+            auto &fine = self->model->run(crop);
+            auto best = std::max_element(fine.begin(), fine.end(),
+                [](const dl::detect::result_t &a, const dl::detect::result_t &b) { return a.score < b.score; });
+            if (best == fine.end()) {
+                results.push_back(region);
+                continue;
+            }
+            InputScaler::to_source(*best, 1.0f, 1.0f, x1, y1);
+            results.push_back(*best);
+        }
+        return &results;
+    }
+
+    // Detects and applies filter, or the filter of the object if it is
+    // nullptr. Does not raise, so it can be used outside of the interpreter;
+    // returns nullptr if a scratch buffer could not be allocated.
+    template <typename T>
+    std::list<dl::detect::result_t> *try_detect(T *self, const ResultFilter *filter = nullptr) {
+        std::list<dl::detect::result_t> *results = detect_unfiltered(self);
+        if (results) {
+            (filter ? *filter : self->filter).apply(*results);
+        }
+        return results;
+    }
+
+    template <typename T>
+    std::list<dl::detect::result_t> &detect(T *self, const ResultFilter *filter = nullptr) {
+        std::list<dl::detect::result_t> *results = try_detect(self, filter);
+        if (!results) {
+            mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Failed to allocate the scaling buffers."));
+        }
+        return *results;
+    }
+
     template <typename T>
     T *get_and_validate_framebuffer(mp_obj_t self_in, mp_obj_t framebuffer_obj) {
         // Cast self_in to the correct type
@@ -101,6 +278,20 @@ namespace mp_esp_dl {
                 case MP_QSTR_pix_type:
                     dest[0] = mp_obj_new_int(self->img.pix_type);
                     break;
+                case MP_QSTR_arena: {
+                    // None once the object has been deleted
+                    if (!self->arena) {
+                        dest[0] = mp_const_none;
+                        break;
+                    }
+                    mp_obj_t dict = mp_obj_new_dict(4);
+                    mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("capacity"), mp_obj_new_int_from_uint(self->arena->capacity()));
+                    mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("used"), mp_obj_new_int_from_uint(self->arena->used()));
+                    mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("high_water"), mp_obj_new_int_from_uint(self->arena->high_water()));
+                    mp_obj_dict_store(dict, mp_obj_new_str_from_cstr("overflows"), mp_obj_new_int_from_uint(self->arena->overflows()));
+                    dest[0] = dict;
+                    break;
+                }
                 default:
                     dest[1] = MP_OBJ_SENTINEL;
             }
@@ -118,9 +309,187 @@ namespace mp_esp_dl {
                 default:
                     return;
             }
+            // The scratch buffers follow the frame size
+            reserve_scratch(self);
             dest[0] = MP_OBJ_NULL;
         }
     }
+
+    // Sets the option attr of filter to value. Returns false if attr is no filter option.
+    inline bool set_filter_option(ResultFilter &filter, qstr attr, mp_obj_t value) {
+        switch (attr) {
+            case MP_QSTR_score_threshold:
+                filter.score_threshold = mp_obj_get_float(value);
+                return true;
+            case MP_QSTR_nms_threshold: {
+                float threshold = mp_obj_get_float(value);
+                if (threshold < 0.0f || threshold > 1.0f) {
+                    mp_raise_ValueError("nms_threshold must be in the range [0, 1].");
+                }
+                filter.nms_threshold = threshold;
+                return true;
+            }
+            case MP_QSTR_max_detections:
+                filter.max_detections = std::max((int)mp_obj_get_int(value), 0);
+                return true;
+            case MP_QSTR_min_size:
+                filter.min_size = std::max((int)mp_obj_get_int(value), 0);
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Keyword arguments of run() which override the filter of the object for
+    // one call. They have to be the last arguments, in this order.
+    #define MP_DL_FILTER_ARGS \
+        { MP_QSTR_score_threshold, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} }, \
+        { MP_QSTR_nms_threshold, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} }, \
+        { MP_QSTR_max_detections, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} }, \
+        { MP_QSTR_min_size, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} }
+
+    // The filter of self with the options given in args, the parsed MP_DL_FILTER_ARGS
+    template <typename T>
+    ResultFilter filter_from_args(T *self, const mp_arg_val_t *args) {
+        static const qstr options[] = {
+            MP_QSTR_score_threshold, MP_QSTR_nms_threshold, MP_QSTR_max_detections, MP_QSTR_min_size,
+        };
+        ResultFilter filter = self->filter;
+        for (size_t i = 0; i < MP_ARRAY_SIZE(options); i++) {
+            if (args[i].u_obj != mp_const_none) {
+                set_filter_option(filter, options[i], args[i].u_obj);
+            }
+        }
+        return filter;
+    }
+
+    // Properties of the detectors: the common ones plus the input scaling and filter options
+    template <typename T>
+    void detector_obj_property(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
+        T *self = static_cast<T *>(MP_OBJ_TO_PTR(self_in));
+        if (dest[0] == MP_OBJ_NULL) {
+            switch (attr) {
+                case MP_QSTR_score_threshold:
+                    dest[0] = mp_obj_new_float(self->filter.score_threshold);
+                    return;
+                case MP_QSTR_nms_threshold:
+                    dest[0] = mp_obj_new_float(self->filter.nms_threshold);
+                    return;
+                case MP_QSTR_max_detections:
+                    dest[0] = mp_obj_new_int(self->filter.max_detections);
+                    return;
+                case MP_QSTR_min_size:
+                    dest[0] = mp_obj_new_int(self->filter.min_size);
+                    return;
+                case MP_QSTR_scale:
+                    dest[0] = mp_obj_new_float(self->scale);
+                    return;
+                case MP_QSTR_max_input:
+                    dest[0] = mp_obj_new_int(self->max_input);
+                    return;
+                case MP_QSTR_refine:
+                    dest[0] = mp_obj_new_bool(self->refine);
+                    return;
+            }
+        } else if (dest[1] != MP_OBJ_NULL) {
+            switch (attr) {
+                case MP_QSTR_scale:
+                    set_input_scale(self, mp_obj_get_float(dest[1]), self->max_input, self->refine);
+                    dest[0] = MP_OBJ_NULL;
+                    return;
+                case MP_QSTR_max_input:
+                    set_input_scale(self, self->scale, mp_obj_get_int(dest[1]), self->refine);
+                    dest[0] = MP_OBJ_NULL;
+                    return;
+                case MP_QSTR_refine:
+                    set_input_scale(self, self->scale, self->max_input, mp_obj_is_true(dest[1]));
+                    dest[0] = MP_OBJ_NULL;
+                    return;
+            }
+            if (set_filter_option(self->filter, attr, dest[1])) {
+                dest[0] = MP_OBJ_NULL;
+                return;
+            }
+        }
+        espdl_obj_property<T>(self_in, attr, dest);
+    }
+
+    // Collects the results of run_batch(). Every result is stored as a fixed
+    // number of floats, so the whole batch comes back as two memoryviews:
+    // the number of results per item and the flat result values. The buffers
+    // are on the GC heap and become the memoryviews, so a raise between the
+    // items leaks nothing.
+    class BatchResult {
+    public:
+        // capacity is the expected number of results, the values grow beyond it
+        BatchResult(size_t n_items, int stride, size_t capacity = 16) :
+            m_stride(stride), m_n_items(0), m_n_values(0), m_capacity(std::max<size_t>(capacity, 1) * stride) {
+            m_counts = m_new(uint16_t, std::max<size_t>(n_items, 1));
+            m_values = m_new(float, m_capacity);
+        }
+
+        // Starts the results of the next batch item
+        void next_item() {
+            m_counts[m_n_items++] = 0;
+        }
+
+        // Appends a result to the current item and returns its m_stride values
+        float *add() {
+            if (m_n_values + m_stride > m_capacity) {
+                m_values = m_renew(float, m_values, m_capacity, m_capacity * 2);
+                m_capacity *= 2;
+            }
+            m_counts[m_n_items - 1]++;
+            m_n_values += m_stride;
+            return &m_values[m_n_values - m_stride];
+        }
+
+        // Returns the tuple (counts, values) with counts as 'H' and values as 'f' memoryview
+        mp_obj_t to_obj() {
+            mp_obj_t items[2] = {
+                mp_obj_new_memoryview('H', m_n_items, m_counts),
+                mp_obj_new_memoryview('f', m_n_values, m_values),
+            };
+            return mp_obj_new_tuple(2, items);
+        }
+
+    private:
+        int m_stride;
+        size_t m_n_items;
+        size_t m_n_values;
+        size_t m_capacity;
+        uint16_t *m_counts;
+        float *m_values;
+    };
+
+    // Runs the detector on every framebuffer of the list buffers_in. Each
+    // detection is stored as score, x1, y1, x2, y2 followed by the keypoints
+    // when with_keypoints is set.
+    template <typename T>
+    mp_obj_t detect_batch(mp_obj_t self_in, mp_obj_t buffers_in, bool with_keypoints) {
+        size_t n_items;
+        mp_obj_t *items;
+        mp_obj_get_array(buffers_in, &n_items, &items);
+
+        BatchResult batch(n_items, with_keypoints ? 15 : 5);
+        for (size_t i = 0; i < n_items; i++) {
+            T *self = get_and_validate_framebuffer<T>(self_in, items[i]);
+            batch.next_item();
+            for (const auto &res : detect(self)) {
+                float *values = batch.add();
+                values[0] = res.score;
+                for (int k = 0; k < 4; k++) {
+                    values[1 + k] = res.box[k];
+                }
+                if (with_keypoints) {
+                    for (int k = 0; k < 10; k++) {
+                        values[5 + k] = res.keypoint[k];
+                    }
+                }
+            }
+        }
+        return batch.to_obj();
+    }
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,201 @@
+#include "mp_esp_dl_api.h"
+#include "mp_esp_dl.hpp"
+#include "esp_log.h"
+#include "human_face_detect.hpp"
+#if MP_DL_PEDESTRISN_DETECTOR_ENABLED
+#include "pedestrian_detect.hpp"
+#endif
+#if MP_DL_IMAGENET_CLS_ENABLED
+#include "lib/mp_esp_dl_imagenet_cls.hpp"
+#endif
+#include <new>
+
+static const char *TAG = "mp_esp_dl_api";
+
+// Handle behind mp_esp_dl_handle_t. The results of the last run are kept
+// in a vector which is reused, so a run does not allocate once the number of
+// results has been seen before.
+struct mp_esp_dl_model {
+    virtual ~mp_esp_dl_model() {}
+    virtual esp_err_t run(const dl::image::img_t &img) = 0;
+
+    std::vector<mp_esp_dl_result_t> results;
+};
+
+namespace mp_esp_dl::api {
+
+// Same fields as MP_DetectorBase, so the detection path of the Python
+// classes (try_detect) is shared, without the MicroPython object header.
+template <typename TModel>
+struct DetectorHandle : public mp_esp_dl_model {
+    dl::image::img_t img;
+    std::shared_ptr<TModel> model;
+    float scale;
+    int max_input;
+    bool refine;
+    std::shared_ptr<InputScaler> scaler;
+    std::shared_ptr<Arena> arena;
+    ResultFilter filter;
+    bool with_keypoints;
+
+    DetectorHandle(const mp_esp_dl_config_t &config, bool keypoints) :
+        img({nullptr, 0, 0, dl::image::DL_IMAGE_PIX_TYPE_RGB888}),
+        model(std::make_shared<TModel>()),
+        scale(config.scale),
+        max_input(config.max_input),
+        refine(config.refine),
+        arena(std::make_shared<Arena>()),
+        with_keypoints(keypoints)
+    {
+        filter.score_threshold = config.score_threshold;
+        filter.nms_threshold = config.nms_threshold;
+        filter.max_detections = config.max_detections;
+        filter.min_size = config.min_size;
+    }
+
+    esp_err_t run(const dl::image::img_t &frame) override
+    {
+        bool resized = frame.width != img.width || frame.height != img.height || frame.pix_type != img.pix_type;
+        img = frame;
+        if (resized) {
+            reserve_scratch(this);
+        }
+
+        std::list<dl::detect::result_t> *detections = try_detect(this);
+        if (!detections) {
+            ESP_LOGE(TAG, "Failed to allocate the scaling buffers.");
+            return ESP_ERR_NO_MEM;
+        }
+
+        results.clear();
+        for (const auto &det : *detections) {
+            mp_esp_dl_result_t res = {};
+            res.score = det.score;
+            std::copy(det.box.begin(), det.box.begin() + 4, res.box);
+            if (with_keypoints && det.keypoint.size() >= 10) {
+                std::copy(det.keypoint.begin(), det.keypoint.begin() + 10, res.keypoint);
+            }
+            results.push_back(res);
+        }
+        return ESP_OK;
+    }
+};
+
+#if MP_DL_IMAGENET_CLS_ENABLED
+struct ClassifierHandle : public mp_esp_dl_model {
+    ImageNetClassifier model;
+    float score_threshold;
+
+    ClassifierHandle(const mp_esp_dl_config_t &config) :
+        model(ImageNetClassifier::MOBILENETV2_S8_V1, config.top_k), score_threshold(config.score_threshold)
+    {
+    }
+
+    esp_err_t run(const dl::image::img_t &img) override
+    {
+        results.clear();
+        for (const auto &cls : model.run(img)) {
+            if (cls.score < score_threshold) {
+                break;
+            }
+            mp_esp_dl_result_t res = {};
+            res.score = cls.score;
+            res.label = cls.cat_name;
+            results.push_back(res);
+        }
+        return ESP_OK;
+    }
+};
+#endif
+
+} // namespace mp_esp_dl::api
+
+using namespace mp_esp_dl::api;
+
+esp_err_t mp_esp_dl_create(mp_esp_dl_model_type_t type, const mp_esp_dl_config_t *config, mp_esp_dl_handle_t *ret_handle)
+{
+    if (!ret_handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *ret_handle = nullptr;
+
+    mp_esp_dl_config_t defaults = MP_ESP_DL_CONFIG_DEFAULT();
+    if (!config) {
+        config = &defaults;
+    }
+    if (config->scale <= 0.0f || config->scale > 1.0f || config->max_input < 0 || config->top_k < 1 ||
+        config->nms_threshold < 0.0f || config->nms_threshold > 1.0f || config->max_detections < 0 || config->min_size < 0) {
+        ESP_LOGE(TAG, "Invalid configuration.");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    mp_esp_dl_model *handle = nullptr;
+    switch (type) {
+    case MP_ESP_DL_FACE_DETECTOR:
+        handle = new (std::nothrow) DetectorHandle<HumanFaceDetect>(*config, true);
+        break;
+#if MP_DL_PEDESTRISN_DETECTOR_ENABLED
+    case MP_ESP_DL_HUMAN_DETECTOR:
+        handle = new (std::nothrow) DetectorHandle<PedestrianDetect>(*config, false);
+        break;
+#endif
+#if MP_DL_IMAGENET_CLS_ENABLED
+    case MP_ESP_DL_IMAGENET:
+        handle = new (std::nothrow) ClassifierHandle(*config);
+        break;
+#endif
+    default:
+        ESP_LOGE(TAG, "Model type %d is not built into this firmware.", (int)type);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (!handle) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    *ret_handle = handle;
+    return ESP_OK;
+}
+
+void mp_esp_dl_destroy(mp_esp_dl_handle_t handle)
+{
+    delete handle;
+}
+
+esp_err_t mp_esp_dl_run(mp_esp_dl_handle_t handle, const mp_esp_dl_image_t *image, size_t *ret_count)
+{
+    if (!handle || !image || !image->data || image->width == 0 || image->height == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    dl::image::img_t img;
+    img.data = image->data;
+    img.width = image->width;
+    img.height = image->height;
+    switch (image->pix_type) {
+    case MP_ESP_DL_PIX_RGB888:
+        img.pix_type = dl::image::DL_IMAGE_PIX_TYPE_RGB888;
+        break;
+    case MP_ESP_DL_PIX_RGB565:
+        img.pix_type = dl::image::DL_IMAGE_PIX_TYPE_RGB565;
+        break;
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = handle->run(img);
+    if (err != ESP_OK) {
+        handle->results.clear();
+    }
+    if (ret_count) {
+        *ret_count = handle->results.size();
+    }
+    return err;
+}
+
+const mp_esp_dl_result_t *mp_esp_dl_get_result(mp_esp_dl_handle_t handle, size_t index)
+{
+    if (!handle || index >= handle->results.size()) {
+        return nullptr;
+    }
+    return &handle->results[index];
+}
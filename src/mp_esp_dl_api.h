@@ -0,0 +1,90 @@
+// Native C API of the espdl module.
+//
+// Lets other C modules linked into the same firmware (camera, JPEG decoder,
+// custom pipelines) run the models on raw framebuffers without going through
+// the interpreter. No MicroPython objects are created and nothing raises, so
+// the functions can be called from a camera callback or another FreeRTOS task.
+// A handle must not be used by two tasks at the same time.
+//
+//   mp_esp_dl_handle_t detector;
+//   mp_esp_dl_config_t config = MP_ESP_DL_CONFIG_DEFAULT();
+//   config.max_input = 320;
+//   if (mp_esp_dl_create(MP_ESP_DL_FACE_DETECTOR, &config, &detector) == ESP_OK) {
+//       mp_esp_dl_image_t image = { fb->buf, fb->width, fb->height, MP_ESP_DL_PIX_RGB888 };
+//       size_t count;
+//       if (mp_esp_dl_run(detector, &image, &count) == ESP_OK) {
+//           for (size_t i = 0; i < count; i++) {
+//               const mp_esp_dl_result_t *res = mp_esp_dl_get_result(detector, i);
+//               ...
+//           }
+//       }
+//       mp_esp_dl_destroy(detector);
+//   }
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MP_ESP_DL_API_VERSION 2
+
+typedef enum {
+    MP_ESP_DL_FACE_DETECTOR,
+    MP_ESP_DL_HUMAN_DETECTOR,   // needs MP_DL_PEDESTRISN_DETECTOR_ENABLED
+    MP_ESP_DL_IMAGENET,         // needs MP_DL_IMAGENET_CLS_ENABLED
+} mp_esp_dl_model_type_t;
+
+typedef enum {
+    MP_ESP_DL_PIX_RGB888,
+    MP_ESP_DL_PIX_RGB565,
+} mp_esp_dl_pix_type_t;
+
+typedef struct {
+    void *data;
+    uint16_t width;
+    uint16_t height;
+    mp_esp_dl_pix_type_t pix_type;
+} mp_esp_dl_image_t;
+
+// Same options as the keyword arguments of the Python classes
+typedef struct {
+    float scale;        // detectors: downscaling factor in (0, 1]
+    int max_input;      // detectors: maximum length of the longer input side, 0 for no limit
+    bool refine;        // detectors: detect again on native resolution crops
+    int top_k;          // ImageNet: number of classes returned per run
+    float score_threshold;  // drops results with a lower score
+    float nms_threshold;    // detectors: drops boxes overlapping a better one by more IoU, 0 for off
+    int max_detections;     // detectors: keeps the best results, 0 for all
+    int min_size;           // detectors: drops boxes narrower or lower than this
+} mp_esp_dl_config_t;
+
+#define MP_ESP_DL_CONFIG_DEFAULT() { .scale = 1.0f, .max_input = 0, .refine = false, .top_k = 5, \
+    .score_threshold = 0.0f, .nms_threshold = 0.0f, .max_detections = 0, .min_size = 0 }
+
+typedef struct {
+    float score;
+    int box[4];             // x1, y1, x2, y2 in framebuffer coordinates, zero for ImageNet
+    int keypoint[10];       // face detector: eyes, nose, mouth corners as x, y; zero otherwise
+    const char *label;      // ImageNet: category name; NULL for the detectors
+} mp_esp_dl_result_t;
+
+typedef struct mp_esp_dl_model *mp_esp_dl_handle_t;
+
+// Loads a model. ESP_ERR_NOT_SUPPORTED if the model is not built into the firmware.
+esp_err_t mp_esp_dl_create(mp_esp_dl_model_type_t type, const mp_esp_dl_config_t *config, mp_esp_dl_handle_t *ret_handle);
+void mp_esp_dl_destroy(mp_esp_dl_handle_t handle);
+
+// Runs the model on image and stores the number of results in ret_count.
+// The results stay valid until the next run on the same handle.
+esp_err_t mp_esp_dl_run(mp_esp_dl_handle_t handle, const mp_esp_dl_image_t *image, size_t *ret_count);
+// Result index of the last run, NULL if index is out of range
+const mp_esp_dl_result_t *mp_esp_dl_get_result(mp_esp_dl_handle_t handle, size_t index);
+
+#ifdef __cplusplus
+}
+#endif
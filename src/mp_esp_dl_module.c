@@ -1,5 +1,25 @@
 #include "py/runtime.h"
+#include "py/mperrno.h"
 #include "mp_esp_dl.hpp"
+#include "lib/mp_esp_dl_trace.h"
+
+#if MP_DL_TRACE_ENABLED
+// Writes the trace events to a file as Chrome trace-event JSON
+static mp_obj_t espdl_trace_dump(mp_obj_t path_in) {
+    int count = mp_esp_dl_trace_dump(mp_obj_str_get_str(path_in));
+    if (count < 0) {
+        mp_raise_OSError(MP_EIO);
+    }
+    return mp_obj_new_int(count);
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(espdl_trace_dump_obj, espdl_trace_dump);
+
+static mp_obj_t espdl_trace_clear(void) {
+    mp_esp_dl_trace_clear();
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_0(espdl_trace_clear_obj, espdl_trace_clear);
+#endif
 
 static const mp_rom_map_elem_t module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_espdl) },
@@ -9,10 +29,20 @@ static const mp_rom_map_elem_t module_globals_table[] = {
     #endif
     #if MP_DL_PEDESTRISN_DETECTOR_ENABLED
     { MP_ROM_QSTR(MP_QSTR_HumanDetector), MP_ROM_PTR(&mp_human_detector_type) },
+    { MP_ROM_QSTR(MP_QSTR_Pipeline), MP_ROM_PTR(&mp_pipeline_type) },
     #endif
     #if MP_DL_IMAGENET_CLS_ENABLED
     { MP_ROM_QSTR(MP_QSTR_ImageNet), MP_ROM_PTR(&mp_image_net_type) },
     #endif
+    { MP_ROM_QSTR(MP_QSTR_Scheduler), MP_ROM_PTR(&mp_scheduler_type) },
+    { MP_ROM_QSTR(MP_QSTR_Model), MP_ROM_PTR(&mp_model_type) },
+    { MP_ROM_QSTR(MP_QSTR_results_to_json), MP_ROM_PTR(&mp_esp_dl_results_to_json_obj) },
+    { MP_ROM_QSTR(MP_QSTR_results_to_bin), MP_ROM_PTR(&mp_esp_dl_results_to_bin_obj) },
+    { MP_ROM_QSTR(MP_QSTR_draw), MP_ROM_PTR(&mp_esp_dl_draw_obj) },
+    #if MP_DL_TRACE_ENABLED
+    { MP_ROM_QSTR(MP_QSTR_trace_dump), MP_ROM_PTR(&espdl_trace_dump_obj) },
+    { MP_ROM_QSTR(MP_QSTR_trace_clear), MP_ROM_PTR(&espdl_trace_clear_obj) },
+    #endif
 };
 static MP_DEFINE_CONST_DICT(module_globals, module_globals_table);
 
@@ -0,0 +1,367 @@
+# Reproducible benchmark for the espdl models.
+#
+# Feeds deterministic frames at the standard camera frame sizes through every
+# model compiled into the firmware and prints fps and latency percentiles as
+# JSON. FaceRecognizer is additionally measured against galleries of several
+# sizes. On the host build (see README) the esp-dl backends are mocked, so the
+# same script measures the binding and marshalling overhead alone.
+#
+#   import espdl_bench
+#   espdl_bench.run()                               # everything
+#   espdl_bench.run(models=("FaceDetector",), sizes=("QVGA", "VGA"), out="/bench.json")
+#   espdl_bench.jpeg_compare("/frames")            # ImageNet, HumanDetector: decode + run() vs run_jpeg()
+#   espdl_bench.projection_compare()               # FaceRecognizer: exact vs projected search
+
+import gc
+import json
+import struct
+import sys
+import time
+
+import espdl
+
+FRAME_SIZES = (
+    ("QQVGA", 160, 120),
+    ("R128x128", 128, 128),
+    ("QCIF", 176, 144),
+    ("HQVGA", 240, 176),
+    ("R240X240", 240, 240),
+    ("QVGA", 320, 240),
+    ("CIF", 400, 296),
+    ("HVGA", 480, 320),
+    ("VGA", 640, 480),
+    ("SVGA", 800, 600),
+    ("XGA", 1024, 768),
+    ("HD", 1280, 720),
+)
+
+MODELS = ("FaceDetector", "HumanDetector", "ImageNet", "FaceRecognizer")
+GALLERY_SIZES = (0, 10, 100, 1000)
+FEAT_LEN = 512
+NAME_LEN = 32
+
+
+def synthetic_frame(width, height, seed=1):
+    # 16 pseudo-random rows repeated over the frame. Identical on every run and
+    # device, and cheap enough to build for HD frames on the target.
+    rows = []
+    x = seed
+    for _ in range(16):
+        row = bytearray(width * 3)
+        for i in range(len(row)):
+            x = (x * 75 + 74) % 65537
+            row[i] = x & 0xFF
+        rows.append(bytes(row))
+    frame = bytearray(width * height * 3)
+    stride = width * 3
+    for y in range(height):
+        frame[y * stride:(y + 1) * stride] = rows[y % 16]
+    return frame
+
+
+def recorded_frame(frames_dir, name, width, height):
+    # Recorded frames are either raw RGB888 (<name>.rgb) or JPEG (<name>.jpg).
+    size = width * height * 3
+    try:
+        with open("%s/%s.rgb" % (frames_dir, name), "rb") as f:
+            frame = f.read()
+        if len(frame) == size:
+            return frame
+    except OSError:
+        pass
+    try:
+        from jpeg import Decoder
+
+        with open("%s/%s.jpg" % (frames_dir, name), "rb") as f:
+            frame = Decoder().decode(f.read())
+        if len(frame) == size:
+            return frame
+    except (ImportError, OSError):
+        pass
+    return None
+
+
+def gallery_path(size):
+    return "bench_gallery_%d.db" % size
+
+
+def make_gallery(size):
+    # Same layout as the recognition DataBase: meta header followed by
+    # (id, feature, name) records. Reused when it already has the right size.
+    path = "/" + gallery_path(size)
+    record = 2 + 4 * FEAT_LEN + NAME_LEN
+    expected = 6 + record * size
+    try:
+        with open(path, "rb") as f:
+            if len(f.read(6)) == 6 and f.seek(0, 2) == expected:
+                return
+    except OSError:
+        pass
+    with open(path, "wb") as f:
+        f.write(struct.pack("<HHH", size, size, FEAT_LEN))
+        feat = bytearray(4 * FEAT_LEN)
+        for i in range(size):
+            for k in range(FEAT_LEN):
+                struct.pack_into("<f", feat, 4 * k, (((i + 1) * 37 + k * 11) % 101 - 50) / 1150.0)
+            name = ("bench%d" % i).encode()
+            f.write(struct.pack("<H", i + 1))
+            f.write(feat)
+            f.write(name + bytes(NAME_LEN - len(name)))
+
+
+def percentile(values, p):
+    idx = (len(values) * p + 99) // 100 - 1
+    return values[min(max(idx, 0), len(values) - 1)]
+
+
+def measure(fn, frame, frames, warmup):
+    for _ in range(warmup):
+        fn(frame)
+    lat = []
+    gc.collect()
+    for _ in range(frames):
+        t = time.ticks_us()
+        fn(frame)
+        lat.append(time.ticks_diff(time.ticks_us(), t))
+    lat.sort()
+    mean = sum(lat) / len(lat)
+    return {
+        "fps": round(1000000 / mean, 2) if mean else None,
+        "latency_ms": {
+            "min": lat[0] / 1000,
+            "p50": percentile(lat, 50) / 1000,
+            "p90": percentile(lat, 90) / 1000,
+            "p99": percentile(lat, 99) / 1000,
+            "max": lat[-1] / 1000,
+            "mean": round(mean / 1000, 3),
+        },
+    }
+
+
+def run(models=MODELS, sizes=None, frames=20, warmup=2, galleries=GALLERY_SIZES, frames_dir=None, out=None):
+    models = [m for m in models if hasattr(espdl, m)]
+    report = {
+        "version": 1,
+        "platform": sys.platform,
+        "frames": frames,
+        "warmup": warmup,
+        "results": [],
+    }
+    for name, width, height in FRAME_SIZES:
+        if sizes and name not in sizes:
+            continue
+        frame = None
+        source = "synthetic"
+        if frames_dir:
+            frame = recorded_frame(frames_dir, name, width, height)
+            source = "recorded"
+        if frame is None:
+            frame = synthetic_frame(width, height)
+            source = "synthetic"
+        for model_name in models:
+            cls = getattr(espdl, model_name)
+            for gallery in galleries if model_name == "FaceRecognizer" else (None,):
+                if gallery is None:
+                    model = cls(width=width, height=height)
+                else:
+                    make_gallery(gallery)
+                    model = cls(width=width, height=height, db_path=gallery_path(gallery))
+                entry = {"model": model_name, "frame_size": name, "width": width, "height": height, "source": source}
+                if gallery is not None:
+                    entry["gallery"] = gallery
+                entry.update(measure(model.run, frame, frames, warmup))
+                report["results"].append(entry)
+                print(json.dumps(entry))
+                model = None
+                gc.collect()
+        frame = None
+        gc.collect()
+    if out:
+        with open(out, "w") as f:
+            json.dump(report, f)
+    return report
+
+
+JPEG_MODELS = ("ImageNet", "HumanDetector")
+
+
+def jpeg_compare(frames_dir, sizes=("VGA", "HD"), models=JPEG_MODELS, frames=10, warmup=1, out=None):
+    # Compares the two JPEG paths of ImageNet and the HumanDetector on recorded <name>.jpg frames:
+    # decoding to a full RGB888 frame followed by run(), and run_jpeg(), which
+    # decodes one MCU row (16 lines) at a time straight into the input tensor.
+    # The intermediate buffer sizes follow from the frame size; the latencies
+    # are measured.
+    report = {"version": 1, "platform": sys.platform, "frames": frames, "results": []}
+    try:
+        from jpeg import Decoder
+    except ImportError:
+        Decoder = None
+    for name, width, height in FRAME_SIZES:
+        if name not in sizes:
+            continue
+        try:
+            with open("%s/%s.jpg" % (frames_dir, name), "rb") as f:
+                data = f.read()
+        except OSError:
+            print("no %s/%s.jpg, skipped" % (frames_dir, name))
+            continue
+        for model_name in models:
+            model = getattr(espdl, model_name)(width=width, height=height)
+            entry = {
+                "model": model_name,
+                "frame_size": name,
+                "width": width,
+                "height": height,
+                "jpeg_bytes": len(data),
+                "frame_bytes": width * height * 3,
+                "block_bytes": width * 16 * 3,
+            }
+            entry["fused"] = measure(model.run_jpeg, data, frames, warmup)
+            if Decoder is not None:
+                decoder = Decoder()
+                entry["decode_run"] = measure(lambda d: model.run(decoder.decode(d)), data, frames, warmup)
+            report["results"].append(entry)
+            print(json.dumps(entry))
+            model = None
+            gc.collect()
+    if out:
+        with open(out, "w") as f:
+            json.dump(report, f)
+    return report
+
+
+PCA_GALLERY = "bench_pca.db"
+
+
+def lcg_floats(state, count):
+    # count values in [-0.5, 0.5) and the new state. A gallery needs far more
+    # values than the period of the synthetic_frame generator, which would
+    # repeat records.
+    values = []
+    for _ in range(count):
+        state = (state * 1103515245 + 12345) & 0x7FFFFFFF
+        values.append(state / 0x80000000 - 0.5)
+    return values, state
+
+
+def normalized(values):
+    norm = sum(v * v for v in values) ** 0.5
+    return [v / norm for v in values]
+
+
+def make_pca_gallery(size, queries, latent=None, similarity=0.7):
+    # Synthetic embeddings in the DataBase layout. Without latent every
+    # coordinate is independent, the variance is spread over all dimensions
+    # and the projection has no structure to exploit; with latent most of the
+    # variance lies in a latent dimensional subspace, as in the embeddings of
+    # a face model. Returns a query with about the given cosine similarity to
+    # every size // queries-th record, as another photo of the same face.
+    path = "/" + PCA_GALLERY
+    step = max(size // queries, 1)
+    gain = [1 + (k % 7) * 0.25 for k in range(FEAT_LEN)]
+    weight = (1 - similarity * similarity) ** 0.5
+    state = 1
+    found = []
+    with open(path, "wb") as f:
+        f.write(struct.pack("<HHH", size, size, FEAT_LEN))
+        for i in range(size):
+            if latent is None:
+                values, state = lcg_floats(state, FEAT_LEN)
+                feat = normalized(values)
+            else:
+                values, state = lcg_floats(state, latent)
+                noise, state = lcg_floats(state, FEAT_LEN)
+                feat = normalized([values[k % latent] * gain[k] + 0.15 * noise[k] for k in range(FEAT_LEN)])
+            name = ("pca%d" % i).encode()
+            f.write(struct.pack("<H", i + 1))
+            f.write(struct.pack("<%df" % FEAT_LEN, *feat))
+            f.write(name + bytes(NAME_LEN - len(name)))
+            if i % step == 0 and len(found) < queries:
+                noise, state = lcg_floats(state, FEAT_LEN)
+                noise = normalized(noise)
+                found.append(normalized([similarity * feat[k] + weight * noise[k] for k in range(FEAT_LEN)]))
+    return [struct.pack("<%df" % FEAT_LEN, *q) for q in found]
+
+
+def gallery_queries(db_path, queries):
+    # Queries close to records of an existing database
+    state = 1
+    with open("/" + db_path, "rb") as f:
+        total, valid, feat_len = struct.unpack("<HHH", f.read(6))
+        step = max(valid // queries, 1)
+        found = []
+        n = 0
+        for _ in range(total):
+            record_id = struct.unpack("<H", f.read(2))[0]
+            data = f.read(4 * feat_len)
+            f.read(NAME_LEN)
+            if record_id == 0:
+                continue
+            if n % step == 0 and len(found) < queries:
+                feat = struct.unpack("<%df" % feat_len, data)
+                noise, state = lcg_floats(state, feat_len)
+                q = normalized([feat[k] + 0.1 * noise[k] / feat_len ** 0.5 for k in range(feat_len)])
+                found.append(struct.pack("<%df" % feat_len, *q))
+            n += 1
+    return found
+
+
+def search_all(model, queries, repeat):
+    top = []
+    gc.collect()
+    t = time.ticks_us()
+    for _ in range(repeat):
+        top = []
+        for q in queries:
+            res = model.search(q)
+            top.append(res[0]["id"] if res else None)
+    us = time.ticks_diff(time.ticks_us(), t) / (repeat * len(queries))
+    return top, us
+
+
+def projection_compare(size=1000, dims=(32, 64, 128), candidates=(16, 32, 64), queries=100, repeat=3, db_path=None, latent=None, out=None):
+    # Accuracy against speed of the projected search of FaceRecognizer. Every
+    # query is searched exactly and with a projection per dims/candidates
+    # pair; agreement is the share of queries with the same best match (or no
+    # match) as the exact search. Without db_path a synthetic gallery of size
+    # records is generated, full-rank unless latent is given (see
+    # make_pca_gallery); with db_path the projection of that database is
+    # replaced and cleared at the end.
+    if db_path is None:
+        qs = make_pca_gallery(size, queries, latent)
+        db_path = PCA_GALLERY
+    else:
+        qs = gallery_queries(db_path, queries)
+    model = espdl.FaceRecognizer(db_path=db_path)
+    model.clear_projection()
+    exact, exact_us = search_all(model, qs, repeat)
+    report = {"version": 1, "platform": sys.platform, "db_path": db_path, "latent": latent, "queries": len(qs), "exact_us": exact_us, "results": []}
+    print(json.dumps({"exact_us": exact_us}))
+    for d in dims:
+        for c in candidates:
+            t = time.ticks_ms()
+            try:
+                model.train_projection(d, candidates=c)
+            except ValueError as e:
+                print("dims %d: %s" % (d, e))
+                break
+            train_ms = time.ticks_diff(time.ticks_ms(), t)
+            top, us = search_all(model, qs, repeat)
+            agree = sum(1 for a, b in zip(top, exact) if a == b)
+            entry = {
+                "dims": d,
+                "candidates": c,
+                "train_ms": train_ms,
+                "search_us": us,
+                "speedup": round(exact_us / us, 2) if us else None,
+                "agreement": agree / len(qs),
+            }
+            report["results"].append(entry)
+            print(json.dumps(entry))
+    model.clear_projection()
+    model = None
+    gc.collect()
+    if out:
+        with open(out, "w") as f:
+            json.dump(report, f)
+    return report
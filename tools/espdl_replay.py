@@ -0,0 +1,242 @@
+# Frame recording and replay for offline profiling of the espdl models.
+#
+# Recorder stores the input frames, raw RGB888 or their JPEG source, together
+# with the results and latencies of every model run on them. replay() feeds a
+# recording back through any set of models, on the device or on the host
+# build (see README, the esp-dl backends are mocked there), and compares the
+# latencies and results with the recorded ones.
+#
+#   import espdl, espdl_replay
+#   rec = espdl_replay.Recorder("/sd/street.rec")
+#   rec.record(frame, {"faces": espdl.FaceDetector()}, jpeg=jpeg_bytes)
+#   rec.close()
+#   espdl_replay.replay("/sd/street.rec", {"faces": espdl.FaceDetector()})
+#
+# File layout, little endian:
+#   header:  b"EDLR", version (H)
+#   frame:   kind (B, 0 = RGB888, 1 = JPEG), width (H), height (H),
+#            ticks_ms (I), data length (I), results length (I),
+#            data, results as JSON {name: {"us": latency, "results": ...}}
+
+import gc
+import json
+import os
+import struct
+import sys
+import time
+
+MAGIC = b"EDLR"
+VERSION = 1
+KIND_RGB888 = 0
+KIND_JPEG = 1
+FRAME_HEADER = "<BHHIII"
+FRAME_HEADER_SIZE = struct.calcsize(FRAME_HEADER)
+
+
+def percentile(values, p):
+    idx = (len(values) * p + 99) // 100 - 1
+    return values[min(max(idx, 0), len(values) - 1)]
+
+
+def latency_stats(lat):
+    lat = sorted(lat)
+    if not lat:
+        return None
+    return {
+        "min": lat[0] / 1000,
+        "p50": percentile(lat, 50) / 1000,
+        "p90": percentile(lat, 90) / 1000,
+        "p99": percentile(lat, 99) / 1000,
+        "max": lat[-1] / 1000,
+        "mean": round(sum(lat) / len(lat) / 1000, 3),
+    }
+
+
+def normalized(results):
+    # Tuples become lists, as in the recording
+    return json.loads(json.dumps(results))
+
+
+def timed_run(model, frame):
+    t = time.ticks_us()
+    results = model.run(frame)
+    return results, time.ticks_diff(time.ticks_us(), t)
+
+
+def complete_length(f):
+    # Length of the header and the complete frames of the recording in f,
+    # a frame torn by a reset at the end is not counted
+    size = f.seek(0, 2)
+    f.seek(0)
+    if f.read(4) != MAGIC:
+        raise ValueError("not a recording")
+    version = f.read(2)
+    if len(version) < 2 or struct.unpack("<H", version)[0] != VERSION:
+        raise ValueError("unsupported recording version")
+    end = 6
+    while end + FRAME_HEADER_SIZE <= size:
+        f.seek(end)
+        _, _, _, _, data_len, meta_len = struct.unpack(FRAME_HEADER, f.read(FRAME_HEADER_SIZE))
+        if end + FRAME_HEADER_SIZE + data_len + meta_len > size:
+            break
+        end += FRAME_HEADER_SIZE + data_len + meta_len
+    return end, size
+
+
+def truncate(path, length):
+    # MicroPython files have no truncate(), the complete part is copied to a
+    # new file which replaces the recording
+    tmp = path + ".tmp"
+    buf = bytearray(4096)
+    with open(path, "rb") as src, open(tmp, "wb") as dst:
+        left = length
+        while left:
+            n = src.readinto(memoryview(buf)[: min(left, len(buf))])
+            if not n:
+                raise OSError("short read")
+            dst.write(memoryview(buf)[:n])
+            left -= n
+    os.rename(tmp, path)
+
+
+class Recorder:
+    # Appends to path if it already holds a recording. A frame torn by a
+    # reset at its end is cut off first, the frames appended after it would
+    # be unreadable otherwise.
+    def __init__(self, path):
+        self.frames = 0
+        try:
+            f = open(path, "rb")
+        except OSError:
+            self.f = open(path, "wb")
+            self.f.write(MAGIC + struct.pack("<H", VERSION))
+            return
+        try:
+            end, size = complete_length(f)
+        except ValueError as e:
+            raise ValueError("%s: %s" % (path, e))
+        finally:
+            f.close()
+        if end < size:
+            print("%s: cutting off a torn frame of %d bytes" % (path, size - end))
+            truncate(path, end)
+        self.f = open(path, "ab")
+
+    def record(self, frame, models, width=None, height=None, jpeg=None):
+        # Runs every model of the dict name -> model on the RGB888 frame and
+        # writes the frame and the results. With jpeg, the JPEG source of the
+        # frame is stored instead of the frame, which is much smaller.
+        # Returns the results by name.
+        results = {}
+        recorded = {}
+        for name, model in models.items():
+            res, us = timed_run(model, frame)
+            results[name] = res
+            recorded[name] = {"us": us, "results": res}
+        if width is None or height is None:
+            model = next(iter(models.values()))
+            width, height = model.width, model.height
+        data = jpeg if jpeg is not None else frame
+        meta = json.dumps(recorded).encode()
+        kind = KIND_JPEG if jpeg is not None else KIND_RGB888
+        self.f.write(struct.pack(FRAME_HEADER, kind, width, height, time.ticks_ms() & 0xFFFFFFFF, len(data), len(meta)))
+        self.f.write(data)
+        self.f.write(meta)
+        self.frames += 1
+        return results
+
+    def close(self):
+        if self.f:
+            self.f.close()
+            self.f = None
+
+
+def frames(path):
+    # Yields (width, height, frame, recorded) with the RGB888 frame; JPEG
+    # frames are decoded with the jpeg module
+    decoder = None
+    with open(path, "rb") as f:
+        if f.read(4) != MAGIC:
+            raise ValueError("%s is not a recording" % path)
+        version = struct.unpack("<H", f.read(2))[0]
+        if version != VERSION:
+            raise ValueError("Unsupported recording version %d" % version)
+        while True:
+            header = f.read(FRAME_HEADER_SIZE)
+            if len(header) < FRAME_HEADER_SIZE:
+                return
+            kind, width, height, _, data_len, meta_len = struct.unpack(FRAME_HEADER, header)
+            data = f.read(data_len)
+            meta = f.read(meta_len)
+            if len(data) < data_len or len(meta) < meta_len:
+                # Torn last frame of an interrupted recording
+                return
+            if kind == KIND_JPEG:
+                if decoder is None:
+                    from jpeg import Decoder
+
+                    decoder = Decoder()
+                data = decoder.decode(data)
+            yield width, height, data, json.loads(meta)
+
+
+def same(a, b, box_tol, score_tol):
+    # Ints (boxes, key points, ids) may differ by box_tol, floats by score_tol
+    if isinstance(a, dict) and isinstance(b, dict):
+        return len(a) == len(b) and all(k in b and same(a[k], b[k], box_tol, score_tol) for k in a)
+    if isinstance(a, list) and isinstance(b, list):
+        return len(a) == len(b) and all(same(x, y, box_tol, score_tol) for x, y in zip(a, b))
+    if isinstance(a, bool) or isinstance(b, bool):
+        return a == b
+    if isinstance(a, int) and isinstance(b, int):
+        return abs(a - b) <= box_tol
+    if isinstance(a, (int, float)) and isinstance(b, (int, float)):
+        return abs(a - b) <= score_tol
+    return a == b
+
+
+def replay(path, models, compare=True, box_tol=2, score_tol=0.02, max_frames=None, out=None):
+    # Feeds every frame of the recording through the dict name -> model and
+    # compares with the results recorded under the same name. Frames of
+    # another size than a model's width and height are skipped for it.
+    stats = {name: {"recorded_us": [], "replay_us": [], "frames": 0, "mismatches": 0, "first_mismatches": []} for name in models}
+    n = 0
+    for width, height, frame, recorded in frames(path):
+        if max_frames is not None and n >= max_frames:
+            break
+        for name, model in models.items():
+            if model.width != width or model.height != height:
+                continue
+            results, us = timed_run(model, frame)
+            s = stats[name]
+            s["frames"] += 1
+            s["replay_us"].append(us)
+            rec = recorded.get(name)
+            if rec is None:
+                continue
+            s["recorded_us"].append(rec["us"])
+            if compare and not same(normalized(results), rec["results"], box_tol, score_tol):
+                s["mismatches"] += 1
+                if len(s["first_mismatches"]) < 5:
+                    s["first_mismatches"].append(n)
+        n += 1
+        frame = None
+        gc.collect()
+
+    report = {"version": 1, "platform": sys.platform, "recording": path, "frames": n, "results": []}
+    for name, s in stats.items():
+        entry = {
+            "model": name,
+            "frames": s["frames"],
+            "recorded_ms": latency_stats(s["recorded_us"]),
+            "replay_ms": latency_stats(s["replay_us"]),
+        }
+        if compare:
+            entry["mismatches"] = s["mismatches"]
+            entry["first_mismatches"] = s["first_mismatches"]
+        report["results"].append(entry)
+        print(json.dumps(entry))
+    if out:
+        with open(out, "w") as f:
+            json.dump(report, f)
+    return report